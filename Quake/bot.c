@@ -97,6 +97,29 @@ qboolean Traceline(vec3_t v1, vec3_t v2, edict_t *ent, edict_t *enemy)
 	return false;				// Otherwise he cant
 }
 
+/*
+=========
+Tracelines
+
+Traceline for a bunch of enemies at once, seen[i] is set if the line from
+v1[i] to v2 is clear
+=========
+*/
+void Tracelines(int count, vec3_t *v1, vec3_t v2, edict_t *ent, qboolean *seen)
+{
+	vec3_t	ends[16];
+	trace_t	traces[16];
+	int		i;
+
+	for (i = 0; i < count; i++)
+		VectorCopy(v2, ends[i]);
+
+	SV_MoveBatch(count, v1, ends, vec3_origin, vec3_origin, true, ent, traces);	// All the lines share one walk through the world
+
+	for (i = 0; i < count; i++)
+		seen[i] = (traces[i].fraction == 1);
+}
+
 /*
 ==========
 CalcAngles
@@ -401,6 +424,10 @@ void SearchForEnemy(client_t *client)
 	vec3_t	eyes1, eyes2, origin, test;
 	int		test2;
 	int		num;
+	edict_t	*nmys[16];
+	vec3_t	nmyeyes[16];
+	qboolean	seen[16];
+	int		count, i;
 
 	if (nmy != bot &&	// If he has an enemy that aint himself
 		nmy->v.health > 0)		// and has some health
@@ -428,6 +455,7 @@ void SearchForEnemy(client_t *client)
 	bot->bot.enemy = bot;				// Set enemy to the bot himself again
 	nmy = Nextent(globot.world);		// Prepare to loop through clients
 	num = 0;
+	count = 0;
 
 	while (num < globot.MaxClients)		// Keep looping as long as there are clients
 	{
@@ -436,26 +464,34 @@ void SearchForEnemy(client_t *client)
 			nmy->v.health > 0 &&		// and is alive
 			nmy->v.team != bot->v.team)	// and in another team
 		{
-			VectorAdd(nmy->v.origin, nmy->v.view_ofs, eyes1);	// We want the origin of the clients eyes
-			VectorAdd(bot->v.origin, bot->v.view_ofs, eyes2);	// We want the origin of the bots eyes
+			nmys[count] = nmy;
+			VectorAdd(nmy->v.origin, nmy->v.view_ofs, nmyeyes[count]);	// We want the origin of the clients eyes
+			count++;
+		}
+		num++;
+		nmy = Nextent(nmy);	// Collect them all first so they can be traced together
+	}
 
-			if (Traceline(eyes1, eyes2, bot, nmy))		// If the bot can see his client
+	VectorAdd(bot->v.origin, bot->v.view_ofs, eyes2);	// We want the origin of the bots eyes
+	Tracelines(count, nmyeyes, eyes2, bot, seen);
+
+	for (i = 0; i < count; i++)
+	{
+		nmy = nmys[i];
+		if (seen[i])		// If the bot can see his client
+		{
+			VectorSubtract(nmyeyes[i], eyes2, origin);	// Get a nice vector
+			CalcAngles(origin, test);				// And use it to see in what direction the client is
+			test2 = test[1] - bot->v.angles[1];		// Another shortcut
+			if (test2 > -60 && test2 < 60)			// If client is in front of the bot so he can see him
 			{
-				VectorSubtract(eyes1, eyes2, origin);	// Get a nice vector
-				CalcAngles(origin, test);				// And use it to see in what direction the client is
-				test2 = test[1] - bot->v.angles[1];		// Another shortcut
-				if (test2 > -60 && test2 < 60)			// If client is in front of the bot so he can see him
-				{
-					bot->bot.enemy = nmy;				// Then set him as the enemy
-					bot->bot.chase = -1;				// and stop chasing
-					VectorCopy(test, bot->v.angles);	// Then turn to the enemy
-					MoveBot(client, true, nmy);		// and start running, jumping and shooting
-					return;								// We are done here now...
-				}
+				bot->bot.enemy = nmy;				// Then set him as the enemy
+				bot->bot.chase = -1;				// and stop chasing
+				VectorCopy(test, bot->v.angles);	// Then turn to the enemy
+				MoveBot(client, true, nmy);		// and start running, jumping and shooting
+				return;								// We are done here now...
 			}
 		}
-		num++;
-		nmy = Nextent(nmy);	// If the client was'nt visible then continue the loop with the next client
 	}
 
 	// Guess we found no enemies
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "quakedef.h"
+#include "bgmusic.h"
 
 static void CL_FinishTimeDemo (void);
 
@@ -32,7 +33,9 @@ When a demo is playing back, all NET_SendMessages are skipped, and
 NET_GetMessages are read from the demo file.
 
 Whenever cl.time gets past the last received message, another message is
-read from the demo file.
+read from the demo file.  Playback reads the file through demo_buf in
+DEMO_BUFSIZE chunks rather than with a few small freads per message, and
+never past the demo's own length, which matters for demos inside a pak.
 ==============================================================================
 */
 
@@ -40,6 +43,16 @@ read from the demo file.
 static byte	demo_head[3][MAX_MSGLEN];
 static int	demo_head_size[2];
 
+#define	DEMO_BUFSIZE	0x10000
+
+static byte	demo_buf[DEMO_BUFSIZE];
+static int	demo_start;	// file offset of the first message
+static int	demo_size;	// bytes of messages from demo_start
+static int	demo_bufofs;	// demo offset of demo_buf[0]
+static int	demo_buflen;	// bytes read into demo_buf
+static int	demo_bufpos;	// next byte of demo_buf to hand out
+static int	demo_msgofs;	// demo offset of the last message read
+
 /*
 ==============
 CL_StopPlayback
@@ -55,6 +68,7 @@ void CL_StopPlayback (void)
 	fclose (cls.demofile);
 	cls.demoplayback = false;
 	cls.demopaused = false;
+	cls.demoseeking = false;
 	cls.demofile = NULL;
 	cls.state = ca_disconnected;
 
@@ -86,11 +100,102 @@ static void CL_WriteDemoMessage (void)
 	fflush (cls.demofile);
 }
 
-static int CL_GetDemoMessage (void)
+/*
+====================
+CL_DemoTell
+
+demo offset of the next unread byte
+====================
+*/
+static int CL_DemoTell (void)
 {
-	int	r, i;
-	float	f;
+	return demo_bufofs + demo_bufpos;
+}
+
+/*
+====================
+CL_DemoSeekTo
+====================
+*/
+static void CL_DemoSeekTo (int ofs)
+{
+	if (ofs >= demo_bufofs && ofs <= demo_bufofs + demo_buflen)
+	{	// still buffered
+		demo_bufpos = ofs - demo_bufofs;
+		return;
+	}
+
+	fseek (cls.demofile, demo_start + ofs, SEEK_SET);
+	demo_bufofs = ofs;
+	demo_buflen = demo_bufpos = 0;
+}
+
+/*
+====================
+CL_DemoRead
 
+false if the demo ends first
+====================
+*/
+static qboolean CL_DemoRead (void *dst, int len)
+{
+	byte	*out = (byte *) dst;
+	int	n;
+
+	while (len > 0)
+	{
+		if (demo_bufpos == demo_buflen)
+		{
+			demo_bufofs += demo_buflen;
+			demo_bufpos = 0;
+			n = q_min (DEMO_BUFSIZE, demo_size - demo_bufofs);
+			demo_buflen = (n > 0) ? (int) fread (demo_buf, 1, n, cls.demofile) : 0;
+			if (!demo_buflen)
+				return false;
+		}
+
+		n = q_min (len, demo_buflen - demo_bufpos);
+		memcpy (out, demo_buf + demo_bufpos, n);
+		demo_bufpos += n;
+		out += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/*
+====================
+CL_ReadDemoMessage
+
+reads the next message into net_message, whatever the time
+====================
+*/
+static qboolean CL_ReadDemoMessage (void)
+{
+	int	i, len;
+	float	f[3];
+
+	demo_msgofs = CL_DemoTell ();
+	if (!CL_DemoRead (&len, 4) || !CL_DemoRead (f, sizeof(f)))
+		return false;
+
+	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
+	for (i = 0 ; i < 3 ; i++)
+		cl.mviewangles[0][i] = LittleFloat (f[i]);
+
+	len = LittleLong (len);
+	if (len < 0 || len > MAX_MSGLEN)
+		Sys_Error ("Demo message > MAX_MSGLEN");
+	if (!CL_DemoRead (net_message.data, len))
+		return false;
+	net_message.cursize = len;
+
+	return true;
+}
+
+static int CL_GetDemoMessage (void)
+{
 	if (cls.demopaused)
 		return 0;
 
@@ -114,19 +219,7 @@ static int CL_GetDemoMessage (void)
 	}
 
 // get the next message
-	fread (&net_message.cursize, 4, 1, cls.demofile);
-	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
-	for (i = 0 ; i < 3 ; i++)
-	{
-		r = fread (&f, 4, 1, cls.demofile);
-		cl.mviewangles[0][i] = LittleFloat (f);
-	}
-
-	net_message.cursize = LittleLong (net_message.cursize);
-	if (net_message.cursize > MAX_MSGLEN)
-		Sys_Error ("Demo message > MAX_MSGLEN");
-	r = fread (net_message.data, net_message.cursize, 1, cls.demofile);
-	if (r != 1)
+	if (!CL_ReadDemoMessage ())
 	{
 		CL_StopPlayback ();
 		return 0;
@@ -209,6 +302,7 @@ void CL_Stop_f (void)
 	
 // ericw -- update demo tab-completion list
 	DemoList_Rebuild ();
+	COM_FlushFileCache ();
 }
 
 /*
@@ -299,6 +393,10 @@ void CL_Record_f (void)
 
 	cls.demorecording = true;
 
+	// have the server send a snapshot that doesn't depend on frames the demo lacks
+	cl.deltaframe = 0;
+	cl.deltaresync = cl.deltaentities;
+
 	// from ProQuake: initialize the demo file if we're already connected
 	if (c == 2 && cls.state == ca_connected)
 	{
@@ -372,44 +470,865 @@ void CL_Record_f (void)
 }
 
 
+/*
+==============================================================================
+
+DEMO INDEX
+
+The first time a demo is played it is parsed through once, without drawing
+or sounds, to find where each level starts and to take a keyframe every
+DEMO_KEYINTERVAL seconds: the offset of the next message and a copy of the
+client state there (stats, scores, lightstyles and every entity the last
+message updated, plus the delta frames the next messages may refer to).
+The index is saved as <demo>.dmi in the game directory and reused while
+the demo's size and first bytes still match.
+
+"demoseek <time>" goes to the last keyframe before the time, reloading the
+level first if it isn't the current one, puts the saved state back and
+parses on to the exact time without drawing the frames in between.  Demo
+time runs on from one level to the next, so it is the same clock as the
+one the demo was recorded with only for single level demos.
+==============================================================================
+*/
+
+#define	DEMOINDEX_IDENT		(('I'<<24)+('M'<<16)+('D'<<8)+'Q')	// little-endian "QDMI"
+#define	DEMOINDEX_VERSION	2	// 1 kept only 8 delta frames
+#define	DEMO_KEYINTERVAL	10	// seconds
+#define	DEMO_KEYDELTAS		ENTITYDELTA_BACKUP	// the server may delta from any of them
+
+typedef struct
+{
+	int		offset;		// of the message with svc_serverinfo
+	double		starttime;	// demo time of its first frame
+	double		firstmtime;	// cl.mtime[0] of its first and last frames
+	double		lastmtime;
+} demolevel_t;
+
+typedef struct
+{
+	int		offset;		// of the message after the keyframe
+	int		level;
+	double		mtime;		// cl.mtime[0] when it was taken
+	int		stateofs;	// demostate_t in demo_states
+} demokey_t;
+
+// followed by numscores demoscore_t, the lightstyles, numents snapentity_t
+// and numdeltas demodelta_t, each followed by its snapentity_t
+typedef struct
+{
+	int		stats[MAX_CL_STATS];
+	int		items;
+	float		item_gettime[32];
+	vec3_t		mviewangles;
+	vec3_t		mvelocity;
+	vec3_t		punchangle;
+	float		idealpitch;
+	float		viewheight;
+	qboolean	paused;
+	qboolean	onground;
+	qboolean	inwater;
+	int		intermission;
+	int		completed_time;
+	int		viewentity;
+	int		cdtrack, looptrack;
+	qboolean	deltaentities;
+	int		deltaframe;
+	qboolean	deltaresync;
+	int		numscores;
+	int		numents;
+	int		numdeltas;
+} demostate_t;
+
+typedef struct
+{
+	char		name[MAX_SCOREBOARDNAME];
+	float		entertime;
+	int		frags;
+	int		colors;
+} demoscore_t;
+
+typedef struct
+{
+	int		frame;
+	int		numents;
+} demodelta_t;
+
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		sizes;		// of the saved structures, in case a build disagrees
+	int		demosize;
+	int		checksum;	// CRC of the first DEMO_BUFSIZE bytes
+	int		numlevels;
+	int		numkeys;
+	int		statesize;
+} demoindexheader_t;
+
+#define	DEMOINDEX_SIZES	((int)(sizeof(demostate_t) + (sizeof(snapentity_t) << 10) + (sizeof(lightstyle_t) << 20)))
+
+static char		demo_indexname[MAX_OSPATH];
+static int		demo_checksum;	// of the demo being played
+static qboolean		demo_indexed;	// the index is complete
+static qboolean		demo_indexing;	// CL_DemoBuildIndex is running
+
+static demolevel_t	*demo_levels;
+static int		demo_numlevels, demo_maxlevels;
+static demokey_t	*demo_keys;
+static int		demo_numkeys, demo_maxkeys;
+static byte		*demo_states;
+static int		demo_statesize, demo_maxstatesize;
+
 /*
 ====================
-CL_PlayDemo_f
+CL_DemoGrow
 
-play [demoname]
+makes room for count elements of size bytes in *data
 ====================
 */
-void CL_PlayDemo_f (void)
+static void CL_DemoGrow (void **data, int *max, int count, int size)
 {
-	char	name[MAX_OSPATH];
-	int	i, c;
-	qboolean neg;
+	if (count <= *max)
+		return;
+
+	*max = q_max (count, *max * 2);
+	*data = realloc (*data, (size_t) *max * size);
+	if (!*data)
+		Sys_Error ("CL_DemoGrow: couldn't allocate %d bytes", *max * size);
+}
+
+/*
+====================
+CL_DemoStateAlloc
+====================
+*/
+static void *CL_DemoStateAlloc (int size)
+{
+	byte	*p;
+
+	CL_DemoGrow ((void **) &demo_states, &demo_maxstatesize, demo_statesize + size, 1);
+	p = demo_states + demo_statesize;
+	demo_statesize += size;
+	return p;
+}
+
+/*
+====================
+CL_DemoLevelAt
+
+the level a demo offset is in, -1 before the first one
+====================
+*/
+static int CL_DemoLevelAt (int ofs)
+{
+	int	i;
+
+	for (i = demo_numlevels - 1; i >= 0; i--)
+	{
+		if (demo_levels[i].offset <= ofs)
+			break;
+	}
+	return i;
+}
+
+/*
+====================
+CL_DemoTime
+
+demo time of cl.mtime[0] in a level
+====================
+*/
+static double CL_DemoTime (int level, double mtime)
+{
+	demolevel_t	*lev = &demo_levels[level];
+
+	return lev->starttime + (mtime - lev->firstmtime);
+}
+
+/*
+====================
+CL_DemoLength
+====================
+*/
+static double CL_DemoLength (void)
+{
+	demolevel_t	*lev;
+
+	if (!demo_numlevels)
+		return 0;
+	lev = &demo_levels[demo_numlevels - 1];
+	return CL_DemoTime (demo_numlevels - 1, lev->lastmtime);
+}
+
+/*
+====================
+CL_DemoServerInfo
+
+called before a demo's svc_serverinfo is parsed
+====================
+*/
+void CL_DemoServerInfo (void)
+{
+	demolevel_t	*lev, *prev;
+
+// a live client gets here through "reconnect", which is ignored in demos
+	cls.signon = 0;
+
+	if (!demo_indexing)
+		return;
+
+	CL_DemoGrow ((void **) &demo_levels, &demo_maxlevels, demo_numlevels + 1, sizeof(demolevel_t));
+	lev = &demo_levels[demo_numlevels++];
+	lev->offset = demo_msgofs;
+	lev->starttime = 0;
+	lev->firstmtime = lev->lastmtime = -1;	// no frame yet
+	if (demo_numlevels > 1)
+	{
+		prev = lev - 1;
+		lev->starttime = prev->starttime;
+		if (prev->firstmtime >= 0)
+			lev->starttime += prev->lastmtime - prev->firstmtime;
+	}
+}
+
+/*
+====================
+CL_DemoAddKeyframe
+
+saves the client state after the message that was just parsed
+====================
+*/
+static void CL_DemoAddKeyframe (void)
+{
+	demokey_t	*k;
+	demostate_t	*st;
+	demoscore_t	*sc;
+	demodelta_t	*d;
+	snapentity_t	*s;
+	const snapentity_t *ents;
+	entity_t	*ent;
+	int		numents, numdeltas, frame, i, j;
+
+	numents = 0;
+	for (i = 1; i < cl.num_entities; i++)
+	{
+		if (cl_entities[i].msgtime == cl.mtime[0])
+			numents++;
+	}
+
+	numdeltas = 0;
+	if (cl.deltaentities)
+	{
+		for (frame = cl.deltaframe - DEMO_KEYDELTAS + 1; frame <= cl.deltaframe; frame++)
+		{
+			if (CL_GetSnapshot (frame, &ents) >= 0)
+				numdeltas++;
+		}
+	}
+
+	CL_DemoGrow ((void **) &demo_keys, &demo_maxkeys, demo_numkeys + 1, sizeof(demokey_t));
+	k = &demo_keys[demo_numkeys++];
+	k->offset = CL_DemoTell ();
+	k->level = demo_numlevels - 1;
+	k->mtime = cl.mtime[0];
+	k->stateofs = demo_statesize;
+
+	st = (demostate_t *) CL_DemoStateAlloc (sizeof(demostate_t));
+	memcpy (st->stats, cl.stats, sizeof(st->stats));
+	st->items = cl.items;
+	memcpy (st->item_gettime, cl.item_gettime, sizeof(st->item_gettime));
+	VectorCopy (cl.mviewangles[0], st->mviewangles);
+	VectorCopy (cl.mvelocity[0], st->mvelocity);
+	VectorCopy (cl.punchangle, st->punchangle);
+	st->idealpitch = cl.idealpitch;
+	st->viewheight = cl.viewheight;
+	st->paused = cl.paused;
+	st->onground = cl.onground;
+	st->inwater = cl.inwater;
+	st->intermission = cl.intermission;
+	st->completed_time = cl.completed_time;
+	st->viewentity = cl.viewentity;
+	st->cdtrack = cl.cdtrack;
+	st->looptrack = cl.looptrack;
+	st->deltaentities = cl.deltaentities;
+	st->deltaframe = cl.deltaframe;
+	st->deltaresync = cl.deltaresync;
+	st->numscores = cl.maxclients;
+	st->numents = numents;
+	st->numdeltas = numdeltas;
+
+	// st is not valid past here, the next allocation can move demo_states
+	for (i = 0; i < cl.maxclients; i++)
+	{
+		sc = (demoscore_t *) CL_DemoStateAlloc (sizeof(demoscore_t));
+		memcpy (sc->name, cl.scores[i].name, sizeof(sc->name));
+		sc->entertime = cl.scores[i].entertime;
+		sc->frags = cl.scores[i].frags;
+		sc->colors = cl.scores[i].colors;
+	}
+
+	memcpy (CL_DemoStateAlloc (sizeof(cl_lightstyle)), cl_lightstyle, sizeof(cl_lightstyle));
+
+	// rebuild the state each visible entity was sent with
+	for (i = 1; i < cl.num_entities; i++)
+	{
+		ent = &cl_entities[i];
+		if (ent->msgtime != cl.mtime[0])
+			continue;
+
+		s = (snapentity_t *) CL_DemoStateAlloc (sizeof(snapentity_t));
+		memset (s, 0, sizeof(*s));
+		s->num = i;
+		VectorCopy (ent->msg_origins[0], s->state.origin);
+		VectorCopy (ent->msg_angles[0], s->state.angles);
+		for (j = 1; j < MAX_MODELS && cl.model_precache[j]; j++)
+		{
+			if (cl.model_precache[j] == ent->model)
+			{
+				s->state.modelindex = j;
+				break;
+			}
+		}
+		s->state.frame = ent->frame;
+		for (j = 0; j < cl.maxclients; j++)
+		{
+			if (ent->colormap == cl.scores[j].translations)
+			{
+				s->state.colormap = j + 1;
+				break;
+			}
+		}
+		s->state.skin = ent->skinnum;
+		s->state.alpha = ent->alpha;
+		s->state.effects = ent->effects;
+		if (ent->lerpflags & LERP_MOVESTEP)
+			s->bits |= U_STEP;
+		if (ent->lerpflags & LERP_FINISH)
+		{
+			s->bits |= U_LERPFINISH;
+			s->lerpfinish = (int) CLAMP (0, (ent->lerpfinish - ent->msgtime) * 255 + 0.5, 255);
+		}
+	}
+
+	for (frame = cl.deltaframe - DEMO_KEYDELTAS + 1; numdeltas && frame <= cl.deltaframe; frame++)
+	{
+		numents = CL_GetSnapshot (frame, &ents);
+		if (numents < 0)
+			continue;
+		d = (demodelta_t *) CL_DemoStateAlloc (sizeof(demodelta_t));
+		d->frame = frame;
+		d->numents = numents;
+		memcpy (CL_DemoStateAlloc (numents * sizeof(snapentity_t)), ents, numents * sizeof(snapentity_t));
+	}
+}
+
+/*
+====================
+CL_DemoRestoreKeyframe
+
+puts the state of a keyframe in the current level back
+====================
+*/
+static void CL_DemoRestoreKeyframe (const demokey_t *k)
+{
+	const demostate_t	*st;
+	const demoscore_t	*sc;
+	const demodelta_t	*d;
+	const byte		*p;
+	int			i;
+
+	p = demo_states + k->stateofs;
+	st = (const demostate_t *) p;
+	p += sizeof(demostate_t);
+
+	cl.mtime[0] = cl.mtime[1] = k->mtime;
+	cl.time = cl.oldtime = k->mtime;
+
+	memcpy (cl.stats, st->stats, sizeof(cl.stats));
+	cl.items = st->items;
+	memcpy (cl.item_gettime, st->item_gettime, sizeof(cl.item_gettime));
+	VectorCopy (st->mviewangles, cl.mviewangles[0]);
+	VectorCopy (st->mviewangles, cl.mviewangles[1]);
+	VectorCopy (st->mvelocity, cl.mvelocity[0]);
+	VectorCopy (st->mvelocity, cl.mvelocity[1]);
+	VectorCopy (st->punchangle, cl.punchangle);
+	cl.idealpitch = st->idealpitch;
+	cl.viewheight = st->viewheight;
+	cl.paused = st->paused;
+	cl.onground = st->onground;
+	cl.inwater = st->inwater;
+	cl.intermission = st->intermission;
+	cl.completed_time = st->completed_time;
+	cl.viewentity = st->viewentity;
+	cl.cdtrack = st->cdtrack;
+	cl.looptrack = st->looptrack;
+	cl.deltaentities = st->deltaentities;
+	cl.deltaframe = st->deltaframe;
+	cl.deltaresync = st->deltaresync;
+	vid.recalc_refdef = true;	// in or out of intermission
+
+	for (i = 0; i < st->numscores && i < cl.maxclients; i++)
+	{
+		sc = (const demoscore_t *) p + i;
+		q_strlcpy (cl.scores[i].name, sc->name, MAX_SCOREBOARDNAME);
+		cl.scores[i].entertime = sc->entertime;
+		cl.scores[i].frags = sc->frags;
+		if (cl.scores[i].colors != sc->colors)
+		{
+			cl.scores[i].colors = sc->colors;
+			CL_NewTranslation (i);
+		}
+	}
+	p += st->numscores * sizeof(demoscore_t);
+	Sbar_Changed ();
+
+	memcpy (cl_lightstyle, p, sizeof(cl_lightstyle));
+	p += sizeof(cl_lightstyle);
+
+	// everything the keyframe doesn't list is gone
+	for (i = 1; i < cl.num_entities; i++)
+		cl_entities[i].msgtime = 0;
+	CL_RestoreEntities ((const snapentity_t *) p, st->numents);
+	p += st->numents * sizeof(snapentity_t);
+
+	CL_ClearSnapshots ();
+	for (i = 0; i < st->numdeltas; i++)
+	{
+		d = (const demodelta_t *) p;
+		p += sizeof(demodelta_t);
+		CL_SetSnapshot (d->frame, (const snapentity_t *) p, d->numents);
+		p += d->numents * sizeof(snapentity_t);
+	}
+}
+
+/*
+====================
+CL_DemoBuildIndex
+
+reads the whole demo, which is left at its end
+====================
+*/
+static void CL_DemoBuildIndex (void)
+{
+	demolevel_t	*lev;
+	double		nextkey;
+	int		level;
+
+	Con_Printf ("Indexing demo...\n");
+
+	demo_numlevels = demo_numkeys = demo_statesize = 0;
+	demo_indexing = true;
+	cls.demoseeking = true;
+	CL_DemoSeekTo (0);
+	cls.signon = 0;
+
+	level = -1;
+	nextkey = 0;
+	while (CL_ReadDemoMessage ())
+	{
+		CL_ParseServerMessage ();
+		cl.time = cl.oldtime = cl.mtime[0];	// so effects from it have the right times
+		if (cls.signon != SIGNONS || !demo_numlevels)
+			continue;
+
+		lev = &demo_levels[demo_numlevels - 1];
+		if (level != demo_numlevels - 1)
+		{	// first frame of the level
+			level = demo_numlevels - 1;
+			lev->firstmtime = cl.mtime[0];
+			nextkey = cl.mtime[0];
+		}
+		lev->lastmtime = cl.mtime[0];
+
+		if (cl.mtime[0] >= nextkey)
+		{
+			CL_DemoAddKeyframe ();
+			nextkey = cl.mtime[0] + DEMO_KEYINTERVAL;
+		}
+	}
+
+	demo_indexing = false;
+	cls.demoseeking = false;
+	demo_indexed = true;
+
+	Con_Printf ("%d levels, %d keyframes, %.1f seconds\n", demo_numlevels, demo_numkeys, CL_DemoLength ());
+}
+
+/*
+====================
+CL_DemoChecksum
+
+CRC of the start of the demo, which also fills demo_buf from there
+====================
+*/
+static int CL_DemoChecksum (void)
+{
+	byte	b;
+
+	CL_DemoSeekTo (0);
+	if (!CL_DemoRead (&b, 1))
+		return 0;
+	CL_DemoSeekTo (0);
+	return CRC_Block (demo_buf, demo_buflen);
+}
+
+/*
+====================
+CL_DemoSaveIndex
+====================
+*/
+static void CL_DemoSaveIndex (void)
+{
+	demoindexheader_t	header;
+	FILE			*f;
+
+	if (!demo_numkeys || strstr (demo_indexname, ".."))
+		return;
+
+	header.ident = DEMOINDEX_IDENT;
+	header.version = DEMOINDEX_VERSION;
+	header.sizes = DEMOINDEX_SIZES;
+	header.demosize = demo_size;
+	header.checksum = demo_checksum;
+	header.numlevels = demo_numlevels;
+	header.numkeys = demo_numkeys;
+	header.statesize = demo_statesize;
+
+	COM_CreatePath (demo_indexname);
+	f = fopen (demo_indexname, "wb");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't write %s\n", demo_indexname);
+		return;
+	}
+	fwrite (&header, sizeof(header), 1, f);
+	fwrite (demo_levels, sizeof(demolevel_t), demo_numlevels, f);
+	fwrite (demo_keys, sizeof(demokey_t), demo_numkeys, f);
+	fwrite (demo_states, 1, demo_statesize, f);
+	fclose (f);
+
+	Con_DPrintf ("Wrote %s\n", demo_indexname);
+}
+
+/*
+====================
+CL_DemoCheckEntities
+
+false if count entities at ofs don't fit in size bytes of demo_states,
+or hold something CL_UpdateEntity can't take
+====================
+*/
+static qboolean CL_DemoCheckEntities (int ofs, int count, int size)
+{
+	const snapentity_t	*s;
+	int			i;
+
+	if (count < 0 || count > MAX_EDICTS || (size - ofs) / (int) sizeof(snapentity_t) < count)
+		return false;
+
+	s = (const snapentity_t *) (demo_states + ofs);
+	for (i = 0; i < count; i++, s++)
+	{
+		if (!s->num || s->num >= MAX_EDICTS
+			|| s->state.modelindex < 0 || s->state.modelindex >= MAX_MODELS
+			|| s->state.colormap < 0 || s->state.colormap > MAX_SCOREBOARD)
+			return false;
+	}
+	return true;
+}
+
+/*
+====================
+CL_DemoCheckKeyframe
+
+walks the state of a loaded keyframe the way CL_DemoRestoreKeyframe will,
+false if any of it falls outside the size bytes of demo_states
+====================
+*/
+static qboolean CL_DemoCheckKeyframe (const demokey_t *k, int size)
+{
+	const demostate_t	*st;
+	const demodelta_t	*d;
+	int			ofs, i;
+
+	ofs = k->stateofs;
+	if (ofs < 0 || size - ofs < (int) sizeof(demostate_t))
+		return false;
+	st = (const demostate_t *) (demo_states + ofs);
+	ofs += sizeof(demostate_t);
+
+	if (st->numscores < 0 || st->numscores > MAX_SCOREBOARD
+		|| st->numdeltas < 0 || st->numdeltas > DEMO_KEYDELTAS)
+		return false;
+	ofs += st->numscores * sizeof(demoscore_t) + sizeof(cl_lightstyle);
+	if (ofs > size)
+		return false;
+
+	if (!CL_DemoCheckEntities (ofs, st->numents, size))
+		return false;
+	ofs += st->numents * sizeof(snapentity_t);
+
+	for (i = 0; i < st->numdeltas; i++)
+	{
+		if (size - ofs < (int) sizeof(demodelta_t))
+			return false;
+		d = (const demodelta_t *) (demo_states + ofs);
+		ofs += sizeof(demodelta_t);
+		if (d->frame <= 0 || !CL_DemoCheckEntities (ofs, d->numents, size))
+			return false;
+		ofs += d->numents * sizeof(snapentity_t);
+	}
+
+	return true;
+}
+
+/*
+====================
+CL_DemoLoadIndex
+
+false if there is no index for this demo, or it's for another one
+====================
+*/
+static qboolean CL_DemoLoadIndex (void)
+{
+	demoindexheader_t	header;
+	const demolevel_t	*lev;
+	const demokey_t		*k;
+	FILE			*f;
+	qboolean		ok;
+	int			i;
+
+	demo_numlevels = demo_numkeys = demo_statesize = 0;
+
+	f = fopen (demo_indexname, "rb");
+	if (!f)
+		return false;
+
+	ok = fread (&header, sizeof(header), 1, f) == 1
+		&& header.ident == DEMOINDEX_IDENT
+		&& header.version == DEMOINDEX_VERSION
+		&& header.sizes == DEMOINDEX_SIZES
+		&& header.demosize == demo_size
+		&& header.checksum == demo_checksum
+		&& header.numlevels > 0 && header.numkeys > 0 && header.statesize > 0;
+	if (ok)
+	{
+		CL_DemoGrow ((void **) &demo_levels, &demo_maxlevels, header.numlevels, sizeof(demolevel_t));
+		CL_DemoGrow ((void **) &demo_keys, &demo_maxkeys, header.numkeys, sizeof(demokey_t));
+		CL_DemoGrow ((void **) &demo_states, &demo_maxstatesize, header.statesize, 1);
+		ok = fread (demo_levels, sizeof(demolevel_t), header.numlevels, f) == (size_t) header.numlevels
+			&& fread (demo_keys, sizeof(demokey_t), header.numkeys, f) == (size_t) header.numkeys
+			&& fread (demo_states, 1, header.statesize, f) == (size_t) header.statesize;
+	}
+	fclose (f);
+
+	// a .dmi can be cut short or come from a different build, trust none of it
+	for (i = 0; ok && i < header.numlevels; i++)
+	{
+		lev = &demo_levels[i];
+		if (lev->offset < 0 || lev->offset > demo_size
+			|| (i && lev->offset < lev[-1].offset)
+			|| !(lev->starttime >= 0) || !(lev->lastmtime >= lev->firstmtime)
+			|| (i && !(lev->starttime >= lev[-1].starttime)))
+			ok = false;
+	}
+	for (i = 0; ok && i < header.numkeys; i++)
+	{
+		k = &demo_keys[i];
+		if (k->level < 0 || k->level >= header.numlevels
+			|| k->offset < demo_levels[k->level].offset || k->offset > demo_size
+			|| !(k->mtime >= demo_levels[k->level].firstmtime && k->mtime <= demo_levels[k->level].lastmtime)
+			|| !CL_DemoCheckKeyframe (k, header.statesize))
+			ok = false;
+	}
+	if (!ok)
+	{
+		Con_DPrintf ("%s is out of date\n", demo_indexname);
+		return false;
+	}
+
+	demo_numlevels = header.numlevels;
+	demo_numkeys = header.numkeys;
+	demo_statesize = header.statesize;
+	return true;
+}
+
+/*
+====================
+CL_DemoCurrentTime
+====================
+*/
+static double CL_DemoCurrentTime (void)
+{
+	int	level = CL_DemoLevelAt (demo_msgofs);
+
+	if (level < 0 || cls.signon != SIGNONS)
+		return 0;
+	return CL_DemoTime (level, cl.mtime[0]);
+}
+
+/*
+====================
+CL_DemoSeek
+====================
+*/
+static void CL_DemoSeek (double time)
+{
+	const demokey_t		*k;
+	const demolevel_t	*lev;
+	double			mtime;
+	qboolean		newlevel;
+	int			i;
+
+	time = CLAMP (0, time, CL_DemoLength ());
+
+	for (i = demo_numkeys - 1; i > 0; i--)
+	{
+		if (CL_DemoTime (demo_keys[i].level, demo_keys[i].mtime) <= time)
+			break;
+	}
+	k = &demo_keys[i];
+	lev = &demo_levels[k->level];
+	mtime = q_min (lev->firstmtime + (time - lev->starttime), lev->lastmtime);
+
+	cls.demoseeking = true;
+	S_StopDynamicSounds ();
+	R_ClearParticles ();
+	memset (cl_dlights, 0, sizeof(cl_dlights));
+	memset (cl_beams, 0, sizeof(cl_beams));
+
+	newlevel = (cls.signon != SIGNONS || CL_DemoLevelAt (demo_msgofs) != k->level);
+	if (newlevel)
+	{	// load the level again, up to the end of its signon
+		S_StopAllSounds (true);
+		CL_DemoSeekTo (lev->offset);
+		while (CL_ReadDemoMessage ())
+		{
+			CL_ParseServerMessage ();
+			if (cls.signon == SIGNONS)
+				break;
+		}
+		if (cls.signon != SIGNONS)
+			Host_Error ("CL_DemoSeek: demo changed since it was indexed");
+	}
+
+	CL_DemoRestoreKeyframe (k);
+	CL_DemoSeekTo (k->offset);
+
+	// skip to the exact time without drawing anything
+	while (cl.mtime[0] < mtime && CL_ReadDemoMessage ())
+	{
+		CL_ParseServerMessage ();
+		cl.time = cl.oldtime = cl.mtime[0];
+	}
+
+	cls.demoseeking = false;
+	cl.time = cl.oldtime = cl.mtime[0];
+	cl.cshifts[CSHIFT_DAMAGE].percent = 0;
+	cl.cshifts[CSHIFT_BONUS].percent = 0;
+
+	if (newlevel)
+	{
+		if (cls.forcetrack != -1)
+			BGM_PlayCDtrack ((byte)cls.forcetrack, true);
+		else
+			BGM_PlayCDtrack ((byte)cl.cdtrack, true);
+	}
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demoseek [time | +seconds | -seconds]
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	const char	*arg;
+	double		now, time;
+	int		ofs, level;
 
 	if (cmd_source != src_command)
 		return;
 
+	if (!cls.demoplayback)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+	if (cls.timedemo)
+	{
+		Con_Printf ("Can't seek during timedemo\n");
+		return;
+	}
+
+	if (!demo_indexed)
+	{	// find out where we are before reading the rest of the demo
+		ofs = demo_msgofs;
+		time = cl.mtime[0];
+		CL_DemoBuildIndex ();
+		CL_DemoSaveIndex ();
+		level = CL_DemoLevelAt (ofs);
+		now = (level < 0) ? 0 : CL_DemoTime (level, time);
+	}
+	else
+		now = CL_DemoCurrentTime ();
+
+	if (!demo_numkeys)
+	{
+		Con_Printf ("Nothing to seek to in this demo\n");
+		return;
+	}
+
 	if (Cmd_Argc() != 2)
 	{
-		Con_Printf ("playdemo <demoname> : plays a demo\n");
+		Con_Printf ("demoseek <time> : jumps to a time in the demo, +/- for relative\n");
+		Con_Printf ("at %.1f of %.1f seconds\n", now, CL_DemoLength ());
 		return;
 	}
 
+	arg = Cmd_Argv(1);
+	if (arg[0] == '+')
+		time = now + Q_atof (arg + 1);
+	else if (arg[0] == '-')
+		time = now - Q_atof (arg + 1);
+	else
+		time = Q_atof (arg);
+
+	CL_DemoSeek (time);
+}
+
+/*
+====================
+CL_PlayDemo
+
+opens demoname and starts playing it back, shared by playdemo and timedemo
+====================
+*/
+static void CL_PlayDemo (const char *demoname)
+{
+	char	name[MAX_OSPATH];
+	int	i, c, length, filestart;
+	qboolean neg;
+
 // disconnect from server
 	CL_Disconnect ();
 
 // open the demo file
-	q_strlcpy (name, Cmd_Argv(1), sizeof(name));
+	q_strlcpy (name, demoname, sizeof(name));
 	COM_AddExtension (name, ".dem", sizeof(name));
 
 	Con_Printf ("Playing demo from %s.\n", name);
 
-	COM_FOpenFile (name, &cls.demofile, NULL);
+	length = COM_FOpenFile (name, &cls.demofile, NULL);
 	if (!cls.demofile)
 	{
 		Con_Printf ("ERROR: couldn't open %s\n", name);
 		cls.demonum = -1;	// stop demo loop
 		return;
 	}
+	filestart = ftell (cls.demofile);
 
 // ZOID, fscanf is evil
 // O.S.: if a space character e.g. 0x20 (' ') follows '\n',
@@ -443,6 +1362,17 @@ void CL_PlayDemo_f (void)
 	if (neg)
 		cls.forcetrack = -cls.forcetrack;
 
+	demo_start = ftell (cls.demofile);
+	demo_size = length - (demo_start - filestart);
+	demo_bufofs = demo_buflen = demo_bufpos = 0;
+
+// the index is cached in the game directory under the demo's own name
+	q_snprintf (demo_indexname, sizeof(demo_indexname), "%s/%s", com_gamedir, name);
+	COM_StripExtension (demo_indexname, demo_indexname, sizeof(demo_indexname));
+	COM_AddExtension (demo_indexname, ".dmi", sizeof(demo_indexname));
+	demo_checksum = CL_DemoChecksum ();
+	demo_indexed = CL_DemoLoadIndex ();
+
 	cls.demoplayback = true;
 	cls.demopaused = false;
 	cls.state = ca_connected;
@@ -451,6 +1381,221 @@ void CL_PlayDemo_f (void)
 	key_dest = key_game;
 }
 
+/*
+====================
+CL_PlayDemo_f
+
+play [demoname]
+====================
+*/
+void CL_PlayDemo_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("playdemo <demoname> : plays a demo\n");
+		return;
+	}
+
+	CL_PlayDemo (Cmd_Argv(1));
+
+// index an unknown demo now, while it's loading anyway, unless it's part
+// of the startup demo loop; demoseek builds it otherwise
+	if (cls.demoplayback && !demo_indexed && cls.demonum == -1)
+	{
+		CL_DemoBuildIndex ();
+		CL_DemoSaveIndex ();
+
+	// start over from the first message
+		S_StopAllSounds (true);
+		R_ClearParticles ();
+		CL_DemoSeekTo (0);
+		cls.signon = 0;
+	}
+}
+
+/*
+==============================================================================
+
+TIMEDEMO REPORT
+
+_Host_Frame hands every counted timedemo frame to CL_TimeDemoFrame with the
+time it spent in each phase.  When "timedemo <demo> <report>" is used the
+samples are written out at the end as <report>.csv (one row per frame) and
+<report>.json (summary: frame time percentiles, mean phase times and the
+QuakeC statement total) in the game directory.  -timedemoquit exits once
+the report is written, for scripted runs such as "make bench".
+==============================================================================
+*/
+
+typedef struct
+{
+	float		total;		// milliseconds
+	float		server, client, render, sound;
+	unsigned int	statements;	// QuakeC statements executed
+} tdframe_t;
+
+static tdframe_t	*td_frames;
+static int		td_numframes, td_maxframes;
+static char		td_demo[MAX_QPATH];
+static char		td_report[MAX_QPATH];
+
+/*
+====================
+CL_TimeDemoFrame
+
+server/client/render/sound are the seconds spent in each phase of this
+host frame
+====================
+*/
+void CL_TimeDemoFrame (double server, double client, double render, double sound, unsigned int statements)
+{
+	tdframe_t	*f;
+
+// the first frame only loads the level, CL_FinishTimeDemo doesn't count it
+	if (!cls.timedemo || host_framecount <= cls.td_startframe)
+		return;
+
+	if (td_numframes == td_maxframes)
+	{
+		td_maxframes = q_max (td_maxframes * 2, 1024);
+		td_frames = (tdframe_t *) realloc (td_frames, td_maxframes * sizeof(*td_frames));
+		if (!td_frames)
+			Sys_Error ("CL_TimeDemoFrame: couldn't grow to %d frames", td_maxframes);
+	}
+
+	f = &td_frames[td_numframes++];
+	f->server = server * 1000;
+	f->client = client * 1000;
+	f->render = render * 1000;
+	f->sound = sound * 1000;
+	f->total = f->server + f->client + f->render + f->sound;
+	f->statements = statements;
+}
+
+static int CL_CompareFrameTimes (const void *a, const void *b)
+{
+	float	fa = *(const float *)a, fb = *(const float *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+====================
+CL_Percentile
+
+nearest-rank percentile of an ascending list
+====================
+*/
+static float CL_Percentile (const float *sorted, int count, float p)
+{
+	int	i;
+
+	i = (int) ceil (p * count) - 1;
+	return sorted[CLAMP (0, i, count - 1)];
+}
+
+/*
+====================
+CL_WriteTimeDemoReport
+====================
+*/
+static void CL_WriteTimeDemoReport (int frames, float time)
+{
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	float		*sorted;
+	double		sum[5];
+	double		statements;
+	tdframe_t	*fr;
+	const char	*c;
+	int		i, n;
+
+	n = td_numframes;
+	if (!n)
+	{
+		Con_Printf ("timedemo: no frames to report\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s.csv", com_gamedir, td_report);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+	fprintf (f, "frame,total_ms,server_ms,client_ms,render_ms,sound_ms,qc_statements\n");
+	for (i = 0, fr = td_frames; i < n; i++, fr++)
+		fprintf (f, "%d,%.4f,%.4f,%.4f,%.4f,%.4f,%u\n", i, fr->total,
+			 fr->server, fr->client, fr->render, fr->sound, fr->statements);
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+
+	sorted = (float *) malloc (n * sizeof(*sorted));
+	if (!sorted)
+		Sys_Error ("CL_WriteTimeDemoReport: couldn't allocate %d frames", n);
+	sum[0] = sum[1] = sum[2] = sum[3] = sum[4] = 0;
+	statements = 0;
+	for (i = 0, fr = td_frames; i < n; i++, fr++)
+	{
+		sorted[i] = fr->total;
+		sum[0] += fr->total;
+		sum[1] += fr->server;
+		sum[2] += fr->client;
+		sum[3] += fr->render;
+		sum[4] += fr->sound;
+		statements += fr->statements;
+	}
+	qsort (sorted, n, sizeof(*sorted), CL_CompareFrameTimes);
+
+	q_snprintf (name, sizeof(name), "%s/%s.json", com_gamedir, td_report);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		free (sorted);
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+	fprintf (f, "{\n");
+	fprintf (f, "\t\"demo\": \"");
+	for (c = td_demo; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fputc ('\\', f);
+		fputc (*c, f);
+	}
+	fprintf (f, "\",\n");
+	fprintf (f, "\t\"nullvideo\": %s,\n", vid_nullvideo ? "true" : "false");
+	fprintf (f, "\t\"frames\": %d,\n", frames);
+	fprintf (f, "\t\"seconds\": %.4f,\n", time);
+	fprintf (f, "\t\"fps\": %.2f,\n", frames / time);
+	fprintf (f, "\t\"frametime_ms\": {\n");
+	fprintf (f, "\t\t\"mean\": %.4f,\n", sum[0] / n);
+	fprintf (f, "\t\t\"p50\": %.4f,\n", CL_Percentile (sorted, n, 0.50f));
+	fprintf (f, "\t\t\"p90\": %.4f,\n", CL_Percentile (sorted, n, 0.90f));
+	fprintf (f, "\t\t\"p99\": %.4f,\n", CL_Percentile (sorted, n, 0.99f));
+	fprintf (f, "\t\t\"max\": %.4f\n", sorted[n - 1]);
+	fprintf (f, "\t},\n");
+	fprintf (f, "\t\"phase_mean_ms\": {\n");
+	fprintf (f, "\t\t\"server\": %.4f,\n", sum[1] / n);
+	fprintf (f, "\t\t\"client\": %.4f,\n", sum[2] / n);
+	fprintf (f, "\t\t\"render\": %.4f,\n", sum[3] / n);
+	fprintf (f, "\t\t\"sound\": %.4f\n", sum[4] / n);
+	fprintf (f, "\t},\n");
+	fprintf (f, "\t\"qc_statements\": %.0f\n", statements);
+	fprintf (f, "}\n");
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+
+	Con_Printf ("frame ms: p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+		    CL_Percentile (sorted, n, 0.50f), CL_Percentile (sorted, n, 0.90f),
+		    CL_Percentile (sorted, n, 0.99f), sorted[n - 1]);
+	free (sorted);
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -470,13 +1615,20 @@ static void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	if (td_report[0])
+		CL_WriteTimeDemoReport (frames, time);
+	td_numframes = 0;
+
+	if (COM_CheckParm ("-timedemoquit"))
+		Cbuf_AddText ("quit\n");
 }
 
 /*
 ====================
 CL_TimeDemo_f
 
-timedemo [demoname]
+timedemo [demoname] [report]
 ====================
 */
 void CL_TimeDemo_f (void)
@@ -484,15 +1636,27 @@ void CL_TimeDemo_f (void)
 	if (cmd_source != src_command)
 		return;
 
-	if (Cmd_Argc() != 2)
+	if (Cmd_Argc() != 2 && Cmd_Argc() != 3)
 	{
-		Con_Printf ("timedemo <demoname> : gets demo speeds\n");
+		Con_Printf ("timedemo <demoname> [report] : gets demo speeds\n");
+		Con_Printf ("  report: also write per-frame <report>.csv and <report>.json\n");
 		return;
 	}
 
-	CL_PlayDemo_f ();
+	CL_PlayDemo (Cmd_Argv(1));
 	if (!cls.demofile)
+	{
+		if (COM_CheckParm ("-timedemoquit"))
+			Cbuf_AddText ("quit\n");
 		return;
+	}
+
+	q_strlcpy (td_demo, Cmd_Argv(1), sizeof(td_demo));
+	if (Cmd_Argc() == 3)
+		q_strlcpy (td_report, Cmd_Argv(2), sizeof(td_report));
+	else
+		td_report[0] = 0;
+	td_numframes = 0;
 
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
@@ -387,6 +387,15 @@ void CL_SendMove (const usercmd_t *cmd)
 	MSG_WriteByte (&buf, in_impulse);
 	in_impulse = 0;
 
+//
+// tell the server which entity snapshot it can delta from
+//
+	if (cl.deltaentities)
+	{
+		MSG_WriteByte (&buf, clc_deltaack);
+		MSG_WriteLong (&buf, cl.deltaframe);
+	}
+
 //
 // deliver the message
 //
@@ -33,6 +33,7 @@ cvar_t	cl_color = {"_cl_color", "0", CVAR_ARCHIVE};
 
 cvar_t	cl_shownet = {"cl_shownet","0",CVAR_NONE};	// can be 0, 1, or 2
 cvar_t	cl_nolerp = {"cl_nolerp","0",CVAR_NONE};
+cvar_t	cl_deltaentities = {"cl_deltaentities","0",CVAR_ARCHIVE};	// ask remote servers for svc_deltaentities
 
 cvar_t	cfg_unbindall = {"cfg_unbindall", "1", CVAR_ARCHIVE};
 
@@ -187,6 +188,12 @@ void CL_SignonReply (void)
 	switch (cls.signon)
 	{
 	case 1:
+		// a local server gains nothing from deltas
+		if (cl_deltaentities.value && cl.protocol != PROTOCOL_NETQUAKE && !sv.active)
+		{
+			MSG_WriteByte (&cls.message, clc_stringcmd);
+			MSG_WriteString (&cls.message, "deltaentities");
+		}
 		MSG_WriteByte (&cls.message, clc_stringcmd);
 		MSG_WriteString (&cls.message, "prespawn");
 		break;
@@ -614,7 +621,9 @@ int CL_ReadFromServer (void)
 			break;
 
 		cl.last_received_message = realtime;
+		PROF_BEGIN ("CL_ParseServerMessage");
 		CL_ParseServerMessage ();
+		PROF_END ();
 	} while (ret && cls.state == ca_connected);
 
 	if (cl_shownet.value)
@@ -788,6 +797,7 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_anglespeedkey);
 	Cvar_RegisterVariable (&cl_shownet);
 	Cvar_RegisterVariable (&cl_nolerp);
+	Cvar_RegisterVariable (&cl_deltaentities);
 	Cvar_RegisterVariable (&lookspring);
 	Cvar_RegisterVariable (&lookstrafe);
 	Cvar_RegisterVariable (&sensitivity);
@@ -810,6 +820,7 @@ void CL_Init (void)
 	Cmd_AddCommand ("stop", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f);
 
 	Cmd_AddCommand ("tracepos", CL_Tracepos_f); //johnfitz
 	Cmd_AddCommand ("viewpos", CL_Viewpos_f); //johnfitz
@@ -80,7 +80,7 @@ const char *svc_strings[] =
 	"svc_spawnbaseline2", //42			// support for large modelindex, large framenum, alpha, using flags
 	"svc_spawnstatic2", // 43			// support for large modelindex, large framenum, alpha, using flags
 	"svc_spawnstaticsound2", //	44		// [coord3] [short] samp [byte] vol [byte] aten
-	"", // 44
+	"svc_deltaentities", // 45			// [long] frame [long] delta frame <update>...[0]
 	"", // 45
 	"", // 46
 	"", // 47
@@ -272,6 +272,7 @@ void CL_ParseServerInfo (void)
 // wipe the client_state_t struct
 //
 	CL_ClearState ();
+	CL_ClearSnapshots ();
 
 // parse protocol version number
 	i = MSG_ReadLong ();
@@ -412,50 +413,97 @@ void CL_ParseServerInfo (void)
 
 /*
 ==================
-CL_ParseUpdate
+CL_ReadEntityFields
 
-Parse an entity update message from the server
-If an entities model or origin changes from frame to frame, it must be
-relinked.  Other attributes can change without relinking.
+Reads the fields flagged in bits over s, which starts out as the state they
+are relative to.
 ==================
 */
-void CL_ParseUpdate (int bits)
+static void CL_ReadEntityFields (int bits, snapentity_t *s)
 {
-	int		i;
-	qmodel_t	*model;
-	int		modnum;
-	qboolean	forcelink;
-	entity_t	*ent;
-	int		num;
-	int		skin;
+	if (bits & U_MODEL)
+		s->state.modelindex = MSG_ReadByte ();
+	if (bits & U_FRAME)
+		s->state.frame = MSG_ReadByte ();
+	if (bits & U_COLORMAP)
+		s->state.colormap = MSG_ReadByte();
+	if (bits & U_SKIN)
+		s->state.skin = MSG_ReadByte();
+	if (bits & U_EFFECTS)
+		s->state.effects = MSG_ReadByte();
 
-	if (cls.signon == SIGNONS - 1)
-	{	// first update is the final signon stage
-		cls.signon = SIGNONS;
-		CL_SignonReply ();
-	}
+	if (bits & U_ORIGIN1)
+		s->state.origin[0] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE1)
+		s->state.angles[0] = MSG_ReadAngle(cl.protocolflags);
+	if (bits & U_ORIGIN2)
+		s->state.origin[1] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE2)
+		s->state.angles[1] = MSG_ReadAngle(cl.protocolflags);
+	if (bits & U_ORIGIN3)
+		s->state.origin[2] = MSG_ReadCoord (cl.protocolflags);
+	if (bits & U_ANGLE3)
+		s->state.angles[2] = MSG_ReadAngle(cl.protocolflags);
 
-	if (bits & U_MOREBITS)
+	//johnfitz -- PROTOCOL_FITZQUAKE and PROTOCOL_NEHAHRA
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
 	{
-		i = MSG_ReadByte ();
-		bits |= (i<<8);
+		if (bits & U_ALPHA)
+			s->state.alpha = MSG_ReadByte();
+		if (bits & U_SCALE)
+			MSG_ReadByte(); // PROTOCOL_RMQ: currently ignored
+		if (bits & U_FRAME2)
+			s->state.frame = (s->state.frame & 0x00FF) | (MSG_ReadByte() << 8);
+		if (bits & U_MODEL2)
+			s->state.modelindex = (s->state.modelindex & 0x00FF) | (MSG_ReadByte() << 8);
+		if (bits & U_LERPFINISH)
+			s->lerpfinish = MSG_ReadByte();
 	}
-
-	//johnfitz -- PROTOCOL_FITZQUAKE
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
+	else if (cl.protocol == PROTOCOL_NETQUAKE)
 	{
-		if (bits & U_EXTEND1)
-			bits |= MSG_ReadByte() << 16;
-		if (bits & U_EXTEND2)
-			bits |= MSG_ReadByte() << 24;
+		//HACK: if this bit is set, assume this is PROTOCOL_NEHAHRA
+		if (bits & U_TRANS)
+		{
+			float a, b;
+
+			if (warn_about_nehahra_protocol)
+			{
+				Con_Warning ("nonstandard update bit, assuming Nehahra protocol\n");
+				warn_about_nehahra_protocol = false;
+			}
+
+			a = MSG_ReadFloat();
+			b = MSG_ReadFloat(); //alpha
+			if (a == 2)
+				MSG_ReadFloat(); //fullbright (not using this yet)
+			s->state.alpha = ENTALPHA_ENCODE(b);
+		}
+		bits &= ~U_LERPFINISH;
 	}
 	//johnfitz
 
-	if (bits & U_LONGENTITY)
-		num = MSG_ReadShort ();
-	else
-		num = MSG_ReadByte ();
+	s->bits = bits & (U_STEP|U_LERPFINISH);
+}
+
+/*
+==================
+CL_UpdateEntity
 
+Moves an entity to the state the server sent this frame.
+If an entities model or origin changes from frame to frame, it must be
+relinked.  Other attributes can change without relinking.
+==================
+*/
+static void CL_UpdateEntity (const snapentity_t *s)
+{
+	int		i;
+	qmodel_t	*model;
+	int		modnum;
+	qboolean	forcelink;
+	entity_t	*ent;
+	int		num;
+
+	num = s->num;
 	ent = CL_EntityNum (num);
 
 	if (ent->msgtime != cl.mtime[1])
@@ -470,24 +518,13 @@ void CL_ParseUpdate (int bits)
 
 	ent->msgtime = cl.mtime[0];
 
-	if (bits & U_MODEL)
-	{
-		modnum = MSG_ReadByte ();
-		if (modnum >= MAX_MODELS)
-			Host_Error ("CL_ParseModel: bad modnum");
-	}
-	else
-		modnum = ent->baseline.modelindex;
+	modnum = s->state.modelindex;
+	if (modnum >= MAX_MODELS)
+		Host_Error ("CL_ParseModel: bad modnum");
 
-	if (bits & U_FRAME)
-		ent->frame = MSG_ReadByte ();
-	else
-		ent->frame = ent->baseline.frame;
+	ent->frame = s->state.frame;
 
-	if (bits & U_COLORMAP)
-		i = MSG_ReadByte();
-	else
-		i = ent->baseline.colormap;
+	i = s->state.colormap;
 	if (!i)
 		ent->colormap = vid.colormap;
 	else
@@ -496,54 +533,22 @@ void CL_ParseUpdate (int bits)
 			Sys_Error ("i >= cl.maxclients");
 		ent->colormap = cl.scores[i-1].translations;
 	}
-	if (bits & U_SKIN)
-		skin = MSG_ReadByte();
-	else
-		skin = ent->baseline.skin;
-	if (skin != ent->skinnum)
+	if (s->state.skin != ent->skinnum)
 	{
-		ent->skinnum = skin;
+		ent->skinnum = s->state.skin;
 		if (num > 0 && num <= cl.maxclients)
 			R_TranslateNewPlayerSkin (num - 1); //johnfitz -- was R_TranslatePlayerSkin
 	}
-	if (bits & U_EFFECTS)
-		ent->effects = MSG_ReadByte();
-	else
-		ent->effects = ent->baseline.effects;
+	ent->effects = s->state.effects;
 
 // shift the known values for interpolation
 	VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
 	VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
-
-	if (bits & U_ORIGIN1)
-		ent->msg_origins[0][0] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][0] = ent->baseline.origin[0];
-	if (bits & U_ANGLE1)
-		ent->msg_angles[0][0] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][0] = ent->baseline.angles[0];
-
-	if (bits & U_ORIGIN2)
-		ent->msg_origins[0][1] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][1] = ent->baseline.origin[1];
-	if (bits & U_ANGLE2)
-		ent->msg_angles[0][1] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][1] = ent->baseline.angles[1];
-
-	if (bits & U_ORIGIN3)
-		ent->msg_origins[0][2] = MSG_ReadCoord (cl.protocolflags);
-	else
-		ent->msg_origins[0][2] = ent->baseline.origin[2];
-	if (bits & U_ANGLE3)
-		ent->msg_angles[0][2] = MSG_ReadAngle(cl.protocolflags);
-	else
-		ent->msg_angles[0][2] = ent->baseline.angles[2];
+	VectorCopy (s->state.origin, ent->msg_origins[0]);
+	VectorCopy (s->state.angles, ent->msg_angles[0]);
 
 	//johnfitz -- lerping for movetype_step entities
-	if (bits & U_STEP)
+	if (s->bits & U_STEP)
 	{
 		ent->lerpflags |= LERP_MOVESTEP;
 		ent->forcelink = true;
@@ -552,50 +557,15 @@ void CL_ParseUpdate (int bits)
 		ent->lerpflags &= ~LERP_MOVESTEP;
 	//johnfitz
 
-	//johnfitz -- PROTOCOL_FITZQUAKE and PROTOCOL_NEHAHRA
-	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
-	{
-		if (bits & U_ALPHA)
-			ent->alpha = MSG_ReadByte();
-		else
-			ent->alpha = ent->baseline.alpha;
-		if (bits & U_SCALE)
-			MSG_ReadByte(); // PROTOCOL_RMQ: currently ignored
-		if (bits & U_FRAME2)
-			ent->frame = (ent->frame & 0x00FF) | (MSG_ReadByte() << 8);
-		if (bits & U_MODEL2)
-			modnum = (modnum & 0x00FF) | (MSG_ReadByte() << 8);
-		if (bits & U_LERPFINISH)
-		{
-			ent->lerpfinish = ent->msgtime + ((float)(MSG_ReadByte()) / 255);
-			ent->lerpflags |= LERP_FINISH;
-		}
-		else
-			ent->lerpflags &= ~LERP_FINISH;
-	}
-	else if (cl.protocol == PROTOCOL_NETQUAKE)
-	{
-		//HACK: if this bit is set, assume this is PROTOCOL_NEHAHRA
-		if (bits & U_TRANS)
-		{
-			float a, b;
+	ent->alpha = s->state.alpha;
 
-			if (warn_about_nehahra_protocol)
-			{
-				Con_Warning ("nonstandard update bit, assuming Nehahra protocol\n");
-				warn_about_nehahra_protocol = false;
-			}
-
-			a = MSG_ReadFloat();
-			b = MSG_ReadFloat(); //alpha
-			if (a == 2)
-				MSG_ReadFloat(); //fullbright (not using this yet)
-			ent->alpha = ENTALPHA_ENCODE(b);
-		}
-		else
-			ent->alpha = ent->baseline.alpha;
+	if (s->bits & U_LERPFINISH)
+	{
+		ent->lerpfinish = ent->msgtime + ((float)(s->lerpfinish) / 255);
+		ent->lerpflags |= LERP_FINISH;
 	}
-	//johnfitz
+	else
+		ent->lerpflags &= ~LERP_FINISH;
 
 	//johnfitz -- moved here from above
 	model = cl.model_precache[modnum];
@@ -630,6 +600,257 @@ void CL_ParseUpdate (int bits)
 	}
 }
 
+/*
+==================
+CL_ReadUpdateBits
+==================
+*/
+static int CL_ReadUpdateBits (int bits, int *num)
+{
+	if (bits & U_MOREBITS)
+		bits |= MSG_ReadByte () << 8;
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (cl.protocol == PROTOCOL_FITZQUAKE || cl.protocol == PROTOCOL_RMQ)
+	{
+		if (bits & U_EXTEND1)
+			bits |= MSG_ReadByte() << 16;
+		if (bits & U_EXTEND2)
+			bits |= MSG_ReadByte() << 24;
+	}
+	//johnfitz
+
+	if (bits & U_LONGENTITY)
+		*num = MSG_ReadShort ();
+	else
+		*num = MSG_ReadByte ();
+
+	return bits;
+}
+
+/*
+==================
+CL_ParseUpdate
+
+Parse an entity update message from the server
+==================
+*/
+void CL_ParseUpdate (int bits)
+{
+	snapentity_t	s;
+	int		num;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	bits = CL_ReadUpdateBits (bits, &num);
+
+	s.num = num;
+	s.state = CL_EntityNum (num)->baseline;
+	s.bits = 0;
+	CL_ReadEntityFields (bits, &s);
+	CL_UpdateEntity (&s);
+}
+
+/*
+==================
+ENTITY DELTAS
+
+svc_deltaentities lists the entities that changed since a frame the client
+acknowledged.  The rest keep the state they had in that frame, so the last
+ENTITYDELTA_BACKUP frames are kept the same way the server keeps them.
+==================
+*/
+typedef struct
+{
+	int		frame;		// 0 if unused
+	int		numents;
+	int		maxents;
+	snapentity_t	*ents;
+} clsnapshot_t;
+
+static clsnapshot_t	cl_snapshots[ENTITYDELTA_BACKUP];
+static clsnapshot_t	cl_snapbuild;
+
+/*
+==================
+CL_ClearSnapshots
+==================
+*/
+void CL_ClearSnapshots (void)
+{
+	int	i;
+
+	for (i = 0 ; i < ENTITYDELTA_BACKUP ; i++)
+		cl_snapshots[i].frame = 0;
+}
+
+/*
+==================
+CL_AddSnapEntity
+==================
+*/
+static void CL_AddSnapEntity (const snapentity_t *s)
+{
+	clsnapshot_t	*snap = &cl_snapbuild;
+
+	if (snap->numents == snap->maxents)
+	{
+		snap->maxents = q_max(256, snap->maxents * 2);
+		snap->ents = (snapentity_t *) realloc (snap->ents, snap->maxents * sizeof(snapentity_t));
+		if (!snap->ents)
+			Sys_Error ("CL_AddSnapEntity: realloc() failed on %d entities", snap->maxents);
+	}
+	snap->ents[snap->numents++] = *s;
+}
+
+/*
+==================
+CL_ParseEntityDelta
+==================
+*/
+static void CL_ParseEntityDelta (void)
+{
+	clsnapshot_t	*from, *to, swap;
+	snapentity_t	s;
+	int		frame, deltaframe, bits, num, i, j;
+	qboolean	valid;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	frame = MSG_ReadLong ();
+	deltaframe = MSG_ReadLong ();
+	cl.deltaentities = true;
+
+	from = NULL;
+	valid = (frame > 0);
+	if (deltaframe)
+	{
+		from = &cl_snapshots[deltaframe & ENTITYDELTA_MASK];
+		if (from->frame != deltaframe)
+			valid = false;
+	}
+
+	// a message we can't use still has to be read through
+	cl_snapbuild.numents = 0;
+	j = 0;
+	while (1)
+	{
+		if (msg_badread)
+			Host_Error ("CL_ParseEntityDelta: Bad server message");
+
+		bits = MSG_ReadByte ();
+		if (!bits)
+			break;
+		bits = CL_ReadUpdateBits (bits & ~U_SIGNAL, &num);
+
+		for ( ; valid && from && j < from->numents && from->ents[j].num < num ; j++)
+			CL_AddSnapEntity (&from->ents[j]);
+
+		if (valid && from && j < from->numents && from->ents[j].num == num)
+			s = from->ents[j++];
+		else
+		{
+			s.num = num;
+			s.state = CL_EntityNum (num)->baseline;
+			s.bits = 0;
+		}
+
+		if (bits & U_REMOVE)
+			continue;
+
+		CL_ReadEntityFields (bits, &s);
+		CL_AddSnapEntity (&s);
+	}
+
+	if (!valid)
+	{
+		Con_DPrintf ("CL_ParseEntityDelta: frame %i is not here to delta from\n", deltaframe);
+		return;
+	}
+
+	for ( ; from && j < from->numents ; j++)
+		CL_AddSnapEntity (&from->ents[j]);
+
+	to = &cl_snapshots[frame & ENTITYDELTA_MASK];
+	swap = *to;
+	*to = cl_snapbuild;
+	cl_snapbuild = swap;
+	to->frame = frame;
+	if (!deltaframe)
+		cl.deltaresync = false;
+	if (!cl.deltaresync)
+		cl.deltaframe = frame;
+
+	for (i = 0 ; i < to->numents ; i++)
+		CL_UpdateEntity (&to->ents[i]);
+}
+
+/*
+==================
+CL_GetSnapshot
+
+the entities of a kept frame for demo keyframes, returns -1 if the frame
+isn't kept
+==================
+*/
+int CL_GetSnapshot (int frame, const snapentity_t **ents)
+{
+	clsnapshot_t	*snap = &cl_snapshots[frame & ENTITYDELTA_MASK];
+
+	if (frame <= 0 || snap->frame != frame)
+		return -1;
+	*ents = snap->ents;
+	return snap->numents;
+}
+
+/*
+==================
+CL_SetSnapshot
+
+puts a frame saved with CL_GetSnapshot back, so the deltas that follow a
+demo keyframe have something to apply to
+==================
+*/
+void CL_SetSnapshot (int frame, const snapentity_t *ents, int numents)
+{
+	clsnapshot_t	*snap = &cl_snapshots[frame & ENTITYDELTA_MASK];
+
+	if (snap->maxents < numents)
+	{
+		snap->maxents = q_max(256, numents);
+		snap->ents = (snapentity_t *) realloc (snap->ents, snap->maxents * sizeof(snapentity_t));
+		if (!snap->ents)
+			Sys_Error ("CL_SetSnapshot: realloc() failed on %d entities", snap->maxents);
+	}
+	memcpy (snap->ents, ents, numents * sizeof(snapentity_t));
+	snap->numents = numents;
+	snap->frame = frame;
+}
+
+/*
+==================
+CL_RestoreEntities
+
+moves the listed entities to a saved state as if it had just arrived in
+the current message, for demo keyframes
+==================
+*/
+void CL_RestoreEntities (const snapentity_t *ents, int numents)
+{
+	int	i;
+
+	for (i = 0 ; i < numents ; i++)
+		CL_UpdateEntity (&ents[i]);
+}
+
 /*
 ==================
 CL_ParseBaseline
@@ -1010,22 +1231,30 @@ void CL_ParseServerMessage (void)
 			break;
 
 		case svc_disconnect:
+			if (cls.demoseeking)
+				break;	// the end of a demo being indexed or skipped through
 			Host_EndGame ("Server disconnected\n");
 
 		case svc_print:
-			Con_Printf ("%s", MSG_ReadString ());
+			str = MSG_ReadString ();
+			if (!cls.demoseeking)
+				Con_Printf ("%s", str);
 			break;
 
 		case svc_centerprint:
 			//johnfitz -- log centerprints to console
 			str = MSG_ReadString ();
+			if (cls.demoseeking)
+				break;
 			SCR_CenterPrint (str);
 			Con_LogCenterPrint (str);
 			//johnfitz
 			break;
 
 		case svc_stufftext:
-			Cbuf_AddText (MSG_ReadString ());
+			str = MSG_ReadString ();
+			if (!cls.demoseeking)
+				Cbuf_AddText (str);
 			break;
 
 		case svc_damage:
@@ -1033,6 +1262,8 @@ void CL_ParseServerMessage (void)
 			break;
 
 		case svc_serverinfo:
+			if (cls.demoplayback)
+				CL_DemoServerInfo ();
 			CL_ParseServerInfo ();
 			vid.recalc_refdef = true;	// leave intermission full screen
 			break;
@@ -1123,6 +1354,8 @@ void CL_ParseServerMessage (void)
 
 		case svc_setpause:
 			cl.paused = MSG_ReadByte ();
+			if (cls.demoseeking)
+				break;
 			if (cl.paused)
 			{
 				CDAudio_Pause ();
@@ -1173,6 +1406,8 @@ void CL_ParseServerMessage (void)
 		case svc_cdtrack:
 			cl.cdtrack = MSG_ReadByte ();
 			cl.looptrack = MSG_ReadByte ();
+			if (cls.demoseeking)
+				break;	// CL_DemoSeek starts the track of the level it lands in
 			if ( (cls.demoplayback || cls.demorecording) && (cls.forcetrack != -1) )
 				BGM_PlayCDtrack ((byte)cls.forcetrack, true);
 			else
@@ -1191,6 +1426,8 @@ void CL_ParseServerMessage (void)
 			vid.recalc_refdef = true;	// go to full screen
 			//johnfitz -- log centerprints to console
 			str = MSG_ReadString ();
+			if (cls.demoseeking)
+				break;
 			SCR_CenterPrint (str);
 			Con_LogCenterPrint (str);
 			//johnfitz
@@ -1202,13 +1439,16 @@ void CL_ParseServerMessage (void)
 			vid.recalc_refdef = true;	// go to full screen
 			//johnfitz -- log centerprints to console
 			str = MSG_ReadString ();
+			if (cls.demoseeking)
+				break;
 			SCR_CenterPrint (str);
 			Con_LogCenterPrint (str);
 			//johnfitz
 			break;
 
 		case svc_sellscreen:
-			Cmd_ExecuteString ("help", src_command);
+			if (!cls.demoseeking)
+				Cmd_ExecuteString ("help", src_command);
 			break;
 
 		//johnfitz -- new svc types
@@ -1238,6 +1478,10 @@ void CL_ParseServerMessage (void)
 			CL_ParseStaticSound (2);
 			break;
 		//johnfitz
+
+		case svc_deltaentities:
+			CL_ParseEntityDelta ();
+			break;
 		}
 
 		lastcmd = cmd; //johnfitz
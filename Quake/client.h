@@ -119,6 +119,10 @@ typedef struct
 // want a svc_setpause inside the demo to actually pause demo playback).
 	qboolean	demopaused;
 
+// demoseek is parsing messages without showing them: no sounds, prints or
+// stufftext, and svc_disconnect doesn't end the demo
+	qboolean	demoseeking;
+
 	qboolean	timedemo;
 	int		forcetrack;		// -1 = use normal cd track
 	FILE		*demofile;
@@ -224,6 +228,10 @@ typedef struct
 
 	unsigned	protocol; //johnfitz
 	unsigned	protocolflags;
+
+	qboolean	deltaentities;	// server is sending svc_deltaentities
+	int			deltaframe;		// last one parsed, acknowledged with clc_deltaack
+	qboolean	deltaresync;	// keep acking 0 until a frame comes relative to the baselines
 } client_state_t;
 
 
@@ -232,6 +240,7 @@ typedef struct
 //
 extern	cvar_t	cl_name;
 extern	cvar_t	cl_color;
+extern	cvar_t	cl_deltaentities;
 
 extern	cvar_t	cl_upspeed;
 extern	cvar_t	cl_forwardspeed;
@@ -337,11 +346,18 @@ void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_DemoSeek_f (void);
+void CL_DemoServerInfo (void);
+void CL_TimeDemoFrame (double server, double client, double render, double sound, unsigned int statements);
 
 //
 // cl_parse.c
 //
 void CL_ParseServerMessage (void);
+void CL_ClearSnapshots (void);
+int CL_GetSnapshot (int frame, const snapentity_t **ents);
+void CL_SetSnapshot (int frame, const snapentity_t *ents, int numents);
+void CL_RestoreEntities (const snapentity_t *ents, int numents);
 void CL_NewTranslation (int slot);
 
 //
@@ -35,10 +35,16 @@ typedef struct cmdalias_s
 	struct cmdalias_s	*next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
+	struct cmdalias_s	*hashnext;
 } cmdalias_t;
 
 cmdalias_t	*cmd_alias;
 
+// aliases and commands are matched case insensitively when executed, so
+// both tables hash with COM_HashStringNoCase
+#define	CMD_HASHSIZE	512
+static cmdalias_t	*cmd_aliashash[CMD_HASHSIZE];
+
 qboolean	cmd_wait;
 
 //=============================================================================
@@ -296,6 +302,25 @@ void Cmd_Echo_f (void)
 	Con_Printf ("\n");
 }
 
+/*
+===============
+Cmd_FindAlias
+
+Exact name match, like the alias commands always did
+===============
+*/
+static cmdalias_t *Cmd_FindAlias (const char *name)
+{
+	cmdalias_t	*a;
+
+	for (a = cmd_aliashash[COM_HashStringNoCase(name) & (CMD_HASHSIZE-1)] ; a ; a = a->hashnext)
+	{
+		if (!strcmp(name, a->name))
+			return a;
+	}
+	return NULL;
+}
+
 /*
 ===============
 Cmd_Alias_f -- johnfitz -- rewritten
@@ -309,6 +334,7 @@ void Cmd_Alias_f (void)
 	char		cmd[1024];
 	int			i, c;
 	const char	*s;
+	unsigned int	hash;
 
 
 	switch (Cmd_Argc())
@@ -322,9 +348,9 @@ void Cmd_Alias_f (void)
 			Con_SafePrintf ("no alias commands found\n");
 		break;
 	case 2: //output current alias string
-		for (a = cmd_alias ; a ; a=a->next)
-			if (!strcmp(Cmd_Argv(1), a->name))
-				Con_Printf ("   %s: %s", a->name, a->value);
+		a = Cmd_FindAlias (Cmd_Argv(1));
+		if (a)
+			Con_Printf ("   %s: %s", a->name, a->value);
 		break;
 	default: //set alias string
 		s = Cmd_Argv(1);
@@ -335,22 +361,19 @@ void Cmd_Alias_f (void)
 		}
 
 		// if the alias allready exists, reuse it
-		for (a = cmd_alias ; a ; a=a->next)
-		{
-			if (!strcmp(s, a->name))
-			{
-				Z_Free (a->value);
-				break;
-			}
-		}
-
-		if (!a)
+		a = Cmd_FindAlias (s);
+		if (a)
+			Z_Free (a->value);
+		else
 		{
 			a = (cmdalias_t *) Z_Malloc (sizeof(cmdalias_t));
 			a->next = cmd_alias;
 			cmd_alias = a;
+			strcpy (a->name, s);
+			hash = COM_HashStringNoCase (s) & (CMD_HASHSIZE-1);
+			a->hashnext = cmd_aliashash[hash];
+			cmd_aliashash[hash] = a;
 		}
-		strcpy (a->name, s);
 
 		// copy the rest of the command line
 		cmd[0] = 0;		// start out with a null string
@@ -380,7 +403,7 @@ Cmd_Unalias_f -- johnfitz
 */
 void Cmd_Unalias_f (void)
 {
-	cmdalias_t	*a, *prev;
+	cmdalias_t	*a, **link;
 
 	switch (Cmd_Argc())
 	{
@@ -389,23 +412,22 @@ void Cmd_Unalias_f (void)
 		Con_Printf("unalias <name> : delete alias\n");
 		break;
 	case 2:
-		prev = NULL;
-		for (a = cmd_alias; a; a = a->next)
+		a = Cmd_FindAlias (Cmd_Argv(1));
+		if (!a)
 		{
-			if (!strcmp(Cmd_Argv(1), a->name))
-			{
-				if (prev)
-					prev->next = a->next;
-				else
-					cmd_alias  = a->next;
-
-				Z_Free (a->value);
-				Z_Free (a);
-				return;
-			}
-			prev = a;
+			Con_Printf ("No alias named %s\n", Cmd_Argv(1));
+			break;
 		}
-		Con_Printf ("No alias named %s\n", Cmd_Argv(1));
+
+		for (link = &cmd_alias; *link != a; link = &(*link)->next)
+			;
+		*link = a->next;
+		for (link = &cmd_aliashash[COM_HashStringNoCase(a->name) & (CMD_HASHSIZE-1)]; *link != a; link = &(*link)->hashnext)
+			;
+		*link = a->hashnext;
+
+		Z_Free (a->value);
+		Z_Free (a);
 		break;
 	}
 }
@@ -426,6 +448,7 @@ void Cmd_Unaliasall_f (void)
 		Z_Free(cmd_alias);
 		cmd_alias = blah;
 	}
+	memset (cmd_aliashash, 0, sizeof(cmd_aliashash));
 }
 
 /*
@@ -441,6 +464,7 @@ typedef struct cmd_function_s
 	struct cmd_function_s	*next;
 	const char		*name;
 	xcommand_t		function;
+	struct cmd_function_s	*hashnext;
 } cmd_function_t;
 
 
@@ -457,6 +481,7 @@ cmd_source_t	cmd_source;
 //static	cmd_function_t	*cmd_functions;		// possible commands to execute
 cmd_function_t	*cmd_functions;		// possible commands to execute
 //johnfitz
+static	cmd_function_t	*cmd_hash[CMD_HASHSIZE];
 
 /*
 ============
@@ -670,6 +695,7 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 {
 	cmd_function_t	*cmd;
 	cmd_function_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 	if (host_initialized)	// because hunk allocation would get stomped
 		Sys_Error ("Cmd_AddCommand after host_initialized");
@@ -682,19 +708,20 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 	}
 
 // fail if the command already exists
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	if (Cmd_Exists (cmd_name))
 	{
-		if (!Q_strcmp (cmd_name, cmd->name))
-		{
-			Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = (cmd_function_t *) Hunk_Alloc (sizeof(cmd_function_t));
 	cmd->name = cmd_name;
 	cmd->function = function;
 
+	hash = COM_HashStringNoCase (cmd_name) & (CMD_HASHSIZE-1);
+	cmd->hashnext = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
+
 	//johnfitz -- insert each entry in alphabetical order
 	if (cmd_functions == NULL || strcmp(cmd->name, cmd_functions->name) < 0) //insert at front
 	{
@@ -725,7 +752,7 @@ qboolean	Cmd_Exists (const char *cmd_name)
 {
 	cmd_function_t	*cmd;
 
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	for (cmd=cmd_hash[COM_HashStringNoCase(cmd_name) & (CMD_HASHSIZE-1)] ; cmd ; cmd=cmd->hashnext)
 	{
 		if (!Q_strcmp (cmd_name,cmd->name))
 			return true;
@@ -764,13 +791,13 @@ const char *Cmd_CompleteCommand (const char *partial)
 Cmd_ExecuteString
 
 A complete command line has been parsed, so try to execute it
-FIXME: lookupnoadd the token to speed search?
 ============
 */
 void	Cmd_ExecuteString (const char *text, cmd_source_t src)
 {
 	cmd_function_t	*cmd;
 	cmdalias_t		*a;
+	unsigned int	hash;
 
 	cmd_source = src;
 	Cmd_TokenizeString (text);
@@ -779,8 +806,10 @@ void	Cmd_ExecuteString (const char *text, cmd_source_t src)
 	if (!Cmd_Argc())
 		return;		// no tokens
 
+	hash = COM_HashStringNoCase (cmd_argv[0]) & (CMD_HASHSIZE-1);
+
 // check functions
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	for (cmd=cmd_hash[hash] ; cmd ; cmd=cmd->hashnext)
 	{
 		if (!q_strcasecmp (cmd_argv[0],cmd->name))
 		{
@@ -790,7 +819,7 @@ void	Cmd_ExecuteString (const char *text, cmd_source_t src)
 	}
 
 // check alias
-	for (a=cmd_alias ; a ; a=a->next)
+	for (a=cmd_aliashash[hash] ; a ; a=a->hashnext)
 	{
 		if (!q_strcasecmp (cmd_argv[0], a->name))
 		{
@@ -254,6 +254,26 @@ char *q_strupr (char *str)
 	return str;
 }
 
+/* string hashing for the lookup tables (djb2 with xor) */
+unsigned int COM_HashString (const char *str)
+{
+	unsigned int	hash = 5381;
+
+	while (*str)
+		hash = ((hash << 5) + hash) ^ (unsigned char)*str++;
+	return hash;
+}
+
+/* case-insensitive variant, matching q_strcasecmp() */
+unsigned int COM_HashStringNoCase (const char *str)
+{
+	unsigned int	hash = 5381;
+
+	while (*str)
+		hash = ((hash << 5) + hash) ^ (unsigned char)q_tolower(*str++);
+	return hash;
+}
+
 /* platform dependant (v)snprintf function names: */
 #if defined(_WIN32)
 #define	snprintf_func		_snprintf
@@ -1555,6 +1575,8 @@ void COM_WriteFile (const char *filename, const void *data, int len)
 	Sys_Printf ("COM_WriteFile: %s\n", name);
 	Sys_FileWrite (handle, data, len);
 	Sys_FileClose (handle);
+
+	COM_FlushFileCache ();
 }
 
 /*
@@ -1594,6 +1616,206 @@ long COM_filelength (FILE *f)
 	return end;
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+All pak file entries of the current search path are kept in one hash,
+each name mapped to the first (i.e. winning) pak that contains it. The
+index is rebuilt lazily after the search path changes. Loose directories
+can't be indexed that way, so failed lookups in them are remembered in a
+separate negative cache which is flushed whenever the engine writes files
+or clears memory for a new map.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	searchpath_t	*search;
+	packfile_t	*file;
+	int		next;		// next entry in the hash chain, -1 ends it
+} fileindex_t;
+
+static fileindex_t	*com_fileindex;
+static int		*com_fileindex_hash;
+static unsigned int	com_fileindex_mask;
+static qboolean		com_fileindex_dirty = true;
+
+typedef struct filemiss_s
+{
+	searchpath_t	*search;
+	struct filemiss_s	*next;
+	char		name[MAX_QPATH];
+} filemiss_t;
+
+#define	FILEMISS_HASHSIZE	1024	// must be a power of 2
+#define	MAX_FILEMISSES		8192
+
+static filemiss_t	*com_filemisses[FILEMISS_HASHSIZE];
+static int		com_numfilemisses;
+
+/*
+============
+COM_FlushFileCache
+
+Forgets about the files which weren't found in the game directories.
+Must be called when files are created in them.
+============
+*/
+void COM_FlushFileCache (void)
+{
+	filemiss_t	*miss, *next;
+	int		i;
+
+	if (!com_numfilemisses)
+		return;
+	for (i = 0; i < FILEMISS_HASHSIZE; i++)
+	{
+		for (miss = com_filemisses[i]; miss; miss = next)
+		{
+			next = miss->next;
+			free (miss);
+		}
+		com_filemisses[i] = NULL;
+	}
+	com_numfilemisses = 0;
+}
+
+static qboolean COM_FileMissed (searchpath_t *search, const char *filename, unsigned int hash)
+{
+	filemiss_t	*miss;
+
+	for (miss = com_filemisses[hash & (FILEMISS_HASHSIZE-1)]; miss; miss = miss->next)
+	{
+		if (miss->search == search && !strcmp(miss->name, filename))
+			return true;
+	}
+	return false;
+}
+
+static void COM_AddFileMiss (searchpath_t *search, const char *filename, unsigned int hash)
+{
+	filemiss_t	*miss;
+
+	if (strlen(filename) >= MAX_QPATH)
+		return;
+	if (com_numfilemisses >= MAX_FILEMISSES)
+		COM_FlushFileCache ();
+
+	miss = (filemiss_t *) malloc (sizeof(filemiss_t));
+	if (!miss)
+		return;
+	miss->search = search;
+	q_strlcpy (miss->name, filename, sizeof(miss->name));
+	miss->next = com_filemisses[hash & (FILEMISS_HASHSIZE-1)];
+	com_filemisses[hash & (FILEMISS_HASHSIZE-1)] = miss;
+	com_numfilemisses++;
+}
+
+/*
+============
+COM_InvalidateFileIndex
+
+Called whenever com_searchpaths is modified.
+============
+*/
+static void COM_InvalidateFileIndex (void)
+{
+	com_fileindex_dirty = true;
+	COM_FlushFileCache ();
+}
+
+/*
+============
+COM_BuildFileIndex
+============
+*/
+static void COM_BuildFileIndex (void)
+{
+	searchpath_t	*search;
+	packfile_t	*file;
+	fileindex_t	*entry;
+	unsigned int	hashsize, bucket;
+	int		i, j, count, numfiles;
+
+	free (com_fileindex);
+	free (com_fileindex_hash);
+	com_fileindex = NULL;
+	com_fileindex_hash = NULL;
+	com_fileindex_dirty = false;
+
+	numfiles = 0;
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+			numfiles += search->pack->numfiles;
+	}
+	if (!numfiles)
+		return;
+
+	// keep the load factor at or below 0.5
+	for (hashsize = 256; hashsize < (unsigned int)numfiles * 2; hashsize <<= 1)
+		;
+
+	com_fileindex = (fileindex_t *) malloc (numfiles * sizeof(fileindex_t));
+	com_fileindex_hash = (int *) malloc (hashsize * sizeof(int));
+	if (!com_fileindex || !com_fileindex_hash)
+		Sys_Error ("COM_BuildFileIndex: failed on allocation of %i files", numfiles);
+	for (i = 0; i < (int)hashsize; i++)
+		com_fileindex_hash[i] = -1;
+	com_fileindex_mask = hashsize - 1;
+
+	// walk the path front to back so that only the winning file goes in
+	count = 0;
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (!search->pack)
+			continue;
+		for (i = 0, file = search->pack->files; i < search->pack->numfiles; i++, file++)
+		{
+			bucket = COM_HashString (file->name) & com_fileindex_mask;
+			for (j = com_fileindex_hash[bucket]; j != -1; j = com_fileindex[j].next)
+			{
+				if (!strcmp(com_fileindex[j].file->name, file->name))
+					break;
+			}
+			if (j != -1)
+				continue;	// overridden
+			entry = &com_fileindex[count];
+			entry->search = search;
+			entry->file = file;
+			entry->next = com_fileindex_hash[bucket];
+			com_fileindex_hash[bucket] = count++;
+		}
+	}
+}
+
+/*
+============
+COM_FileIndexLookup
+
+Returns the highest priority pak entry for the file, or NULL.
+============
+*/
+static fileindex_t *COM_FileIndexLookup (const char *filename, unsigned int hash)
+{
+	int		i;
+
+	if (com_fileindex_dirty)
+		COM_BuildFileIndex ();
+	if (!com_fileindex)
+		return NULL;
+
+	for (i = com_fileindex_hash[hash & com_fileindex_mask]; i != -1; i = com_fileindex[i].next)
+	{
+		if (!strcmp(com_fileindex[i].file->name, filename))
+			return &com_fileindex[i];
+	}
+	return NULL;
+}
+
 /*
 ===========
 COM_FindFile
@@ -1610,6 +1832,8 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 	searchpath_t	*search;
 	char		netpath[MAX_OSPATH];
 	pack_t		*pak;
+	fileindex_t	*packed;
+	unsigned int	hash;
 	int		i, findtime;
 
 	if (file && handle)
@@ -1617,40 +1841,41 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 
 	file_from_pak = 0;
 
+	hash = COM_HashString (filename);
+	packed = COM_FileIndexLookup (filename, hash);
+
 //
-// search through the path, one element at a time
+// search through the path, one element at a time. the index already
+// knows the winning pak, so only the directories before it are checked.
 //
 	for (search = com_searchpaths; search; search = search->next)
 	{
-		if (search->pack)	/* look through all the pak file elements */
+		if (search->pack)
 		{
+			if (!packed || packed->search != search)
+				continue;
+			// found it!
 			pak = search->pack;
-			for (i = 0; i < pak->numfiles; i++)
+			com_filesize = packed->file->filelen;
+			file_from_pak = 1;
+			if (path_id)
+				*path_id = search->path_id;
+			if (handle)
 			{
-				if (strcmp(pak->files[i].name, filename) != 0)
-					continue;
-				// found it!
-				com_filesize = pak->files[i].filelen;
-				file_from_pak = 1;
-				if (path_id)
-					*path_id = search->path_id;
-				if (handle)
-				{
-					*handle = pak->handle;
-					Sys_FileSeek (pak->handle, pak->files[i].filepos);
-					return com_filesize;
-				}
-				else if (file)
-				{ /* open a new file on the pakfile */
-					*file = fopen (pak->filename, "rb");
-					if (*file)
-						fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return com_filesize;
-				}
-				else /* for COM_FileExists() */
-				{
-					return com_filesize;
-				}
+				*handle = pak->handle;
+				Sys_FileSeek (pak->handle, packed->file->filepos);
+				return com_filesize;
+			}
+			else if (file)
+			{ /* open a new file on the pakfile */
+				*file = fopen (pak->filename, "rb");
+				if (*file)
+					fseek (*file, packed->file->filepos, SEEK_SET);
+				return com_filesize;
+			}
+			else /* for COM_FileExists() */
+			{
+				return com_filesize;
 			}
 		}
 		else	/* check a file in the directory tree */
@@ -1661,10 +1886,16 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 					continue;
 			}
 
+			if (COM_FileMissed (search, filename, hash))
+				continue;
+
 			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
 			findtime = Sys_FileTime (netpath);
 			if (findtime == -1)
+			{
+				COM_AddFileMiss (search, filename, hash);
 				continue;
+			}
 
 			if (path_id)
 				*path_id = search->path_id;
@@ -1876,6 +2107,35 @@ byte *COM_LoadMallocFile (const char *path, unsigned int *path_id)
 	return COM_LoadFile (path, LOADFILE_MALLOC, path_id);
 }
 
+/*
+============
+COM_MapFile
+
+Hands out a view into a memory mapped pak instead of reading the file.
+Files at unaligned pak offsets aren't handed out, because the loaders
+expect aligned data.
+============
+*/
+const byte *COM_MapFile (const char *path, unsigned int *path_id)
+{
+	fileindex_t	*packed;
+	pack_t		*pak;
+
+	if (COM_FindFile (path, NULL, NULL, path_id) == -1 || !file_from_pak)
+		return NULL;
+
+	// COM_FindFile picked the pak from the index, so this is the same one
+	packed = COM_FileIndexLookup (path, COM_HashString (path));
+	pak = packed->search->pack;
+	if (!pak->mapped || (packed->file->filepos & 3))
+		return NULL;
+	if (packed->file->filepos < 0 || packed->file->filelen < 0 ||
+		packed->file->filepos > pak->mappedsize - packed->file->filelen)
+		return NULL;
+
+	return pak->mapped + packed->file->filepos;
+}
+
 byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
 {
 	FILE	*f;
@@ -2009,6 +2269,8 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	if (!COM_CheckParm ("-nommap"))
+		pack->mapped = (byte *) Sys_FileMap (packhandle, &pack->mappedsize);
 
 	//Sys_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
@@ -2030,6 +2292,8 @@ static void COM_AddGameDirectory (const char *base, const char *dir)
 
 	q_strlcpy (com_gamedir, va("%s/%s", base, dir), sizeof(com_gamedir));
 
+	COM_InvalidateFileIndex ();
+
 	// assign a path_id to this game directory
 	if (com_searchpaths)
 		path_id = com_searchpaths->path_id << 1;
@@ -2148,11 +2412,16 @@ static void COM_Game_f (void)
 		//Write config file
 		Host_WriteConfiguration ();
 
+		//Sounds can point into the paks that are about to be unmapped
+		S_FlushSounds ();
+
 		//Kill the extra game if it is loaded
 		while (com_searchpaths != com_base_searchpaths)
 		{
 			if (com_searchpaths->pack)
 			{
+				if (com_searchpaths->pack->mapped)
+					Sys_FileUnmap (com_searchpaths->pack->mapped, com_searchpaths->pack->mappedsize);
 				Sys_FileClose (com_searchpaths->pack->handle);
 				Z_Free (com_searchpaths->pack->files);
 				Z_Free (com_searchpaths->pack);
@@ -2161,6 +2430,7 @@ static void COM_Game_f (void)
 			Z_Free (com_searchpaths);
 			com_searchpaths = search;
 		}
+		COM_InvalidateFileIndex ();
 		hipnotic = false;
 		rogue = false;
 		standard_quake = true;
@@ -148,6 +148,11 @@ extern char *q_strcasestr(const char *haystack, const char *needle);
 extern char *q_strlwr (char *str);
 extern char *q_strupr (char *str);
 
+/* string hashes for lookup tables. the NoCase variant is
+ * consistent with q_strcasecmp(). */
+unsigned int COM_HashString (const char *str);
+unsigned int COM_HashStringNoCase (const char *str);
+
 /* snprintf, vsnprintf : always use our versions. */
 extern int q_snprintf (char *str, size_t size, const char *format, ...) FUNC_PRINTF(3,4);
 extern int q_vsnprintf(char *str, size_t size, const char *format, va_list args) FUNC_PRINTF(3,0);
@@ -206,6 +211,8 @@ typedef struct pack_s
 	int		handle;
 	int		numfiles;
 	packfile_t	*files;
+	byte		*mapped;	// read-only view of the whole pak, or NULL
+	int		mappedsize;
 } pack_t;
 
 typedef struct searchpath_s
@@ -233,6 +240,9 @@ int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id);
 qboolean COM_FileExists (const char *filename, unsigned int *path_id);
 void COM_CloseFile (int h);
+void COM_FlushFileCache (void);
+	// forgets about files previously not found in the game directories.
+	// call it after creating files there outside of COM_WriteFile.
 
 // these procedures open a file using COM_FindFile and loads it into a proper
 // buffer. the buffer is allocated with a total size of com_filesize + 1. the
@@ -254,6 +264,13 @@ void COM_LoadCacheFile (const char *path, struct cache_user_s *cu,
 byte *COM_LoadMallocFile (const char *path, unsigned int *path_id);
 	// allocates the buffer on the system mem (malloc).
 
+// returns a read-only view of a file which is inside a memory mapped pak,
+// without copying it. returns NULL if the file isn't found or can't be
+// mapped, callers then use one of the loaders above. com_filesize is set
+// and the view stays valid until the game directory changes. note that
+// the data isn't '\0'-terminated.
+const byte *COM_MapFile (const char *path, unsigned int *path_id);
+
 // Opens the given path directly, ignoring search paths.
 // Returns NULL on failure, or else a '\0'-terminated malloc'ed buffer.
 // Loads in "t" mode so CRLF to LF translation is performed on Windows.
@@ -722,6 +722,7 @@ typedef struct cmd_function_s
 	struct cmd_function_s	*next;
 	const char		*name;
 	xcommand_t		function;
+	struct cmd_function_s	*hashnext;
 } cmd_function_t;
 extern	cmd_function_t	*cmd_functions;
 #define	MAX_ALIAS_NAME	32
@@ -730,6 +731,7 @@ typedef struct cmdalias_s
 	struct cmdalias_s	*next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
+	struct cmdalias_s	*hashnext;
 } cmdalias_t;
 extern	cmdalias_t	*cmd_alias;
 
@@ -26,6 +26,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static cvar_t	*cvar_vars;
 static char	cvar_null_string[] = "";
 
+// cvar_vars stays sorted for listing and completion, lookups go through here
+#define	CVAR_HASHSIZE	512
+static cvar_t	*cvar_hash[CVAR_HASHSIZE];
+
 //==============================================================================
 //
 //  USER COMMANDS
@@ -249,7 +253,7 @@ cvar_t *Cvar_FindVar (const char *var_name)
 {
 	cvar_t	*var;
 
-	for (var = cvar_vars ; var ; var = var->next)
+	for (var = cvar_hash[COM_HashString(var_name) & (CVAR_HASHSIZE-1)] ; var ; var = var->hashnext)
 	{
 		if (!Q_strcmp(var_name, var->name))
 			return var;
@@ -534,6 +538,7 @@ void Cvar_RegisterVariable (cvar_t *variable)
 	char	value[512];
 	qboolean	set_rom;
 	cvar_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 // first check to see if it has already been defined
 	if (Cvar_FindVar (variable->name))
@@ -570,6 +575,9 @@ void Cvar_RegisterVariable (cvar_t *variable)
 		prev->next = variable;
 	}
 	//johnfitz
+	hash = COM_HashString(variable->name) & (CVAR_HASHSIZE-1);
+	variable->hashnext = cvar_hash[hash];
+	cvar_hash[hash] = variable;
 	variable->flags |= CVAR_REGISTERED;
 
 // copy the value off, because future sets will Z_Free it
@@ -356,6 +356,12 @@ void GL_MakeAliasModelDisplayLists (qmodel_t *m, aliashdr_t *hdr)
 unsigned int r_meshindexbuffer = 0;
 unsigned int r_meshvertexbuffer = 0;
 
+// hash chains for welding the vbo verts, every (vertindex, s, t) is unique
+// in desc so a chain lookup finds the same vert the old linear scan did
+#define	VBO_HASHSIZE	8192
+static int	vbohash[VBO_HASHSIZE];
+static int	vbonext[MAXALIASTRIS*3];
+
 /*
 ================
 GL_MakeAliasModelDisplayLists_VBO
@@ -395,12 +401,13 @@ void GL_MakeAliasModelDisplayLists_VBO (void)
 	pheader->meshdesc = (intptr_t) desc - (intptr_t) pheader;
 	pheader->numindexes = 0;
 	pheader->numverts_vbo = 0;
+	memset (vbohash, -1, sizeof(vbohash));
 
 	for (i = 0; i < pheader->numtris; i++)
 	{
 		for (j = 0; j < 3; j++)
 		{
-			int v;
+			int v, hash;
 
 			// index into hdr->vertexes
 			unsigned short vertindex = triangles[i].vertindex[j];
@@ -413,7 +420,8 @@ void GL_MakeAliasModelDisplayLists_VBO (void)
 			if (!triangles[i].facesfront && stverts[vertindex].onseam) s += pheader->skinwidth / 2;
 
 			// see does this vert already exist
-			for (v = 0; v < pheader->numverts_vbo; v++)
+			hash = (vertindex * 31 + s * 17 + t * 7) & (VBO_HASHSIZE - 1);
+			for (v = vbohash[hash]; v != -1; v = vbonext[v])
 			{
 				// it could use the same xyz but have different s and t
 				if (desc[v].vertindex == vertindex && (int) desc[v].st[0] == s && (int) desc[v].st[1] == t)
@@ -426,11 +434,13 @@ void GL_MakeAliasModelDisplayLists_VBO (void)
 				}
 			}
 
-			if (v == pheader->numverts_vbo)
+			if (v == -1)
 			{
 				// doesn't exist; emit a new vert and index
 				indexes[pheader->numindexes++] = pheader->numverts_vbo;
 
+				vbonext[pheader->numverts_vbo] = vbohash[hash];
+				vbohash[hash] = pheader->numverts_vbo;
 				desc[pheader->numverts_vbo].vertindex = vertindex;
 				desc[pheader->numverts_vbo].st[0] = s;
 				desc[pheader->numverts_vbo++].st[1] = t;
@@ -328,9 +328,16 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 	}
 
 //
-// load the file
+// load the file. brush models are parsed straight out of a memory
+// mapped pak if possible, the other loaders get a private copy.
 //
-	buf = COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
+	buf = (byte *) COM_MapFile (mod->name, & mod->path_id);
+	if (buf && (com_filesize < (int) sizeof(dheader_t) ||
+			LittleLong (*(int *)buf) == IDPOLYHEADER ||
+			LittleLong (*(int *)buf) == IDSPRITEHEADER))
+		buf = NULL;
+	if (!buf)
+		buf = COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
 	if (!buf)
 	{
 		if (crash)
@@ -427,7 +434,7 @@ void Mod_LoadTextures (lump_t *l)
 	dmiptexlump_t	*m;
 //johnfitz -- more variables
 	char		texturename[64];
-	int			nummiptex;
+	int			nummiptex, dataofs, mtwidth, mtheight;
 	src_offset_t		offset;
 	int			mark, fwidth, fheight;
 	char		filename[MAX_OSPATH], filename2[MAX_OSPATH], mapname[MAX_OSPATH];
@@ -445,36 +452,34 @@ void Mod_LoadTextures (lump_t *l)
 	else
 	{
 		m = (dmiptexlump_t *)(mod_base + l->fileofs);
-		m->nummiptex = LittleLong (m->nummiptex);
-		nummiptex = m->nummiptex;
+		nummiptex = LittleLong (m->nummiptex);
 	}
 	//johnfitz
 
 	loadmodel->numtextures = nummiptex + 2; //johnfitz -- need 2 dummy texture chains for missing textures
 	loadmodel->textures = (texture_t **) Hunk_AllocName (loadmodel->numtextures * sizeof(*loadmodel->textures) , loadname);
 
+	// the lump is read-only (see Mod_LoadBrushModel), swap into locals
 	for (i=0 ; i<nummiptex ; i++)
 	{
-		m->dataofs[i] = LittleLong(m->dataofs[i]);
-		if (m->dataofs[i] == -1)
+		dataofs = LittleLong (m->dataofs[i]);
+		if (dataofs == -1)
 			continue;
-		mt = (miptex_t *)((byte *)m + m->dataofs[i]);
-		mt->width = LittleLong (mt->width);
-		mt->height = LittleLong (mt->height);
-		for (j=0 ; j<MIPLEVELS ; j++)
-			mt->offsets[j] = LittleLong (mt->offsets[j]);
+		mt = (miptex_t *)((byte *)m + dataofs);
+		mtwidth = LittleLong (mt->width);
+		mtheight = LittleLong (mt->height);
 
-		if ( (mt->width & 15) || (mt->height & 15) )
+		if ( (mtwidth & 15) || (mtheight & 15) )
 			Sys_Error ("Texture %s is not 16 aligned", mt->name);
-		pixels = mt->width*mt->height/64*85;
+		pixels = mtwidth*mtheight/64*85;
 		tx = (texture_t *) Hunk_AllocName (sizeof(texture_t) +pixels, loadname );
 		loadmodel->textures[i] = tx;
 
 		memcpy (tx->name, mt->name, sizeof(tx->name));
-		tx->width = mt->width;
-		tx->height = mt->height;
+		tx->width = mtwidth;
+		tx->height = mtheight;
 		for (j=0 ; j<MIPLEVELS ; j++)
-			tx->offsets[j] = mt->offsets[j] + sizeof(texture_t) - sizeof(miptex_t);
+			tx->offsets[j] = LittleLong (mt->offsets[j]) + sizeof(texture_t) - sizeof(miptex_t);
 		// the pixels immediately follow the structures
 
 		// ericw -- check for pixels extending past the end of the lump.
@@ -751,9 +756,8 @@ void Mod_LoadLighting (lump_t *l)
 	if (!l->filelen)
 		return;
 	loadmodel->lightdata = (byte *) Hunk_AllocName ( l->filelen*3, litfilename);
-	in = loadmodel->lightdata + l->filelen*2; // place the file at the end, so it will not be overwritten until the very last write
+	in = mod_base + l->fileofs;
 	out = loadmodel->lightdata;
-	memcpy (in, mod_base + l->fileofs, l->filelen);
 	for (i = 0;i < l->filelen;i++)
 	{
 		d = *in++;
@@ -986,10 +990,11 @@ void Mod_LoadTexinfo (lump_t *l)
 ================
 CalcSurfaceExtents
 
-Fills in s->texturemins[] and s->extents[]
+Fills in s->texturemins[] and s->extents[]. Returns false if the
+extents are too big; may run on a worker thread, so doesn't error out.
 ================
 */
-void CalcSurfaceExtents (msurface_t *s)
+static qboolean CalcSurfaceExtents (msurface_t *s)
 {
 	float	mins[2], maxs[2], val;
 	int		i,j, e;
@@ -1048,8 +1053,9 @@ void CalcSurfaceExtents (msurface_t *s)
 		s->extents[i] = (bmaxs[i] - bmins[i]) * 16;
 
 		if ( !(tex->flags & TEX_SPECIAL) && s->extents[i] > 2000) //johnfitz -- was 512 in glquake, 256 in winquake
-			Sys_Error ("Bad surface extents");
+			return false;
 	}
+	return true;
 }
 
 /*
@@ -1136,6 +1142,74 @@ void Mod_CalcSurfaceBounds (msurface_t *s)
 	}
 }
 
+typedef struct
+{
+	dsface_t	*ins;
+	dlface_t	*inl;
+	msurface_t	*out;
+	qboolean	badextents;
+} loadfaces_t;
+
+/*
+=================
+Mod_LoadFaceTask
+
+Decodes one face and does the cpu heavy part, runs on the worker threads
+=================
+*/
+static void Mod_LoadFaceTask (void *data, int surfnum, int thread)
+{
+	loadfaces_t	*job = (loadfaces_t *) data;
+	msurface_t	*out = job->out + surfnum;
+	int			i, lofs;
+	int			planenum, side, texinfon;
+
+	if (job->inl)
+	{
+		dlface_t *inl = job->inl + surfnum;
+		out->firstedge = LittleLong(inl->firstedge);
+		out->numedges = LittleLong(inl->numedges);
+		planenum = LittleLong(inl->planenum);
+		side = LittleLong(inl->side);
+		texinfon = LittleLong (inl->texinfo);
+		for (i=0 ; i<MAXLIGHTMAPS ; i++)
+			out->styles[i] = inl->styles[i];
+		lofs = LittleLong(inl->lightofs);
+	}
+	else
+	{
+		dsface_t *ins = job->ins + surfnum;
+		out->firstedge = LittleLong(ins->firstedge);
+		out->numedges = LittleShort(ins->numedges);
+		planenum = LittleShort(ins->planenum);
+		side = LittleShort(ins->side);
+		texinfon = LittleShort (ins->texinfo);
+		for (i=0 ; i<MAXLIGHTMAPS ; i++)
+			out->styles[i] = ins->styles[i];
+		lofs = LittleLong(ins->lightofs);
+	}
+
+	out->flags = 0;
+
+	if (side)
+		out->flags |= SURF_PLANEBACK;
+
+	out->plane = loadmodel->planes + planenum;
+
+	out->texinfo = loadmodel->texinfo + texinfon;
+
+	if (!CalcSurfaceExtents (out))
+		job->badextents = true;
+
+	Mod_CalcSurfaceBounds (out); //johnfitz -- for per-surface frustum culling
+
+// lighting info
+	if (lofs == -1)
+		out->samples = NULL;
+	else
+		out->samples = loadmodel->lightdata + (lofs * 3); //johnfitz -- lit support via lordhavoc (was "+ i")
+}
+
 /*
 =================
 Mod_LoadFaces
@@ -1143,27 +1217,25 @@ Mod_LoadFaces
 */
 void Mod_LoadFaces (lump_t *l, qboolean bsp2)
 {
-	dsface_t	*ins;
-	dlface_t	*inl;
+	loadfaces_t	job;
 	msurface_t 	*out;
-	int			i, count, surfnum, lofs;
-	int			planenum, side, texinfon;
+	int			count, surfnum;
 
 	if (bsp2)
 	{
-		ins = NULL;
-		inl = (dlface_t *)(mod_base + l->fileofs);
-		if (l->filelen % sizeof(*inl))
+		job.ins = NULL;
+		job.inl = (dlface_t *)(mod_base + l->fileofs);
+		if (l->filelen % sizeof(*job.inl))
 			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-		count = l->filelen / sizeof(*inl);
+		count = l->filelen / sizeof(*job.inl);
 	}
 	else
 	{
-		ins = (dsface_t *)(mod_base + l->fileofs);
-		inl = NULL;
-		if (l->filelen % sizeof(*ins))
+		job.ins = (dsface_t *)(mod_base + l->fileofs);
+		job.inl = NULL;
+		if (l->filelen % sizeof(*job.ins))
 			Sys_Error ("MOD_LoadBmodel: funny lump size in %s",loadmodel->name);
-		count = l->filelen / sizeof(*ins);
+		count = l->filelen / sizeof(*job.ins);
 	}
 	out = (msurface_t *)Hunk_AllocName ( count*sizeof(*out), loadname);
 
@@ -1175,52 +1247,16 @@ void Mod_LoadFaces (lump_t *l, qboolean bsp2)
 	loadmodel->surfaces = out;
 	loadmodel->numsurfaces = count;
 
+	// decode the faces and calc their extents in parallel, the
+	// rest needs the hunk and is done in order below
+	job.out = out;
+	job.badextents = false;
+	Tasks_ParallelFor (Mod_LoadFaceTask, &job, count);
+	if (job.badextents)
+		Sys_Error ("Bad surface extents");
+
 	for (surfnum=0 ; surfnum<count ; surfnum++, out++)
 	{
-		if (bsp2)
-		{
-			out->firstedge = LittleLong(inl->firstedge);
-			out->numedges = LittleLong(inl->numedges);
-			planenum = LittleLong(inl->planenum);
-			side = LittleLong(inl->side);
-			texinfon = LittleLong (inl->texinfo);
-			for (i=0 ; i<MAXLIGHTMAPS ; i++)
-				out->styles[i] = inl->styles[i];
-			lofs = LittleLong(inl->lightofs);
-			inl++;
-		}
-		else
-		{
-			out->firstedge = LittleLong(ins->firstedge);
-			out->numedges = LittleShort(ins->numedges);
-			planenum = LittleShort(ins->planenum);
-			side = LittleShort(ins->side);
-			texinfon = LittleShort (ins->texinfo);
-			for (i=0 ; i<MAXLIGHTMAPS ; i++)
-				out->styles[i] = ins->styles[i];
-			lofs = LittleLong(ins->lightofs);
-			ins++;
-		}
-
-		out->flags = 0;
-
-		if (side)
-			out->flags |= SURF_PLANEBACK;
-
-		out->plane = loadmodel->planes + planenum;
-
-		out->texinfo = loadmodel->texinfo + texinfon;
-
-		CalcSurfaceExtents (out);
-
-		Mod_CalcSurfaceBounds (out); //johnfitz -- for per-surface frustum culling
-
-	// lighting info
-		if (lofs == -1)
-			out->samples = NULL;
-		else
-			out->samples = loadmodel->lightdata + (lofs * 3); //johnfitz -- lit support via lordhavoc (was "+ i")
-
 		//johnfitz -- this section rewritten
 		if (!q_strncasecmp(out->texinfo->texture->name,"sky",3)) // sky surface //also note -- was Q_strncmp, changed to match qbsp
 		{
@@ -1991,13 +2027,18 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 {
 	int			i, j;
 	int			bsp2;
-	dheader_t	*header;
+	dheader_t	*header, swapped;
 	dmodel_t 	*bm;
 	float		radius; //johnfitz
 
+	PROF_BEGIN ("Mod_LoadBrushModel");
+
 	loadmodel->type = mod_brush;
 
-	header = (dheader_t *)buffer;
+	// the buffer may be a read-only view of a pak, so swap a copy
+	// of the header and leave the file data alone
+	memcpy (&swapped, buffer, sizeof(swapped));
+	header = &swapped;
 
 	mod->bspversion = LittleLong (header->version);
 
@@ -2018,7 +2059,7 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	}
 
 // swap all the lumps
-	mod_base = (byte *)header;
+	mod_base = (byte *)buffer;
 
 	for (i = 0; i < (int) sizeof(dheader_t) / 4; i++)
 		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
@@ -2102,6 +2143,8 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 			mod = loadmodel;
 		}
 	}
+
+	PROF_END ();
 }
 
 /*
@@ -37,6 +37,7 @@ mplane_t	frustum[4];
 //johnfitz -- rendering statistics
 int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+int rs_brushbatches, rs_texbinds;
 float rs_megatexels;
 
 //
@@ -68,6 +69,8 @@ cvar_t	r_lightmap = {"r_lightmap","0",CVAR_NONE};
 cvar_t	r_shadows = {"r_shadows","0",CVAR_ARCHIVE};
 cvar_t	r_dynamic = {"r_dynamic","1",CVAR_ARCHIVE};
 cvar_t	r_novis = {"r_novis","0",CVAR_ARCHIVE};
+cvar_t	r_lightmapsize = {"r_lightmapsize","0",CVAR_ARCHIVE}; // 0 = fit the map, else lightmap page size, on next map load
+cvar_t	r_lightmapthreads = {"r_lightmapthreads","1",CVAR_ARCHIVE}; // rebuild dynamic lightmaps on the worker threads
 
 cvar_t	gl_finish = {"gl_finish","0",CVAR_NONE};
 cvar_t	gl_clear = {"gl_clear","1",CVAR_NONE};
@@ -912,6 +915,8 @@ R_RenderScene
 */
 void R_RenderScene (void)
 {
+	PROF_BEGIN ("R_RenderScene");
+
 	R_SetupScene (); //johnfitz -- this does everything that should be done once per call to RenderScene
 
 	Fog_EnableGFog (); //johnfitz
@@ -941,6 +946,8 @@ void R_RenderScene (void)
 	R_ShowTris (); //johnfitz
 
 	R_ShowBoundingBoxes (); //johnfitz
+
+	PROF_END ();
 }
 
 static GLuint r_scaleview_texture;
@@ -1073,7 +1080,8 @@ void R_RenderView (void)
 
 		//johnfitz -- rendering statistics
 		rs_brushpolys = rs_aliaspolys = rs_skypolys = rs_particles = rs_fogpolys = rs_megatexels =
-		rs_dynamiclightmaps = rs_aliaspasses = rs_skypasses = rs_brushpasses = 0;
+		rs_dynamiclightmaps = rs_aliaspasses = rs_skypasses = rs_brushpasses =
+		rs_brushbatches = rs_texbinds = 0;
 	}
 	else if (gl_finish.value)
 		glFinish ();
@@ -1129,7 +1137,7 @@ void R_RenderView (void)
 			(int)cl.viewangles[YAW],
 			(int)cl.viewangles[ROLL]);
 	else if (r_speeds.value == 2)
-		Con_Printf ("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i lmap %4i/%4i sky %1.1f mtex\n",
+		Con_Printf ("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i lmap %4i/%4i sky %1.1f mtex %4i batch %4i bind\n",
 					(int)((time2-time1)*1000),
 					rs_brushpolys,
 					rs_brushpasses,
@@ -1138,7 +1146,9 @@ void R_RenderView (void)
 					rs_dynamiclightmaps,
 					rs_skypolys,
 					rs_skypasses,
-					TexMgr_FrameUsage ());
+					TexMgr_FrameUsage (),
+					rs_brushbatches,
+					rs_texbinds);
 	else if (r_speeds.value)
 		Con_Printf ("%3i ms  %4i wpoly %4i epoly %3i lmap\n",
 					(int)((time2-time1)*1000),
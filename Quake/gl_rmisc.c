@@ -47,6 +47,8 @@ extern cvar_t r_nolerp_list;
 extern cvar_t r_noshadow_list;
 //johnfitz
 extern cvar_t gl_zfix; // QuakeSpasm z-fighting fix
+extern cvar_t r_lightmapsize;
+extern cvar_t r_lightmapthreads;
 
 extern gltexture_t *playertextures[MAX_SCOREBOARD]; //johnfitz
 
@@ -177,8 +179,11 @@ void R_Init (void)
 	extern cvar_t gl_finish;
 
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);
+	Cmd_AddCommand ("timelightmaps", R_TimeLightmaps_f);
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);
 
+	R_InitLightmapKernels ();
+
 	Cvar_RegisterVariable (&r_norefresh);
 	Cvar_RegisterVariable (&r_lightmap);
 	Cvar_RegisterVariable (&r_fullbright);
@@ -190,6 +195,8 @@ void R_Init (void)
 	Cvar_RegisterVariable (&r_dynamic);
 	Cvar_RegisterVariable (&r_novis);
 	Cvar_SetCallback (&r_novis, R_VisChanged);
+	Cvar_RegisterVariable (&r_lightmapsize);
+	Cvar_RegisterVariable (&r_lightmapthreads);
 	Cvar_RegisterVariable (&r_speeds);
 	Cvar_RegisterVariable (&r_pos);
 
@@ -429,6 +436,12 @@ void R_TimeRefresh_f (void)
 		return;
 	}
 
+	if (vid_nullvideo)
+	{
+		Con_Printf("timerefresh has nothing to draw with -nullvideo\n");
+		return;
+	}
+
 	start = Sys_DoubleTime ();
 	for (i = 0; i < 128; i++)
 	{
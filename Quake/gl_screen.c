@@ -1064,6 +1064,8 @@ void SCR_UpdateScreen (void)
 	if (!scr_initialized || !con_initialized)
 		return;				// not initialized yet
 
+	if (vid_nullvideo)
+		return;				// nothing to draw to
 
 	GL_BeginRendering (&glx, &gly, &glwidth, &glheight);
 
@@ -94,6 +94,9 @@ TexMgr_SetFilterModes
 */
 static void TexMgr_SetFilterModes (gltexture_t *glt)
 {
+	if (vid_nullvideo)
+		return;
+
 	GL_Bind (glt);
 
 	if (glt->flags & TEXPREF_NEAREST)
@@ -180,7 +183,7 @@ static void TexMgr_Anisotropy_f (cvar_t *var)
 	{
 		Cvar_SetValueQuick (&gl_texture_anisotropy, gl_max_anisotropy);
 	}
-	else
+	else if (!vid_nullvideo)
 	{
 		gltexture_t	*glt;
 		for (glt = active_gltextures; glt; glt = glt->next)
@@ -338,7 +341,10 @@ gltexture_t *TexMgr_NewTexture (void)
 	glt->next = active_gltextures;
 	active_gltextures = glt;
 
-	glGenTextures(1, &glt->texnum);
+	if (vid_nullvideo)
+		glt->texnum = 0;
+	else
+		glGenTextures(1, &glt->texnum);
 	numgltextures++;
 	return glt;
 }
@@ -569,6 +575,9 @@ void TexMgr_RecalcWarpImageSize (void)
 	while (gl_warpimagesize > vid.height)
 		gl_warpimagesize >>= 1;
 
+	if (vid_nullvideo)
+		return;
+
 	// ericw -- removed early exit if (gl_warpimagesize == oldsize).
 	// after vid_restart TexMgr_ReloadImage reloads textures
 	// to tx->source_width/source_height, which might not match oldsize.
@@ -630,7 +639,10 @@ void TexMgr_Init (void)
 	Cmd_AddCommand ("imagedump", &TexMgr_Imagedump_f);
 
 	// poll max size from hardware
-	glGetIntegerv (GL_MAX_TEXTURE_SIZE, &gl_hardware_maxsize);
+	if (vid_nullvideo)
+		gl_hardware_maxsize = 2048;	// no hardware to ask; only sizes the bookkeeping
+	else
+		glGetIntegerv (GL_MAX_TEXTURE_SIZE, &gl_hardware_maxsize);
 
 	// load notexture images
 	notexture = TexMgr_LoadImage (NULL, "notexture", 2, 2, SRC_RGBA, notexture_data, "", (src_offset_t)notexture_data, TEXPREF_NEAREST | TEXPREF_PERSIST | TEXPREF_NOPICMIP);
@@ -1238,6 +1250,10 @@ gltexture_t *TexMgr_LoadImage (qmodel_t *owner, const char *name, int width, int
 	glt->source_height = height;
 	glt->source_crc = crc;
 
+	// -nullvideo keeps the texture record but has nowhere to upload it
+	if (vid_nullvideo)
+		return glt;
+
 	//upload it
 	mark = Hunk_LowMark();
 
@@ -1277,6 +1293,9 @@ void TexMgr_ReloadImage (gltexture_t *glt, int shirt, int pants)
 	byte	translation[256];
 	byte	*src, *dst, *data = NULL, *translated;
 	int	mark, size, i;
+
+	if (vid_nullvideo)
+		return;
 //
 // get source data
 //
@@ -1503,6 +1522,7 @@ void GL_Bind (gltexture_t *texture)
 		currenttexture[currenttarget - GL_TEXTURE0_ARB] = texture->texnum;
 		glBindTexture (GL_TEXTURE_2D, texture->texnum);
 		texture->visframe = r_framecount;
+		rs_texbinds++;
 	}
 }
 
@@ -1516,7 +1536,8 @@ from our per-TMU cached texture binding table.
 */
 static void GL_DeleteTexture (gltexture_t *texture)
 {
-	glDeleteTextures (1, &texture->texnum);
+	if (!vid_nullvideo)
+		glDeleteTextures (1, &texture->texnum);
 
 	if (texture->texnum == currenttexture[0]) currenttexture[0] = GL_UNUSED_TEXTURE;
 	if (texture->texnum == currenttexture[1]) currenttexture[1] = GL_UNUSED_TEXTURE;
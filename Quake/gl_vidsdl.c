@@ -298,7 +298,7 @@ static void VID_Gamma_Init (void)
 	Cvar_SetCallback (&vid_gamma, VID_Gamma_f);
 	Cvar_SetCallback (&vid_contrast, VID_Gamma_f);
 
-	if (gl_glsl_gamma_able)
+	if (gl_glsl_gamma_able || vid_nullvideo)
 		return;
 
 #if defined(USE_SDL2)
@@ -466,6 +466,8 @@ VID_HasMouseOrInputFocus
 */
 qboolean VID_HasMouseOrInputFocus (void)
 {
+	if (vid_nullvideo)
+		return true;
 #if defined(USE_SDL2)
 	return (SDL_GetWindowFlags(draw_context) & (SDL_WINDOW_MOUSE_FOCUS | SDL_WINDOW_INPUT_FOCUS)) != 0;
 #else
@@ -480,6 +482,8 @@ VID_IsMinimized
 */
 qboolean VID_IsMinimized (void)
 {
+	if (vid_nullvideo)
+		return false;
 #if defined(USE_SDL2)
 	return !(SDL_GetWindowFlags(draw_context) & SDL_WINDOW_SHOWN);
 #else
@@ -779,7 +783,7 @@ static void VID_Restart (void)
 	int width, height, refreshrate, bpp;
 	qboolean fullscreen;
 
-	if (vid_locked || !vid_changed)
+	if (vid_locked || !vid_changed || vid_nullvideo)
 		return;
 
 	width = (int)vid_width.value;
@@ -857,7 +861,7 @@ static void VID_Test (void)
 {
 	int old_width, old_height, old_refreshrate, old_bpp, old_fullscreen;
 
-	if (vid_locked || !vid_changed)
+	if (vid_locked || !vid_changed || vid_nullvideo)
 		return;
 //
 // now try the switch
@@ -1369,7 +1373,7 @@ GL_EndRendering
 */
 void GL_EndRendering (void)
 {
-	if (!scr_skipupdate)
+	if (!scr_skipupdate && !vid_nullvideo)
 	{
 #if defined(USE_SDL2)
 		SDL_GL_SwapWindow(draw_context);
@@ -1613,6 +1617,14 @@ void	VID_Init (void)
 	Cmd_AddCommand ("vid_describecurrentmode", VID_DescribeCurrentMode_f);
 	Cmd_AddCommand ("vid_describemodes", VID_DescribeModes_f);
 
+	if (COM_CheckParm("-nullvideo"))
+	{
+		VID_Null_Init ();
+		VID_Gamma_Init ();
+		vid_locked = true;
+		return;
+	}
+
 	putenv (vid_center);	/* SDL_putenv is problematic in versions <= 1.2.9 */
 
 	if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
@@ -1766,6 +1778,9 @@ void	VID_Toggle (void)
 	Uint32 flags = 0;
 #endif
 
+	if (vid_nullvideo)
+		return;
+
 	S_ClearBuffer ();
 
 	if (!vid_toggle_works)
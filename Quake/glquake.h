@@ -85,14 +85,11 @@ typedef enum {
 	pt_static, pt_grav, pt_slowgrav, pt_fire, pt_explode, pt_explode2, pt_blob, pt_blob2
 } ptype_t;
 
-// !!! if this is changed, it must be changed in d_ifacea.h too !!!
-typedef struct particle_s
+// one particle as the effects fill it in, r_part.c keeps them in arrays by type
+typedef struct
 {
-// driver-usable fields
 	vec3_t		org;
 	float		color;
-// drivers never touch the following fields
-	struct particle_s	*next;
 	vec3_t		vel;
 	float		ramp;
 	float		die;
@@ -265,6 +262,7 @@ extern qboolean gl_texture_env_add; // for GL_EXT_texture_env_add
 //johnfitz -- rendering statistics
 extern int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 extern int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+extern int rs_brushbatches, rs_texbinds;
 extern float rs_megatexels;
 
 //johnfitz -- track developer statistics that vary every frame
@@ -293,26 +291,51 @@ extern overflowtimes_t dev_overflows; //this stores the last time overflow messa
 //johnfitz -- moved here from r_brush.c
 extern int gl_lightmap_format, lightmap_bytes;
 
-#define LMBLOCK_WIDTH	256	//FIXME: make dynamic. if we have a decent card there's no real reason not to use 4k or 16k (assuming there's no lightstyles/dynamics that need uploading...)
-#define LMBLOCK_HEIGHT	256 //Alternatively, use texture arrays, which would avoid the need to switch textures as often.
+//size of each lightmap page, picked per map by GL_BuildLightmaps from how much
+//lightmap the map has and what the card can take (see r_lightmapsize)
+extern int lmblock_width, lmblock_height;
+#define LMBLOCK_MINSIZE	256
+#define LMSURF_MAXSIZE	256	//largest single surface lightmap, in luxels each way
 
 typedef struct glRect_s {
 	unsigned short l,t,w,h;
 } glRect_t;
+#define MAX_LIGHTMAP_RECTS	4	//dirty areas kept apart per page before they get merged
 struct lightmap_s
 {
 	gltexture_t *texture;
 	glpoly_t	*polys;
 	qboolean	modified;
-	glRect_t	rectchange;
+	glRect_t	rectchange[MAX_LIGHTMAP_RECTS];
+	int			numrects;
 
 	// the lightmap texture data needs to be kept in
 	// main memory so texsubimage can update properly
-	byte		*data;//[4*LMBLOCK_WIDTH*LMBLOCK_HEIGHT];
+	byte		*data;//[4*lmblock_width*lmblock_height];
 };
 extern struct lightmap_s *lightmap;
 extern int lightmap_count;	//allocated lightmaps
 
+//inner loops of R_BuildLightMap, see r_lightmap.c
+typedef struct
+{
+	float	local[2];	//light position in the surface's lightmap space, in texels*16
+	float	rad;		//radius left at the surface
+	float	minlight;	//texels closer than this get light
+	float	color[3];	//colour * 256
+} lmdlight_t;
+typedef struct
+{
+	const char	*name;
+	void		(*addstyle) (unsigned *bl, const byte *lightmap, int count, unsigned scale);
+	void		(*adddlight) (unsigned *bl, int smax, int tmax, const lmdlight_t *dl);
+	void		(*store) (byte *dest, int stride, const unsigned *bl, int smax, int tmax, int shift, qboolean bgra);
+} lmkernels_t;
+extern const lmkernels_t *lmkernels;
+const lmkernels_t *R_LightmapKernels (int i);
+void R_InitLightmapKernels (void);
+void R_TimeLightmaps_f (void);
+
 extern int gl_warpimagesize; //johnfitz -- for water warp
 
 extern qboolean r_drawflat_cheatsafe, r_fullbright_cheatsafe, r_lightmap_cheatsafe, r_drawworld_cheatsafe; //johnfitz
@@ -377,6 +400,7 @@ int R_LightPoint (vec3_t p);
 void GL_SubdivideSurface (msurface_t *fa);
 void R_BuildLightMap (msurface_t *surf, byte *dest, int stride);
 void R_RenderDynamicLightmaps (msurface_t *fa);
+void R_FlushDynamicLightmaps (void);
 void R_UploadLightmaps (void);
 
 void R_DrawWorld_ShowTris (void);
@@ -327,6 +327,7 @@ void Host_WriteConfiguration (void)
 		//johnfitz
 
 		fclose (f);
+		COM_FlushFileCache ();
 	}
 }
 
@@ -430,6 +431,9 @@ void SV_DropClient (qboolean crash)
 			pr_global_struct->self = EDICT_TO_PROG(host_client->edict);
 			PR_ExecuteProgram (pr_global_struct->ClientDisconnect);
 			pr_global_struct->self = saveSelf;
+
+		// the clients still to be sent this frame must not see the old edicts
+			SV_InvalidateEntityVis ();
 		}
 
 		Sys_Printf ("Client %s removed\n",host_client->name);
@@ -482,6 +486,8 @@ void Host_ShutdownServer(qboolean crash)
 
 	sv.active = false;
 
+	SV_StopDemo ();
+
 // stop all client sounds immediately
 	if (cls.state == ca_connected)
 		CL_Disconnect ();
@@ -545,6 +551,7 @@ void Host_ClearMemory (void)
 {
 	Con_DPrintf ("Clearing memory\n");
 	D_FlushCaches ();
+	COM_FlushFileCache ();
 	Mod_ClearAll ();
 /* host_hunklevel MUST be set at this point */
 	Hunk_FreeToLowMark (host_hunklevel);
@@ -678,6 +685,9 @@ void _Host_Frame (float time)
 	static double		time2 = 0;
 	static double		time3 = 0;
 	int			pass1, pass2, pass3;
+	double			td[5] = {0};	// timedemo phase boundaries
+	unsigned int		tdstatements = 0;
+	qboolean		tdsample;
 
 	if (setjmp (host_abortserver) )
 		return;			// something bad happened, or the server disconnected
@@ -689,6 +699,17 @@ void _Host_Frame (float time)
 	if (!Host_FilterTime (time))
 		return;			// don't run too fast, or packets will flood out
 
+	Prof_Frame ();
+	PROF_BEGIN ("_Host_Frame");
+
+// timedemo reports break every frame down by phase
+	tdsample = cls.timedemo;
+	if (tdsample)
+	{
+		td[0] = Prof_Time ();
+		tdstatements = pr_statementcount;
+	}
+
 // get new key events
 	Key_UpdateForDest ();
 	IN_UpdateInputMode ();
@@ -718,6 +739,9 @@ void _Host_Frame (float time)
 	if (sv.active)
 		Host_ServerFrame ();
 
+	if (tdsample)
+		td[1] = Prof_Time ();
+
 //-------------------
 //
 // client operations
@@ -733,6 +757,9 @@ void _Host_Frame (float time)
 	if (cls.state == ca_connected)
 		CL_ReadFromServer ();
 
+	if (tdsample)
+		td[2] = Prof_Time ();
+
 // update video
 	if (host_speeds.value)
 		time1 = Sys_DoubleTime ();
@@ -741,6 +768,9 @@ void _Host_Frame (float time)
 
 	CL_RunParticles (); //johnfitz -- seperated from rendering
 
+	if (tdsample)
+		td[3] = Prof_Time ();
+
 	if (host_speeds.value)
 		time2 = Sys_DoubleTime ();
 
@@ -756,6 +786,13 @@ void _Host_Frame (float time)
 
 	CDAudio_Update();
 
+	if (tdsample && cls.timedemo)
+	{
+		td[4] = Prof_Time ();
+		CL_TimeDemoFrame (td[1] - td[0], td[2] - td[1], td[3] - td[2], td[4] - td[3],
+				  pr_statementcount - tdstatements);
+	}
+
 	if (host_speeds.value)
 	{
 		pass1 = (time1 - time3)*1000;
@@ -766,6 +803,8 @@ void _Host_Frame (float time)
 					pass1+pass2+pass3, pass1, pass2, pass3);
 	}
 
+	PROF_END ();
+
 	host_framecount++;
 
 }
@@ -834,6 +873,8 @@ void Host_Init (void)
 	COM_Init ();
 	COM_InitFilesystem ();
 	Host_InitLocal ();
+	Prof_Init ();
+	Tasks_Init ();
 	W_LoadWadFile (); //johnfitz -- filename is now hard-coded for honesty
 	if (cls.state != ca_dedicated)
 	{
@@ -926,6 +967,7 @@ void Host_Shutdown(void)
 	Host_WriteConfiguration ();
 
 	NET_Shutdown ();
+	Tasks_Shutdown ();
 
 	if (cls.state != ca_dedicated)
 	{
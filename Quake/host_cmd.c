@@ -40,7 +40,7 @@ Host_Quit_f
 
 void Host_Quit_f (void)
 {
-	if (key_dest != key_console && cls.state != ca_dedicated)
+	if (key_dest != key_console && cls.state != ca_dedicated && !vid_nullvideo)
 	{
 		M_Menu_Quit_f ();
 		return;
@@ -1249,6 +1249,7 @@ void Host_Loadgame_f (void)
 
 	sv.num_edicts = entnum;
 	sv.time = time;
+	ED_ResetFindIndex ();
 
 	free (start);
 	start = NULL;
@@ -1610,6 +1611,25 @@ void Host_PreSpawn_f (void)
 	host_client->sendsignon = true;
 }
 
+/*
+==================
+Host_DeltaEntities_f
+
+The client can parse svc_deltaentities and will acknowledge them
+==================
+*/
+void Host_DeltaEntities_f (void)
+{
+	if (cmd_source == src_command)
+	{
+		Con_Printf ("deltaentities is not valid from the console\n");
+		return;
+	}
+
+	SV_ClearSnapshots (host_client);
+	host_client->deltaentities = sv_deltaentities.value && sv.protocol != PROTOCOL_NETQUAKE;
+}
+
 /*
 ==================
 Host_Spawn_f
@@ -1618,7 +1638,6 @@ Host_Spawn_f
 void Host_Spawn_f (void)
 {
 	int		i;
-	client_t	*client;
 	edict_t	*ent;
 
 	if (cmd_source == src_command)
@@ -1644,6 +1663,7 @@ void Host_Spawn_f (void)
 		// set up the edict
 		ent = host_client->edict;
 
+		ED_TouchFindIndex (ent);
 		memset (&ent->v, 0, progs->entityfields * 4);
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
@@ -1667,61 +1687,7 @@ void Host_Spawn_f (void)
 // send all current names, colors, and frag counts
 	SZ_Clear (&host_client->message);
 
-// send time of update
-	MSG_WriteByte (&host_client->message, svc_time);
-	MSG_WriteFloat (&host_client->message, sv.time);
-
-	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
-	{
-		MSG_WriteByte (&host_client->message, svc_updatename);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteString (&host_client->message, client->name);
-		MSG_WriteByte (&host_client->message, svc_updatefrags);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteShort (&host_client->message, client->old_frags);
-		MSG_WriteByte (&host_client->message, svc_updatecolors);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteByte (&host_client->message, client->colors);
-	}
-
-// send all current light styles
-	for (i = 0; i < MAX_LIGHTSTYLES; i++)
-	{
-		MSG_WriteByte (&host_client->message, svc_lightstyle);
-		MSG_WriteByte (&host_client->message, (char)i);
-		MSG_WriteString (&host_client->message, sv.lightstyles[i]);
-	}
-
-//
-// send some stats
-//
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_TOTALSECRETS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->total_secrets);
-
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_TOTALMONSTERS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->total_monsters);
-
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_SECRETS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->found_secrets);
-
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_MONSTERS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->killed_monsters);
-
-//
-// send a fixangle
-// Never send a roll angle, because savegames can catch the server
-// in a state where it is expecting the client to correct the angle
-// and it won't happen if the game was just loaded, so you wind up
-// with a permanent head tilt
-	ent = EDICT_NUM( 1 + (host_client - svs.clients) );
-	MSG_WriteByte (&host_client->message, svc_setangle);
-	for (i = 0; i < 2; i++)
-		MSG_WriteAngle (&host_client->message, ent->v.angles[i], sv.protocolflags );
-	MSG_WriteAngle (&host_client->message, 0, sv.protocolflags );
+	SV_WriteSpawnState (host_client, &host_client->message);
 
 	SV_WriteClientdataToMessage (sv_player, &host_client->message);
 
@@ -2322,6 +2288,7 @@ void Host_InitCommands (void)
 	Cmd_AddCommand ("spawn", Host_Spawn_f);
 	Cmd_AddCommand ("begin", Host_Begin_f);
 	Cmd_AddCommand ("prespawn", Host_PreSpawn_f);
+	Cmd_AddCommand ("deltaentities", Host_DeltaEntities_f);
 	Cmd_AddCommand ("kick", Host_Kick_f);
 	Cmd_AddCommand ("ping", Host_Ping_f);
 	Cmd_AddCommand ("load", Host_Loadgame_f);
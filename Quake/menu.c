@@ -1547,6 +1547,8 @@ void M_Keys_Key (int k)
 
 void M_Menu_Video_f (void)
 {
+	if (!vid_menucmdfn)
+		return;		// -nullvideo has no modes to offer
 	(*vid_menucmdfn) (); //johnfitz
 }
 
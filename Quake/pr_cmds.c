@@ -980,6 +980,49 @@ static void PF_localcmd (void)
 	Cbuf_AddText (str);
 }
 
+/*
+=================
+PF_FindCvar
+
+Mods read the same few cvars every frame with string constants from the
+progs string table, which can't change until the next PR_LoadProgs, so the
+lookups are cached by string offset.
+=================
+*/
+#define	CVARCACHE_SIZE	256
+
+static struct
+{
+	int		str;
+	cvar_t	*var;
+} pr_cvarcache[CVARCACHE_SIZE];
+
+void PR_ClearCvarCache (void)
+{
+	memset (pr_cvarcache, 0, sizeof(pr_cvarcache));
+}
+
+static cvar_t *PF_FindCvar (int str)
+{
+	cvar_t	*var;
+	int		slot;
+
+	if (str <= 0 || str >= progs->numstrings)
+		return Cvar_FindVar (PR_GetString(str));
+
+	slot = str & (CVARCACHE_SIZE-1);
+	if (pr_cvarcache[slot].str == str)
+		return pr_cvarcache[slot].var;
+
+	var = Cvar_FindVar (PR_GetString(str));
+	if (var) // cvars are never unregistered, misses may be registered later
+	{
+		pr_cvarcache[slot].str = str;
+		pr_cvarcache[slot].var = var;
+	}
+	return var;
+}
+
 /*
 =================
 PF_cvar
@@ -989,11 +1032,11 @@ float cvar (string)
 */
 static void PF_cvar (void)
 {
-	const char	*str;
+	cvar_t	*var;
 
-	str = G_STRING(OFS_PARM0);
+	var = PF_FindCvar (G_INT(OFS_PARM0));
 
-	G_FLOAT(OFS_RETURN) = Cvar_VariableValue (str);
+	G_FLOAT(OFS_RETURN) = var ? var->value : 0;
 }
 
 /*
@@ -1005,12 +1048,19 @@ float cvar (string)
 */
 static void PF_cvar_set (void)
 {
-	const char	*var, *val;
+	cvar_t		*var;
+	const char	*val;
 
-	var = G_STRING(OFS_PARM0);
+	var = PF_FindCvar (G_INT(OFS_PARM0));
 	val = G_STRING(OFS_PARM1);
 
-	Cvar_Set (var, val);
+	if (!var)
+	{
+		Con_Printf ("Cvar_Set: variable %s not found\n", G_STRING(OFS_PARM0));
+		return;
+	}
+
+	Cvar_SetQuick (var, val);
 }
 
 /*
@@ -1020,12 +1070,15 @@ PF_findradius
 Returns a chain of entities that have origins within a spherical area
 
 findradius (origin, radius)
+
+Anything clearly outside the radius is dropped on its squared distance,
+only the ones near the edge pay for the exact VectorLength test.
 =================
 */
 static void PF_findradius (void)
 {
 	edict_t	*ent, *chain;
-	float	rad;
+	float	rad, outside;
 	float	*org;
 	vec3_t	eorg;
 	int	i, j;
@@ -1034,6 +1087,8 @@ static void PF_findradius (void)
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
+	// a little slack so rounding in sqrt can't flip the result
+	outside = (rad >= 0) ? rad * rad * 1.0001f : -1;
 
 	ent = NEXT_EDICT(sv.edicts);
 	for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent))
@@ -1044,6 +1099,8 @@ static void PF_findradius (void)
 			continue;
 		for (j = 0; j < 3; j++)
 			eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+		if (outside >= 0 && DotProduct(eorg, eorg) > outside)
+			continue;
 		if (VectorLength(eorg) > rad)
 			continue;
 
@@ -1119,18 +1176,36 @@ static void PF_Find (void)
 	int		f;
 	const char	*s, *t;
 	edict_t	*ed;
+	string_t	sid, tid;
+	qboolean	interned;
 
 	e = G_EDICTNUM(OFS_PARM0);
 	f = G_INT(OFS_PARM1);
 	s = G_STRING(OFS_PARM2);
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
+	sid = G_INT(OFS_PARM2);
+
+	if (pr_findindex.value && ED_IsFindField(f))
+	{
+		RETURN_EDICT(EDICT_NUM(ED_FindIndexed (e, f, sid, s)));
+		return;
+	}
 
+	interned = PR_IsInternedString (sid);
 	for (e++ ; e < sv.num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
 		if (ed->free)
 			continue;
+		tid = E_INT(ed,f);
+		if (tid == sid)
+		{
+			RETURN_EDICT(ed);
+			return;
+		}
+		if (interned && PR_IsInternedString (tid))
+			continue;	// different interned strings never match
 		t = E_STRING(ed,f);
 		if (!t)
 			continue;
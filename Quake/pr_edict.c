@@ -29,11 +29,38 @@ dfunction_t		*pr_functions;
 static	char		*pr_strings;
 static	int		pr_stringssize;
 static	const char	**pr_knownstrings;
+static	byte		*pr_knowninterned;	// parallel to pr_knownstrings
 static	int		pr_maxknownstrings;
 static	int		pr_numknownstrings;
+
+// strings from the progs string table and ED_NewString are interned, so
+// two interned strings are equal exactly when their string_t's are
+#define	PR_INTERN_HASHSIZE	8192
+typedef struct
+{
+	string_t	num;
+	int		next;
+} printerned_t;
+static	int		pr_internhash[PR_INTERN_HASHSIZE];
+static	printerned_t	*pr_interned;
+static	int		pr_numinterned;
+static	int		pr_maxinterned;
+static	byte		*pr_internedbits;	// one bit per pr_strings offset
 static	ddef_t		*pr_fielddefs;
 static	ddef_t		*pr_globaldefs;
 
+// name and offset indexes for the defs and functions, built by PR_LoadProgs
+typedef struct
+{
+	int		*hash;		// first index per bucket, -1 for none
+	int		*next;		// next index in the same bucket
+	int		mask;
+} prnamehash_t;
+
+static	prnamehash_t	pr_fieldhash, pr_globalhash, pr_functionhash;
+static	ddef_t		**pr_fieldofs, **pr_globalofs;	// def at each offset
+static	int		pr_numfieldofs, pr_numglobalofs;
+
 qboolean	pr_alpha_supported; //johnfitz
 
 dstatement_t	*pr_statements;
@@ -55,6 +82,8 @@ int		type_size[8] = {
 };
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
+static string_t	PR_InternString (const char *s);
+static void	PR_InternProgsStrings (void);
 static qboolean	ED_ParseEpair (void *base, ddef_t *key, const char *s);
 
 #define	MAX_FIELD_LEN	64
@@ -71,6 +100,7 @@ static gefv_cache	gefvCache[GEFV_CACHESIZE] =
 		{ NULL,	"" }
 };
 
+cvar_t	pr_findindex = {"pr_findindex", "1", CVAR_NONE};
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
 cvar_t	scratch1 = {"scratch1", "0", CVAR_NONE};
@@ -92,6 +122,7 @@ Sets everything to NULL
 */
 void ED_ClearEdict (edict_t *e)
 {
+	ED_TouchFindIndex (e);
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->free = false;
 }
@@ -130,6 +161,7 @@ edict_t *ED_Alloc (void)
 	sv.num_edicts++;
 	e = EDICT_NUM(i);
 	memset(e, 0, pr_edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
+	ED_TouchFindIndex (e);
 
 	return e;
 }
@@ -171,16 +203,9 @@ ED_GlobalAtOfs
 */
 static ddef_t *ED_GlobalAtOfs (int ofs)
 {
-	ddef_t		*def;
-	int			i;
-
-	for (i = 0; i < progs->numglobaldefs; i++)
-	{
-		def = &pr_globaldefs[i];
-		if (def->ofs == ofs)
-			return def;
-	}
-	return NULL;
+	if (ofs < 0 || ofs >= pr_numglobalofs)
+		return NULL;
+	return pr_globalofs[ofs];
 }
 
 /*
@@ -190,16 +215,9 @@ ED_FieldAtOfs
 */
 static ddef_t *ED_FieldAtOfs (int ofs)
 {
-	ddef_t		*def;
-	int			i;
-
-	for (i = 0; i < progs->numfielddefs; i++)
-	{
-		def = &pr_fielddefs[i];
-		if (def->ofs == ofs)
-			return def;
-	}
-	return NULL;
+	if (ofs < 0 || ofs >= pr_numfieldofs)
+		return NULL;
+	return pr_fieldofs[ofs];
 }
 
 /*
@@ -209,14 +227,12 @@ ED_FindField
 */
 static ddef_t *ED_FindField (const char *name)
 {
-	ddef_t		*def;
-	int			i;
+	int		i;
 
-	for (i = 0; i < progs->numfielddefs; i++)
+	for (i = pr_fieldhash.hash[COM_HashString(name) & pr_fieldhash.mask]; i != -1; i = pr_fieldhash.next[i])
 	{
-		def = &pr_fielddefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
+		if ( !strcmp(PR_GetString(pr_fielddefs[i].s_name), name) )
+			return &pr_fielddefs[i];
 	}
 	return NULL;
 }
@@ -229,14 +245,12 @@ ED_FindGlobal
 */
 static ddef_t *ED_FindGlobal (const char *name)
 {
-	ddef_t		*def;
-	int			i;
+	int		i;
 
-	for (i = 0; i < progs->numglobaldefs; i++)
+	for (i = pr_globalhash.hash[COM_HashString(name) & pr_globalhash.mask]; i != -1; i = pr_globalhash.next[i])
 	{
-		def = &pr_globaldefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
+		if ( !strcmp(PR_GetString(pr_globaldefs[i].s_name), name) )
+			return &pr_globaldefs[i];
 	}
 	return NULL;
 }
@@ -249,14 +263,12 @@ ED_FindFunction
 */
 static dfunction_t *ED_FindFunction (const char *fn_name)
 {
-	dfunction_t		*func;
-	int				i;
+	int		i;
 
-	for (i = 0; i < progs->numfunctions; i++)
+	for (i = pr_functionhash.hash[COM_HashString(fn_name) & pr_functionhash.mask]; i != -1; i = pr_functionhash.next[i])
 	{
-		func = &pr_functions[i];
-		if ( !strcmp(PR_GetString(func->s_name), fn_name) )
-			return func;
+		if ( !strcmp(PR_GetString(pr_functions[i].s_name), fn_name) )
+			return &pr_functions[i];
 	}
 	return NULL;
 }
@@ -646,6 +658,41 @@ static void ED_Count (void)
 }
 
 
+/*
+=============
+PR_Checksum_f
+
+Prints crcs of the progs globals and of all entity fields, to compare
+the server state between runs, e.g. with pr_translate 0 and 1
+=============
+*/
+static void PR_Checksum_f (void)
+{
+	edict_t		*ent;
+	unsigned short	crc;
+	int		i, j, active;
+
+	if (!sv.active)
+		return;
+
+	CRC_Init (&crc);
+	for (i = 0, active = 0; i < sv.num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->free)
+			continue;
+		active++;
+		CRC_ProcessByte (&crc, i & 0xff);
+		CRC_ProcessByte (&crc, i >> 8);
+		for (j = 0; j < progs->entityfields * 4; j++)
+			CRC_ProcessByte (&crc, ((byte *)&ent->v)[j]);
+	}
+
+	Con_Printf ("globals %04x, %i edicts %04x\n",
+			CRC_Block ((byte *)pr_globals, progs->numglobals * 4),
+			active, CRC_Value (crc));
+}
+
 /*
 ==============================================================================
 
@@ -738,12 +785,18 @@ ED_NewString
 */
 static string_t ED_NewString (const char *string)
 {
-	char	*new_p;
+	char	buf[1024], *new_p;
 	int		i, l;
 	string_t	num;
 
 	l = strlen(string) + 1;
-	num = PR_AllocString (l, &new_p);
+	if (l > (int) sizeof(buf))
+		num = PR_AllocString (l, &new_p);	// too long to intern
+	else
+	{
+		num = 0;
+		new_p = buf;
+	}
 
 	for (i = 0; i < l; i++)
 	{
@@ -759,6 +812,9 @@ static string_t ED_NewString (const char *string)
 			*new_p++ = string[i];
 	}
 
+	if (!num)
+		num = PR_InternString (buf);
+
 	return num;
 }
 
@@ -870,7 +926,10 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 
 	// clear it
 	if (ent != sv.edicts)	// hack
+	{
+		ED_TouchFindIndex (ent);
 		memset (&ent->v, 0, progs->entityfields * 4);
+	}
 
 	// go through all the dictionary pairs
 	while (1)
@@ -1044,6 +1103,58 @@ void ED_LoadFromFile (const char *data)
 }
 
 
+/*
+===============
+PR_HashNames
+
+Indexes count names, stride bytes apart. Earlier entries come first in
+their chain, so lookups find the same entry the old linear scans did.
+===============
+*/
+static void PR_HashNames (prnamehash_t *h, const int *first_name, int stride, int count)
+{
+	int		i, size, bucket;
+	const char	*name;
+
+	for (size = 64; size < count * 2; size <<= 1)
+		;
+	h->mask = size - 1;
+	h->hash = (int *) Hunk_AllocName (size * sizeof(int), "progidx");
+	h->next = (int *) Hunk_AllocName (q_max(count, 1) * sizeof(int), "progidx");
+	memset (h->hash, -1, size * sizeof(int));
+
+	for (i = count - 1; i >= 0; i--)
+	{
+		name = PR_GetString (*(const int *)((const byte *)first_name + i * stride));
+		bucket = COM_HashString (name) & h->mask;
+		h->next[i] = h->hash[bucket];
+		h->hash[bucket] = i;
+	}
+}
+
+/*
+===============
+PR_IndexOffsets
+
+Maps every offset to the first def using it
+===============
+*/
+static ddef_t **PR_IndexOffsets (ddef_t *defs, int count, int *numofs)
+{
+	ddef_t	**index;
+	int	i, size;
+
+	for (i = 0, size = 0; i < count; i++)
+		size = q_max (size, defs[i].ofs + 1);
+
+	index = (ddef_t **) Hunk_AllocName (q_max(size, 1) * sizeof(ddef_t *), "progidx");
+	for (i = count - 1; i >= 0; i--)
+		index[defs[i].ofs] = &defs[i];
+
+	*numofs = size;
+	return index;
+}
+
 /*
 ===============
 PR_LoadProgs
@@ -1088,7 +1199,12 @@ void PR_LoadProgs (void)
 	if (pr_knownstrings)
 		Z_Free ((void *)pr_knownstrings);
 	pr_knownstrings = NULL;
+	if (pr_knowninterned)
+		Z_Free (pr_knowninterned);
+	pr_knowninterned = NULL;
 	PR_SetEngineString("");
+	PR_InternProgsStrings ();
+	PR_ClearCvarCache ();
 
 	pr_globaldefs = (ddef_t *)((byte *)progs + progs->ofs_globaldefs);
 	pr_fielddefs = (ddef_t *)((byte *)progs + progs->ofs_fielddefs);
@@ -1098,13 +1214,18 @@ void PR_LoadProgs (void)
 	pr_globals = (float *)pr_global_struct;
 
 	// byte swap the lumps
+	pr_badopcodes = false;
 	for (i = 0; i < progs->numstatements; i++)
 	{
 		pr_statements[i].op = LittleShort(pr_statements[i].op);
 		pr_statements[i].a = LittleShort(pr_statements[i].a);
 		pr_statements[i].b = LittleShort(pr_statements[i].b);
 		pr_statements[i].c = LittleShort(pr_statements[i].c);
+		if (pr_statements[i].op > OP_BITOR)
+			pr_badopcodes = true;
 	}
+	if (pr_badopcodes)
+		Con_DWarning ("progs.dat has unknown opcodes, using the checked interpreter\n");
 
 	for (i = 0; i < progs->numfunctions; i++)
 	{
@@ -1148,6 +1269,14 @@ void PR_LoadProgs (void)
 	// properly aligned
 	pr_edict_size += sizeof(void *) - 1;
 	pr_edict_size &= ~(sizeof(void *) - 1);
+
+	PR_HashNames (&pr_fieldhash, &pr_fielddefs[0].s_name, sizeof(ddef_t), progs->numfielddefs);
+	PR_HashNames (&pr_globalhash, &pr_globaldefs[0].s_name, sizeof(ddef_t), progs->numglobaldefs);
+	PR_HashNames (&pr_functionhash, &pr_functions[0].s_name, sizeof(dfunction_t), progs->numfunctions);
+	pr_fieldofs = PR_IndexOffsets (pr_fielddefs, progs->numfielddefs, &pr_numfieldofs);
+	pr_globalofs = PR_IndexOffsets (pr_globaldefs, progs->numglobaldefs, &pr_numglobalofs);
+
+	PR_TranslateProgs ();
 }
 
 
@@ -1162,6 +1291,9 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_checksum", PR_Checksum_f);
+	Cvar_RegisterVariable (&pr_translate);
+	Cvar_RegisterVariable (&pr_findindex);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
@@ -1202,9 +1334,362 @@ int NUM_FOR_EDICT(edict_t *e)
 
 static void PR_AllocStringSlots (void)
 {
-	pr_maxknownstrings += PR_STRING_ALLOCSLOTS;
+	// grow geometrically, entity heavy maps need thousands of slots
+	pr_maxknownstrings = q_max (PR_STRING_ALLOCSLOTS, pr_maxknownstrings * 2);
 	Con_DPrintf2("PR_AllocStringSlots: realloc'ing for %d slots\n", pr_maxknownstrings);
 	pr_knownstrings = (const char **) Z_Realloc ((void *)pr_knownstrings, pr_maxknownstrings * sizeof(char *));
+	pr_knowninterned = (byte *) Z_Realloc (pr_knowninterned, pr_maxknownstrings);
+}
+
+/*
+===============
+PR_FindInterned
+
+Returns the interned string_t for s, or 0
+===============
+*/
+static string_t PR_FindInterned (const char *s, unsigned int hash)
+{
+	int	i;
+
+	for (i = pr_internhash[hash & (PR_INTERN_HASHSIZE-1)]; i != -1; i = pr_interned[i].next)
+	{
+		if (!strcmp(PR_GetString(pr_interned[i].num), s))
+			return pr_interned[i].num;
+	}
+	return 0;
+}
+
+static void PR_AddInterned (string_t num, unsigned int hash)
+{
+	if (pr_numinterned == pr_maxinterned)
+	{
+		pr_maxinterned = q_max (1024, pr_maxinterned * 2);
+		pr_interned = (printerned_t *) realloc (pr_interned, pr_maxinterned * sizeof(printerned_t));
+		if (!pr_interned)
+			Sys_Error ("PR_AddInterned: out of memory");
+	}
+	pr_interned[pr_numinterned].num = num;
+	pr_interned[pr_numinterned].next = pr_internhash[hash & (PR_INTERN_HASHSIZE-1)];
+	pr_internhash[hash & (PR_INTERN_HASHSIZE-1)] = pr_numinterned++;
+
+	if (num >= 0)
+		pr_internedbits[num >> 3] |= 1 << (num & 7);
+	else
+		pr_knowninterned[-1 - num] = 1;
+}
+
+/*
+===============
+PR_InternProgsStrings
+
+Interns every string starting in the progs string table. Offset 0 is left
+out: a string_t of 0 tests false in QuakeC, a parsed "" never did.
+===============
+*/
+static void PR_InternProgsStrings (void)
+{
+	int		ofs, len;
+	const char	*s;
+	unsigned int	hash;
+
+	memset (pr_internhash, -1, sizeof(pr_internhash));
+	pr_numinterned = 0;
+	pr_internedbits = (byte *) Hunk_AllocName ((pr_stringssize + 7) >> 3, "strings");
+
+	for (ofs = 0; ofs < pr_stringssize; ofs += len + 1)
+	{
+		s = pr_strings + ofs;
+		len = strlen (s);
+		if (!ofs || ofs + len >= pr_stringssize)
+			continue;
+		hash = COM_HashString (s);
+		if (!PR_FindInterned (s, hash))
+			PR_AddInterned (ofs, hash);
+	}
+}
+
+/*
+===============
+PR_InternString
+
+Returns the string_t of an equal interned string, or allocates one
+===============
+*/
+static string_t PR_InternString (const char *s)
+{
+	unsigned int	hash;
+	string_t	num;
+	char		*buf;
+	int		len;
+
+	hash = COM_HashString (s);
+	num = PR_FindInterned (s, hash);
+	if (num)
+		return num;
+
+	len = strlen (s) + 1;
+	num = PR_AllocString (len, &buf);
+	memcpy (buf, s, len);
+	PR_AddInterned (num, hash);
+	return num;
+}
+
+/*
+===============
+PR_IsInternedString
+
+Two different string_t's that are both interned never hold equal strings
+===============
+*/
+qboolean PR_IsInternedString (string_t num)
+{
+	if (num >= 0)
+		return num < pr_stringssize && (pr_internedbits[num >> 3] & (1 << (num & 7)));
+	return num >= -pr_numknownstrings && pr_knowninterned[-1 - num];
+}
+
+/*
+===============================================================================
+
+FIND INDEX
+
+Chains the edicts by their classname, targetname and target strings, so
+PF_Find doesn't have to walk every edict. Only interned strings (and the
+constant "" at 0) are chained; any other string_t may point at a buffer
+that gets rewritten, so those edicts are kept on a loose list and checked
+on every lookup. Edicts whose fields may have changed since the chains
+were built are touched onto a dirty list, which is checked the same way
+until there are too many of them and the chains get rebuilt.
+
+===============================================================================
+*/
+
+#define	ED_FIND_FIELDS		3
+#define	ED_FIND_HASHSIZE	1024
+#define	ED_FIND_MAXDIRTY	64
+
+typedef struct
+{
+	int		ofs;				// field offset in entvars_t
+	int		head[ED_FIND_HASHSIZE];		// first edict per bucket, 0 for none
+	int		*next;				// next edict in the same bucket, ascending
+	int		*loose;				// edicts with strings that aren't interned
+	int		numloose;
+} edfindfield_t;
+
+static	edfindfield_t	ed_find[ED_FIND_FIELDS];
+static	int		ed_findtail[ED_FIND_HASHSIZE];
+static	int		ed_finddirty[ED_FIND_MAXDIRTY];
+static	int		ed_numfinddirty;
+static	byte		*ed_findtouched;		// per edict, set while on the dirty list
+static	int		*ed_findcands;			// scratch for ED_FindIndexed
+static	void		*ed_findmem;
+static	int		ed_findmax;			// sv.max_edicts the arrays were sized for
+static	qboolean	ed_findrebuild = true;
+
+#define	ED_FindBucket(key)	((((unsigned int)(key)) * 2654435761u >> 16) & (ED_FIND_HASHSIZE-1))
+
+/*
+=================
+ED_ResetFindIndex
+
+Called whenever the edicts are replaced wholesale
+=================
+*/
+void ED_ResetFindIndex (void)
+{
+	int		i;
+	byte		*mem;
+
+	if (ed_findmax != sv.max_edicts)
+	{
+		ed_findmax = sv.max_edicts;
+		mem = (byte *) realloc (ed_findmem, ed_findmax * (ED_FIND_FIELDS * 2 + 1) * sizeof(int) +
+						    ED_FIND_MAXDIRTY * sizeof(int) + ed_findmax);
+		if (!mem)
+			Sys_Error ("ED_ResetFindIndex: out of memory");
+		ed_findmem = mem;
+		for (i = 0; i < ED_FIND_FIELDS; i++)
+		{
+			ed_find[i].next = (int *) mem;
+			mem += ed_findmax * sizeof(int);
+			ed_find[i].loose = (int *) mem;
+			mem += ed_findmax * sizeof(int);
+		}
+		ed_findcands = (int *) mem;
+		mem += (ed_findmax + ED_FIND_MAXDIRTY) * sizeof(int);
+		ed_findtouched = mem;
+	}
+
+	ed_find[0].ofs = offsetof (entvars_t, classname) / 4;
+	ed_find[1].ofs = offsetof (entvars_t, targetname) / 4;
+	ed_find[2].ofs = offsetof (entvars_t, target) / 4;
+
+	memset (ed_findtouched, 0, ed_findmax);
+	ed_numfinddirty = 0;
+	ed_findrebuild = true;
+}
+
+/*
+=================
+ED_TouchFindIndex
+
+Called when the engine or QuakeC changes one of the indexed fields, before
+any later lookup can run
+=================
+*/
+void ED_TouchFindIndex (edict_t *ed)
+{
+	int		e;
+
+	if (ed_findrebuild)
+		return;
+	e = NUM_FOR_EDICT (ed);
+	if (ed_findtouched[e])
+		return;
+	if (ed_numfinddirty == ED_FIND_MAXDIRTY)
+	{
+		ed_findrebuild = true;
+		return;
+	}
+	ed_findtouched[e] = 1;
+	ed_finddirty[ed_numfinddirty++] = e;
+}
+
+static void ED_RebuildFindIndex (void)
+{
+	edfindfield_t	*ff;
+	edict_t		*ed;
+	string_t	id;
+	int		i, e, b;
+
+	for (i = 0, ff = ed_find; i < ED_FIND_FIELDS; i++, ff++)
+	{
+		memset (ff->head, 0, sizeof(ff->head));
+		memset (ed_findtail, 0, sizeof(ed_findtail));
+		ff->numloose = 0;
+
+		ed = NEXT_EDICT(sv.edicts);
+		for (e = 1; e < sv.num_edicts; e++, ed = NEXT_EDICT(ed))
+		{
+			if (ed->free)
+				continue;	// cleared and touched again when reused
+			id = E_INT(ed, ff->ofs);
+			if (id && !PR_IsInternedString (id))
+			{
+				ff->loose[ff->numloose++] = e;
+				continue;
+			}
+			b = ED_FindBucket (id);
+			ff->next[e] = 0;
+			if (ed_findtail[b])
+				ff->next[ed_findtail[b]] = e;
+			else
+				ff->head[b] = e;
+			ed_findtail[b] = e;
+		}
+	}
+
+	for (i = 0; i < ed_numfinddirty; i++)
+		ed_findtouched[ed_finddirty[i]] = 0;
+	ed_numfinddirty = 0;
+	ed_findrebuild = false;
+}
+
+/*
+=================
+ED_FindChain
+
+First edict after start still holding key. Anything chained that no longer
+does has either been freed or touched, so it is safe to skip here.
+=================
+*/
+static int ED_FindChain (edfindfield_t *ff, int start, string_t key)
+{
+	edict_t		*ed;
+	int		e;
+
+	for (e = ff->head[ED_FindBucket (key)]; e; e = ff->next[e])
+	{
+		if (e <= start)
+			continue;
+		ed = EDICT_NUM(e);
+		if (!ed->free && E_INT(ed, ff->ofs) == key)
+			return e;
+	}
+	return 0;
+}
+
+static int ED_FindCandOrder (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+ED_FindIndexed
+
+Same result as walking the edicts after start in order and comparing field
+f against s, as PF_Find does. Returns 0 if no edict matches.
+=================
+*/
+int ED_FindIndexed (int start, int f, string_t sid, const char *s)
+{
+	edfindfield_t	*ff;
+	edict_t		*ed;
+	string_t	key, tid;
+	qboolean	interned;
+	const char	*t;
+	int		i, e, best, numcands;
+
+	if (ed_findrebuild)
+		ED_RebuildFindIndex ();
+
+	for (ff = ed_find; ff->ofs != f; ff++)
+		;
+
+	interned = PR_IsInternedString (sid);
+	key = interned ? sid : PR_FindInterned (s, COM_HashString (s));
+
+	best = sv.num_edicts;
+	if (key && (e = ED_FindChain (ff, start, key)) != 0)
+		best = e;
+	if (!*s && (e = ED_FindChain (ff, start, 0)) != 0 && e < best)
+		best = e;
+
+	// the dirty and loose edicts before best get checked in edict order,
+	// the same as a full walk would
+	numcands = 0;
+	for (i = 0; i < ed_numfinddirty; i++)
+	{
+		if (ed_finddirty[i] > start && ed_finddirty[i] < best)
+			ed_findcands[numcands++] = ed_finddirty[i];
+	}
+	for (i = 0; i < ff->numloose; i++)
+	{
+		if (ff->loose[i] > start && ff->loose[i] < best)
+			ed_findcands[numcands++] = ff->loose[i];
+	}
+	if (numcands > 1)
+		qsort (ed_findcands, numcands, sizeof(int), ED_FindCandOrder);
+
+	for (i = 0; i < numcands; i++)
+	{
+		ed = EDICT_NUM(ed_findcands[i]);
+		if (ed->free)
+			continue;
+		tid = E_INT(ed, f);
+		if (tid == sid)
+			return ed_findcands[i];
+		if (interned && PR_IsInternedString (tid))
+			continue;
+		t = E_STRING(ed, f);
+		if (t && !strcmp(t, s))
+			return ed_findcands[i];
+	}
+
+	return (best < sv.num_edicts) ? best : 0;
 }
 
 const char *PR_GetString (int num)
@@ -1260,6 +1745,7 @@ int PR_SetEngineString (const char *s)
 			PR_AllocStringSlots();
 		pr_numknownstrings++;
 //	}
+	pr_knowninterned[i] = 0;
 	pr_knownstrings[i] = s;
 	return -1 - i;
 }
@@ -1270,17 +1756,12 @@ int PR_AllocString (int size, char **ptr)
 
 	if (!size)
 		return 0;
-	for (i = 0; i < pr_numknownstrings; i++)
-	{
-		if (!pr_knownstrings[i])
-			break;
-	}
-//	if (i >= pr_numknownstrings)
-//	{
-		if (i >= pr_maxknownstrings)
-			PR_AllocStringSlots();
-		pr_numknownstrings++;
-//	}
+	// slots are never freed, so there are no holes to reuse
+	i = pr_numknownstrings;
+	if (i >= pr_maxknownstrings)
+		PR_AllocStringSlots();
+	pr_numknownstrings++;
+	pr_knowninterned[i] = 0;
 	pr_knownstrings[i] = (char *)Hunk_AllocName(size, "string");
 	if (ptr)
 		*ptr = (char *) pr_knownstrings[i];
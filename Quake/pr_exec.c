@@ -36,9 +36,11 @@ static int		localstack[LOCALSTACK_SIZE];
 static int		localstack_used;
 
 qboolean	pr_trace;
+qboolean	pr_badopcodes;
 dfunction_t	*pr_xfunction;
 int		pr_xstatement;
 int		pr_argc;
+unsigned int	pr_statementcount;	// running total of statements executed, wraps
 
 static const char *pr_opnames[] =
 {
@@ -353,302 +355,698 @@ The interpretation main loop
 #define OPB ((eval_t *)&pr_globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&pr_globals[(unsigned short)st->c])
 
-void PR_ExecuteProgram (func_t fnum)
+#define	PR_RUNAWAY_LIMIT	100000
+
+// the checked loop handles opcodes outside the dispatch table too
+#define	PR_WANT_TRACE()	(pr_trace || pr_badopcodes)
+
+typedef struct
+{
+	int		profile;	// statements run by this PR_ExecuteProgram call
+	int		startprofile;	// profile when pr_xfunction was last credited
+	qboolean	fallback;	// left the translated code for the interpreter
+} prexec_t;
+
+#define	PR_LOOP_NAME	PR_ExecuteLoop
+#define	PR_LOOP_TRACE	0
+#include "pr_execloop.h"
+#undef	PR_LOOP_NAME
+#undef	PR_LOOP_TRACE
+
+#define	PR_LOOP_NAME	PR_ExecuteLoopTrace
+#define	PR_LOOP_TRACE	1
+#include "pr_execloop.h"
+#undef	PR_LOOP_NAME
+#undef	PR_LOOP_TRACE
+
+/*
+=============================================================================
+
+TRANSLATED PROGS
+
+PR_TranslateProgs rewrites the statements of every function into an
+instruction array that the translated loop runs instead. Instructions
+stay one per statement so branch offsets, pr_xstatement and the runaway
+count all still line up with pr_statements, but:
+- operands are resolved to pointers into pr_globals
+- branch targets are resolved to instruction pointers
+- a float compare followed by an IF/IFNOT on its result becomes one
+  instruction (the IF/IFNOT stays in place for jumps that land on it)
+- calls remember the builtin the called global held at load time, and
+  call it directly while the global still holds that function
+
+Functions that can't be translated (unknown opcodes, branches out of the
+function) get XOP_FALLBACK instructions, which hand the rest of the
+PR_ExecuteProgram call to the interpreter.
+
+=============================================================================
+*/
+
+cvar_t	pr_translate = {"pr_translate", "1", CVAR_NONE};
+
+enum
+{
+	XOP_LT_IF = OP_BITOR + 1, XOP_LT_IFNOT,
+	XOP_LE_IF, XOP_LE_IFNOT,
+	XOP_GT_IF, XOP_GT_IFNOT,
+	XOP_GE_IF, XOP_GE_IFNOT,
+	XOP_EQ_F_IF, XOP_EQ_F_IFNOT,
+	XOP_NE_F_IF, XOP_NE_F_IFNOT,
+	XOP_FALLBACK,
+	NUM_XOPS
+};
+
+typedef struct prinstr_s
+{
+	int			xop;
+	eval_t			*a, *b, *c;
+	struct prinstr_s	*target;	// branch destination
+	builtin_t		builtin;	// bound builtin for calls
+	int			func;		// function number the builtin was bound for
+} prinstr_t;
+
+static prinstr_t	*pr_xlate;
+static int		pr_xlatecount;
+
+static int PR_FuncOrder (const void *a, const void *b)
+{
+	return (*(const dfunction_t * const *)a)->first_statement - (*(const dfunction_t * const *)b)->first_statement;
+}
+
+/*
+====================
+PR_TranslateFunction
+
+Returns false if the statements [first, end) can't be translated
+====================
+*/
+static qboolean PR_TranslateFunction (int first, int end)
 {
-	eval_t		*ptr;
 	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int profile, startprofile;
-	edict_t		*ed;
-	int		exitdepth;
+	prinstr_t	*ip;
+	dfunction_t	*f;
+	int		i, fnum, fused;
 
-	if (!fnum || fnum >= progs->numfunctions)
+	for (i = first; i < end; i++)
 	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
+		st = &pr_statements[i];
+		ip = &pr_xlate[i];
+
+		if (st->op > OP_BITOR)
+			return false;
+
+		ip->xop = st->op;
+		ip->a = (eval_t *)&pr_globals[(unsigned short)st->a];
+		ip->b = (eval_t *)&pr_globals[(unsigned short)st->b];
+		ip->c = (eval_t *)&pr_globals[(unsigned short)st->c];
+		ip->target = NULL;
+		ip->builtin = NULL;
+		ip->func = 0;
+
+		switch (st->op)
+		{
+		case OP_IF:
+		case OP_IFNOT:
+			if (i + st->b < first || i + st->b >= end)
+				return false;
+			ip->target = &pr_xlate[i + st->b];
+			break;
+		case OP_GOTO:
+			if (i + st->a < first || i + st->a >= end)
+				return false;
+			ip->target = &pr_xlate[i + st->a];
+			break;
+		case OP_CALL0:
+		case OP_CALL1:
+		case OP_CALL2:
+		case OP_CALL3:
+		case OP_CALL4:
+		case OP_CALL5:
+		case OP_CALL6:
+		case OP_CALL7:
+		case OP_CALL8:
+			fnum = ip->a->function;
+			if (fnum <= 0 || fnum >= progs->numfunctions)
+				break;
+			f = &pr_functions[fnum];
+			if (f->first_statement < 0 && -f->first_statement < pr_numbuiltins)
+			{
+				ip->builtin = pr_builtins[-f->first_statement];
+				ip->func = fnum;
+			}
+			break;
+		default:
+			break;
+		}
 	}
 
-	f = &pr_functions[fnum];
+	// fuse compare + branch pairs
+	for (i = first; i < end - 1; i++)
+	{
+		st = &pr_statements[i];
+		if ((st[1].op != OP_IF && st[1].op != OP_IFNOT) || st[1].a != st->c)
+			continue;
+		switch (st->op)
+		{
+		case OP_LT:	fused = XOP_LT_IF;	break;
+		case OP_LE:	fused = XOP_LE_IF;	break;
+		case OP_GT:	fused = XOP_GT_IF;	break;
+		case OP_GE:	fused = XOP_GE_IF;	break;
+		case OP_EQ_F:	fused = XOP_EQ_F_IF;	break;
+		case OP_NE_F:	fused = XOP_NE_F_IF;	break;
+		default:	continue;
+		}
+		if (st[1].op == OP_IFNOT)
+			fused++;
+		pr_xlate[i].xop = fused;
+		pr_xlate[i].target = pr_xlate[i + 1].target;
+	}
 
-	pr_trace = false;
+	return true;
+}
 
-// make a stack frame
-	exitdepth = pr_depth;
+/*
+====================
+PR_TranslateProgs
 
-	st = &pr_statements[PR_EnterFunction(f)];
-	startprofile = profile = 0;
+Called by PR_LoadProgs once the progs are byte swapped
+====================
+*/
+void PR_TranslateProgs (void)
+{
+	dfunction_t	**order;
+	int		i, n, first, end, failed;
 
-    while (1)
-    {
-	st++;	/* next statement */
+	free (pr_xlate);
+	pr_xlate = NULL;
+	pr_xlatecount = 0;
 
-	if (++profile > 100000)
+	if (progs->numstatements <= 0)
+		return;
+
+	pr_xlate = (prinstr_t *) malloc (progs->numstatements * sizeof(prinstr_t));
+	order = (dfunction_t **) malloc (progs->numfunctions * sizeof(dfunction_t *));
+	if (!pr_xlate || !order)
 	{
-		pr_xstatement = st - pr_statements;
-		PR_RunError("runaway loop error");
+		free (pr_xlate);
+		free (order);
+		pr_xlate = NULL;
+		Con_Warning ("PR_TranslateProgs: out of memory, progs will be interpreted\n");
+		return;
 	}
+	pr_xlatecount = progs->numstatements;
+
+	for (i = 0; i < pr_xlatecount; i++)
+		pr_xlate[i].xop = XOP_FALLBACK;
 
-	if (pr_trace)
-		PR_PrintStatement(st);
+	// a function runs up to the next one in statement order
+	for (i = n = 0; i < progs->numfunctions; i++)
+	{
+		if (pr_functions[i].first_statement > 0 && pr_functions[i].first_statement < pr_xlatecount)
+			order[n++] = &pr_functions[i];
+	}
+	qsort (order, n, sizeof(dfunction_t *), PR_FuncOrder);
 
-	switch (st->op)
+	failed = 0;
+	for (i = 0; i < n; i++)
 	{
-	case OP_ADD_F:
-		OPC->_float = OPA->_float + OPB->_float;
-		break;
-	case OP_ADD_V:
-		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
-		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
-		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
-		break;
-
-	case OP_SUB_F:
-		OPC->_float = OPA->_float - OPB->_float;
-		break;
-	case OP_SUB_V:
-		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
-		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
-		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
-		break;
-
-	case OP_MUL_F:
-		OPC->_float = OPA->_float * OPB->_float;
-		break;
-	case OP_MUL_V:
-		OPC->_float = OPA->vector[0] * OPB->vector[0] +
-			      OPA->vector[1] * OPB->vector[1] +
-			      OPA->vector[2] * OPB->vector[2];
-		break;
-	case OP_MUL_FV:
-		OPC->vector[0] = OPA->_float * OPB->vector[0];
-		OPC->vector[1] = OPA->_float * OPB->vector[1];
-		OPC->vector[2] = OPA->_float * OPB->vector[2];
-		break;
-	case OP_MUL_VF:
-		OPC->vector[0] = OPB->_float * OPA->vector[0];
-		OPC->vector[1] = OPB->_float * OPA->vector[1];
-		OPC->vector[2] = OPB->_float * OPA->vector[2];
-		break;
-
-	case OP_DIV_F:
-		OPC->_float = OPA->_float / OPB->_float;
-		break;
-
-	case OP_BITAND:
-		OPC->_float = (int)OPA->_float & (int)OPB->_float;
-		break;
-
-	case OP_BITOR:
-		OPC->_float = (int)OPA->_float | (int)OPB->_float;
-		break;
-
-	case OP_GE:
-		OPC->_float = OPA->_float >= OPB->_float;
-		break;
-	case OP_LE:
-		OPC->_float = OPA->_float <= OPB->_float;
-		break;
-	case OP_GT:
-		OPC->_float = OPA->_float > OPB->_float;
-		break;
-	case OP_LT:
-		OPC->_float = OPA->_float < OPB->_float;
-		break;
-	case OP_AND:
-		OPC->_float = OPA->_float && OPB->_float;
-		break;
-	case OP_OR:
-		OPC->_float = OPA->_float || OPB->_float;
-		break;
-
-	case OP_NOT_F:
-		OPC->_float = !OPA->_float;
-		break;
-	case OP_NOT_V:
-		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
-		break;
-	case OP_NOT_S:
-		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
-		break;
-	case OP_NOT_FNC:
-		OPC->_float = !OPA->function;
-		break;
-	case OP_NOT_ENT:
-		OPC->_float = (PROG_TO_EDICT(OPA->edict) == sv.edicts);
-		break;
-
-	case OP_EQ_F:
-		OPC->_float = OPA->_float == OPB->_float;
-		break;
-	case OP_EQ_V:
-		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
-			      (OPA->vector[1] == OPB->vector[1]) &&
-			      (OPA->vector[2] == OPB->vector[2]);
-		break;
-	case OP_EQ_S:
-		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_EQ_E:
-		OPC->_float = OPA->_int == OPB->_int;
-		break;
-	case OP_EQ_FNC:
-		OPC->_float = OPA->function == OPB->function;
-		break;
-
-	case OP_NE_F:
-		OPC->_float = OPA->_float != OPB->_float;
-		break;
-	case OP_NE_V:
-		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
-			      (OPA->vector[1] != OPB->vector[1]) ||
-			      (OPA->vector[2] != OPB->vector[2]);
-		break;
-	case OP_NE_S:
-		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_NE_E:
-		OPC->_float = OPA->_int != OPB->_int;
-		break;
-	case OP_NE_FNC:
-		OPC->_float = OPA->function != OPB->function;
-		break;
-
-	case OP_STORE_F:
-	case OP_STORE_ENT:
-	case OP_STORE_FLD:	// integers
-	case OP_STORE_S:
-	case OP_STORE_FNC:	// pointers
-		OPB->_int = OPA->_int;
-		break;
-	case OP_STORE_V:
-		OPB->vector[0] = OPA->vector[0];
-		OPB->vector[1] = OPA->vector[1];
-		OPB->vector[2] = OPA->vector[2];
-		break;
-
-	case OP_STOREP_F:
-	case OP_STOREP_ENT:
-	case OP_STOREP_FLD:	// integers
-	case OP_STOREP_S:
-	case OP_STOREP_FNC:	// pointers
-		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
-		ptr->_int = OPA->_int;
-		break;
-	case OP_STOREP_V:
-		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
-		ptr->vector[0] = OPA->vector[0];
-		ptr->vector[1] = OPA->vector[1];
-		ptr->vector[2] = OPA->vector[2];
-		break;
-
-	case OP_ADDRESS:
-		ed = PROG_TO_EDICT(OPA->edict);
+		first = order[i]->first_statement;
+		end = (i + 1 < n) ? order[i + 1]->first_statement : pr_xlatecount;
+		if (first == end)
+			continue;	// aliased function, already done
+		if (!PR_TranslateFunction (first, end))
+		{
+			for ( ; first < end; first++)
+				pr_xlate[first].xop = XOP_FALLBACK;
+			Con_DPrintf ("PR_TranslateProgs: %s is interpreted\n", PR_GetString(order[i]->s_name));
+			failed++;
+		}
+	}
+	free (order);
+
+	if (failed)
+		Con_DPrintf ("PR_TranslateProgs: %i of %i functions interpreted\n", failed, n);
+}
+
+#define	XA	(ip->a)
+#define	XB	(ip->b)
+#define	XC	(ip->c)
+#define	XSTATEMENT	(pr_statements + (ip - pr_xlate))
+
+#if defined(__GNUC__)
+#define	PR_XOP(op)	L_##op:
+#define	PR_XNEXT	goto *dispatch[ip->xop]
+#else
+#define	PR_XOP(op)	case op:
+#define	PR_XNEXT	continue
+#endif
+
+#define	PR_XSEGMENT_END(last)						\
+	if ((ex->profile += (last) - seg + 1) > PR_RUNAWAY_LIMIT)	\
+	{								\
+		pr_xstatement = (last) - pr_xlate;			\
+		PR_RunError("runaway loop error");			\
+	}
+
+#define	PR_XBRANCH(cond)						\
+	PR_XSEGMENT_END(ip + 1);					\
+	ip = (cond) ? ip[1].target : ip + 2;				\
+	seg = ip;							\
+	PR_XNEXT;
+
+/*
+====================
+PR_ExecuteTranslated
+
+Same contract as the interpreter loops, see pr_execloop.h. Also returns
+when it reaches a function that wasn't translated, with ex->fallback set.
+====================
+*/
+static dstatement_t *PR_ExecuteTranslated (dstatement_t *st, int exitdepth, prexec_t *ex)
+{
+	prinstr_t	*ip, *seg;
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	edict_t		*ed;
+	float		f;
+	int		i;
+#if defined(__GNUC__)
+	// in xop order, see above and pr_comp.h
+	static const void *const dispatch[NUM_XOPS] =
+	{
+		&&L_OP_DONE,
+		&&L_OP_MUL_F, &&L_OP_MUL_V, &&L_OP_MUL_FV, &&L_OP_MUL_VF,
+		&&L_OP_DIV_F,
+		&&L_OP_ADD_F, &&L_OP_ADD_V,
+		&&L_OP_SUB_F, &&L_OP_SUB_V,
+		&&L_OP_EQ_F, &&L_OP_EQ_V, &&L_OP_EQ_S, &&L_OP_EQ_E, &&L_OP_EQ_FNC,
+		&&L_OP_NE_F, &&L_OP_NE_V, &&L_OP_NE_S, &&L_OP_NE_E, &&L_OP_NE_FNC,
+		&&L_OP_LE, &&L_OP_GE, &&L_OP_LT, &&L_OP_GT,
+		&&L_OP_LOAD_F, &&L_OP_LOAD_V, &&L_OP_LOAD_S, &&L_OP_LOAD_ENT, &&L_OP_LOAD_FLD, &&L_OP_LOAD_FNC,
+		&&L_OP_ADDRESS,
+		&&L_OP_STORE_F, &&L_OP_STORE_V, &&L_OP_STORE_S, &&L_OP_STORE_ENT, &&L_OP_STORE_FLD, &&L_OP_STORE_FNC,
+		&&L_OP_STOREP_F, &&L_OP_STOREP_V, &&L_OP_STOREP_S, &&L_OP_STOREP_ENT, &&L_OP_STOREP_FLD, &&L_OP_STOREP_FNC,
+		&&L_OP_RETURN,
+		&&L_OP_NOT_F, &&L_OP_NOT_V, &&L_OP_NOT_S, &&L_OP_NOT_ENT, &&L_OP_NOT_FNC,
+		&&L_OP_IF, &&L_OP_IFNOT,
+		&&L_OP_CALL0, &&L_OP_CALL1, &&L_OP_CALL2, &&L_OP_CALL3, &&L_OP_CALL4,
+		&&L_OP_CALL5, &&L_OP_CALL6, &&L_OP_CALL7, &&L_OP_CALL8,
+		&&L_OP_STATE,
+		&&L_OP_GOTO,
+		&&L_OP_AND, &&L_OP_OR,
+		&&L_OP_BITAND, &&L_OP_BITOR,
+		&&L_XOP_LT_IF, &&L_XOP_LT_IFNOT,
+		&&L_XOP_LE_IF, &&L_XOP_LE_IFNOT,
+		&&L_XOP_GT_IF, &&L_XOP_GT_IFNOT,
+		&&L_XOP_GE_IF, &&L_XOP_GE_IFNOT,
+		&&L_XOP_EQ_F_IF, &&L_XOP_EQ_F_IFNOT,
+		&&L_XOP_NE_F_IF, &&L_XOP_NE_F_IFNOT,
+		&&L_XOP_FALLBACK
+	};
+#endif
+
+	ip = seg = &pr_xlate[st + 1 - pr_statements];
+
+#if defined(__GNUC__)
+	PR_XNEXT;
+#else
+    while (1)
+    {
+	switch (ip->xop)
+	{
+#endif
+	PR_XOP(OP_ADD_F)
+		XC->_float = XA->_float + XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_ADD_V)
+		XC->vector[0] = XA->vector[0] + XB->vector[0];
+		XC->vector[1] = XA->vector[1] + XB->vector[1];
+		XC->vector[2] = XA->vector[2] + XB->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_SUB_F)
+		XC->_float = XA->_float - XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_SUB_V)
+		XC->vector[0] = XA->vector[0] - XB->vector[0];
+		XC->vector[1] = XA->vector[1] - XB->vector[1];
+		XC->vector[2] = XA->vector[2] - XB->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_MUL_F)
+		XC->_float = XA->_float * XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_MUL_V)
+		XC->_float = XA->vector[0] * XB->vector[0] +
+			     XA->vector[1] * XB->vector[1] +
+			     XA->vector[2] * XB->vector[2];
+		ip++; PR_XNEXT;
+	PR_XOP(OP_MUL_FV)
+		XC->vector[0] = XA->_float * XB->vector[0];
+		XC->vector[1] = XA->_float * XB->vector[1];
+		XC->vector[2] = XA->_float * XB->vector[2];
+		ip++; PR_XNEXT;
+	PR_XOP(OP_MUL_VF)
+		XC->vector[0] = XB->_float * XA->vector[0];
+		XC->vector[1] = XB->_float * XA->vector[1];
+		XC->vector[2] = XB->_float * XA->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_DIV_F)
+		XC->_float = XA->_float / XB->_float;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_BITAND)
+		XC->_float = (int)XA->_float & (int)XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_BITOR)
+		XC->_float = (int)XA->_float | (int)XB->_float;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_GE)
+		XC->_float = XA->_float >= XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_LE)
+		XC->_float = XA->_float <= XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_GT)
+		XC->_float = XA->_float > XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_LT)
+		XC->_float = XA->_float < XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_AND)
+		XC->_float = XA->_float && XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_OR)
+		XC->_float = XA->_float || XB->_float;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_NOT_F)
+		XC->_float = !XA->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NOT_V)
+		XC->_float = !XA->vector[0] && !XA->vector[1] && !XA->vector[2];
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NOT_S)
+		XC->_float = !XA->string || !*PR_GetString(XA->string);
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NOT_FNC)
+		XC->_float = !XA->function;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NOT_ENT)
+		XC->_float = (PROG_TO_EDICT(XA->edict) == sv.edicts);
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_EQ_F)
+		XC->_float = XA->_float == XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_EQ_V)
+		XC->_float = (XA->vector[0] == XB->vector[0]) &&
+			     (XA->vector[1] == XB->vector[1]) &&
+			     (XA->vector[2] == XB->vector[2]);
+		ip++; PR_XNEXT;
+	PR_XOP(OP_EQ_S)
+		XC->_float = !strcmp(PR_GetString(XA->string), PR_GetString(XB->string));
+		ip++; PR_XNEXT;
+	PR_XOP(OP_EQ_E)
+		XC->_float = XA->_int == XB->_int;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_EQ_FNC)
+		XC->_float = XA->function == XB->function;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_NE_F)
+		XC->_float = XA->_float != XB->_float;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NE_V)
+		XC->_float = (XA->vector[0] != XB->vector[0]) ||
+			     (XA->vector[1] != XB->vector[1]) ||
+			     (XA->vector[2] != XB->vector[2]);
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NE_S)
+		XC->_float = strcmp(PR_GetString(XA->string), PR_GetString(XB->string));
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NE_E)
+		XC->_float = XA->_int != XB->_int;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_NE_FNC)
+		XC->_float = XA->function != XB->function;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_STORE_F)
+	PR_XOP(OP_STORE_ENT)
+	PR_XOP(OP_STORE_FLD)	// integers
+	PR_XOP(OP_STORE_S)
+	PR_XOP(OP_STORE_FNC)	// pointers
+		XB->_int = XA->_int;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_STORE_V)
+		XB->vector[0] = XA->vector[0];
+		XB->vector[1] = XA->vector[1];
+		XB->vector[2] = XA->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_STOREP_F)
+	PR_XOP(OP_STOREP_ENT)
+	PR_XOP(OP_STOREP_FLD)	// integers
+	PR_XOP(OP_STOREP_S)
+	PR_XOP(OP_STOREP_FNC)	// pointers
+		if (ED_IsFindField(ED_PointerField(XB->_int)))
+			ED_TouchFindIndex (EDICT_NUM(XB->_int / pr_edict_size));
+		ptr = (eval_t *)((byte *)sv.edicts + XB->_int);
+		ptr->_int = XA->_int;
+		ip++; PR_XNEXT;
+	PR_XOP(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + XB->_int);
+		ptr->vector[0] = XA->vector[0];
+		ptr->vector[1] = XA->vector[1];
+		ptr->vector[2] = XA->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_ADDRESS)
+		ed = PROG_TO_EDICT(XA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
 #endif
 		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
 		{
-			pr_xstatement = st - pr_statements;
+			pr_xstatement = ip - pr_xlate;
 			PR_RunError("assignment to world entity");
 		}
-		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
-		break;
-
-	case OP_LOAD_F:
-	case OP_LOAD_FLD:
-	case OP_LOAD_ENT:
-	case OP_LOAD_S:
-	case OP_LOAD_FNC:
-		ed = PROG_TO_EDICT(OPA->edict);
+		XC->_int = (byte *)((int *)&ed->v + XB->_int) - (byte *)sv.edicts;
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_LOAD_F)
+	PR_XOP(OP_LOAD_FLD)
+	PR_XOP(OP_LOAD_ENT)
+	PR_XOP(OP_LOAD_S)
+	PR_XOP(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(XA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
 #endif
-		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
-		break;
+		XC->_int = ((eval_t *)((int *)&ed->v + XB->_int))->_int;
+		ip++; PR_XNEXT;
 
-	case OP_LOAD_V:
-		ed = PROG_TO_EDICT(OPA->edict);
+	PR_XOP(OP_LOAD_V)
+		ed = PROG_TO_EDICT(XA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
 #endif
-		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
-		OPC->vector[0] = ptr->vector[0];
-		OPC->vector[1] = ptr->vector[1];
-		OPC->vector[2] = ptr->vector[2];
-		break;
-
-	case OP_IFNOT:
-		if (!OPA->_int)
-			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
-
-	case OP_IF:
-		if (OPA->_int)
-			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
-
-	case OP_GOTO:
-		st += st->a - 1;		/* -1 to offset the st++ */
-		break;
-
-	case OP_CALL0:
-	case OP_CALL1:
-	case OP_CALL2:
-	case OP_CALL3:
-	case OP_CALL4:
-	case OP_CALL5:
-	case OP_CALL6:
-	case OP_CALL7:
-	case OP_CALL8:
-		pr_xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		pr_xstatement = st - pr_statements;
-		pr_argc = st->op - OP_CALL0;
-		if (!OPA->function)
-			PR_RunError("NULL function");
-		newf = &pr_functions[OPA->function];
-		if (newf->first_statement < 0)
-		{ // Built-in function
-			int i = -newf->first_statement;
+		ptr = (eval_t *)((int *)&ed->v + XB->_int);
+		XC->vector[0] = ptr->vector[0];
+		XC->vector[1] = ptr->vector[1];
+		XC->vector[2] = ptr->vector[2];
+		ip++; PR_XNEXT;
+
+	PR_XOP(OP_IFNOT)
+		PR_XSEGMENT_END(ip);
+		ip = !XA->_int ? ip->target : ip + 1;
+		seg = ip;
+		PR_XNEXT;
+
+	PR_XOP(OP_IF)
+		PR_XSEGMENT_END(ip);
+		ip = XA->_int ? ip->target : ip + 1;
+		seg = ip;
+		PR_XNEXT;
+
+	PR_XOP(OP_GOTO)
+		PR_XSEGMENT_END(ip);
+		ip = ip->target;
+		seg = ip;
+		PR_XNEXT;
+
+	// the compare result is still stored, later code may read it
+	PR_XOP(XOP_LT_IF)
+		XC->_float = f = XA->_float < XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_LT_IFNOT)
+		XC->_float = f = XA->_float < XB->_float;
+		PR_XBRANCH(!f);
+	PR_XOP(XOP_LE_IF)
+		XC->_float = f = XA->_float <= XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_LE_IFNOT)
+		XC->_float = f = XA->_float <= XB->_float;
+		PR_XBRANCH(!f);
+	PR_XOP(XOP_GT_IF)
+		XC->_float = f = XA->_float > XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_GT_IFNOT)
+		XC->_float = f = XA->_float > XB->_float;
+		PR_XBRANCH(!f);
+	PR_XOP(XOP_GE_IF)
+		XC->_float = f = XA->_float >= XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_GE_IFNOT)
+		XC->_float = f = XA->_float >= XB->_float;
+		PR_XBRANCH(!f);
+	PR_XOP(XOP_EQ_F_IF)
+		XC->_float = f = XA->_float == XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_EQ_F_IFNOT)
+		XC->_float = f = XA->_float == XB->_float;
+		PR_XBRANCH(!f);
+	PR_XOP(XOP_NE_F_IF)
+		XC->_float = f = XA->_float != XB->_float;
+		PR_XBRANCH(f);
+	PR_XOP(XOP_NE_F_IFNOT)
+		XC->_float = f = XA->_float != XB->_float;
+		PR_XBRANCH(!f);
+
+	PR_XOP(OP_CALL0)
+	PR_XOP(OP_CALL1)
+	PR_XOP(OP_CALL2)
+	PR_XOP(OP_CALL3)
+	PR_XOP(OP_CALL4)
+	PR_XOP(OP_CALL5)
+	PR_XOP(OP_CALL6)
+	PR_XOP(OP_CALL7)
+	PR_XOP(OP_CALL8)
+		PR_XSEGMENT_END(ip);
+		pr_xfunction->profile += ex->profile - ex->startprofile;
+		ex->startprofile = ex->profile;
+		pr_xstatement = ip - pr_xlate;
+		pr_argc = ip->xop - OP_CALL0;
+		if (ip->builtin && XA->function == ip->func)
+			ip->builtin();	// bound at load time
+		else
+		{
+			if (!XA->function)
+				PR_RunError("NULL function");
+			newf = &pr_functions[XA->function];
+			if (newf->first_statement >= 0)
+			{ // Normal function
+				ip = &pr_xlate[PR_EnterFunction(newf) + 1];
+				seg = ip;
+				PR_XNEXT;
+			}
+			// Built-in function
+			i = -newf->first_statement;
 			if (i >= pr_numbuiltins)
 				PR_RunError("Bad builtin call number %d", i);
 			pr_builtins[i]();
-			break;
 		}
-		// Normal function
-		st = &pr_statements[PR_EnterFunction(newf)];
-		break;
-
-	case OP_DONE:
-	case OP_RETURN:
-		pr_xfunction->profile += profile - startprofile;
-		startprofile = profile;
-		pr_xstatement = st - pr_statements;
-		pr_globals[OFS_RETURN] = pr_globals[(unsigned short)st->a];
-		pr_globals[OFS_RETURN + 1] = pr_globals[(unsigned short)st->a + 1];
-		pr_globals[OFS_RETURN + 2] = pr_globals[(unsigned short)st->a + 2];
-		st = &pr_statements[PR_LeaveFunction()];
+		if (PR_WANT_TRACE())
+			return XSTATEMENT;	// traceon, let the trace loop carry on
+		ip++;
+		seg = ip;
+		PR_XNEXT;
+
+	PR_XOP(OP_DONE)
+	PR_XOP(OP_RETURN)
+		PR_XSEGMENT_END(ip);
+		pr_xfunction->profile += ex->profile - ex->startprofile;
+		ex->startprofile = ex->profile;
+		pr_xstatement = ip - pr_xlate;
+		pr_globals[OFS_RETURN] = XA->vector[0];
+		pr_globals[OFS_RETURN + 1] = XA->vector[1];
+		pr_globals[OFS_RETURN + 2] = XA->vector[2];
+		ip = &pr_xlate[PR_LeaveFunction() + 1];
 		if (pr_depth == exitdepth)
 		{ // Done
-			return;
+			return NULL;
 		}
-		break;
+		seg = ip;
+		PR_XNEXT;
 
-	case OP_STATE:
+	PR_XOP(OP_STATE)
 		ed = PROG_TO_EDICT(pr_global_struct->self);
 		ed->v.nextthink = pr_global_struct->time + 0.1;
-		ed->v.frame = OPA->_float;
-		ed->v.think = OPB->function;
-		break;
+		ed->v.frame = XA->_float;
+		ed->v.think = XB->function;
+		ip++; PR_XNEXT;
 
+	PR_XOP(XOP_FALLBACK)
+		// count what ran so far, the interpreter picks up at ip
+		ex->profile += ip - seg;
+		ex->fallback = true;
+		return XSTATEMENT - 1;
+
+#if !defined(__GNUC__)
 	default:
-		pr_xstatement = st - pr_statements;
-		PR_RunError("Bad opcode %i", st->op);
+		pr_xstatement = ip - pr_xlate;
+		PR_RunError("Bad opcode %i", ip->xop);
 	}
     }	/* end of while(1) loop */
+#endif
+}
+
+#undef	XA
+#undef	XB
+#undef	XC
+#undef	XSTATEMENT
+#undef	PR_XOP
+#undef	PR_XNEXT
+#undef	PR_XSEGMENT_END
+#undef	PR_XBRANCH
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dstatement_t	*st;
+	dfunction_t	*f;
+	int		exitdepth;
+	prexec_t	ex;
+
+	if (!fnum || fnum >= progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	f = &pr_functions[fnum];
+
+	pr_trace = false;
+
+// make a stack frame
+	exitdepth = pr_depth;
+
+	st = &pr_statements[PR_EnterFunction(f)];
+	ex.startprofile = ex.profile = 0;
+	ex.fallback = false;
+
+	// the loops hand over to each other when a builtin turns tracing
+	// on or off, and return NULL once the function is done
+	while (st)
+	{
+		if (PR_WANT_TRACE())
+			st = PR_ExecuteLoopTrace (st, exitdepth, &ex);
+		else if (pr_xlate && pr_translate.value && !ex.fallback)
+			st = PR_ExecuteTranslated (st, exitdepth, &ex);
+		else
+			st = PR_ExecuteLoop (st, exitdepth, &ex);
+	}
+
+	pr_statementcount += ex.profile;
 }
 #undef OPA
 #undef OPB
 #undef OPC
-
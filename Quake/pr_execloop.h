@@ -0,0 +1,395 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// pr_execloop.h -- the interpreter main loop, included by pr_exec.c once
+// for every variant.
+//
+// PR_LOOP_NAME		name of the function to generate
+// PR_LOOP_TRACE	1: switch dispatch, counts every statement and
+//			prints it if pr_trace is set.
+//			0: no trace checks; statements are counted per
+//			straight-line run at each branch, call and return,
+//			and dispatched with computed gotos where the
+//			compiler supports them.
+//
+// The function runs until the outermost function returns (returns NULL)
+// or until a builtin flips the wanted variant (returns the call statement,
+// the other variant carries on after it).
+
+#if !PR_LOOP_TRACE && defined(__GNUC__)
+#define	PR_LOOP_GOTO	1
+#else
+#define	PR_LOOP_GOTO	0
+#endif
+
+#if PR_LOOP_GOTO
+#define	PR_OP(op)	L_##op:
+#define	PR_NEXT		goto *dispatch[(++st)->op]
+#else
+#define	PR_OP(op)	case op:
+#define	PR_NEXT		break
+#endif
+
+#if PR_LOOP_TRACE
+#define	PR_SEGMENT_END()
+#define	PR_SEGMENT_START()
+#else
+#define	PR_SEGMENT_END()						\
+	if ((ex->profile += st - seg + 1) > PR_RUNAWAY_LIMIT)		\
+	{								\
+		pr_xstatement = st - pr_statements;			\
+		PR_RunError("runaway loop error");			\
+	}
+#define	PR_SEGMENT_START()	seg = st + 1
+#endif
+
+static dstatement_t *PR_LOOP_NAME (dstatement_t *st, int exitdepth, prexec_t *ex)
+{
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	edict_t		*ed;
+#if !PR_LOOP_TRACE
+	dstatement_t	*seg = st + 1;	// first statement of the current run
+#endif
+#if PR_LOOP_GOTO
+	// in opcode order, see pr_comp.h
+	static const void *const dispatch[] =
+	{
+		&&L_OP_DONE,
+		&&L_OP_MUL_F, &&L_OP_MUL_V, &&L_OP_MUL_FV, &&L_OP_MUL_VF,
+		&&L_OP_DIV_F,
+		&&L_OP_ADD_F, &&L_OP_ADD_V,
+		&&L_OP_SUB_F, &&L_OP_SUB_V,
+		&&L_OP_EQ_F, &&L_OP_EQ_V, &&L_OP_EQ_S, &&L_OP_EQ_E, &&L_OP_EQ_FNC,
+		&&L_OP_NE_F, &&L_OP_NE_V, &&L_OP_NE_S, &&L_OP_NE_E, &&L_OP_NE_FNC,
+		&&L_OP_LE, &&L_OP_GE, &&L_OP_LT, &&L_OP_GT,
+		&&L_OP_LOAD_F, &&L_OP_LOAD_V, &&L_OP_LOAD_S, &&L_OP_LOAD_ENT, &&L_OP_LOAD_FLD, &&L_OP_LOAD_FNC,
+		&&L_OP_ADDRESS,
+		&&L_OP_STORE_F, &&L_OP_STORE_V, &&L_OP_STORE_S, &&L_OP_STORE_ENT, &&L_OP_STORE_FLD, &&L_OP_STORE_FNC,
+		&&L_OP_STOREP_F, &&L_OP_STOREP_V, &&L_OP_STOREP_S, &&L_OP_STOREP_ENT, &&L_OP_STOREP_FLD, &&L_OP_STOREP_FNC,
+		&&L_OP_RETURN,
+		&&L_OP_NOT_F, &&L_OP_NOT_V, &&L_OP_NOT_S, &&L_OP_NOT_ENT, &&L_OP_NOT_FNC,
+		&&L_OP_IF, &&L_OP_IFNOT,
+		&&L_OP_CALL0, &&L_OP_CALL1, &&L_OP_CALL2, &&L_OP_CALL3, &&L_OP_CALL4,
+		&&L_OP_CALL5, &&L_OP_CALL6, &&L_OP_CALL7, &&L_OP_CALL8,
+		&&L_OP_STATE,
+		&&L_OP_GOTO,
+		&&L_OP_AND, &&L_OP_OR,
+		&&L_OP_BITAND, &&L_OP_BITOR
+	};
+
+	PR_NEXT;
+#else
+    while (1)
+    {
+	st++;	/* next statement */
+
+#if PR_LOOP_TRACE
+	if (++ex->profile > PR_RUNAWAY_LIMIT)
+	{
+		pr_xstatement = st - pr_statements;
+		PR_RunError("runaway loop error");
+	}
+
+	if (pr_trace)
+		PR_PrintStatement(st);
+#endif
+
+	switch (st->op)
+	{
+#endif
+	PR_OP(OP_ADD_F)
+		OPC->_float = OPA->_float + OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_ADD_V)
+		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_SUB_F)
+		OPC->_float = OPA->_float - OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_SUB_V)
+		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_MUL_F)
+		OPC->_float = OPA->_float * OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_MUL_V)
+		OPC->_float = OPA->vector[0] * OPB->vector[0] +
+			      OPA->vector[1] * OPB->vector[1] +
+			      OPA->vector[2] * OPB->vector[2];
+		PR_NEXT;
+	PR_OP(OP_MUL_FV)
+		OPC->vector[0] = OPA->_float * OPB->vector[0];
+		OPC->vector[1] = OPA->_float * OPB->vector[1];
+		OPC->vector[2] = OPA->_float * OPB->vector[2];
+		PR_NEXT;
+	PR_OP(OP_MUL_VF)
+		OPC->vector[0] = OPB->_float * OPA->vector[0];
+		OPC->vector[1] = OPB->_float * OPA->vector[1];
+		OPC->vector[2] = OPB->_float * OPA->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_DIV_F)
+		OPC->_float = OPA->_float / OPB->_float;
+		PR_NEXT;
+
+	PR_OP(OP_BITAND)
+		OPC->_float = (int)OPA->_float & (int)OPB->_float;
+		PR_NEXT;
+
+	PR_OP(OP_BITOR)
+		OPC->_float = (int)OPA->_float | (int)OPB->_float;
+		PR_NEXT;
+
+	PR_OP(OP_GE)
+		OPC->_float = OPA->_float >= OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_LE)
+		OPC->_float = OPA->_float <= OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_GT)
+		OPC->_float = OPA->_float > OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_LT)
+		OPC->_float = OPA->_float < OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_AND)
+		OPC->_float = OPA->_float && OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_OR)
+		OPC->_float = OPA->_float || OPB->_float;
+		PR_NEXT;
+
+	PR_OP(OP_NOT_F)
+		OPC->_float = !OPA->_float;
+		PR_NEXT;
+	PR_OP(OP_NOT_V)
+		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
+		PR_NEXT;
+	PR_OP(OP_NOT_S)
+		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
+		PR_NEXT;
+	PR_OP(OP_NOT_FNC)
+		OPC->_float = !OPA->function;
+		PR_NEXT;
+	PR_OP(OP_NOT_ENT)
+		OPC->_float = (PROG_TO_EDICT(OPA->edict) == sv.edicts);
+		PR_NEXT;
+
+	PR_OP(OP_EQ_F)
+		OPC->_float = OPA->_float == OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_EQ_V)
+		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
+			      (OPA->vector[1] == OPB->vector[1]) &&
+			      (OPA->vector[2] == OPB->vector[2]);
+		PR_NEXT;
+	PR_OP(OP_EQ_S)
+		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		PR_NEXT;
+	PR_OP(OP_EQ_E)
+		OPC->_float = OPA->_int == OPB->_int;
+		PR_NEXT;
+	PR_OP(OP_EQ_FNC)
+		OPC->_float = OPA->function == OPB->function;
+		PR_NEXT;
+
+	PR_OP(OP_NE_F)
+		OPC->_float = OPA->_float != OPB->_float;
+		PR_NEXT;
+	PR_OP(OP_NE_V)
+		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
+			      (OPA->vector[1] != OPB->vector[1]) ||
+			      (OPA->vector[2] != OPB->vector[2]);
+		PR_NEXT;
+	PR_OP(OP_NE_S)
+		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		PR_NEXT;
+	PR_OP(OP_NE_E)
+		OPC->_float = OPA->_int != OPB->_int;
+		PR_NEXT;
+	PR_OP(OP_NE_FNC)
+		OPC->_float = OPA->function != OPB->function;
+		PR_NEXT;
+
+	PR_OP(OP_STORE_F)
+	PR_OP(OP_STORE_ENT)
+	PR_OP(OP_STORE_FLD)	// integers
+	PR_OP(OP_STORE_S)
+	PR_OP(OP_STORE_FNC)	// pointers
+		OPB->_int = OPA->_int;
+		PR_NEXT;
+	PR_OP(OP_STORE_V)
+		OPB->vector[0] = OPA->vector[0];
+		OPB->vector[1] = OPA->vector[1];
+		OPB->vector[2] = OPA->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_STOREP_F)
+	PR_OP(OP_STOREP_ENT)
+	PR_OP(OP_STOREP_FLD)	// integers
+	PR_OP(OP_STOREP_S)
+	PR_OP(OP_STOREP_FNC)	// pointers
+		if (ED_IsFindField(ED_PointerField(OPB->_int)))
+			ED_TouchFindIndex (EDICT_NUM(OPB->_int / pr_edict_size));
+		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		PR_NEXT;
+	PR_OP(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
+		ptr->vector[0] = OPA->vector[0];
+		ptr->vector[1] = OPA->vector[1];
+		ptr->vector[2] = OPA->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_ADDRESS)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_statements;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
+		PR_NEXT;
+
+	PR_OP(OP_LOAD_F)
+	PR_OP(OP_LOAD_FLD)
+	PR_OP(OP_LOAD_ENT)
+	PR_OP(OP_LOAD_S)
+	PR_OP(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		PR_NEXT;
+
+	PR_OP(OP_LOAD_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+		OPC->vector[0] = ptr->vector[0];
+		OPC->vector[1] = ptr->vector[1];
+		OPC->vector[2] = ptr->vector[2];
+		PR_NEXT;
+
+	PR_OP(OP_IFNOT)
+		PR_SEGMENT_END();
+		if (!OPA->_int)
+			st += st->b - 1;	/* -1 to offset the st++ */
+		PR_SEGMENT_START();
+		PR_NEXT;
+
+	PR_OP(OP_IF)
+		PR_SEGMENT_END();
+		if (OPA->_int)
+			st += st->b - 1;	/* -1 to offset the st++ */
+		PR_SEGMENT_START();
+		PR_NEXT;
+
+	PR_OP(OP_GOTO)
+		PR_SEGMENT_END();
+		st += st->a - 1;		/* -1 to offset the st++ */
+		PR_SEGMENT_START();
+		PR_NEXT;
+
+	PR_OP(OP_CALL0)
+	PR_OP(OP_CALL1)
+	PR_OP(OP_CALL2)
+	PR_OP(OP_CALL3)
+	PR_OP(OP_CALL4)
+	PR_OP(OP_CALL5)
+	PR_OP(OP_CALL6)
+	PR_OP(OP_CALL7)
+	PR_OP(OP_CALL8)
+		PR_SEGMENT_END();
+		pr_xfunction->profile += ex->profile - ex->startprofile;
+		ex->startprofile = ex->profile;
+		pr_xstatement = st - pr_statements;
+		pr_argc = st->op - OP_CALL0;
+		if (!OPA->function)
+			PR_RunError("NULL function");
+		newf = &pr_functions[OPA->function];
+		if (newf->first_statement < 0)
+		{ // Built-in function
+			int i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError("Bad builtin call number %d", i);
+			pr_builtins[i]();
+			if (PR_WANT_TRACE() != PR_LOOP_TRACE)
+				return st;	// traceon/traceoff, switch variants
+			PR_SEGMENT_START();
+			PR_NEXT;
+		}
+		// Normal function
+		st = &pr_statements[PR_EnterFunction(newf)];
+		PR_SEGMENT_START();
+		PR_NEXT;
+
+	PR_OP(OP_DONE)
+	PR_OP(OP_RETURN)
+		PR_SEGMENT_END();
+		pr_xfunction->profile += ex->profile - ex->startprofile;
+		ex->startprofile = ex->profile;
+		pr_xstatement = st - pr_statements;
+		pr_globals[OFS_RETURN] = pr_globals[(unsigned short)st->a];
+		pr_globals[OFS_RETURN + 1] = pr_globals[(unsigned short)st->a + 1];
+		pr_globals[OFS_RETURN + 2] = pr_globals[(unsigned short)st->a + 2];
+		st = &pr_statements[PR_LeaveFunction()];
+		if (pr_depth == exitdepth)
+		{ // Done
+			return NULL;
+		}
+		PR_SEGMENT_START();
+		PR_NEXT;
+
+	PR_OP(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = OPA->_float;
+		ed->v.think = OPB->function;
+		PR_NEXT;
+
+#if !PR_LOOP_GOTO
+	default:
+		pr_xstatement = st - pr_statements;
+		PR_RunError("Bad opcode %i", st->op);
+	}
+    }	/* end of while(1) loop */
+#endif
+}
+
+#undef	PR_LOOP_GOTO
+#undef	PR_OP
+#undef	PR_NEXT
+#undef	PR_SEGMENT_END
+#undef	PR_SEGMENT_START
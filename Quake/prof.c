@@ -0,0 +1,384 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// prof.c -- scoped zone profiler with chrome trace export
+
+#include "quakedef.h"
+#if !defined(USE_SDL2)
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+#endif
+
+/*
+While host_profile is on, every thread that opens a zone keeps a ring of
+its last PROF_RING_EVENTS closed zones, so recording never takes a lock:
+Prof_Begin pushes the zone on the thread's own stack and Prof_End writes
+it to the thread's ring with its start and end time. The main thread also
+keeps a ring of frame start times, and "profiledump [frames] [name]"
+writes every zone that started in the last frames to <name>.json in the
+Chrome trace event format, which chrome://tracing and ui.perfetto.dev
+load directly.
+
+The rings are only read by profiledump, on the main thread between task
+jobs, so a ring is never written and read at the same time. Threads are
+told apart by SDL_ThreadID; a new thread takes the lock once to claim its
+slot.
+*/
+
+#define	PROF_MAX_THREADS	(MAX_TASK_WORKERS + 8)
+#define	PROF_RING_EVENTS	16384	// per thread, power of two
+#define	PROF_MAX_DEPTH		32
+#define	PROF_MAX_FRAMES		1024	// power of two
+#define	PROF_DEFAULT_FRAMES	60
+
+typedef struct
+{
+	const char	*name;
+	Uint64		start, end;	// counter ticks
+} profevent_t;
+
+typedef struct
+{
+	unsigned long	id;		// SDL_ThreadID
+	char		name[32];
+	profevent_t	*events;	// allocated on the first zone
+	int		head;		// next event to write
+	int		count;		// events in the ring
+	int		depth;		// open zones, can go past PROF_MAX_DEPTH
+	const char	*stackname[PROF_MAX_DEPTH];
+	Uint64		stackstart[PROF_MAX_DEPTH];
+} profthread_t;
+
+static profthread_t	prof_threads[PROF_MAX_THREADS];
+static int		prof_numthreads;
+static SDL_mutex	*prof_lock;
+
+static Uint64		prof_frames[PROF_MAX_FRAMES];	// frame start ticks
+static int		prof_frame;	// next frame to write
+static int		prof_numframes;	// frames in the ring
+
+static Uint64		prof_frequency;	// ticks per second
+static Uint64		prof_basetime;
+qboolean		prof_recording;
+
+static void Prof_Enable_f (cvar_t *var);
+static cvar_t	host_profile = {"host_profile", "0", CVAR_NONE};
+
+/*
+================
+Prof_Ticks
+
+SDL 1.2 only has the millisecond SDL_GetTicks, too coarse for zones, so
+those builds read the system's own high resolution counter.
+================
+*/
+static Uint64 Prof_Ticks (void)
+{
+#if defined(USE_SDL2)
+	return SDL_GetPerformanceCounter ();
+#elif defined(PLATFORM_WINDOWS)
+	LARGE_INTEGER	count;
+	QueryPerformanceCounter (&count);
+	return (Uint64) count.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec	ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (Uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval	tv;
+	gettimeofday (&tv, NULL);
+	return (Uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/*
+================
+Prof_Frequency
+================
+*/
+static Uint64 Prof_Frequency (void)
+{
+#if defined(USE_SDL2)
+	return SDL_GetPerformanceFrequency ();
+#elif defined(PLATFORM_WINDOWS)
+	LARGE_INTEGER	freq;
+	QueryPerformanceFrequency (&freq);	// can't fail on XP and later
+	return (Uint64) freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	return 1000000000;	// clock_gettime nanoseconds
+#else
+	return 1000000;		// gettimeofday microseconds
+#endif
+}
+
+/*
+================
+Prof_Time
+================
+*/
+double Prof_Time (void)
+{
+	if (!prof_frequency)
+		return Sys_DoubleTime ();	// not initialized yet
+	return (double) (Prof_Ticks () - prof_basetime) / prof_frequency;
+}
+
+/*
+================
+Prof_GetThread
+
+finds or claims the calling thread's slot, NULL once they are all taken
+================
+*/
+static profthread_t *Prof_GetThread (void)
+{
+	unsigned long	id = (unsigned long) SDL_ThreadID ();
+	profthread_t	*t;
+	int		i, n;
+
+	n = prof_numthreads;
+	for (i = 0, t = prof_threads; i < n; i++, t++)
+	{
+		if (t->id == id)
+			return t;
+	}
+
+	if (n == PROF_MAX_THREADS || (!prof_lock && n))
+		return NULL;
+
+	t = NULL;
+	SDL_LockMutex (prof_lock);
+	if (prof_numthreads < PROF_MAX_THREADS)
+	{
+		t = &prof_threads[prof_numthreads];
+		t->id = id;
+		q_snprintf (t->name, sizeof(t->name), "thread %d", prof_numthreads);
+		t->events = NULL;
+		t->head = t->count = t->depth = 0;
+#ifdef TASKS_HAVE_BARRIER
+		Tasks_MemoryBarrier ();	// the slot is complete before readers can see it
+#endif
+		prof_numthreads++;
+	}
+	SDL_UnlockMutex (prof_lock);
+
+	return t;
+}
+
+/*
+================
+Prof_ThreadName
+================
+*/
+void Prof_ThreadName (const char *name)
+{
+	profthread_t	*t = Prof_GetThread ();
+
+	if (t)
+		q_strlcpy (t->name, name, sizeof(t->name));
+}
+
+/*
+================
+Prof_Begin
+================
+*/
+void Prof_Begin (const char *name)
+{
+	profthread_t	*t = Prof_GetThread ();
+
+	if (!t)
+		return;
+
+	if (!t->events)
+	{
+		// no Sys_Error here, this may be a worker thread
+		t->events = (profevent_t *) malloc (PROF_RING_EVENTS * sizeof(profevent_t));
+		if (!t->events)
+			return;
+	}
+
+	if (t->depth < PROF_MAX_DEPTH)
+	{
+		t->stackname[t->depth] = name;
+		t->stackstart[t->depth] = Prof_Ticks ();
+	}
+	t->depth++;
+}
+
+/*
+================
+Prof_End
+================
+*/
+void Prof_End (void)
+{
+	profthread_t	*t = Prof_GetThread ();
+	profevent_t	*ev;
+
+	if (!t || !t->depth)
+		return;		// recording was switched on inside the zone
+
+	if (--t->depth >= PROF_MAX_DEPTH)
+		return;
+
+	ev = &t->events[t->head];
+	ev->name = t->stackname[t->depth];
+	ev->start = t->stackstart[t->depth];
+	ev->end = Prof_Ticks ();
+	t->head = (t->head + 1) & (PROF_RING_EVENTS - 1);
+	if (t->count < PROF_RING_EVENTS)
+		t->count++;
+}
+
+/*
+================
+Prof_Frame
+================
+*/
+void Prof_Frame (void)
+{
+	if (!prof_recording)
+		return;
+
+	prof_threads[0].depth = 0;	// Prof_Init claimed slot 0 for the main thread
+
+	prof_frames[prof_frame] = Prof_Ticks ();
+	prof_frame = (prof_frame + 1) & (PROF_MAX_FRAMES - 1);
+	if (prof_numframes < PROF_MAX_FRAMES)
+		prof_numframes++;
+}
+
+/*
+================
+Prof_Enable_f -- called when host_profile changes
+================
+*/
+static void Prof_Enable_f (cvar_t *var)
+{
+	int	i;
+
+	if (prof_recording == (var->value != 0))
+		return;
+
+	// start from empty rings, keep them when stopping so they can still be dumped
+	if (var->value)
+	{
+		for (i = 0; i < prof_numthreads; i++)
+			prof_threads[i].head = prof_threads[i].count = prof_threads[i].depth = 0;
+		prof_frame = prof_numframes = 0;
+	}
+	prof_recording = (var->value != 0);
+}
+
+/*
+================
+Prof_Dump_f
+
+profiledump [frames] [name]
+================
+*/
+static void Prof_Dump_f (void)
+{
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	profthread_t	*t;
+	profevent_t	*ev;
+	Uint64		windowstart;
+	double		tous;
+	int		frames, i, j, k, written;
+
+	if (!prof_numframes)
+	{
+		Con_Printf ("nothing recorded, set host_profile 1 first\n");
+		return;
+	}
+
+	frames = (Cmd_Argc() >= 2) ? Q_atoi (Cmd_Argv(1)) : PROF_DEFAULT_FRAMES;
+	frames = CLAMP (1, frames, prof_numframes);
+	windowstart = prof_frames[(prof_frame - frames) & (PROF_MAX_FRAMES - 1)];
+	tous = 1000000.0 / prof_frequency;
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, (Cmd_Argc() >= 3) ? Cmd_Argv(2) : "profile");
+	COM_AddExtension (name, ".json", sizeof(name));
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf (f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"quakespasm\"}}");
+
+	written = 0;
+	for (i = 0; i < frames; i++)
+	{
+		j = (prof_frame - frames + i) & (PROF_MAX_FRAMES - 1);
+		fprintf (f, ",\n{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+			 (double) (prof_frames[j] - windowstart) * tous);
+	}
+
+	for (i = 0, t = prof_threads; i < prof_numthreads; i++, t++)
+	{
+		fprintf (f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i, t->name);
+		for (j = 0; j < t->count; j++)
+		{
+			k = (t->head - t->count + j) & (PROF_RING_EVENTS - 1);
+			ev = &t->events[k];
+			if (ev->start < windowstart)
+				continue;
+			fprintf (f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				 ev->name, i, (double) (ev->start - windowstart) * tous,
+				 (double) (ev->end - ev->start) * tous);
+			written++;
+		}
+	}
+
+	fprintf (f, "\n]}\n");
+	fclose (f);
+
+	Con_Printf ("Wrote %d zones from %d frames to %s\n", written, frames, name);
+}
+
+/*
+================
+Prof_Init
+================
+*/
+void Prof_Init (void)
+{
+	prof_frequency = Prof_Frequency ();
+	prof_basetime = Prof_Ticks ();
+
+	prof_lock = SDL_CreateMutex ();
+	if (!prof_lock)
+		Con_Warning ("Prof_Init: couldn't create mutex, only the main thread is profiled\n");
+	Prof_ThreadName ("main");	// slot 0
+
+	Cvar_RegisterVariable (&host_profile);
+	Cvar_SetCallback (&host_profile, Prof_Enable_f);
+	Cmd_AddCommand ("profiledump", Prof_Dump_f);
+}
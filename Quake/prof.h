@@ -0,0 +1,53 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_PROF_H
+#define _QUAKE_PROF_H
+
+// prof.h -- scoped zone profiler with chrome trace export
+
+extern qboolean	prof_recording;		// host_profile is on
+
+void Prof_Init (void);
+
+double Prof_Time (void);
+// seconds from the high resolution counter (Sys_DoubleTime only has
+// milliseconds), usable whether or not the profiler is recording.
+
+void Prof_Frame (void);
+// marks the start of a host frame. called on the main thread, it also
+// drops the zones a Host_Error longjmp left open.
+
+void Prof_Begin (const char *name);
+void Prof_End (void);
+// open and close a zone on the calling thread. name must be a string
+// literal, only the pointer is kept. zones nest, and every Prof_Begin
+// needs its Prof_End on the same thread before the function returns.
+// safe to call from task functions and other threads.
+
+void Prof_ThreadName (const char *name);
+// labels the calling thread in dumped traces.
+
+#define	PROF_BEGIN(name)	do { if (prof_recording) Prof_Begin (name); } while (0)
+#define	PROF_END()		do { if (prof_recording) Prof_End (); } while (0)
+
+#endif	/* _QUAKE_PROF_H */
@@ -78,10 +78,26 @@ void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
 void PR_LoadProgs (void);
+void PR_ClearCvarCache (void);
+void PR_TranslateProgs (void);
 
 const char *PR_GetString (int num);
 int PR_SetEngineString (const char *s);
 int PR_AllocString (int bufferlength, char **ptr);
+qboolean PR_IsInternedString (string_t num);
+
+void ED_ResetFindIndex (void);
+void ED_TouchFindIndex (edict_t *ed);
+int ED_FindIndexed (int start, int f, string_t sid, const char *s);
+
+/* fields PF_Find looks up through the find index. QuakeC stores to them
+   touch the edict in OP_STOREP, not OP_ADDRESS: the right hand side is
+   evaluated in between and may call find() */
+#define	ED_IsFindField(f)	((f) == (int)(offsetof(entvars_t, classname) / 4) ||	\
+				 (f) == (int)(offsetof(entvars_t, targetname) / 4) ||	\
+				 (f) == (int)(offsetof(entvars_t, target) / 4))
+/* field of an OP_ADDRESS pointer */
+#define	ED_PointerField(ptr)	(((ptr) % pr_edict_size - (int)offsetof(edict_t, v)) / 4)
 
 void PR_Profile_f (void);
 
@@ -131,8 +147,12 @@ extern	int		pr_numbuiltins;
 extern	int		pr_argc;
 
 extern	qboolean	pr_trace;
+extern	cvar_t		pr_translate;
+extern	cvar_t		pr_findindex;
+extern	qboolean	pr_badopcodes;	/* progs has opcodes the fast loop can't dispatch */
 extern	dfunction_t	*pr_xfunction;
 extern	int		pr_xstatement;
+extern	unsigned int	pr_statementcount;
 
 extern	unsigned short	pr_crc;
 
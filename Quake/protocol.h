@@ -64,7 +64,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define U_MODEL2		(1<<18) // 1 byte, this is .modelindex & 0xFF00 (second byte)
 #define U_LERPFINISH	(1<<19) // 1 byte, 0.0-1.0 maps to 0-255, not sent if exactly 0.1, this is ent->v.nextthink - sv.time, used for lerping
 #define U_SCALE			(1<<20) // 1 byte, for PROTOCOL_RMQ PRFL_EDICTSCALE, currently read but ignored
-#define U_UNUSED21		(1<<21)
+#define U_REMOVE		(1<<21) // svc_deltaentities only, entity left the snapshot
 #define U_UNUSED22		(1<<22)
 #define U_EXTEND2		(1<<23) // another byte to follow, future expansion
 //johnfitz
@@ -201,6 +201,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	svc_spawnstaticsound2	44	// [coord3] [short] samp [byte] vol [byte] aten
 //johnfitz
 
+#define	svc_deltaentities		45	// [long] frame [long] delta frame, 0 for baselines
+									// <update>...[0] relative to the delta frame
+
 //
 // client to server
 //
@@ -209,6 +212,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	clc_disconnect	2
 #define	clc_move		3		// [usercmd_t]
 #define	clc_stringcmd	4		// [string] message
+#define	clc_deltaack	5		// [long] last svc_deltaentities frame received
 
 //
 // temp entity events
@@ -243,6 +247,20 @@ typedef struct
 	int		effects;
 } entity_state_t;
 
+// entity snapshots sent with svc_deltaentities.  entities missing from the
+// update list keep their state from the delta frame, U_STEP and U_LERPFINISH
+// are carried as part of the state rather than sent every frame.
+#define	ENTITYDELTA_BACKUP	32	// frames either side keeps, must be a power of 2
+#define	ENTITYDELTA_MASK	(ENTITYDELTA_BACKUP - 1)
+
+typedef struct
+{
+	unsigned short	num;
+	unsigned char	lerpfinish;
+	int		bits;		// U_STEP and U_LERPFINISH
+	entity_state_t	state;
+} snapentity_t;
+
 typedef struct
 {
 	vec3_t	viewangles;
@@ -32,12 +32,6 @@ typedef struct
 	int right;
 } portable_samplepair_t;
 
-typedef struct sfx_s
-{
-	char	name[MAX_QPATH];
-	cache_user_t	cache;
-} sfx_t;
-
 /* !!! if this is changed, it must be changed in asm_i386.h too !!! */
 typedef struct
 {
@@ -46,9 +40,24 @@ typedef struct
 	int	speed;
 	int	width;
 	int	stereo;
+	int	decoded;		/* samples of data filled in, see S_DecodeSound */
+	const byte	*source;	/* wav samples data is decoded from		*/
+	byte	*filebuf;		/* malloc'd wav file if source points into it	*/
+	int	sourcewidth;
+	int	fracstep;		/* source samples per output sample, 8.8	*/
+	int	size;			/* bytes counted against snd_cachesize		*/
 	byte	data[1];	/* variable sized	*/
 } sfxcache_t;
 
+typedef struct sfx_s
+{
+	char	name[MAX_QPATH];
+	sfxcache_t	*cache;		/* NULL if not loaded			*/
+	struct sfx_s	*prev, *next;	/* loaded sounds, most recently used first */
+	double	used;			/* realtime of the last S_LoadSound	*/
+	struct sndload_s	*load;	/* queued background load		*/
+} sfx_t;
+
 typedef struct
 {
 	int	channels;
@@ -96,6 +105,7 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation);
 void S_StopSound (int entnum, int entchannel);
 void S_StopAllSounds(qboolean clear);
+void S_StopDynamicSounds (void);
 void S_ClearBuffer (void);
 void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up);
 void S_ExtraUpdate (void);
@@ -103,12 +113,18 @@ void S_ExtraUpdate (void);
 void S_BlockSound (void);
 void S_UnblockSound (void);
 
+/* held by the mixer thread while it mixes: taken around anything that
+   moves or frees sound data it might be reading. no-ops without the thread */
+void S_LockMixer (void);
+void S_UnlockMixer (void);
+
 sfx_t *S_PrecacheSound (const char *sample);
 void S_TouchSound (const char *sample);
 void S_ClearPrecache (void);
 void S_BeginPrecaching (void);
 void S_EndPrecaching (void);
-void S_PaintChannels (int endtime);
+void S_PaintChannels (channel_t *channels, int numchannels, int endtime, qboolean canload);
+void SND_MixBench_f (void);
 void S_InitPaintChannels (void);
 
 /* picks a channel based on priorities, empty slots, number of channels */
@@ -171,6 +187,10 @@ extern	vec3_t		listener_up;
 extern	cvar_t		sndspeed;
 extern	cvar_t		snd_mixspeed;
 extern	cvar_t		snd_filterquality;
+extern	cvar_t		snd_mixfloat;
+extern	cvar_t		snd_mixthreads;
+extern	cvar_t		snd_cachesize;
+extern	cvar_t		snd_streamlength;
 extern	cvar_t		sfxvolume;
 extern	cvar_t		loadas8bit;
 
@@ -181,6 +201,17 @@ extern	cvar_t		bgmvolume;
 
 void S_LocalSound (const char *name);
 sfxcache_t *S_LoadSound (sfx_t *s);
+sfxcache_t *S_CachedSound (sfx_t *s);
+void S_QueueSound (sfx_t *s);
+void S_StartLoading (void);
+void S_UpdateLoading (void);
+void S_FlushSounds (void);
+void S_InitSoundCache (void);
+void S_ShutdownSoundCache (void);
+
+/* fills in the samples of a streamed sound up to upto */
+void S_DecodeSound (sfxcache_t *sc, int upto);
+#define	S_ReadySound(sc, upto)	((sc)->decoded < (upto) ? S_DecodeSound ((sc), (upto)) : (void)0)
 
 wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength);
 
@@ -257,6 +257,8 @@ typedef struct
 
 #include "gl_model.h"
 #include "world.h"
+#include "tasks.h"
+#include "prof.h"
 
 #include "image.h"	//johnfitz
 #include "gl_texmgr.h"	//johnfitz
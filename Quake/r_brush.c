@@ -24,7 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
-extern cvar_t gl_fullbrights, r_drawflat, gl_overbright, r_oldwater; //johnfitz
+extern cvar_t gl_fullbrights, r_drawflat, gl_overbright, r_oldwater, r_lightmapsize, r_lightmapthreads; //johnfitz
 extern cvar_t gl_zfix; // QuakeSpasm z-fighting fix
 
 int		gl_lightmap_format;
@@ -34,9 +34,23 @@ int		lightmap_bytes;
 struct lightmap_s	*lightmap;
 int					lightmap_count;
 int					last_lightmap_allocated;
-int					allocated[LMBLOCK_WIDTH];
+int					lmblock_width, lmblock_height;
 
-unsigned	blocklights[LMBLOCK_WIDTH*LMBLOCK_HEIGHT*3]; //johnfitz -- was 18*18, added lit support (*3) and loosened surface extents maximum (LMBLOCK_WIDTH*LMBLOCK_HEIGHT)
+// skyline of each lightmap page, only kept while packing
+typedef struct
+{
+	int		x, y, w;
+} lmskyseg_t;
+typedef struct
+{
+	lmskyseg_t	*segs;
+	int			numsegs;
+} lmskyline_t;
+static lmskyline_t	*lm_skylines;
+
+unsigned	blocklights[LMSURF_MAXSIZE*LMSURF_MAXSIZE*3]; //johnfitz -- was 18*18, added lit support (*3) and loosened surface extents maximum (LMSURF_MAXSIZE*LMSURF_MAXSIZE)
+
+static void R_BuildLightMapBlock (msurface_t *surf, byte *dest, int stride, unsigned *blocklights);
 
 
 /*
@@ -646,18 +660,73 @@ void R_DrawBrushModel_ShowTris (entity_t *e)
 =============================================================
 */
 
+/*
+================
+R_MarkLightmapRect
+
+Adds a surface's rectangle to the areas of its page that need uploading.
+A page keeps a few areas apart so dlights at opposite ends of a big page
+don't upload everything in between; once they run out the new one joins
+whichever area grows least.
+================
+*/
+static void R_MarkLightmapRect (struct lightmap_s *lm, int s, int t, int w, int h)
+{
+	glRect_t	*r;
+	int			i, l, tp, rt, bt, grow, bestgrow, best;
+
+	best = -1;
+	bestgrow = 0x7fffffff;
+	for (i=0, r=lm->rectchange ; i<lm->numrects ; i++, r++)
+	{
+		l = q_min (r->l, s);
+		tp = q_min (r->t, t);
+		rt = q_max (r->l + r->w, s + w);
+		bt = q_max (r->t + r->h, t + h);
+		grow = (rt - l) * (bt - tp) - r->w * r->h;
+		if (grow < bestgrow)
+		{
+			bestgrow = grow;
+			best = i;
+		}
+	}
+
+	// join an area when that uploads no more than keeping them apart
+	if (best < 0 || (bestgrow > w * h && lm->numrects < MAX_LIGHTMAP_RECTS))
+	{
+		r = &lm->rectchange[lm->numrects++];
+		r->l = s;
+		r->t = t;
+		r->w = w;
+		r->h = h;
+	}
+	else
+	{
+		r = &lm->rectchange[best];
+		l = q_min (r->l, s);
+		tp = q_min (r->t, t);
+		r->w = q_max (r->l + r->w, s + w) - l;
+		r->h = q_max (r->t + r->h, t + h) - tp;
+		r->l = l;
+		r->t = tp;
+	}
+	lm->modified = true;
+}
+
+// surfaces R_RenderDynamicLightmaps queued for R_FlushDynamicLightmaps
+static msurface_t	**lm_dirtysurfs;
+static int			lm_numdirtysurfs, lm_maxdirtysurfs;
+static unsigned		*lm_threadblocklights;	// one block per thread
+
 /*
 ================
 R_RenderDynamicLightmaps
-called during rendering
 ================
 */
 void R_RenderDynamicLightmaps (msurface_t *fa)
 {
 	byte		*base;
 	int			maps;
-	glRect_t    *theRect;
-	int smax, tmax;
 
 	if (fa->flags & SURF_DRAWTILED) //johnfitz -- not a lightmapped surface
 		return;
@@ -678,41 +747,167 @@ dynamic:
 		if (r_dynamic.value)
 		{
 			struct lightmap_s *lm = &lightmap[fa->lightmaptexturenum];
-			lm->modified = true;
-			theRect = &lm->rectchange;
-			if (fa->light_t < theRect->t) {
-				if (theRect->h)
-					theRect->h += theRect->t - fa->light_t;
-				theRect->t = fa->light_t;
-			}
-			if (fa->light_s < theRect->l) {
-				if (theRect->w)
-					theRect->w += theRect->l - fa->light_s;
-				theRect->l = fa->light_s;
+			R_MarkLightmapRect (lm, fa->light_s, fa->light_t, (fa->extents[0]>>4)+1, (fa->extents[1]>>4)+1);
+
+			// each surface owns its own rectangle, so the rebuilds can be
+			// left for R_FlushDynamicLightmaps to do all at once
+			if (r_lightmapthreads.value && Tasks_NumThreads () > 1)
+			{
+				if (lm_numdirtysurfs == lm_maxdirtysurfs)
+				{
+					lm_maxdirtysurfs = q_max (256, lm_maxdirtysurfs * 2);
+					lm_dirtysurfs = (msurface_t **) realloc (lm_dirtysurfs, lm_maxdirtysurfs * sizeof(*lm_dirtysurfs));
+					if (!lm_dirtysurfs)
+						Sys_Error ("R_RenderDynamicLightmaps: out of memory");
+				}
+				lm_dirtysurfs[lm_numdirtysurfs++] = fa;
+				return;
 			}
-			smax = (fa->extents[0]>>4)+1;
-			tmax = (fa->extents[1]>>4)+1;
-			if ((theRect->w + theRect->l) < (fa->light_s + smax))
-				theRect->w = (fa->light_s-theRect->l)+smax;
-			if ((theRect->h + theRect->t) < (fa->light_t + tmax))
-				theRect->h = (fa->light_t-theRect->t)+tmax;
+
 			base = lm->data;
-			base += fa->light_t * LMBLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-			R_BuildLightMap (fa, base, LMBLOCK_WIDTH*lightmap_bytes);
+			base += fa->light_t * lmblock_width * lightmap_bytes + fa->light_s * lightmap_bytes;
+			R_BuildLightMap (fa, base, lmblock_width*lightmap_bytes);
 		}
 	}
 }
 
+/*
+================
+R_DynamicLightmapTask
+
+Task function, rebuilds one queued surface
+================
+*/
+static void R_DynamicLightmapTask (void *data, int index, int thread)
+{
+	msurface_t	*fa = lm_dirtysurfs[index];
+	byte		*base;
+
+	base = lightmap[fa->lightmaptexturenum].data;
+	base += (fa->light_t * lmblock_width + fa->light_s) * lightmap_bytes;
+	R_BuildLightMapBlock (fa, base, lmblock_width*lightmap_bytes,
+			lm_threadblocklights + thread * LMSURF_MAXSIZE*LMSURF_MAXSIZE*3);
+}
+
+/*
+================
+R_FlushDynamicLightmaps
+
+Rebuilds the lightmaps R_RenderDynamicLightmaps queued, spread over the
+worker threads. Has to run before R_UploadLightmaps.
+================
+*/
+void R_FlushDynamicLightmaps (void)
+{
+	int		i;
+
+	if (!lm_numdirtysurfs)
+		return;
+
+	// the inline path uses thread 0's block too
+	if (!lm_threadblocklights)
+	{
+		lm_threadblocklights = (unsigned *) malloc (Tasks_NumThreads() * LMSURF_MAXSIZE*LMSURF_MAXSIZE*3 * sizeof(unsigned));
+		if (!lm_threadblocklights)
+			Sys_Error ("R_FlushDynamicLightmaps: out of memory");
+	}
+
+	if (lm_numdirtysurfs < 8)
+	{
+		// not worth waking the workers for
+		for (i=0 ; i<lm_numdirtysurfs ; i++)
+			R_DynamicLightmapTask (NULL, i, 0);
+	}
+	else
+		Tasks_ParallelFor (R_DynamicLightmapTask, NULL, lm_numdirtysurfs);
+
+	lm_numdirtysurfs = 0;
+}
+
+/*
+========================
+LM_SkylineFit
+
+Bottom of a w wide block whose left edge sits on segment i, or -1 if it
+doesn't fit there
+========================
+*/
+static int LM_SkylineFit (lmskyline_t *sky, int i, int w, int h)
+{
+	int		y, left;
+
+	if (sky->segs[i].x + w > lmblock_width)
+		return -1;
+	y = 0;
+	for (left = w; left > 0; left -= sky->segs[i++].w)
+	{
+		if (sky->segs[i].y > y)
+			y = sky->segs[i].y;
+		if (y + h > lmblock_height)
+			return -1;
+	}
+	return y;
+}
+
+/*
+========================
+LM_SkylinePlace
+
+Raises the skyline over a block placed on segment i
+========================
+*/
+static void LM_SkylinePlace (lmskyline_t *sky, int i, int w, int top)
+{
+	lmskyseg_t	*segs = sky->segs;
+	int			x, end, j, cut;
+
+	x = segs[i].x;
+	end = x + w;
+
+	// drop the segments the block covers completely, trim the last one
+	for (j = i; j < sky->numsegs && segs[j].x + segs[j].w <= end; j++)
+		;
+	if (j < sky->numsegs && segs[j].x < end)
+	{
+		cut = end - segs[j].x;
+		segs[j].x += cut;
+		segs[j].w -= cut;
+	}
+	memmove (&segs[i + 1], &segs[j], (sky->numsegs - j) * sizeof(*segs));
+	sky->numsegs -= j - i - 1;
+	segs[i].x = x;
+	segs[i].y = top;
+	segs[i].w = w;
+
+	// merge with level neighbours
+	if (i + 1 < sky->numsegs && segs[i + 1].y == top)
+	{
+		segs[i].w += segs[i + 1].w;
+		memmove (&segs[i + 1], &segs[i + 2], (sky->numsegs - i - 2) * sizeof(*segs));
+		sky->numsegs--;
+	}
+	if (i > 0 && segs[i - 1].y == top)
+	{
+		segs[i - 1].w += segs[i].w;
+		memmove (&segs[i], &segs[i + 1], (sky->numsegs - i - 1) * sizeof(*segs));
+		sky->numsegs--;
+	}
+}
+
 /*
 ========================
 AllocBlock -- returns a texture number and the position inside it
+
+Skyline bottom-left packing: the block goes wherever its top ends up
+lowest, leftmost on ties. GL_BuildLightmaps feeds the surfaces tallest
+first, which keeps the skyline flat.
 ========================
 */
 int AllocBlock (int w, int h, int *x, int *y)
 {
-	int		i, j;
-	int		best, best2;
+	int		i, top, best, bestseg;
 	int		texnum;
+	lmskyline_t	*sky;
 
 	// ericw -- rather than searching starting at lightmap 0 every time,
 	// start at the last lightmap we allocated a surface in.
@@ -728,35 +923,37 @@ int AllocBlock (int w, int h, int *x, int *y)
 			memset(&lightmap[texnum], 0, sizeof(lightmap[texnum]));
 			/* FIXME: we leave 'gaps' in malloc()ed data,  CRC_Block() later accesses
 			 * that uninitialized data and valgrind complains for it.  use calloc() ? */
-			lightmap[texnum].data = (byte *) malloc(4*LMBLOCK_WIDTH*LMBLOCK_HEIGHT);
-			//as we're only tracking one texture, we don't need multiple copies of allocated any more.
-			memset(allocated, 0, sizeof(allocated));
+			lightmap[texnum].data = (byte *) malloc(4*lmblock_width*lmblock_height);
+			lm_skylines = (lmskyline_t *) realloc(lm_skylines, sizeof(*lm_skylines)*lightmap_count);
+			sky = &lm_skylines[texnum];
+			sky->segs = (lmskyseg_t *) malloc(sizeof(*sky->segs)*lmblock_width);
+			if (!lightmap || !lightmap[texnum].data || !lm_skylines || !sky->segs)
+				Sys_Error ("AllocBlock: out of memory");
+			sky->segs[0].x = 0;
+			sky->segs[0].y = 0;
+			sky->segs[0].w = lmblock_width;
+			sky->numsegs = 1;
 		}
-		best = LMBLOCK_HEIGHT;
+		sky = &lm_skylines[texnum];
 
-		for (i=0 ; i<LMBLOCK_WIDTH-w ; i++)
+		best = lmblock_height + 1;
+		bestseg = -1;
+		for (i=0 ; i<sky->numsegs ; i++)
 		{
-			best2 = 0;
-
-			for (j=0 ; j<w ; j++)
+			top = LM_SkylineFit (sky, i, w, h);
+			if (top >= 0 && top + h < best)
 			{
-				if (allocated[i+j] >= best)
-					break;
-				if (allocated[i+j] > best2)
-					best2 = allocated[i+j];
-			}
-			if (j == w)
-			{	// this is a valid spot
-				*x = i;
-				*y = best = best2;
+				best = top + h;
+				bestseg = i;
+				*y = top;
 			}
 		}
 
-		if (best + h > LMBLOCK_HEIGHT)
+		if (bestseg < 0)
 			continue;
 
-		for (i=0 ; i<w ; i++)
-			allocated[*x + i] = best + h;
+		*x = sky->segs[bestseg].x;
+		LM_SkylinePlace (sky, bestseg, w, best);
 
 		last_lightmap_allocated = texnum;
 		return texnum;
@@ -766,6 +963,21 @@ int AllocBlock (int w, int h, int *x, int *y)
 	return 0; //johnfitz -- shut up compiler
 }
 
+/*
+========================
+LM_FreeSkylines
+========================
+*/
+static void LM_FreeSkylines (void)
+{
+	int		i;
+
+	for (i=0 ; i<lightmap_count ; i++)
+		free (lm_skylines[i].segs);
+	free (lm_skylines);
+	lm_skylines = NULL;
+}
+
 
 mvertex_t	*r_pcurrentvertbase;
 qmodel_t	*currentmodel;
@@ -780,15 +992,41 @@ GL_CreateSurfaceLightmap
 void GL_CreateSurfaceLightmap (msurface_t *surf)
 {
 	int		smax, tmax;
-	byte	*base;
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
 
+	// the packing depends on every earlier surface, so this stays serial.
+	// the lightmap itself is filled in later by GL_FillSurfaceLightmaps
 	surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
+}
+
+typedef struct
+{
+	msurface_t	*surfaces;
+	unsigned	*blocklights;	// one block per thread
+} filllightmaps_t;
+
+/*
+========================
+GL_FillSurfaceLightmap
+
+Task function, fills the lightmap of one surface
+========================
+*/
+static void GL_FillSurfaceLightmap (void *data, int surfnum, int thread)
+{
+	filllightmaps_t	*job = (filllightmaps_t *) data;
+	msurface_t	*surf = job->surfaces + surfnum;
+	byte		*base;
+
+	if (surf->flags & SURF_DRAWTILED)
+		return;
+
 	base = lightmap[surf->lightmaptexturenum].data;
-	base += (surf->light_t * LMBLOCK_WIDTH + surf->light_s) * lightmap_bytes;
-	R_BuildLightMap (surf, base, LMBLOCK_WIDTH*lightmap_bytes);
+	base += (surf->light_t * lmblock_width + surf->light_s) * lightmap_bytes;
+	R_BuildLightMapBlock (surf, base, lmblock_width*lightmap_bytes,
+			job->blocklights + thread * LMSURF_MAXSIZE*LMSURF_MAXSIZE*3);
 }
 
 /*
@@ -847,13 +1085,13 @@ void BuildSurfaceDisplayList (msurface_t *fa)
 		s -= fa->texturemins[0];
 		s += fa->light_s*16;
 		s += 8;
-		s /= LMBLOCK_WIDTH*16; //fa->texinfo->texture->width;
+		s /= lmblock_width*16; //fa->texinfo->texture->width;
 
 		t = DotProduct (vec, fa->texinfo->vecs[1]) + fa->texinfo->vecs[1][3];
 		t -= fa->texturemins[1];
 		t += fa->light_t*16;
 		t += 8;
-		t /= LMBLOCK_HEIGHT*16; //fa->texinfo->texture->height;
+		t /= lmblock_height*16; //fa->texinfo->texture->height;
 
 		poly->verts[i][5] = s;
 		poly->verts[i][6] = t;
@@ -864,6 +1102,51 @@ void BuildSurfaceDisplayList (msurface_t *fa)
 	poly->numverts = lnumverts;
 }
 
+/*
+==================
+GL_LightmapOrder
+
+Tallest first, then widest, then in map order so the layout is repeatable
+==================
+*/
+static int GL_LightmapOrder (const void *a, const void *b)
+{
+	const msurface_t	*sa = *(const msurface_t * const *)a;
+	const msurface_t	*sb = *(const msurface_t * const *)b;
+
+	if (sa->extents[1] != sb->extents[1])
+		return sb->extents[1] - sa->extents[1];
+	if (sa->extents[0] != sb->extents[0])
+		return sb->extents[0] - sa->extents[0];
+	return (sa < sb) ? -1 : (sa > sb);
+}
+
+/*
+==================
+GL_LightmapSize
+
+Smallest square page that should hold every lightmap at once, as big as
+the card and gl_max_size allow, or r_lightmapsize if that is set
+==================
+*/
+static int GL_LightmapSize (int luxels)
+{
+	int		size, maxsize;
+
+	maxsize = TexMgr_SafeTextureSize (1 << 30);
+	if (r_lightmapsize.value > 0)
+	{
+		size = TexMgr_Pad ((int)r_lightmapsize.value);
+		return CLAMP (LMBLOCK_MINSIZE, size, q_max(maxsize, LMBLOCK_MINSIZE));
+	}
+
+	// the packer wastes a bit, so leave some room
+	luxels += luxels / 8;
+	for (size = LMBLOCK_MINSIZE; size < maxsize && size * size < luxels; size <<= 1)
+		;
+	return q_max (size, LMBLOCK_MINSIZE);
+}
+
 /*
 ==================
 GL_BuildLightmaps -- called at level load time
@@ -875,9 +1158,11 @@ with all the surfaces from all brush models
 void GL_BuildLightmaps (void)
 {
 	char	name[24];
-	int		i, j;
+	int		i, j, numsurfs, luxels;
 	struct lightmap_s *lm;
 	qmodel_t	*m;
+	msurface_t	**surfs;
+	filllightmaps_t	job;
 
 	r_framecount = 1; // no dlightcache
 
@@ -903,6 +1188,49 @@ void GL_BuildLightmaps (void)
 		Sys_Error ("GL_BuildLightmaps: bad lightmap format");
 	}
 
+	//
+	// gather every lightmapped surface, size the pages to fit them and
+	// pack them tallest first
+	//
+	numsurfs = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] != '*')
+			numsurfs += m->numsurfaces;
+	}
+	surfs = (msurface_t **) malloc (q_max(numsurfs, 1) * sizeof(*surfs));
+	if (!surfs)
+		Sys_Error ("GL_BuildLightmaps: out of memory");
+	numsurfs = 0;
+	luxels = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*')
+			continue;
+		for (i=0 ; i<m->numsurfaces ; i++)
+		{
+			//johnfitz -- rewritten to use SURF_DRAWTILED instead of the sky/water flags
+			if (m->surfaces[i].flags & SURF_DRAWTILED)
+				continue;
+			surfs[numsurfs++] = m->surfaces + i;
+			luxels += ((m->surfaces[i].extents[0]>>4)+1) * ((m->surfaces[i].extents[1]>>4)+1);
+		}
+	}
+
+	lmblock_width = lmblock_height = GL_LightmapSize (luxels);
+
+	qsort (surfs, numsurfs, sizeof(*surfs), GL_LightmapOrder);
+	for (i=0 ; i<numsurfs ; i++)
+		GL_CreateSurfaceLightmap (surfs[i]);
+	free (surfs);
+	LM_FreeSkylines ();
+
 	for (j=1 ; j<MAX_MODELS ; j++)
 	{
 		m = cl.model_precache[j];
@@ -914,15 +1242,31 @@ void GL_BuildLightmaps (void)
 		currentmodel = m;
 		for (i=0 ; i<m->numsurfaces ; i++)
 		{
-			//johnfitz -- rewritten to use SURF_DRAWTILED instead of the sky/water flags
 			if (m->surfaces[i].flags & SURF_DRAWTILED)
 				continue;
-			GL_CreateSurfaceLightmap (m->surfaces + i);
 			BuildSurfaceDisplayList (m->surfaces + i);
-			//johnfitz
 		}
 	}
 
+	//
+	// fill the allocated blocks, each surface owns its own rectangle so
+	// this can go wide
+	//
+	job.blocklights = (unsigned *) malloc (Tasks_NumThreads() * LMSURF_MAXSIZE*LMSURF_MAXSIZE*3 * sizeof(unsigned));
+	if (!job.blocklights)
+		Sys_Error ("GL_BuildLightmaps: out of memory");
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*')
+			continue;
+		job.surfaces = m->surfaces;
+		Tasks_ParallelFor (GL_FillSurfaceLightmap, &job, m->numsurfaces);
+	}
+	free (job.blocklights);
+
 	//
 	// upload all lightmaps that were filled
 	//
@@ -930,25 +1274,25 @@ void GL_BuildLightmaps (void)
 	{
 		lm = &lightmap[i];
 		lm->modified = false;
-		lm->rectchange.l = LMBLOCK_WIDTH;
-		lm->rectchange.t = LMBLOCK_HEIGHT;
-		lm->rectchange.w = 0;
-		lm->rectchange.h = 0;
+		lm->numrects = 0;
 
 		//johnfitz -- use texture manager
 		sprintf(name, "lightmap%07i",i);
-		lm->texture = TexMgr_LoadImage (cl.worldmodel, name, LMBLOCK_WIDTH, LMBLOCK_HEIGHT,
+		lm->texture = TexMgr_LoadImage (cl.worldmodel, name, lmblock_width, lmblock_height,
 						SRC_LIGHTMAP, lm->data, "", (src_offset_t)lm->data, TEXPREF_LINEAR | TEXPREF_NOPICMIP);
 		//johnfitz
 	}
 
 	//johnfitz -- warn about exceeding old limits
 	//GLQuake limit was 64 textures of 128x128. Estimate how many 128x128 textures we would need
-	//given that we are using lightmap_count of LMBLOCK_WIDTH x LMBLOCK_HEIGHT
-	i = lightmap_count * ((LMBLOCK_WIDTH / 128) * (LMBLOCK_HEIGHT / 128));
+	//given that we are using lightmap_count of lmblock_width x lmblock_height
+	i = lightmap_count * ((lmblock_width / 128) * (lmblock_height / 128));
 	if (i > 64)
 		Con_DWarning("%i lightmaps exceeds standard limit of 64.\n",i);
 	//johnfitz
+
+	Con_DPrintf ("%i lightmap%s of %ix%i\n", lightmap_count, (lightmap_count == 1) ? "" : "s",
+				lmblock_width, lmblock_height);
 }
 
 /*
@@ -1042,20 +1386,15 @@ void GL_BuildBModelVertexBuffer (void)
 R_AddDynamicLights
 ===============
 */
-void R_AddDynamicLights (msurface_t *surf)
+static void R_AddDynamicLights (msurface_t *surf, unsigned *blocklights)
 {
 	int			lnum;
-	int			sd, td;
 	float		dist, rad, minlight;
-	vec3_t		impact, local;
-	int			s, t;
+	vec3_t		impact;
 	int			i;
 	int			smax, tmax;
 	mtexinfo_t	*tex;
-	//johnfitz -- lit support via lordhavoc
-	float		cred, cgreen, cblue, brightness;
-	unsigned	*bl;
-	//johnfitz
+	lmdlight_t	dl;
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
@@ -1081,64 +1420,40 @@ void R_AddDynamicLights (msurface_t *surf)
 					surf->plane->normal[i]*dist;
 		}
 
-		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3];
-		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3];
+		dl.local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3];
+		dl.local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3];
 
-		local[0] -= surf->texturemins[0];
-		local[1] -= surf->texturemins[1];
+		dl.local[0] -= surf->texturemins[0];
+		dl.local[1] -= surf->texturemins[1];
 
+		dl.rad = rad;
+		dl.minlight = minlight;
 		//johnfitz -- lit support via lordhavoc
-		bl = blocklights;
-		cred = cl_dlights[lnum].color[0] * 256.0f;
-		cgreen = cl_dlights[lnum].color[1] * 256.0f;
-		cblue = cl_dlights[lnum].color[2] * 256.0f;
+		dl.color[0] = cl_dlights[lnum].color[0] * 256.0f;
+		dl.color[1] = cl_dlights[lnum].color[1] * 256.0f;
+		dl.color[2] = cl_dlights[lnum].color[2] * 256.0f;
 		//johnfitz
-		for (t = 0 ; t<tmax ; t++)
-		{
-			td = local[1] - t*16;
-			if (td < 0)
-				td = -td;
-			for (s=0 ; s<smax ; s++)
-			{
-				sd = local[0] - s*16;
-				if (sd < 0)
-					sd = -sd;
-				if (sd > td)
-					dist = sd + (td>>1);
-				else
-					dist = td + (sd>>1);
-				if (dist < minlight)
-				//johnfitz -- lit support via lordhavoc
-				{
-					brightness = rad - dist;
-					bl[0] += (int) (brightness * cred);
-					bl[1] += (int) (brightness * cgreen);
-					bl[2] += (int) (brightness * cblue);
-				}
-				bl += 3;
-				//johnfitz
-			}
-		}
+		lmkernels->adddlight (blocklights, smax, tmax, &dl);
 	}
 }
 
 
 /*
 ===============
-R_BuildLightMap -- johnfitz -- revised for lit support via lordhavoc
+R_BuildLightMapBlock -- johnfitz -- revised for lit support via lordhavoc
 
-Combine and scale multiple lightmaps into the 8.8 format in blocklights
+Combine and scale multiple lightmaps into the 8.8 format in blocklights.
+Only touches the surface and the given scratch block, so it's safe to
+run on worker threads for different surfaces.
 ===============
 */
-void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+static void R_BuildLightMapBlock (msurface_t *surf, byte *dest, int stride, unsigned *blocklights)
 {
 	int			smax, tmax;
-	int			r,g,b;
-	int			i, j, size;
+	int			size;
 	byte		*lightmap;
 	unsigned	scale;
 	int			maps;
-	unsigned	*bl;
 
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
 
@@ -1160,21 +1475,14 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 			{
 				scale = d_lightstylevalue[surf->styles[maps]];
 				surf->cached_light[maps] = scale;	// 8.8 fraction
-				//johnfitz -- lit support via lordhavoc
-				bl = blocklights;
-				for (i=0 ; i<size ; i++)
-				{
-					*bl++ += *lightmap++ * scale;
-					*bl++ += *lightmap++ * scale;
-					*bl++ += *lightmap++ * scale;
-				}
-				//johnfitz
+				lmkernels->addstyle (blocklights, lightmap, size*3, scale); //johnfitz -- lit support via lordhavoc
+				lightmap += size*3;
 			}
 		}
 
 	// add all the dynamic lights
 		if (surf->dlightframe == r_framecount)
-			R_AddDynamicLights (surf);
+			R_AddDynamicLights (surf, blocklights);
 	}
 	else
 	{
@@ -1187,60 +1495,119 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 	switch (gl_lightmap_format)
 	{
 	case GL_RGBA:
-		stride -= smax * 4;
-		bl = blocklights;
-		for (i=0 ; i<tmax ; i++, dest += stride)
+	case GL_BGRA:
+		lmkernels->store (dest, stride, blocklights, smax, tmax, gl_overbright.value ? 8 : 7, gl_lightmap_format == GL_BGRA);
+		break;
+	default:
+		Sys_Error ("R_BuildLightMap: bad lightmap format");
+	}
+}
+
+/*
+===============
+R_BuildLightMap
+===============
+*/
+void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+{
+	R_BuildLightMapBlock (surf, dest, stride, blocklights);
+}
+
+/*
+===============
+R_TimeLightmaps_f
+
+Rebuilds every world lightmap with each kernel set the cpu has, and adds
+a dynamic light to each of them, checking the sets agree byte for byte
+===============
+*/
+void R_TimeLightmaps_f (void)
+{
+	const lmkernels_t	*saved, *k;
+	msurface_t	*surf;
+	lmdlight_t	dl;
+	byte		*out, *refout;
+	unsigned	*dlout, *refdl;
+	int			i, j, pass, passes, smax, tmax, numtexels;
+	size_t		ofs;
+	double		start, stylems, dlightms;
+
+	if (!cl.worldmodel || !cl.worldmodel->lightdata)
+	{
+		Con_Printf ("No map with lightmaps loaded\n");
+		return;
+	}
+	passes = (Cmd_Argc() > 1) ? q_max(1, atoi(Cmd_Argv(1))) : 10;
+
+	numtexels = 0;
+	for (i=0, surf=cl.worldmodel->surfaces ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+	{
+		if (!(surf->flags & SURF_DRAWTILED))
+			numtexels += ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1);
+	}
+	out = (byte *) malloc (numtexels * 4 * 2);
+	dlout = (unsigned *) malloc (numtexels * 3 * sizeof(unsigned) * 2);
+	if (!out || !dlout)
+		Sys_Error ("R_TimeLightmaps_f: out of memory");
+	refout = out + numtexels * 4;
+	refdl = dlout + numtexels * 3;
+
+	saved = lmkernels;
+	for (j=0 ; (k = R_LightmapKernels (j)) != NULL ; j++)
+	{
+		lmkernels = k;
+
+		start = Sys_DoubleTime ();
+		for (pass=0 ; pass<passes ; pass++)
 		{
-			for (j=0 ; j<smax ; j++)
+			for (i=0, surf=cl.worldmodel->surfaces, ofs=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
 			{
-				if (gl_overbright.value)
-				{
-					r = *bl++ >> 8;
-					g = *bl++ >> 8;
-					b = *bl++ >> 8;
-				}
-				else
-				{
-					r = *bl++ >> 7;
-					g = *bl++ >> 7;
-					b = *bl++ >> 7;
-				}
-				*dest++ = (r > 255)? 255 : r;
-				*dest++ = (g > 255)? 255 : g;
-				*dest++ = (b > 255)? 255 : b;
-				*dest++ = 255;
+				if (surf->flags & SURF_DRAWTILED)
+					continue;
+				smax = (surf->extents[0]>>4)+1;
+				tmax = (surf->extents[1]>>4)+1;
+				R_BuildLightMapBlock (surf, out + ofs*4, smax*4, blocklights);
+				ofs += smax*tmax;
 			}
 		}
-		break;
-	case GL_BGRA:
-		stride -= smax * 4;
-		bl = blocklights;
-		for (i=0 ; i<tmax ; i++, dest += stride)
+		stylems = (Sys_DoubleTime () - start) * 1000.0 / passes;
+
+		// a light over the middle of each surface
+		start = Sys_DoubleTime ();
+		for (pass=0 ; pass<passes ; pass++)
 		{
-			for (j=0 ; j<smax ; j++)
+			memset (dlout, 0, numtexels * 3 * sizeof(unsigned));
+			for (i=0, surf=cl.worldmodel->surfaces, ofs=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
 			{
-				if (gl_overbright.value)
-				{
-					r = *bl++ >> 8;
-					g = *bl++ >> 8;
-					b = *bl++ >> 8;
-				}
-				else
-				{
-					r = *bl++ >> 7;
-					g = *bl++ >> 7;
-					b = *bl++ >> 7;
-				}
-				*dest++ = (b > 255)? 255 : b;
-				*dest++ = (g > 255)? 255 : g;
-				*dest++ = (r > 255)? 255 : r;
-				*dest++ = 255;
+				if (surf->flags & SURF_DRAWTILED)
+					continue;
+				smax = (surf->extents[0]>>4)+1;
+				tmax = (surf->extents[1]>>4)+1;
+				dl.local[0] = surf->extents[0] * 0.5f + 3.5f;
+				dl.local[1] = surf->extents[1] * 0.5f + 5.25f;
+				dl.rad = 350;
+				dl.minlight = 300;
+				dl.color[0] = dl.color[1] = 256.0f;
+				dl.color[2] = 128.0f;
+				lmkernels->adddlight (dlout + ofs*3, smax, tmax, &dl);
+				ofs += smax*tmax;
 			}
 		}
-		break;
-	default:
-		Sys_Error ("R_BuildLightMap: bad lightmap format");
+		dlightms = (Sys_DoubleTime () - start) * 1000.0 / passes;
+
+		if (!j)
+		{
+			memcpy (refout, out, numtexels * 4);
+			memcpy (refdl, dlout, numtexels * 3 * sizeof(unsigned));
+		}
+		Con_Printf ("%-5s %8.3f ms styles %8.3f ms dlights%s\n", k->name, stylems, dlightms,
+			(memcmp (refout, out, numtexels * 4) || memcmp (refdl, dlout, numtexels * 3 * sizeof(unsigned))) ?
+			"  MISMATCH" : "");
 	}
+	lmkernels = saved;
+
+	free (out);
+	free (dlout);
 }
 
 /*
@@ -1253,20 +1620,24 @@ assumes lightmap texture is already bound
 static void R_UploadLightmap(int lmap)
 {
 	struct lightmap_s *lm = &lightmap[lmap];
+	glRect_t	*r;
+	int			i;
 
 	if (!lm->modified)
 		return;
 
 	lm->modified = false;
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, lm->rectchange.t, LMBLOCK_WIDTH, lm->rectchange.h, gl_lightmap_format,
-			GL_UNSIGNED_BYTE, lm->data+lm->rectchange.t*LMBLOCK_WIDTH*lightmap_bytes);
-	lm->rectchange.l = LMBLOCK_WIDTH;
-	lm->rectchange.t = LMBLOCK_HEIGHT;
-	lm->rectchange.h = 0;
-	lm->rectchange.w = 0;
-
-	rs_dynamiclightmaps++;
+	// only the changed areas, the pages can be much wider than 256 now
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, lmblock_width);
+	for (i=0, r=lm->rectchange ; i<lm->numrects ; i++, r++)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r->l, r->t, r->w, r->h, gl_lightmap_format,
+				GL_UNSIGNED_BYTE, lm->data+(r->t*lmblock_width+r->l)*lightmap_bytes);
+		rs_dynamiclightmaps++;
+	}
+	glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	lm->numrects = 0;
 }
 
 void R_UploadLightmaps (void)
@@ -1309,8 +1680,8 @@ void R_RebuildAllLightmaps (void)
 			if (fa->flags & SURF_DRAWTILED)
 				continue;
 			base = lightmap[fa->lightmaptexturenum].data;
-			base += fa->light_t * LMBLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-			R_BuildLightMap (fa, base, LMBLOCK_WIDTH*lightmap_bytes);
+			base += fa->light_t * lmblock_width * lightmap_bytes + fa->light_s * lightmap_bytes;
+			R_BuildLightMap (fa, base, lmblock_width*lightmap_bytes);
 		}
 	}
 
@@ -1318,7 +1689,7 @@ void R_RebuildAllLightmaps (void)
 	for (i=0; i<lightmap_count; i++)
 	{
 		GL_Bind (lightmap[i].texture);
-		glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, LMBLOCK_WIDTH, LMBLOCK_HEIGHT, gl_lightmap_format,
+		glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, lmblock_width, lmblock_height, gl_lightmap_format,
 				 GL_UNSIGNED_BYTE, lightmap[i].data);
 	}
 }
@@ -0,0 +1,435 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_lightmap.c -- inner loops of R_BuildLightMap, in plain C and SIMD
+
+#include "quakedef.h"
+
+/*
+Every kernel set gives bit for bit the same blocklights and lightmap bytes
+as the C one; timelightmaps checks that. The SSE2 set is compiled in
+whenever the compiler targets SSE2, the AVX2 set only with gcc or clang and
+is picked at runtime from cpuid. Anything else gets the C set.
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LM_SSE2
+#include <emmintrin.h>
+#if (defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__)
+#define LM_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+const lmkernels_t	*lmkernels;
+
+/*
+==============================================================================
+
+PLAIN C
+
+==============================================================================
+*/
+
+static void LM_AddStyle_C (unsigned *bl, const byte *lightmap, int count, unsigned scale)
+{
+	int		i;
+
+	for (i=0 ; i<count ; i++)
+		bl[i] += lightmap[i] * scale;
+}
+
+/*
+dlight falloff for one row: sd and dist are ints like in the original,
+brightness and the colour scale are floats
+*/
+static void LM_AddDlight_C (unsigned *bl, int smax, int tmax, const lmdlight_t *dl)
+{
+	int		s, t, sd, td;
+	float	dist, brightness;
+
+	for (t = 0 ; t<tmax ; t++)
+	{
+		td = dl->local[1] - t*16;
+		if (td < 0)
+			td = -td;
+		for (s=0 ; s<smax ; s++)
+		{
+			sd = dl->local[0] - s*16;
+			if (sd < 0)
+				sd = -sd;
+			if (sd > td)
+				dist = sd + (td>>1);
+			else
+				dist = td + (sd>>1);
+			if (dist < dl->minlight)
+			{
+				brightness = dl->rad - dist;
+				bl[0] += (int) (brightness * dl->color[0]);
+				bl[1] += (int) (brightness * dl->color[1]);
+				bl[2] += (int) (brightness * dl->color[2]);
+			}
+			bl += 3;
+		}
+	}
+}
+
+static void LM_Store_C (byte *dest, int stride, const unsigned *bl, int smax, int tmax, int shift, qboolean bgra)
+{
+	int		i, j, r, g, b;
+
+	stride -= smax * 4;
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		for (j=0 ; j<smax ; j++)
+		{
+			r = *bl++ >> shift;
+			g = *bl++ >> shift;
+			b = *bl++ >> shift;
+			if (bgra)
+			{
+				*dest++ = (b > 255)? 255 : b;
+				*dest++ = (g > 255)? 255 : g;
+				*dest++ = (r > 255)? 255 : r;
+			}
+			else
+			{
+				*dest++ = (r > 255)? 255 : r;
+				*dest++ = (g > 255)? 255 : g;
+				*dest++ = (b > 255)? 255 : b;
+			}
+			*dest++ = 255;
+		}
+	}
+}
+
+static const lmkernels_t lm_c = {"C", LM_AddStyle_C, LM_AddDlight_C, LM_Store_C};
+
+#ifdef LM_SSE2
+/*
+==============================================================================
+
+SSE2
+
+==============================================================================
+*/
+
+static void LM_AddStyle_SSE2 (unsigned *bl, const byte *lightmap, int count, unsigned scale)
+{
+	__m128i	zero, s, x, lo, hi, p;
+	int		i;
+
+	if (scale > 0xffff)
+	{
+		LM_AddStyle_C (bl, lightmap, count, scale);
+		return;
+	}
+
+	// 16 bit multiplies, the high and low halves give the 32 bit products
+	zero = _mm_setzero_si128 ();
+	s = _mm_set1_epi16 ((short)scale);
+	for (i=0 ; i+16<=count ; i+=16)
+	{
+		x = _mm_loadu_si128 ((const __m128i *)(lightmap + i));
+
+		p = _mm_unpacklo_epi8 (x, zero);
+		lo = _mm_mullo_epi16 (p, s);
+		hi = _mm_mulhi_epu16 (p, s);
+		_mm_storeu_si128 ((__m128i *)(bl + i), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i)), _mm_unpacklo_epi16 (lo, hi)));
+		_mm_storeu_si128 ((__m128i *)(bl + i + 4), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i + 4)), _mm_unpackhi_epi16 (lo, hi)));
+
+		p = _mm_unpackhi_epi8 (x, zero);
+		lo = _mm_mullo_epi16 (p, s);
+		hi = _mm_mulhi_epu16 (p, s);
+		_mm_storeu_si128 ((__m128i *)(bl + i + 8), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i + 8)), _mm_unpacklo_epi16 (lo, hi)));
+		_mm_storeu_si128 ((__m128i *)(bl + i + 12), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i + 12)), _mm_unpackhi_epi16 (lo, hi)));
+	}
+	LM_AddStyle_C (bl + i, lightmap + i, count - i, scale);
+}
+
+/*
+four texels at a time; only texels inside minlight touch blocklights, and
+a group with none of them is skipped outright
+*/
+static void LM_AddDlight_SSE2 (unsigned *bl, int smax, int tmax, const lmdlight_t *dl)
+{
+	__m128i	sd, td, tdhalf, sign, dist;
+	__m128	local0, minlight, rad, fdist, in, br;
+	int		s, t, k, mask, tdi;
+	unsigned	*row;
+	int		rgb[3][4];
+
+	local0 = _mm_set1_ps (dl->local[0]);
+	minlight = _mm_set1_ps (dl->minlight);
+	rad = _mm_set1_ps (dl->rad);
+
+	for (t = 0, row = bl ; t<tmax ; t++, row += smax*3)
+	{
+		tdi = dl->local[1] - t*16;
+		if (tdi < 0)
+			tdi = -tdi;
+		td = _mm_set1_epi32 (tdi);
+		tdhalf = _mm_set1_epi32 (tdi >> 1);
+
+		for (s=0 ; s+4<=smax ; s+=4)
+		{
+			sd = _mm_cvttps_epi32 (_mm_sub_ps (local0, _mm_cvtepi32_ps (_mm_setr_epi32 (s*16, s*16+16, s*16+32, s*16+48))));
+			sign = _mm_srai_epi32 (sd, 31);
+			sd = _mm_sub_epi32 (_mm_xor_si128 (sd, sign), sign);
+
+			// sd > td ? sd + (td>>1) : td + (sd>>1)
+			in = _mm_castsi128_ps (_mm_cmpgt_epi32 (sd, td));
+			dist = _mm_castps_si128 (_mm_or_ps (
+				_mm_and_ps (in, _mm_castsi128_ps (_mm_add_epi32 (sd, tdhalf))),
+				_mm_andnot_ps (in, _mm_castsi128_ps (_mm_add_epi32 (td, _mm_srai_epi32 (sd, 1))))));
+			fdist = _mm_cvtepi32_ps (dist);
+
+			in = _mm_cmplt_ps (fdist, minlight);
+			mask = _mm_movemask_ps (in);
+			if (!mask)
+				continue;
+
+			br = _mm_sub_ps (rad, fdist);
+			for (k=0 ; k<3 ; k++)
+				_mm_storeu_si128 ((__m128i *)rgb[k], _mm_cvttps_epi32 (_mm_mul_ps (br, _mm_set1_ps (dl->color[k]))));
+			for (k=0 ; k<4 ; k++)
+			{
+				if (mask & (1 << k))
+				{
+					row[(s+k)*3+0] += rgb[0][k];
+					row[(s+k)*3+1] += rgb[1][k];
+					row[(s+k)*3+2] += rgb[2][k];
+				}
+			}
+		}
+		for ( ; s<smax ; s++)
+		{
+			lmdlight_t	one = *dl;
+
+			one.local[0] -= s*16;
+			one.local[1] -= t*16;
+			LM_AddDlight_C (row + s*3, 1, 1, &one);
+		}
+	}
+}
+
+/*
+shift and saturate four texels into twelve bytes, then spread them out
+with the alpha byte in between
+*/
+static void LM_Store_SSE2 (byte *dest, int stride, const unsigned *bl, int smax, int tmax, int shift, qboolean bgra)
+{
+	__m128i	count, a, b, c;
+	int		i, j, k;
+	byte	rgb[16];
+
+	count = _mm_cvtsi32_si128 (shift);
+	for (i=0 ; i<tmax ; i++, dest += stride, bl += smax*3)
+	{
+		for (j=0 ; j+4<=smax ; j+=4)
+		{
+			a = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3)), count);
+			b = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3 + 4)), count);
+			c = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3 + 8)), count);
+			_mm_storeu_si128 ((__m128i *)rgb, _mm_packus_epi16 (_mm_packs_epi32 (a, b), _mm_packs_epi32 (c, c)));
+			for (k=0 ; k<4 ; k++)
+			{
+				dest[(j+k)*4+0] = rgb[k*3 + (bgra ? 2 : 0)];
+				dest[(j+k)*4+1] = rgb[k*3+1];
+				dest[(j+k)*4+2] = rgb[k*3 + (bgra ? 0 : 2)];
+				dest[(j+k)*4+3] = 255;
+			}
+		}
+		if (j < smax)
+			LM_Store_C (dest + j*4, (smax - j)*4, bl + j*3, smax - j, 1, shift, bgra);
+	}
+}
+
+static const lmkernels_t lm_sse2 = {"SSE2", LM_AddStyle_SSE2, LM_AddDlight_SSE2, LM_Store_SSE2};
+#endif	/* LM_SSE2 */
+
+#ifdef LM_AVX2
+/*
+==============================================================================
+
+AVX2
+
+==============================================================================
+*/
+
+__attribute__((target("avx2")))
+static void LM_AddStyle_AVX2 (unsigned *bl, const byte *lightmap, int count, unsigned scale)
+{
+	__m256i	s, x;
+	int		i;
+
+	s = _mm256_set1_epi32 ((int)scale);
+	for (i=0 ; i+8<=count ; i+=8)
+	{
+		x = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)(lightmap + i)));
+		x = _mm256_add_epi32 (_mm256_loadu_si256 ((__m256i *)(bl + i)), _mm256_mullo_epi32 (x, s));
+		_mm256_storeu_si256 ((__m256i *)(bl + i), x);
+	}
+	LM_AddStyle_C (bl + i, lightmap + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void LM_AddDlight_AVX2 (unsigned *bl, int smax, int tmax, const lmdlight_t *dl)
+{
+	__m256i	sd, td, tdhalf, dist, step;
+	__m256	local0, minlight, rad, fdist, in, br;
+	int		s, t, k, mask, tdi;
+	unsigned	*row;
+	int		rgb[3][8];
+
+	local0 = _mm256_set1_ps (dl->local[0]);
+	minlight = _mm256_set1_ps (dl->minlight);
+	rad = _mm256_set1_ps (dl->rad);
+	step = _mm256_setr_epi32 (0, 16, 32, 48, 64, 80, 96, 112);
+
+	for (t = 0, row = bl ; t<tmax ; t++, row += smax*3)
+	{
+		tdi = dl->local[1] - t*16;
+		if (tdi < 0)
+			tdi = -tdi;
+		td = _mm256_set1_epi32 (tdi);
+		tdhalf = _mm256_set1_epi32 (tdi >> 1);
+
+		for (s=0 ; s+8<=smax ; s+=8)
+		{
+			sd = _mm256_add_epi32 (_mm256_set1_epi32 (s*16), step);
+			sd = _mm256_abs_epi32 (_mm256_cvttps_epi32 (_mm256_sub_ps (local0, _mm256_cvtepi32_ps (sd))));
+
+			dist = _mm256_blendv_epi8 (_mm256_add_epi32 (td, _mm256_srai_epi32 (sd, 1)),
+						   _mm256_add_epi32 (sd, tdhalf),
+						   _mm256_cmpgt_epi32 (sd, td));
+			fdist = _mm256_cvtepi32_ps (dist);
+
+			in = _mm256_cmp_ps (fdist, minlight, _CMP_LT_OQ);
+			mask = _mm256_movemask_ps (in);
+			if (!mask)
+				continue;
+
+			br = _mm256_sub_ps (rad, fdist);
+			for (k=0 ; k<3 ; k++)
+				_mm256_storeu_si256 ((__m256i *)rgb[k], _mm256_cvttps_epi32 (_mm256_mul_ps (br, _mm256_set1_ps (dl->color[k]))));
+			for (k=0 ; k<8 ; k++)
+			{
+				if (mask & (1 << k))
+				{
+					row[(s+k)*3+0] += rgb[0][k];
+					row[(s+k)*3+1] += rgb[1][k];
+					row[(s+k)*3+2] += rgb[2][k];
+				}
+			}
+		}
+		for ( ; s<smax ; s++)
+		{
+			lmdlight_t	one = *dl;
+
+			one.local[0] -= s*16;
+			one.local[1] -= t*16;
+			LM_AddDlight_C (row + s*3, 1, 1, &one);
+		}
+	}
+}
+
+/*
+same packing as SSE2, but pshufb drops the bytes straight into RGBA order
+*/
+__attribute__((target("avx2")))
+static void LM_Store_AVX2 (byte *dest, int stride, const unsigned *bl, int smax, int tmax, int shift, qboolean bgra)
+{
+	__m128i	count, a, b, c, order, alpha;
+	int		i, j;
+
+	count = _mm_cvtsi32_si128 (shift);
+	alpha = _mm_set1_epi32 ((int)0xff000000);
+	if (bgra)
+		order = _mm_setr_epi8 (2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	else
+		order = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+	for (i=0 ; i<tmax ; i++, dest += stride, bl += smax*3)
+	{
+		for (j=0 ; j+4<=smax ; j+=4)
+		{
+			a = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3)), count);
+			b = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3 + 4)), count);
+			c = _mm_srl_epi32 (_mm_loadu_si128 ((const __m128i *)(bl + j*3 + 8)), count);
+			a = _mm_packus_epi16 (_mm_packs_epi32 (a, b), _mm_packs_epi32 (c, c));
+			a = _mm_or_si128 (_mm_shuffle_epi8 (a, order), alpha);
+			_mm_storeu_si128 ((__m128i *)(dest + j*4), a);
+		}
+		if (j < smax)
+			LM_Store_C (dest + j*4, (smax - j)*4, bl + j*3, smax - j, 1, shift, bgra);
+	}
+}
+
+static const lmkernels_t lm_avx2 = {"AVX2", LM_AddStyle_AVX2, LM_AddDlight_AVX2, LM_Store_AVX2};
+#endif	/* LM_AVX2 */
+
+/*
+===============
+R_LightmapKernels
+
+Kernel sets this cpu can run, slowest first; NULL past the last one
+===============
+*/
+const lmkernels_t *R_LightmapKernels (int i)
+{
+	static const lmkernels_t	*sets[3];
+	static int	numsets = -1;
+
+	if (numsets < 0)
+	{
+		numsets = 0;
+		sets[numsets++] = &lm_c;
+#ifdef LM_SSE2
+		sets[numsets++] = &lm_sse2;
+#endif
+#ifdef LM_AVX2
+		if (__builtin_cpu_supports ("avx2"))
+			sets[numsets++] = &lm_avx2;
+#endif
+	}
+	return (i >= 0 && i < numsets) ? sets[i] : NULL;
+}
+
+/*
+===============
+R_InitLightmapKernels
+
+Picks the fastest set, or the C one with -nosimd
+===============
+*/
+void R_InitLightmapKernels (void)
+{
+	int		i;
+
+	lmkernels = R_LightmapKernels (0);
+	if (!COM_CheckParm ("-nosimd"))
+	{
+		for (i = 1; R_LightmapKernels (i); i++)
+			lmkernels = R_LightmapKernels (i);
+	}
+	Con_Printf ("Lightmap kernels: %s\n", lmkernels->name);
+}
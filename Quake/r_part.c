@@ -23,20 +23,58 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
-#define MAX_PARTICLES			2048	// default max # of particles at one
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PART_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+Particles are kept per ptype_t as a structure of arrays, so
+CL_RunParticles moves all the particles of a type with a few loops over
+contiguous floats instead of switching on the type of each one. Dead
+particles are squeezed out at the start of the frame. The arrays of a
+type start small and double when full; -particles only caps how many can
+be alive at once. R_DrawParticles expands them into one vertex array and
+draws it with a single glDrawArrays.
+*/
+
+#define MAX_PARTICLES			65536	// default max # of particles at one
 										//  time
 #define ABSOLUTE_MIN_PARTICLES	512		// no fewer than this no matter what's
 										//  on the command line
+#define PARTICLES_PER_BLOCK		256		// first allocation for a type
+#define NUM_PTYPES				(pt_blob2 + 1)
+
+typedef struct
+{
+	int		count, max;
+	float	*org[3];	// org[0][i] is the x of particle i
+	float	*vel[3];
+	float	*ramp;
+	float	*die;
+	byte	*color;
+	byte	*block;		// holds all of the above
+} partarrays_t;
+
+typedef struct
+{
+	float	xyz[3];
+	float	st[2];
+	byte	rgba[4];
+} partvert_t;
 
 int		ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 int		ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 int		ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t	*active_particles, *free_particles, *particles;
+static partarrays_t	r_partarrays[NUM_PTYPES];
+static partvert_t	*r_partverts;
+static int			r_maxpartverts;
 
 vec3_t			r_pright, r_pup, r_ppn;
 
-int			r_numparticles;
+int			r_numparticles;		// alive
+int			r_maxparticles;
 
 gltexture_t *particletexture, *particletexture1, *particletexture2, *particletexture3, *particletexture4; //johnfitz
 float texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
@@ -152,20 +190,17 @@ void R_InitParticles (void)
 
 	i = COM_CheckParm ("-particles");
 
-	if (i)
+	if (i && i < com_argc-1)
 	{
-		r_numparticles = (int)(Q_atoi(com_argv[i+1]));
-		if (r_numparticles < ABSOLUTE_MIN_PARTICLES)
-			r_numparticles = ABSOLUTE_MIN_PARTICLES;
+		r_maxparticles = (int)(Q_atoi(com_argv[i+1]));
+		if (r_maxparticles < ABSOLUTE_MIN_PARTICLES)
+			r_maxparticles = ABSOLUTE_MIN_PARTICLES;
 	}
 	else
 	{
-		r_numparticles = MAX_PARTICLES;
+		r_maxparticles = MAX_PARTICLES;
 	}
 
-	particles = (particle_t *)
-			Hunk_AllocName (r_numparticles * sizeof(particle_t), "particles");
-
 	Cvar_RegisterVariable (&r_particles); //johnfitz
 	Cvar_SetCallback (&r_particles, R_SetParticleTexture_f);
 	Cvar_RegisterVariable (&r_quadparticles); //johnfitz
@@ -173,6 +208,82 @@ void R_InitParticles (void)
 	R_InitParticleTextures (); //johnfitz
 }
 
+/*
+===============
+R_GrowParticles
+
+doubles a type's arrays, up to r_maxparticles
+===============
+*/
+static void R_GrowParticles (partarrays_t *pa)
+{
+	int	max, i;
+	float	*f;
+	byte	*block;
+
+	max = pa->max ? pa->max * 2 : PARTICLES_PER_BLOCK;
+	if (max > r_maxparticles)
+		max = r_maxparticles;
+
+	block = (byte *) malloc (max * (8 * sizeof(float) + 1));
+	if (!block)
+		Sys_Error ("R_GrowParticles: couldn't allocate %d particles", max);
+
+	f = (float *) block;
+	for (i = 0; i < 3; i++)
+	{
+		memcpy (f, pa->org[i], pa->count * sizeof(float));
+		pa->org[i] = f;
+		f += max;
+		memcpy (f, pa->vel[i], pa->count * sizeof(float));
+		pa->vel[i] = f;
+		f += max;
+	}
+	memcpy (f, pa->ramp, pa->count * sizeof(float));
+	pa->ramp = f;
+	f += max;
+	memcpy (f, pa->die, pa->count * sizeof(float));
+	pa->die = f;
+	f += max;
+	memcpy (f, pa->color, pa->count);
+	pa->color = (byte *) f;
+
+	free (pa->block);
+	pa->block = block;
+	pa->max = max;
+}
+
+/*
+===============
+R_AddParticle
+
+copies p to the end of its type's arrays, false once r_maxparticles are alive
+===============
+*/
+static qboolean R_AddParticle (const particle_t *p)
+{
+	partarrays_t	*pa = &r_partarrays[p->type];
+	int		i, n;
+
+	if (r_numparticles >= r_maxparticles)
+		return false;
+	if (pa->count == pa->max)
+		R_GrowParticles (pa);
+
+	n = pa->count++;
+	for (i = 0; i < 3; i++)
+	{
+		pa->org[i][n] = p->org[i];
+		pa->vel[i][n] = p->vel[i];
+	}
+	pa->ramp[n] = p->ramp;
+	pa->die[n] = p->die;
+	pa->color[n] = (byte) p->color;
+	r_numparticles++;
+
+	return true;
+}
+
 /*
 ===============
 R_EntityParticles
@@ -189,7 +300,7 @@ float	timescale = 0.01;
 void R_EntityParticles (entity_t *ent)
 {
 	int		i;
-	particle_t	*p;
+	particle_t	p;
 	float		angle;
 	float		sp, sy, cp, cy;
 //	float		sr, cr;
@@ -210,6 +321,12 @@ void R_EntityParticles (entity_t *ent)
 		}
 	}
 
+	p.die = cl.time + 0.01;
+	p.color = 0x6f;
+	p.type = pt_explode;
+	p.ramp = 0;
+	VectorCopy (vec3_origin, p.vel);
+
 	for (i = 0; i < NUMVERTEXNORMALS; i++)
 	{
 		angle = cl.time * avelocities[i][0];
@@ -226,20 +343,12 @@ void R_EntityParticles (entity_t *ent)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		p.org[0] = ent->origin[0] + r_avertexnormals[i][0]*dist + forward[0]*beamlength;
+		p.org[1] = ent->origin[1] + r_avertexnormals[i][1]*dist + forward[1]*beamlength;
+		p.org[2] = ent->origin[2] + r_avertexnormals[i][2]*dist + forward[2]*beamlength;
+
+		if (!R_AddParticle (&p))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		p->die = cl.time + 0.01;
-		p->color = 0x6f;
-		p->type = pt_explode;
-
-		p->org[0] = ent->origin[0] + r_avertexnormals[i][0]*dist + forward[0]*beamlength;
-		p->org[1] = ent->origin[1] + r_avertexnormals[i][1]*dist + forward[1]*beamlength;
-		p->org[2] = ent->origin[2] + r_avertexnormals[i][2]*dist + forward[2]*beamlength;
 	}
 }
 
@@ -252,12 +361,9 @@ void R_ClearParticles (void)
 {
 	int		i;
 
-	free_particles = &particles[0];
-	active_particles = NULL;
-
-	for (i=0 ;i<r_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[r_numparticles-1].next = NULL;
+	for (i=0 ; i<NUM_PTYPES ; i++)
+		r_partarrays[i].count = 0;
+	r_numparticles = 0;
 }
 
 /*
@@ -271,7 +377,7 @@ void R_ReadPointFile_f (void)
 	vec3_t	org;
 	int		r;
 	int		c;
-	particle_t	*p;
+	particle_t	p;
 	char	name[MAX_QPATH];
 
 	if (cls.state != ca_connected)
@@ -296,21 +402,18 @@ void R_ReadPointFile_f (void)
 			break;
 		c++;
 
-		if (!free_particles)
+		p.die = 99999;
+		p.color = (-c)&15;
+		p.type = pt_static;
+		p.ramp = 0;
+		VectorCopy (vec3_origin, p.vel);
+		VectorCopy (org, p.org);
+
+		if (!R_AddParticle (&p))
 		{
 			Con_Printf ("Not enough free particles\n");
 			break;
 		}
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		p->die = 99999;
-		p->color = (-c)&15;
-		p->type = pt_static;
-		VectorCopy (vec3_origin, p->vel);
-		VectorCopy (org, p->org);
 	}
 
 	fclose (f);
@@ -352,38 +455,34 @@ R_ParticleExplosion
 void R_ParticleExplosion (vec3_t org)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		p->die = cl.time + 5;
-		p->color = ramp1[0];
-		p->ramp = rand()&3;
+		p.die = cl.time + 5;
+		p.color = ramp1[0];
+		p.ramp = rand()&3;
 		if (i & 1)
 		{
-			p->type = pt_explode;
+			p.type = pt_explode;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
 		else
 		{
-			p->type = pt_explode2;
+			p.type = pt_explode2;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
+
+		if (!R_AddParticle (&p))
+			return;
 	}
 }
 
@@ -395,28 +494,26 @@ R_ParticleExplosion2
 void R_ParticleExplosion2 (vec3_t org, int colorStart, int colorLength)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 	int			colorMod = 0;
 
+	p.ramp = 0;
+
 	for (i=0; i<512; i++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		p->die = cl.time + 0.3;
-		p->color = colorStart + (colorMod % colorLength);
+		p.die = cl.time + 0.3;
+		p.color = colorStart + (colorMod % colorLength);
 		colorMod++;
 
-		p->type = pt_blob;
+		p.type = pt_blob;
 		for (j=0 ; j<3 ; j++)
 		{
-			p->org[j] = org[j] + ((rand()%32)-16);
-			p->vel[j] = (rand()%512)-256;
+			p.org[j] = org[j] + ((rand()%32)-16);
+			p.vel[j] = (rand()%512)-256;
 		}
+
+		if (!R_AddParticle (&p))
+			return;
 	}
 }
 
@@ -428,39 +525,37 @@ R_BlobExplosion
 void R_BlobExplosion (vec3_t org)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
+
+	p.ramp = 0;
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		p->die = cl.time + 1 + (rand()&8)*0.05;
+		p.die = cl.time + 1 + (rand()&8)*0.05;
 
 		if (i & 1)
 		{
-			p->type = pt_blob;
-			p->color = 66 + rand()%6;
+			p.type = pt_blob;
+			p.color = 66 + rand()%6;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
 		else
 		{
-			p->type = pt_blob2;
-			p->color = 150 + rand()%6;
+			p.type = pt_blob2;
+			p.color = 150 + rand()%6;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
+
+		if (!R_AddParticle (&p))
+			return;
 	}
 }
 
@@ -472,52 +567,50 @@ R_RunParticleEffect
 void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
+
+	p.ramp = 0;
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		if (count == 1024)
 		{	// rocket explosion
-			p->die = cl.time + 5;
-			p->color = ramp1[0];
-			p->ramp = rand()&3;
+			p.die = cl.time + 5;
+			p.color = ramp1[0];
+			p.ramp = rand()&3;
 			if (i & 1)
 			{
-				p->type = pt_explode;
+				p.type = pt_explode;
 				for (j=0 ; j<3 ; j++)
 				{
-					p->org[j] = org[j] + ((rand()%32)-16);
-					p->vel[j] = (rand()%512)-256;
+					p.org[j] = org[j] + ((rand()%32)-16);
+					p.vel[j] = (rand()%512)-256;
 				}
 			}
 			else
 			{
-				p->type = pt_explode2;
+				p.type = pt_explode2;
 				for (j=0 ; j<3 ; j++)
 				{
-					p->org[j] = org[j] + ((rand()%32)-16);
-					p->vel[j] = (rand()%512)-256;
+					p.org[j] = org[j] + ((rand()%32)-16);
+					p.vel[j] = (rand()%512)-256;
 				}
 			}
 		}
 		else
 		{
-			p->die = cl.time + 0.1*(rand()%5);
-			p->color = (color&~7) + (rand()&7);
-			p->type = pt_slowgrav;
+			p.die = cl.time + 0.1*(rand()%5);
+			p.color = (color&~7) + (rand()&7);
+			p.type = pt_slowgrav;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()&15)-8);
-				p->vel[j] = dir[j]*15;// + (rand()%300)-150;
+				p.org[j] = org[j] + ((rand()&15)-8);
+				p.vel[j] = dir[j]*15;// + (rand()%300)-150;
 			}
 		}
+
+		if (!R_AddParticle (&p))
+			return;
 	}
 }
 
@@ -529,36 +622,34 @@ R_LavaSplash
 void R_LavaSplash (vec3_t org)
 {
 	int			i, j, k;
-	particle_t	*p;
+	particle_t	p;
 	float		vel;
 	vec3_t		dir;
 
+	p.ramp = 0;
+
 	for (i=-16 ; i<16 ; i++)
 		for (j=-16 ; j<16 ; j++)
 			for (k=0 ; k<1 ; k++)
 			{
-				if (!free_particles)
-					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
-
-				p->die = cl.time + 2 + (rand()&31) * 0.02;
-				p->color = 224 + (rand()&7);
-				p->type = pt_slowgrav;
+				p.die = cl.time + 2 + (rand()&31) * 0.02;
+				p.color = 224 + (rand()&7);
+				p.type = pt_slowgrav;
 
 				dir[0] = j*8 + (rand()&7);
 				dir[1] = i*8 + (rand()&7);
 				dir[2] = 256;
 
-				p->org[0] = org[0] + dir[0];
-				p->org[1] = org[1] + dir[1];
-				p->org[2] = org[2] + (rand()&63);
+				p.org[0] = org[0] + dir[0];
+				p.org[1] = org[1] + dir[1];
+				p.org[2] = org[2] + (rand()&63);
 
 				VectorNormalize (dir);
 				vel = 50 + (rand()&63);
-				VectorScale (dir, vel, p->vel);
+				VectorScale (dir, vel, p.vel);
+
+				if (!R_AddParticle (&p))
+					return;
 			}
 }
 
@@ -570,36 +661,34 @@ R_TeleportSplash
 void R_TeleportSplash (vec3_t org)
 {
 	int			i, j, k;
-	particle_t	*p;
+	particle_t	p;
 	float		vel;
 	vec3_t		dir;
 
+	p.ramp = 0;
+
 	for (i=-16 ; i<16 ; i+=4)
 		for (j=-16 ; j<16 ; j+=4)
 			for (k=-24 ; k<32 ; k+=4)
 			{
-				if (!free_particles)
-					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
-
-				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
-				p->color = 7 + (rand()&7);
-				p->type = pt_slowgrav;
+				p.die = cl.time + 0.2 + (rand()&7) * 0.02;
+				p.color = 7 + (rand()&7);
+				p.type = pt_slowgrav;
 
 				dir[0] = j*8;
 				dir[1] = i*8;
 				dir[2] = k*8;
 
-				p->org[0] = org[0] + i + (rand()&3);
-				p->org[1] = org[1] + j + (rand()&3);
-				p->org[2] = org[2] + k + (rand()&3);
+				p.org[0] = org[0] + i + (rand()&3);
+				p.org[1] = org[1] + j + (rand()&3);
+				p.org[2] = org[2] + k + (rand()&3);
 
 				VectorNormalize (dir);
 				vel = 50 + (rand()&63);
-				VectorScale (dir, vel, p->vel);
+				VectorScale (dir, vel, p.vel);
+
+				if (!R_AddParticle (&p))
+					return;
 			}
 }
 
@@ -615,7 +704,7 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	vec3_t		vec;
 	float		len;
 	int			j;
-	particle_t	*p;
+	particle_t	p;
 	int			dec;
 	static int	tracercount;
 
@@ -629,90 +718,187 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 		type -= 128;
 	}
 
+	p.ramp = 0;
+
 	while (len > 0)
 	{
 		len -= dec;
 
-		if (!free_particles)
-			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
-		VectorCopy (vec3_origin, p->vel);
-		p->die = cl.time + 2;
+		VectorCopy (vec3_origin, p.vel);
+		p.die = cl.time + 2;
 
 		switch (type)
 		{
 			case 0:	// rocket trail
-				p->ramp = (rand()&3);
-				p->color = ramp3[(int)p->ramp];
-				p->type = pt_fire;
+				p.ramp = (rand()&3);
+				p.color = ramp3[(int)p.ramp];
+				p.type = pt_fire;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 1:	// smoke smoke
-				p->ramp = (rand()&3) + 2;
-				p->color = ramp3[(int)p->ramp];
-				p->type = pt_fire;
+				p.ramp = (rand()&3) + 2;
+				p.color = ramp3[(int)p.ramp];
+				p.type = pt_fire;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 2:	// blood
-				p->type = pt_grav;
-				p->color = 67 + (rand()&3);
+				p.type = pt_grav;
+				p.color = 67 + (rand()&3);
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 3:
 			case 5:	// tracer
-				p->die = cl.time + 0.5;
-				p->type = pt_static;
+				p.die = cl.time + 0.5;
+				p.type = pt_static;
 				if (type == 3)
-					p->color = 52 + ((tracercount&4)<<1);
+					p.color = 52 + ((tracercount&4)<<1);
 				else
-					p->color = 230 + ((tracercount&4)<<1);
+					p.color = 230 + ((tracercount&4)<<1);
 
 				tracercount++;
 
-				VectorCopy (start, p->org);
+				VectorCopy (start, p.org);
 				if (tracercount & 1)
 				{
-					p->vel[0] = 30*vec[1];
-					p->vel[1] = 30*-vec[0];
+					p.vel[0] = 30*vec[1];
+					p.vel[1] = 30*-vec[0];
 				}
 				else
 				{
-					p->vel[0] = 30*-vec[1];
-					p->vel[1] = 30*vec[0];
+					p.vel[0] = 30*-vec[1];
+					p.vel[1] = 30*vec[0];
 				}
 				break;
 
 			case 4:	// slight blood
-				p->type = pt_grav;
-				p->color = 67 + (rand()&3);
+				p.type = pt_grav;
+				p.color = 67 + (rand()&3);
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				len -= 3;
 				break;
 
 			case 6:	// voor trail
-				p->color = 9*16 + 8 + (rand()&3);
-				p->type = pt_static;
-				p->die = cl.time + 0.3;
+				p.color = 9*16 + 8 + (rand()&3);
+				p.type = pt_static;
+				p.die = cl.time + 0.3;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()&15)-8);
+					p.org[j] = start[j] + ((rand()&15)-8);
 				break;
+
+			default:
+				return;
 		}
 
+		if (!R_AddParticle (&p))
+			return;
+
 		VectorAdd (start, vec, start);
 	}
 }
 
+/*
+===============
+R_ParticleMA -- dst[i] += src[i] * scale
+===============
+*/
+static void R_ParticleMA (float *dst, const float *src, float scale, int count)
+{
+	int	i = 0;
+#ifdef PART_SSE2
+	__m128	s = _mm_set1_ps (scale);
+
+	for ( ; i + 8 <= count; i += 8)
+	{
+		_mm_storeu_ps (dst + i,     _mm_add_ps (_mm_loadu_ps (dst + i),     _mm_mul_ps (_mm_loadu_ps (src + i),     s)));
+		_mm_storeu_ps (dst + i + 4, _mm_add_ps (_mm_loadu_ps (dst + i + 4), _mm_mul_ps (_mm_loadu_ps (src + i + 4), s)));
+	}
+#endif
+	for ( ; i < count; i++)
+		dst[i] += src[i] * scale;
+}
+
+/*
+===============
+R_ParticleAdd -- dst[i] += add
+===============
+*/
+static void R_ParticleAdd (float *dst, float add, int count)
+{
+	int	i = 0;
+#ifdef PART_SSE2
+	__m128	a = _mm_set1_ps (add);
+
+	for ( ; i + 8 <= count; i += 8)
+	{
+		_mm_storeu_ps (dst + i,     _mm_add_ps (_mm_loadu_ps (dst + i),     a));
+		_mm_storeu_ps (dst + i + 4, _mm_add_ps (_mm_loadu_ps (dst + i + 4), a));
+	}
+#endif
+	for ( ; i < count; i++)
+		dst[i] += add;
+}
+
+/*
+===============
+R_ParticleRamp
+
+advances the ramp, kills the particles that ran off the end and colors the rest
+===============
+*/
+static void R_ParticleRamp (partarrays_t *pa, float step, const int *ramp, float end)
+{
+	int	i;
+
+	R_ParticleAdd (pa->ramp, step, pa->count);
+	for (i = 0; i < pa->count; i++)
+	{
+		if (pa->ramp[i] >= end)
+			pa->die[i] = -1;
+		else
+			pa->color[i] = ramp[(int)pa->ramp[i]];
+	}
+}
+
+/*
+===============
+R_KillParticles
+
+drops the dead particles of a type, keeping the order of the rest
+===============
+*/
+static void R_KillParticles (partarrays_t *pa)
+{
+	int	i, j, k;
+
+	for (i = 0; i < pa->count && pa->die[i] >= cl.time; i++)
+		;
+
+	for (j = i; i < pa->count; i++)
+	{
+		if (pa->die[i] < cl.time)
+			continue;
+		for (k = 0; k < 3; k++)
+		{
+			pa->org[k][j] = pa->org[k][i];
+			pa->vel[k][j] = pa->vel[k][i];
+		}
+		pa->ramp[j] = pa->ramp[i];
+		pa->die[j] = pa->die[i];
+		pa->color[j] = pa->color[i];
+		j++;
+	}
+
+	r_numparticles -= pa->count - j;
+	pa->count = j;
+}
+
 /*
 ===============
 CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
@@ -720,8 +906,8 @@ CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawP
 */
 void CL_RunParticles (void)
 {
-	particle_t		*p, *kill;
-	int				i;
+	partarrays_t	*pa;
+	int				type, i, n;
 	float			time1, time2, time3, dvel, frametime, grav;
 	extern	cvar_t	sv_gravity;
 
@@ -732,88 +918,55 @@ void CL_RunParticles (void)
 	grav = frametime * sv_gravity.value * 0.05;
 	dvel = 4*frametime;
 
-	for ( ;; )
+	for (type = 0; type < NUM_PTYPES; type++)
 	{
-		kill = active_particles;
-		if (kill && kill->die < cl.time)
-		{
-			active_particles = kill->next;
-			kill->next = free_particles;
-			free_particles = kill;
+		pa = &r_partarrays[type];
+		R_KillParticles (pa);
+		n = pa->count;
+		if (!n)
 			continue;
-		}
-		break;
-	}
 
-	for (p=active_particles ; p ; p=p->next)
-	{
-		for ( ;; )
-		{
-			kill = p->next;
-			if (kill && kill->die < cl.time)
-			{
-				p->next = kill->next;
-				kill->next = free_particles;
-				free_particles = kill;
-				continue;
-			}
-			break;
-		}
-
-		p->org[0] += p->vel[0]*frametime;
-		p->org[1] += p->vel[1]*frametime;
-		p->org[2] += p->vel[2]*frametime;
+		for (i=0 ; i<3 ; i++)
+			R_ParticleMA (pa->org[i], pa->vel[i], frametime, n);
 
-		switch (p->type)
+		switch (type)
 		{
 		case pt_static:
 			break;
 		case pt_fire:
-			p->ramp += time1;
-			if (p->ramp >= 6)
-				p->die = -1;
-			else
-				p->color = ramp3[(int)p->ramp];
-			p->vel[2] += grav;
+			R_ParticleRamp (pa, time1, ramp3, 6);
+			R_ParticleAdd (pa->vel[2], grav, n);
 			break;
 
 		case pt_explode:
-			p->ramp += time2;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp1[(int)p->ramp];
+			R_ParticleRamp (pa, time2, ramp1, 8);
 			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
+				R_ParticleMA (pa->vel[i], pa->vel[i], dvel, n);
+			R_ParticleAdd (pa->vel[2], -grav, n);
 			break;
 
 		case pt_explode2:
-			p->ramp += time3;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp2[(int)p->ramp];
+			R_ParticleRamp (pa, time3, ramp2, 8);
 			for (i=0 ; i<3 ; i++)
-				p->vel[i] -= p->vel[i]*frametime;
-			p->vel[2] -= grav;
+				R_ParticleMA (pa->vel[i], pa->vel[i], -frametime, n);
+			R_ParticleAdd (pa->vel[2], -grav, n);
 			break;
 
 		case pt_blob:
 			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
+				R_ParticleMA (pa->vel[i], pa->vel[i], dvel, n);
+			R_ParticleAdd (pa->vel[2], -grav, n);
 			break;
 
 		case pt_blob2:
 			for (i=0 ; i<2 ; i++)
-				p->vel[i] -= p->vel[i]*dvel;
-			p->vel[2] -= grav;
+				R_ParticleMA (pa->vel[i], pa->vel[i], -dvel, n);
+			R_ParticleAdd (pa->vel[2], -grav, n);
 			break;
 
 		case pt_grav:
 		case pt_slowgrav:
-			p->vel[2] -= grav;
+			R_ParticleAdd (pa->vel[2], -grav, n);
 			break;
 		}
 	}
@@ -821,121 +974,134 @@ void CL_RunParticles (void)
 
 /*
 ===============
-R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+R_ParticleVert
 ===============
 */
-void R_DrawParticles (void)
+static void R_ParticleVert (partvert_t *v, const vec3_t xyz, float s, float t, const byte *c)
 {
-	particle_t		*p;
-	float			scale;
-	vec3_t			up, right, p_up, p_right, p_upright; //johnfitz -- p_ vectors
-	GLubyte			color[4], *c; //johnfitz -- particle transparency
-	extern	cvar_t	r_particles; //johnfitz
-	//float			alpha; //johnfitz -- particle transparency
+	VectorCopy (xyz, v->xyz);
+	v->st[0] = s;
+	v->st[1] = t;
+	v->rgba[0] = c[0];
+	v->rgba[1] = c[1];
+	v->rgba[2] = c[2];
+	v->rgba[3] = 255;
+}
 
-	if (!r_particles.value)
-		return;
+/*
+===============
+R_BuildParticleVerts
 
-	//ericw -- avoid empty glBegin(),glEnd() pair below; causes issues on AMD
-	if (!active_particles)
-		return;
+turns every particle into a quad (or triangle) facing the view in r_partverts,
+returns the vertex count
+===============
+*/
+static int R_BuildParticleVerts (qboolean quads)
+{
+	partarrays_t	*pa;
+	partvert_t		*v;
+	float			scale, st;
+	vec3_t			org, up, right, p_up, p_right, p_upright;
+	byte			*c;
+	int				type, i, numverts;
+
+	numverts = r_numparticles * (quads ? 4 : 3);
+	if (numverts > r_maxpartverts)
+	{
+		r_maxpartverts = numverts + numverts / 2;
+		r_partverts = (partvert_t *) realloc (r_partverts, r_maxpartverts * sizeof(partvert_t));
+		if (!r_partverts)
+			Sys_Error ("R_BuildParticleVerts: couldn't allocate %d vertexes", r_maxpartverts);
+	}
 
 	VectorScale (vup, 1.5, up);
 	VectorScale (vright, 1.5, right);
+	st = quads ? 0.5 : 1;
 
-	GL_Bind(particletexture);
-	glEnable (GL_BLEND);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glDepthMask (GL_FALSE); //johnfitz -- fix for particle z-buffer bug
-
-	if (r_quadparticles.value) //johnitz -- quads save fillrate
+	v = r_partverts;
+	for (type = 0; type < NUM_PTYPES; type++)
 	{
-		glBegin (GL_QUADS);
-		for (p=active_particles ; p ; p=p->next)
+		pa = &r_partarrays[type];
+		for (i = 0; i < pa->count; i++)
 		{
+			org[0] = pa->org[0][i];
+			org[1] = pa->org[1][i];
+			org[2] = pa->org[2][i];
+
 			// hack a scale up to keep particles from disapearing
-			scale = (p->org[0] - r_origin[0]) * vpn[0]
-				  + (p->org[1] - r_origin[1]) * vpn[1]
-				  + (p->org[2] - r_origin[2]) * vpn[2];
+			scale = (org[0] - r_origin[0]) * vpn[0]
+				  + (org[1] - r_origin[1]) * vpn[1]
+				  + (org[2] - r_origin[2]) * vpn[2];
 			if (scale < 20)
 				scale = 1 + 0.08; //johnfitz -- added .08 to be consistent
 			else
 				scale = 1 + scale * 0.004;
 
-			scale /= 2.0; //quad is half the size of triangle
+			if (quads)
+				scale /= 2.0; //quad is half the size of triangle
 
 			scale *= texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
 
-			//johnfitz -- particle transparency and fade out
-			c = (GLubyte *) &d_8to24table[(int)p->color];
-			color[0] = c[0];
-			color[1] = c[1];
-			color[2] = c[2];
-			//alpha = CLAMP(0, p->die + 0.5 - cl.time, 1);
-			color[3] = 255; //(int)(alpha * 255);
-			glColor4ubv(color);
-			//johnfitz
+			c = (byte *) &d_8to24table[pa->color[i]];
+			VectorMA (org, scale, up, p_up);
+			VectorMA (org, scale, right, p_right);
 
-			glTexCoord2f (0,0);
-			glVertex3fv (p->org);
+			R_ParticleVert (v++, org, 0, 0, c);
+			R_ParticleVert (v++, p_up, st, 0, c);
+			if (quads)
+			{
+				VectorMA (p_up, scale, right, p_upright);
+				R_ParticleVert (v++, p_upright, st, st, c);
+				R_ParticleVert (v++, p_right, 0, st, c);
+			}
+			else
+				R_ParticleVert (v++, p_right, 0, st, c);
+		}
+	}
 
-			glTexCoord2f (0.5,0);
-			VectorMA (p->org, scale, up, p_up);
-			glVertex3fv (p_up);
+	return numverts;
+}
 
-			glTexCoord2f (0.5,0.5);
-			VectorMA (p_up, scale, right, p_upright);
-			glVertex3fv (p_upright);
+/*
+===============
+R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+===============
+*/
+void R_DrawParticles (void)
+{
+	int			numverts;
+	qboolean	quads;
 
-			glTexCoord2f (0,0.5);
-			VectorMA (p->org, scale, right, p_right);
-			glVertex3fv (p_right);
+	if (!r_particles.value)
+		return;
 
-			rs_particles++; //johnfitz //FIXME: just use r_numparticles
-		}
-		glEnd ();
-	}
-	else //johnitz --  triangles save verts
-	{
-		glBegin (GL_TRIANGLES);
-		for (p=active_particles ; p ; p=p->next)
-		{
-			// hack a scale up to keep particles from disapearing
-			scale = (p->org[0] - r_origin[0]) * vpn[0]
-				  + (p->org[1] - r_origin[1]) * vpn[1]
-				  + (p->org[2] - r_origin[2]) * vpn[2];
-			if (scale < 20)
-				scale = 1 + 0.08; //johnfitz -- added .08 to be consistent
-			else
-				scale = 1 + scale * 0.004;
+	//ericw -- avoid empty draws; caused issues on AMD
+	if (!r_numparticles)
+		return;
 
-			scale *= texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
+	quads = (r_quadparticles.value != 0); //johnitz -- quads save fillrate, triangles save verts
+	numverts = R_BuildParticleVerts (quads);
 
-			//johnfitz -- particle transparency and fade out
-			c = (GLubyte *) &d_8to24table[(int)p->color];
-			color[0] = c[0];
-			color[1] = c[1];
-			color[2] = c[2];
-			//alpha = CLAMP(0, p->die + 0.5 - cl.time, 1);
-			color[3] = 255; //(int)(alpha * 255);
-			glColor4ubv(color);
-			//johnfitz
+	GL_Bind(particletexture);
+	glEnable (GL_BLEND);
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glDepthMask (GL_FALSE); //johnfitz -- fix for particle z-buffer bug
 
-			glTexCoord2f (0,0);
-			glVertex3fv (p->org);
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0); // vertexes come from client memory
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+	glVertexPointer (3, GL_FLOAT, sizeof(partvert_t), r_partverts->xyz);
+	glTexCoordPointer (2, GL_FLOAT, sizeof(partvert_t), r_partverts->st);
+	glColorPointer (4, GL_UNSIGNED_BYTE, sizeof(partvert_t), r_partverts->rgba);
 
-			glTexCoord2f (1,0);
-			VectorMA (p->org, scale, up, p_up);
-			glVertex3fv (p_up);
+	glDrawArrays (quads ? GL_QUADS : GL_TRIANGLES, 0, numverts);
 
-			glTexCoord2f (0,1);
-			VectorMA (p->org, scale, right, p_right);
-			glVertex3fv (p_right);
+	glDisableClientState (GL_COLOR_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState (GL_VERTEX_ARRAY);
 
-			rs_particles++; //johnfitz //FIXME: just use r_numparticles
-		}
-		glEnd ();
-	}
+	rs_particles += r_numparticles; //johnfitz
 
 	glDepthMask (GL_TRUE); //johnfitz -- fix for particle z-buffer bug
 	glDisable (GL_BLEND);
@@ -951,75 +1117,21 @@ R_DrawParticles_ShowTris -- johnfitz
 */
 void R_DrawParticles_ShowTris (void)
 {
-	particle_t		*p;
-	float			scale;
-	vec3_t			up, right, p_up, p_right, p_upright;
-	extern	cvar_t	r_particles;
+	int			numverts;
+	qboolean	quads;
 
 	if (!r_particles.value)
 		return;
 
-	VectorScale (vup, 1.5, up);
-	VectorScale (vright, 1.5, right);
-
-	if (r_quadparticles.value)
-	{
-		for (p=active_particles ; p ; p=p->next)
-		{
-			glBegin (GL_TRIANGLE_FAN);
-
-			// hack a scale up to keep particles from disapearing
-			scale = (p->org[0] - r_origin[0]) * vpn[0]
-				  + (p->org[1] - r_origin[1]) * vpn[1]
-				  + (p->org[2] - r_origin[2]) * vpn[2];
-			if (scale < 20)
-				scale = 1 + 0.08; //johnfitz -- added .08 to be consistent
-			else
-				scale = 1 + scale * 0.004;
-
-			scale /= 2.0; //quad is half the size of triangle
-
-			scale *= texturescalefactor; //compensate for apparent size of different particle textures
-
-			glVertex3fv (p->org);
-
-			VectorMA (p->org, scale, up, p_up);
-			glVertex3fv (p_up);
-
-			VectorMA (p_up, scale, right, p_upright);
-			glVertex3fv (p_upright);
-
-			VectorMA (p->org, scale, right, p_right);
-			glVertex3fv (p_right);
-
-			glEnd ();
-		}
-	}
-	else
-	{
-		glBegin (GL_TRIANGLES);
-		for (p=active_particles ; p ; p=p->next)
-		{
-			// hack a scale up to keep particles from disapearing
-			scale = (p->org[0] - r_origin[0]) * vpn[0]
-				  + (p->org[1] - r_origin[1]) * vpn[1]
-				  + (p->org[2] - r_origin[2]) * vpn[2];
-			if (scale < 20)
-				scale = 1 + 0.08; //johnfitz -- added .08 to be consistent
-			else
-				scale = 1 + scale * 0.004;
-
-			scale *= texturescalefactor; //compensate for apparent size of different particle textures
-
-			glVertex3fv (p->org);
+	if (!r_numparticles)
+		return;
 
-			VectorMA (p->org, scale, up, p_up);
-			glVertex3fv (p_up);
+	quads = (r_quadparticles.value != 0);
+	numverts = R_BuildParticleVerts (quads);
 
-			VectorMA (p->org, scale, right, p_right);
-			glVertex3fv (p_right);
-		}
-		glEnd ();
-	}
+	GL_BindBuffer (GL_ARRAY_BUFFER, 0);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glVertexPointer (3, GL_FLOAT, sizeof(partvert_t), r_partverts->xyz);
+	glDrawArrays (quads ? GL_QUADS : GL_TRIANGLES, 0, numverts);
+	glDisableClientState (GL_VERTEX_ARRAY);
 }
-
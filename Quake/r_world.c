@@ -83,6 +83,8 @@ void R_MarkSurfaces (void)
 	int			i, j;
 	qboolean	nearwaterportal;
 
+	PROF_BEGIN ("R_MarkSurfaces");
+
 	// clear lightmap chains
 	for (i=0 ; i<lightmap_count ; i++)
 		lightmap[i].polys = NULL;
@@ -110,6 +112,7 @@ void R_MarkSurfaces (void)
 			if (vis[i>>3] & (1<<(i&7)))
 				if (leaf->efrags)
 					R_StoreEfrags (&leaf->efrags);
+		PROF_END ();
 		return;
 	}
 
@@ -162,6 +165,8 @@ void R_MarkSurfaces (void)
 		}
 	}
 #endif
+
+	PROF_END ();
 }
 
 /*
@@ -263,6 +268,8 @@ void R_BuildLightmapChains (qmodel_t *model, texchain_t chain)
 			if (!s->culled)
 				R_RenderDynamicLightmaps (s);
 	}
+
+	R_FlushDynamicLightmaps ();
 }
 
 //==============================================================================
@@ -481,6 +488,7 @@ static void R_FlushBatch ()
 	{
 		glDrawElements (GL_TRIANGLES, num_vbo_indices, GL_UNSIGNED_INT, vbo_indices);
 		num_vbo_indices = 0;
+		rs_brushbatches++;
 	}
 }
 
@@ -1021,7 +1029,9 @@ R_DrawWorld -- johnfitz -- rewritten
 void R_DrawTextureChains (qmodel_t *model, entity_t *ent, texchain_t chain)
 {
 	float entalpha;
-	
+
+	PROF_BEGIN ("R_DrawTextureChains");
+
 	if (ent != NULL)
 		entalpha = ENTALPHA_DECODE(ent->alpha);
 	else
@@ -1040,6 +1050,7 @@ void R_DrawTextureChains (qmodel_t *model, entity_t *ent, texchain_t chain)
 		glDisable (GL_TEXTURE_2D);
 		R_DrawTextureChains_Drawflat (model, chain);
 		glEnable (GL_TEXTURE_2D);
+		PROF_END ();
 		return;
 	}
 
@@ -1065,6 +1076,7 @@ void R_DrawTextureChains (qmodel_t *model, entity_t *ent, texchain_t chain)
 			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 		}
 		R_DrawTextureChains_White (model, chain);
+		PROF_END ();
 		return;
 	}
 
@@ -1078,6 +1090,7 @@ void R_DrawTextureChains (qmodel_t *model, entity_t *ent, texchain_t chain)
 		R_EndTransparentDrawing (entalpha);
 		
 		R_DrawTextureChains_GLSL (model, ent, chain);
+		PROF_END ();
 		return;
 	}
 
@@ -1193,6 +1206,8 @@ fullbrights:
 		glDisable (GL_BLEND);
 		glDepthMask (GL_TRUE);
 	}
+
+	PROF_END ();
 }
 
 /*
@@ -111,6 +111,9 @@ typedef struct client_s
 
 // client known data for deltas
 	int				old_frags;
+
+	qboolean		deltaentities;		// send svc_deltaentities
+	int				deltaframe;			// last snapshot acknowledged, 0 for none
 } client_t;
 
 
@@ -185,6 +188,8 @@ extern	cvar_t	coop;
 extern	cvar_t	fraglimit;
 extern	cvar_t	timelimit;
 
+extern	cvar_t	sv_deltaentities;
+
 extern	server_static_t	svs;				// persistant server info
 extern	server_t		sv;					// local server
 
@@ -204,6 +209,14 @@ void SV_DropClient (qboolean crash);
 
 void SV_SendClientMessages (void);
 void SV_ClearDatagram (void);
+void SV_InvalidateEntityVis (void);
+
+void SV_ClearSnapshots (client_t *client);
+void SV_WriteEntityDeltas (client_t *client, sizebuf_t *msg);
+void SV_WriteAllEntities (sizebuf_t *msg);
+
+void SV_WriteServerinfo (client_t *client, sizebuf_t *msg);
+void SV_WriteSpawnState (client_t *client, sizebuf_t *msg);
 
 int SV_ModelIndex (const char *name);
 
@@ -218,6 +231,7 @@ void SV_ClientPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 void SV_BroadcastPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 
 void SV_Physics (void);
+void SV_ParallelStats_f (void);
 
 qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
@@ -231,5 +245,16 @@ void SV_RunClients (void);
 void SV_SaveSpawnparms ();
 void SV_SpawnServer (const char *server);
 
+// sv_demo.c
+extern	qboolean	sv_demorecording;
+
+void SV_InitDemo (void);
+void SV_StopDemo (void);
+void SV_DemoStartSignon (client_t *client);
+void SV_DemoBeginFrame (void);
+void SV_DemoClientData (client_t *client, const byte *data, int len);
+void SV_DemoReliable (client_t *client);
+void SV_DemoEndFrame (void);
+
 #endif	/* _QUAKE_SERVER_H */
 
@@ -34,6 +34,13 @@ static void S_SoundList (void);
 static void S_Update_ (void);
 void S_StopAllSounds (qboolean clear);
 static void S_StopAllSoundsC (void);
+static void S_StartMixerThread (void);
+static void S_StopMixerThread (void);
+static void S_SyncChannel (int i);
+static void S_SyncStart (int i, sfxcache_t *sc);
+static void S_SyncStopAll (void);
+static void S_SyncChannels (void);
+static void S_MixerWrapped (void);
 
 // =======================================================================
 // Internal sound data & structures
@@ -45,6 +52,8 @@ int		total_channels;
 static int	snd_blocked = 0;
 static qboolean	snd_initialized = false;
 
+static SDL_Thread	*snd_mixthread;	// snd_asyncmix is running
+
 static dma_t	sn;
 volatile dma_t	*shm = NULL;
 
@@ -87,12 +96,15 @@ cvar_t		snd_mixspeed = {"snd_mixspeed", "44100", CVAR_NONE};
 
 cvar_t		snd_filterquality = {"snd_filterquality", SND_FILTERQUALITY_DEFAULT,
 								 CVAR_NONE};
+cvar_t		snd_mixfloat = {"snd_mixfloat", "1", CVAR_ARCHIVE};
+cvar_t		snd_mixthreads = {"snd_mixthreads", "0", CVAR_ARCHIVE};
 
 static	cvar_t	nosound = {"nosound", "0", CVAR_NONE};
 static	cvar_t	ambient_level = {"ambient_level", "0.3", CVAR_NONE};
 static	cvar_t	ambient_fade = {"ambient_fade", "100", CVAR_NONE};
 static	cvar_t	snd_noextraupdate = {"snd_noextraupdate", "0", CVAR_NONE};
 static	cvar_t	snd_show = {"snd_show", "0", CVAR_NONE};
+static	cvar_t	snd_asyncmix = {"snd_asyncmix", "1", CVAR_ARCHIVE};
 static	cvar_t	_snd_mixahead = {"_snd_mixahead", "0.1", CVAR_ARCHIVE};
 
 
@@ -116,7 +128,17 @@ static void S_SoundInfo_f (void)
 
 static void SND_Callback_sfxvolume (cvar_t *var)
 {
+	S_LockMixer ();
 	SND_InitScaletable ();
+	S_UnlockMixer ();
+}
+
+static void SND_Callback_snd_asyncmix (cvar_t *var)
+{
+	if (var->value)
+		S_StartMixerThread ();
+	else
+		S_StopMixerThread ();
 }
 
 static void SND_Callback_snd_filterquality (cvar_t *var)
@@ -182,6 +204,11 @@ void S_Init (void)
 	Cvar_RegisterVariable(&sndspeed);
 	Cvar_RegisterVariable(&snd_mixspeed);
 	Cvar_RegisterVariable(&snd_filterquality);
+	Cvar_RegisterVariable(&snd_mixfloat);
+	Cvar_RegisterVariable(&snd_mixthreads);
+	Cvar_RegisterVariable(&snd_asyncmix);
+	Cvar_RegisterVariable(&snd_cachesize);
+	Cvar_RegisterVariable(&snd_streamlength);
 	
 	if (safemode || COM_CheckParm("-nosound"))
 		return;
@@ -193,6 +220,7 @@ void S_Init (void)
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_mixbench", SND_MixBench_f);
 
 	i = COM_CheckParm("-sndspeed");
 	if (i && i < com_argc-1)
@@ -214,6 +242,7 @@ void S_Init (void)
 
 	Cvar_SetCallback(&sfxvolume, SND_Callback_sfxvolume);
 	Cvar_SetCallback(&snd_filterquality, &SND_Callback_snd_filterquality);
+	Cvar_SetCallback(&snd_asyncmix, SND_Callback_snd_asyncmix);
 
 	SND_InitScaletable ();
 
@@ -226,6 +255,8 @@ void S_Init (void)
 	if (sound_started == 0)
 		return;
 
+	S_InitSoundCache ();
+
 // provides a tick sound until washed clean
 //	if (shm->buffer)
 //		shm->buffer[4] = shm->buffer[5] = 0x7f;	// force a pop for debugging
@@ -236,6 +267,9 @@ void S_Init (void)
 	S_CodecInit ();
 
 	S_StopAllSounds (true);
+
+	if (snd_asyncmix.value)
+		S_StartMixerThread ();
 }
 
 
@@ -247,6 +281,9 @@ void S_Shutdown (void)
 	if (!sound_started)
 		return;
 
+	S_StopMixerThread ();
+	S_ShutdownSoundCache ();
+
 	sound_started = 0;
 	snd_blocked = 0;
 
@@ -313,7 +350,7 @@ void S_TouchSound (const char *name)
 		return;
 
 	sfx = S_FindName (name);
-	Cache_Check (&sfx->cache);
+	S_CachedSound (sfx);
 }
 
 /*
@@ -331,9 +368,9 @@ sfx_t *S_PrecacheSound (const char *name)
 
 	sfx = S_FindName (name);
 
-// cache it in
+// have the loader cache it in
 	if (precache.value)
-		S_LoadSound (sfx);
+		S_QueueSound (sfx);
 
 	return sfx;
 }
@@ -458,6 +495,9 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 	if (nosound.value)
 		return;
 
+	if (cls.demoseeking)
+		return;		// skipping through a demo, nothing is heard
+
 // pick a channel to play on
 	target_chan = SND_PickChannel(entnum, entchannel);
 	if (!target_chan)
@@ -512,6 +552,9 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 			break;
 		}
 	}
+
+	if (snd_mixthread)
+		S_SyncStart (target_chan - snd_channels, sc);
 }
 
 void S_StopSound (int entnum, int entchannel)
@@ -525,11 +568,39 @@ void S_StopSound (int entnum, int entchannel)
 		{
 			snd_channels[i].end = 0;
 			snd_channels[i].sfx = NULL;
+			if (snd_mixthread)
+				S_SyncChannel (i);
 			return;
 		}
 	}
 }
 
+/*
+=================
+S_StopDynamicSounds
+
+stops the entity sounds but keeps the ambient and static channels, for
+demo playback jumping within a level
+=================
+*/
+void S_StopDynamicSounds (void)
+{
+	int	i;
+
+	if (!sound_started)
+		return;
+
+	for (i = NUM_AMBIENTS; i < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS; i++)
+	{
+		if (!snd_channels[i].sfx)
+			continue;
+		snd_channels[i].end = 0;
+		snd_channels[i].sfx = NULL;
+		if (snd_mixthread)
+			S_SyncChannel (i);
+	}
+}
+
 void S_StopAllSounds (qboolean clear)
 {
 	int		i;
@@ -547,6 +618,9 @@ void S_StopAllSounds (qboolean clear)
 
 	memset(snd_channels, 0, MAX_CHANNELS * sizeof(channel_t));
 
+	if (snd_mixthread)
+		S_SyncStopAll ();
+
 	if (clear)
 		S_ClearBuffer ();
 }
@@ -563,9 +637,14 @@ void S_ClearBuffer (void)
 	if (!sound_started || !shm)
 		return;
 
+	S_LockMixer ();
 	SNDDMA_LockBuffer ();
 	if (! shm->buffer)
+	{
+		SNDDMA_Submit ();
+		S_UnlockMixer ();
 		return;
+	}
 
 	s_rawend = 0;
 
@@ -577,6 +656,7 @@ void S_ClearBuffer (void)
 	memset(shm->buffer, clear, shm->samples * shm->samplebits / 8);
 
 	SNDDMA_Submit ();
+	S_UnlockMixer ();
 }
 
 
@@ -619,6 +699,9 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	ss->end = paintedtime + sc->length;
 
 	SND_Spatialize (ss);
+
+	if (snd_mixthread)
+		S_SyncStart (ss - snd_channels, sc);
 }
 
 
@@ -695,6 +778,9 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 	float scale;
 	int intVolume;
 
+// s_rawend and the samples are shared with the mixer thread
+	S_LockMixer ();
+
 	if (s_rawend < paintedtime)
 		s_rawend = paintedtime;
 
@@ -761,6 +847,8 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data, f
 			s_rawsamples [dst].right = (((byte *) data)[src] - 128) * intVolume;
 		}
 	}
+
+	S_UnlockMixer ();
 }
 
 /*
@@ -780,11 +868,16 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
+	PROF_BEGIN ("S_Update");
+
 	VectorCopy(origin, listener_origin);
 	VectorCopy(forward, listener_forward);
 	VectorCopy(right, listener_right);
 	VectorCopy(up, listener_up);
 
+// take in what the loader has decoded
+	S_UpdateLoading ();
+
 // update general area ambient sound sources
 	S_UpdateAmbientSounds ();
 
@@ -862,9 +955,11 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 
 // mix some sound
 	S_Update_();
+
+	PROF_END ();
 }
 
-static void GetSoundtime (void)
+static void GetSoundtime (qboolean mainthread)
 {
 	int		samplepos;
 	static	int		buffers;
@@ -885,7 +980,10 @@ static void GetSoundtime (void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds (true);
+			if (mainthread)
+				S_StopAllSounds (true);
+			else
+				S_MixerWrapped ();
 		}
 	}
 	oldsamplepos = samplepos;
@@ -897,23 +995,30 @@ void S_ExtraUpdate (void)
 {
 	if (snd_noextraupdate.value)
 		return;		// don't pollute timings
+	if (snd_mixthread)
+		return;		// mixing doesn't wait for us
 	S_Update_();
 }
 
-static void S_Update_ (void)
+/*
+============
+S_MixAhead
+
+mixes up to _snd_mixahead past the DMA position, on the main thread or
+with snd_mixlock held on the mixer thread
+============
+*/
+static void S_MixAhead (channel_t *channels, int numchannels, qboolean mainthread)
 {
 	unsigned int	endtime;
 	int		samps;
 
-	if (!sound_started || (snd_blocked > 0))
-		return;
-
 	SNDDMA_LockBuffer ();
 	if (! shm->buffer)
 		return;
 
 // Updates DMA time
-	GetSoundtime();
+	GetSoundtime(mainthread);
 
 // check to make sure that we haven't overshot
 	if (paintedtime < soundtime)
@@ -927,11 +1032,22 @@ static void S_Update_ (void)
 	samps = shm->samples >> (shm->channels - 1);
 	endtime = q_min(endtime, (unsigned int)(soundtime + samps));
 
-	S_PaintChannels (endtime);
+	S_PaintChannels (channels, numchannels, endtime, mainthread);
 
 	SNDDMA_Submit ();
 }
 
+static void S_Update_ (void)
+{
+	if (!sound_started || (snd_blocked > 0))
+		return;
+
+	if (snd_mixthread)
+		S_SyncChannels ();
+	else
+		S_MixAhead (snd_channels, total_channels, true);
+}
+
 void S_BlockSound (void)
 {
 /* FIXME: do we really need the blocking at the
@@ -961,6 +1077,331 @@ void S_UnblockSound (void)
 /*
 ===============================================================================
 
+MIXER THREAD
+
+With snd_asyncmix the mixing runs on a thread of its own, so the DMA
+buffer stays topped up however long a frame takes and the frame doesn't
+pay for the mixing. The thread owns paintedtime and its own copy of the
+channels. The main thread still decides what plays in snd_channels and
+sends the changes through a single producer, single consumer ring:
+S_StartSound and S_StaticSound send starts, S_StopSound and the
+spatialization pass in S_Update send volume and sfx changes. The main
+thread keeps pos and end as estimates from paintedtime and retires
+finished one-shot sounds without telling the mixer, which stops them
+itself.
+
+The mixer plays sound data straight from the sound cache and can't load
+anything. It holds snd_mixlock while it mixes, and the cache takes the
+lock to add and free sounds, so the data can't go away under it; the
+main thread reloads evicted sounds in S_SyncChannels. Streamed
+music and buffer clears take the lock instead of going through the ring.
+
+===============================================================================
+*/
+
+#ifndef TASKS_HAVE_BARRIER
+#define	Tasks_MemoryBarrier()	/* S_StartMixerThread refuses to start */
+#endif
+
+#define	SND_MAXCOMMANDS		4096	// power of two
+
+typedef enum
+{
+	SNDCMD_START,		// start sfx at pos
+	SNDCMD_SET,		// change sfx and volume, keep the position
+	SNDCMD_STOPALL		// clear all channels, channel is the new total
+} sndcmdtype_t;
+
+typedef struct
+{
+	sndcmdtype_t	type;
+	int		channel;
+	sfx_t		*sfx;
+	int		leftvol, rightvol;
+	int		pos, length;
+} sndcmd_t;
+
+static SDL_mutex	*snd_mixlock;
+static volatile qboolean	snd_mixquit;
+static volatile qboolean	snd_mixwrapped;	// paintedtime was chopped, stop everything
+
+static channel_t	snd_mixchannels[MAX_CHANNELS];
+static int		snd_mixtotal;
+
+static sndcmd_t		snd_commands[SND_MAXCOMMANDS];
+static volatile int	snd_cmdhead;	// only written by the main thread
+static volatile int	snd_cmdtail;	// only written with snd_mixlock held
+
+// what the mixer has been told about each channel
+static struct
+{
+	sfx_t	*sfx;
+	int	leftvol, rightvol;
+} snd_sent[MAX_CHANNELS];
+
+void S_LockMixer (void)
+{
+	if (snd_mixlock)
+		SDL_LockMutex (snd_mixlock);
+}
+
+void S_UnlockMixer (void)
+{
+	if (snd_mixlock)
+		SDL_UnlockMutex (snd_mixlock);
+}
+
+/*
+============
+S_RunCommands
+
+applies the queued commands to the mixer's channels, snd_mixlock held
+============
+*/
+static void S_RunCommands (void)
+{
+	int		head, tail;
+	sndcmd_t	*cmd;
+	channel_t	*ch;
+
+	head = snd_cmdhead;
+	Tasks_MemoryBarrier ();
+
+	for (tail = snd_cmdtail; tail != head; tail++)
+	{
+		cmd = &snd_commands[tail & (SND_MAXCOMMANDS - 1)];
+		ch = &snd_mixchannels[cmd->channel];
+
+		switch (cmd->type)
+		{
+		case SNDCMD_START:
+			ch->pos = cmd->pos;
+			ch->end = paintedtime + cmd->length - cmd->pos;
+			/* fall through */
+		case SNDCMD_SET:
+			ch->sfx = cmd->sfx;
+			ch->leftvol = cmd->leftvol;
+			ch->rightvol = cmd->rightvol;
+			snd_mixtotal = q_max (snd_mixtotal, cmd->channel + 1);
+			break;
+		case SNDCMD_STOPALL:
+			memset (snd_mixchannels, 0, sizeof(snd_mixchannels));
+			snd_mixtotal = cmd->channel;
+			break;
+		}
+	}
+
+	Tasks_MemoryBarrier ();
+	snd_cmdtail = tail;
+}
+
+static void S_PostCommand (sndcmdtype_t type, int channel, sfx_t *sfx, int leftvol, int rightvol, int pos, int length)
+{
+	sndcmd_t	*cmd;
+	int		head;
+
+	head = snd_cmdhead;
+	if (head - snd_cmdtail == SND_MAXCOMMANDS)
+	{	// the mixer has fallen behind, catch up for it
+		SDL_LockMutex (snd_mixlock);
+		S_RunCommands ();
+		SDL_UnlockMutex (snd_mixlock);
+	}
+
+	cmd = &snd_commands[head & (SND_MAXCOMMANDS - 1)];
+	cmd->type = type;
+	cmd->channel = channel;
+	cmd->sfx = sfx;
+	cmd->leftvol = leftvol;
+	cmd->rightvol = rightvol;
+	cmd->pos = pos;
+	cmd->length = length;
+
+	Tasks_MemoryBarrier ();
+	snd_cmdhead = head + 1;
+}
+
+/*
+============
+S_SyncChannel
+
+tells the mixer about a changed sfx or volume on channel i
+============
+*/
+static void S_SyncChannel (int i)
+{
+	channel_t	*ch = &snd_channels[i];
+
+	if (snd_sent[i].sfx == ch->sfx && snd_sent[i].leftvol == ch->leftvol && snd_sent[i].rightvol == ch->rightvol)
+		return;
+
+	snd_sent[i].sfx = ch->sfx;
+	snd_sent[i].leftvol = ch->leftvol;
+	snd_sent[i].rightvol = ch->rightvol;
+	S_PostCommand (SNDCMD_SET, i, ch->sfx, ch->leftvol, ch->rightvol, 0, 0);
+}
+
+static void S_SyncStart (int i, sfxcache_t *sc)
+{
+	channel_t	*ch = &snd_channels[i];
+
+	snd_sent[i].sfx = ch->sfx;
+	snd_sent[i].leftvol = ch->leftvol;
+	snd_sent[i].rightvol = ch->rightvol;
+	S_PostCommand (SNDCMD_START, i, ch->sfx, ch->leftvol, ch->rightvol, ch->pos, sc->length);
+}
+
+static void S_SyncStopAll (void)
+{
+	memset (snd_sent, 0, sizeof(snd_sent));
+	S_PostCommand (SNDCMD_STOPALL, total_channels, NULL, 0, 0, 0, 0);
+}
+
+/*
+============
+S_SyncChannels
+
+called every frame instead of mixing: keeps the sounds cached, advances
+the estimated positions and sends whatever changed
+============
+*/
+static void S_SyncChannels (void)
+{
+	int		i;
+	channel_t	*ch;
+	sfxcache_t	*sc;
+
+	if (snd_mixwrapped)
+	{
+		snd_mixwrapped = false;
+		S_StopAllSounds (true);
+		return;
+	}
+
+	for (i = 0, ch = snd_channels; i < total_channels; i++, ch++)
+	{
+		if (ch->sfx)
+		{
+			// ambients too, or the LRU frees them and nothing loads them again
+			if (ch->leftvol || ch->rightvol)
+				sc = S_LoadSound (ch->sfx);
+			else
+				sc = S_CachedSound (ch->sfx);
+		}
+		if (ch->sfx && i >= NUM_AMBIENTS)
+		{
+			while (sc && ch->end <= paintedtime)
+			{
+				if (sc->loopstart < 0 || sc->loopstart >= sc->length)
+				{	// done, the mixer stops it on its own
+					ch->sfx = snd_sent[i].sfx = NULL;
+					break;
+				}
+				ch->end += sc->length - sc->loopstart;
+			}
+			if (sc && ch->sfx)
+				ch->pos = sc->length - (ch->end - paintedtime);
+		}
+		S_SyncChannel (i);
+	}
+}
+
+/*
+============
+S_MixerWrapped
+
+GetSoundtime chopped paintedtime on the mixer thread
+============
+*/
+static void S_MixerWrapped (void)
+{
+	memset (snd_mixchannels, 0, sizeof(snd_mixchannels));
+	snd_mixwrapped = true;
+}
+
+static int S_MixerThread (void *unused)
+{
+	int	delay;
+
+	while (!snd_mixquit)
+	{
+		SDL_LockMutex (snd_mixlock);
+		S_RunCommands ();
+		if (snd_blocked <= 0)
+			S_MixAhead (snd_mixchannels, snd_mixtotal, false);
+		SDL_UnlockMutex (snd_mixlock);
+
+	// wake up a few times per mixahead period
+		delay = (int)(_snd_mixahead.value * 250);
+		SDL_Delay (CLAMP (1, delay, 20));
+	}
+
+	return 0;
+}
+
+static void S_StartMixerThread (void)
+{
+#ifdef TASKS_HAVE_BARRIER
+	int	i;
+
+	if (snd_mixthread || !sound_started)
+		return;
+
+	if (!snd_mixlock)
+		snd_mixlock = SDL_CreateMutex ();
+	if (!snd_mixlock)
+	{
+		Con_Printf ("Couldn't create the mixer lock\n");
+		return;
+	}
+
+	SDL_LockMutex (snd_mixlock);
+
+	memcpy (snd_mixchannels, snd_channels, sizeof(snd_mixchannels));
+	snd_mixtotal = total_channels;
+	for (i = 0; i < MAX_CHANNELS; i++)
+	{
+		snd_sent[i].sfx = snd_channels[i].sfx;
+		snd_sent[i].leftvol = snd_channels[i].leftvol;
+		snd_sent[i].rightvol = snd_channels[i].rightvol;
+	}
+	snd_cmdhead = snd_cmdtail = 0;
+	snd_mixquit = false;
+	snd_mixwrapped = false;
+
+	snd_mixthread = Tasks_CreateThread (S_MixerThread, NULL, "mixer");
+
+	SDL_UnlockMutex (snd_mixlock);
+
+	if (!snd_mixthread)
+		Con_Printf ("Couldn't start the mixer thread\n");
+#endif
+}
+
+static void S_StopMixerThread (void)
+{
+	int	i;
+
+	if (!snd_mixthread)
+		return;
+
+	snd_mixquit = true;
+	SDL_WaitThread (snd_mixthread, NULL);
+	snd_mixthread = NULL;
+
+// pick up where the mixer left off
+	S_RunCommands ();
+	for (i = 0; i < MAX_CHANNELS; i++)
+	{
+		snd_channels[i].sfx = snd_mixchannels[i].sfx;
+		snd_channels[i].pos = snd_mixchannels[i].pos;
+		snd_channels[i].end = snd_mixchannels[i].end;
+	}
+}
+
+/*
+===============================================================================
+
 console functions
 
 ===============================================================================
@@ -1020,7 +1461,7 @@ static void S_SoundList (void)
 	total = 0;
 	for (sfx = known_sfx, i = 0; i < num_sfx; i++, sfx++)
 	{
-		sc = (sfxcache_t *) Cache_Check (&sfx->cache);
+		sc = sfx->cache;
 		if (!sc)
 			continue;
 		size = sc->length*sc->width*(sc->stereo + 1);
@@ -1066,5 +1507,7 @@ void S_BeginPrecaching (void)
 
 void S_EndPrecaching (void)
 {
+	if (sound_started)
+		S_StartLoading ();
 }
 
@@ -23,56 +23,107 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 /*
-================
-ResampleSfx
-================
+===============================================================================
+
+SOUND CACHE
+
+Decoded sounds live in malloc'd memory of their own instead of the zone
+cache, so loading models and hunk allocations don't throw them out. The
+loaded sounds are kept on an LRU list and the least recently used are
+freed when they take more than snd_cachesize megabytes; sounds used in
+the last second are never freed, so the budget can be overrun while
+they play.
+
+S_PrecacheSound only queues a sound: the wav is found and its header
+parsed right away, and S_EndPrecaching hands the queue to a loader
+thread that decodes in the background. S_LoadSound takes over a queued
+sound the loader hasn't reached yet, or waits for the one it is on.
+
+Sounds longer than snd_streamlength seconds that have to be loaded on
+the spot are decoded as they play: only the start is decoded up front,
+and the mixer decodes the rest a block ahead of the channels playing it
+(S_ReadySound). Their wav stays mapped or in memory until they are
+freed.
+
+===============================================================================
 */
-static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+
+#define	SND_STREAMHEAD		0.5	// seconds decoded up front when streaming
+#define	SND_MAXLOADS		1024
+
+typedef enum
 {
-	int		outcount;
-	int		srcsample;
-	float	stepscale;
-	int		i;
-	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
+	SNDLOAD_FREE,
+	SNDLOAD_QUEUED,
+	SNDLOAD_RUNNING,
+	SNDLOAD_DONE
+} sndloadstate_t;
 
-	sc = (sfxcache_t *) Cache_Check (&sfx->cache);
-	if (!sc)
-		return;
+typedef struct sndload_s
+{
+	sfx_t		*sfx;
+	const byte	*wav;
+	byte		*filebuf;	// malloc'd file if the pak isn't mapped
+	int		filesize;
+	wavinfo_t	info;
+	sfxcache_t	*result;
+	sndloadstate_t	state;
+} sndload_t;
 
-	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
+cvar_t		snd_cachesize = {"snd_cachesize", "64", CVAR_ARCHIVE};
+cvar_t		snd_streamlength = {"snd_streamlength", "4", CVAR_ARCHIVE};
 
-	outcount = sc->length / stepscale;
-	sc->length = outcount;
-	if (sc->loopstart != -1)
-		sc->loopstart = sc->loopstart / stepscale;
+static sfx_t	snd_lru;		// sentinel of the list of loaded sounds
+static int	snd_cachebytes;		// total size of the loaded sounds
 
-	sc->speed = shm->speed;
-	if (loadas8bit.value)
-		sc->width = 1;
-	else
-		sc->width = inwidth;
-	sc->stereo = 0;
+static sndload_t	snd_loads[SND_MAXLOADS];
+static int		snd_numloads;	// queued by the main thread
+static int		snd_loadposted;	// handed to the loader
+static int		snd_loadnext;	// first one the loader hasn't looked at
 
-// resample / decimate to the current source rate
+static SDL_Thread	*snd_loader;
+static SDL_mutex	*snd_loadlock;
+static SDL_cond		*snd_loadwake;
+static SDL_cond		*snd_loaddone;
+static qboolean		snd_loadquit;
 
-	if (stepscale == 1 && inwidth == 1 && sc->width == 1)
+/*
+================
+S_DecodeSound
+
+Resamples the wav samples up to upto into sc->data, continuing where the
+last call stopped; the same steps ResampleSfx always took. Called by the
+loader, by S_LoadSound and by the mixer for streamed sounds.
+================
+*/
+void S_DecodeSound (sfxcache_t *sc, int upto)
+{
+	int		i;
+	int		srcsample;
+	int		sample, samplefrac;
+	const byte	*data = sc->source;
+
+	if (upto > sc->length)
+		upto = sc->length;
+	if (sc->decoded >= upto)
+		return;
+
+	if (sc->fracstep == 256 && sc->sourcewidth == 1 && sc->width == 1)
 	{
 // fast special case
-		for (i = 0; i < outcount; i++)
+		for (i = sc->decoded; i < upto; i++)
 			((signed char *)sc->data)[i] = (int)( (unsigned char)(data[i]) - 128);
 	}
 	else
 	{
 // general case
-		samplefrac = 0;
-		fracstep = stepscale*256;
-		for (i = 0; i < outcount; i++)
+		samplefrac = sc->decoded * sc->fracstep;
+		for (i = sc->decoded; i < upto; i++)
 		{
 			srcsample = samplefrac >> 8;
-			samplefrac += fracstep;
-			if (inwidth == 2)
-				sample = LittleShort ( ((short *)data)[srcsample] );
+			samplefrac += sc->fracstep;
+			if (sc->sourcewidth == 2)
+				sample = LittleShort ( ((const short *)data)[srcsample] );
 			else
 				sample = (int)( (unsigned char)(data[srcsample]) - 128) << 8;
 			if (sc->width == 2)
@@ -81,86 +132,464 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 				((signed char *)sc->data)[i] = sample >> 8;
 		}
 	}
-}
 
-//=============================================================================
+	sc->decoded = upto;
+}
 
 /*
-==============
-S_LoadSound
-==============
+================
+S_OpenSound
+
+finds the wav and checks its header, on the main thread
+================
 */
-sfxcache_t *S_LoadSound (sfx_t *s)
+static qboolean S_OpenSound (sfx_t *s, sndload_t *load)
 {
 	char	namebuffer[256];
 	byte	*data;
-	wavinfo_t	info;
-	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
-	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
-
-// see if still in memory
-	sc = (sfxcache_t *) Cache_Check (&s->cache);
-	if (sc)
-		return sc;
-
-//	Con_Printf ("S_LoadSound: %x\n", (int)stackbuf);
 
-// load it in
 	q_strlcpy(namebuffer, "sound/", sizeof(namebuffer));
 	q_strlcat(namebuffer, s->name, sizeof(namebuffer));
 
-//	Con_Printf ("loading %s\n",namebuffer);
-
-	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
+	// parse straight from a mapped pak if possible, the decoding only
+	// reads the data
+	load->filebuf = NULL;
+	data = (byte *) COM_MapFile(namebuffer, NULL);
+	if (!data)
+		data = load->filebuf = COM_LoadMallocFile(namebuffer, NULL);
 
 	if (!data)
 	{
 		Con_Printf ("Couldn't load %s\n", namebuffer);
-		return NULL;
+		return false;
 	}
 
-	info = GetWavinfo (s->name, data, com_filesize);
-	if (info.channels != 1)
+	load->info = GetWavinfo (s->name, data, com_filesize);
+	if (load->info.channels != 1)
 	{
 		Con_Printf ("%s is a stereo sample\n",s->name);
-		return NULL;
+		free (load->filebuf);
+		return false;
 	}
 
-	if (info.width != 1 && info.width != 2)
+	if (load->info.width != 1 && load->info.width != 2)
 	{
 		Con_Printf("%s is not 8 or 16 bit\n", s->name);
+		free (load->filebuf);
+		return false;
+	}
+
+	if (load->info.samples == 0 || (int)(load->info.samples / ((float)load->info.rate / shm->speed)) == 0)
+	{
+		Con_Printf("%s has zero samples\n", s->name);
+		free (load->filebuf);
+		return false;
+	}
+
+	load->sfx = s;
+	load->wav = data;
+	load->filesize = com_filesize;
+	load->result = NULL;
+	return true;
+}
+
+/*
+================
+S_BuildSound
+
+allocates the sfxcache_t for an opened wav and decodes it, all of it or
+only the start if it streams. doesn't touch anything shared, the loader
+runs it too
+================
+*/
+static sfxcache_t *S_BuildSound (const sndload_t *load, qboolean stream)
+{
+	const wavinfo_t	*info = &load->info;
+	float	stepscale;
+	int	outcount, width, len;
+	sfxcache_t	*sc;
+
+	stepscale = (float)info->rate / shm->speed;	// this is usually 0.5, 1, or 2
+	outcount = info->samples / stepscale;
+	width = loadas8bit.value ? 1 : info->width;
+	len = outcount * width;
+
+	sc = (sfxcache_t *) malloc (len + sizeof(sfxcache_t));
+	if (!sc)
 		return NULL;
+
+	sc->length = outcount;
+	sc->loopstart = info->loopstart;
+	if (sc->loopstart != -1)
+		sc->loopstart = sc->loopstart / stepscale;
+	sc->speed = shm->speed;
+	sc->width = width;
+	sc->stereo = 0;
+	sc->decoded = 0;
+	sc->source = load->wav + info->dataofs;
+	sc->filebuf = NULL;
+	sc->sourcewidth = info->width;
+	sc->fracstep = stepscale*256;
+	sc->size = len + sizeof(sfxcache_t);
+
+	if (stream)
+		S_DecodeSound (sc, (int)(SND_STREAMHEAD * shm->speed));
+	else
+		S_DecodeSound (sc, sc->length);
+
+	return sc;
+}
+
+static void S_FreeSound (sfx_t *s)
+{
+	sfxcache_t	*sc = s->cache;
+
+// the mixer thread may be reading it
+	S_LockMixer ();
+	s->cache = NULL;
+	S_UnlockMixer ();
+
+	s->prev->next = s->next;
+	s->next->prev = s->prev;
+	s->prev = s->next = NULL;
+
+	snd_cachebytes -= sc->size;
+	free (sc->filebuf);
+	free (sc);
+}
+
+/*
+================
+S_AddSound
+
+puts a built sound in the cache, and frees the least recently used
+sounds over snd_cachesize
+================
+*/
+static void S_AddSound (sfx_t *s, sfxcache_t *sc, const sndload_t *load)
+{
+	sfx_t	*old;
+	int	limit;
+
+	if (sc->decoded < sc->length)
+	{	// streaming, keep the file
+		sc->filebuf = load->filebuf;
+		if (sc->filebuf)
+			sc->size += load->filesize;
+	}
+	else
+	{
+		sc->source = NULL;
+		free (load->filebuf);
 	}
 
-	stepscale = (float)info.rate / shm->speed;
-	len = info.samples / stepscale;
+	S_LockMixer ();
+	s->cache = sc;
+	S_UnlockMixer ();
 
-	len = len * info.width * info.channels;
+	s->next = snd_lru.next;
+	s->prev = &snd_lru;
+	s->next->prev = s;
+	s->prev->next = s;
+	s->used = realtime;
+	snd_cachebytes += sc->size;
 
-	if (info.samples == 0 || len == 0)
+	limit = (int)(q_max (snd_cachesize.value, 1.f) * 1024 * 1024);
+	while (snd_cachebytes > limit)
 	{
-		Con_Printf("%s has zero samples\n", s->name);
+		old = snd_lru.prev;
+		if (old == &snd_lru || old == s || realtime - old->used < 1.0)
+			break;
+		S_FreeSound (old);
+	}
+}
+
+static int S_LoaderThread (void *unused)
+{
+	sndload_t	*load;
+	sfxcache_t	*sc;
+
+	SDL_LockMutex (snd_loadlock);
+	while (!snd_loadquit)
+	{
+		while (snd_loadnext < snd_loadposted && snd_loads[snd_loadnext].state != SNDLOAD_QUEUED)
+			snd_loadnext++;
+		if (snd_loadnext == snd_loadposted)
+		{
+			SDL_CondWait (snd_loadwake, snd_loadlock);
+			continue;
+		}
+
+		load = &snd_loads[snd_loadnext++];
+		load->state = SNDLOAD_RUNNING;
+		SDL_UnlockMutex (snd_loadlock);
+
+		sc = S_BuildSound (load, false);
+
+		SDL_LockMutex (snd_loadlock);
+		load->result = sc;
+		load->state = SNDLOAD_DONE;
+		SDL_CondBroadcast (snd_loaddone);
+	}
+	SDL_UnlockMutex (snd_loadlock);
+
+	return 0;
+}
+
+/*
+================
+S_FinishLoad
+
+gets a queued sound into the cache now, building it here if the loader
+hasn't started on it
+================
+*/
+static void S_FinishLoad (sndload_t *load)
+{
+	qboolean	build = false;
+
+	SDL_LockMutex (snd_loadlock);
+	if (load->state == SNDLOAD_QUEUED)
+	{
+		load->state = SNDLOAD_RUNNING;
+		build = true;
+	}
+	else
+	{
+		while (load->state == SNDLOAD_RUNNING)
+			SDL_CondWait (snd_loaddone, snd_loadlock);
+	}
+	SDL_UnlockMutex (snd_loadlock);
+
+	if (build)
+		load->result = S_BuildSound (load, false);
+
+	load->sfx->load = NULL;
+	if (load->result)
+		S_AddSound (load->sfx, load->result, load);
+	else
+		free (load->filebuf);
+
+	SDL_LockMutex (snd_loadlock);
+	load->state = SNDLOAD_FREE;
+	SDL_UnlockMutex (snd_loadlock);
+}
+
+/*
+================
+S_QueueSound
+
+called by S_PrecacheSound instead of loading
+================
+*/
+void S_QueueSound (sfx_t *s)
+{
+	sndload_t	*load;
+
+	if (s->cache || s->load)
+		return;
+	if (!snd_loader || snd_numloads == SND_MAXLOADS)
+	{
+		S_LoadSound (s);
+		return;
+	}
+
+	load = &snd_loads[snd_numloads];
+	if (!S_OpenSound (s, load))
+		return;
+
+	s->load = load;
+	SDL_LockMutex (snd_loadlock);
+	load->state = SNDLOAD_QUEUED;
+	snd_numloads++;
+	SDL_UnlockMutex (snd_loadlock);
+}
+
+/*
+================
+S_StartLoading
+
+called by S_EndPrecaching: hands the queued sounds to the loader
+================
+*/
+void S_StartLoading (void)
+{
+	if (!snd_loader)
+		return;
+
+	SDL_LockMutex (snd_loadlock);
+	snd_loadposted = snd_numloads;
+	SDL_CondSignal (snd_loadwake);
+	SDL_UnlockMutex (snd_loadlock);
+}
+
+/*
+================
+S_UpdateLoading
+
+called every frame: moves what the loader finished into the cache, and
+empties the queue once everything is through
+================
+*/
+void S_UpdateLoading (void)
+{
+	int		i;
+	qboolean	idle;
+
+	if (!snd_loader || !snd_numloads)
+		return;
+
+	idle = true;
+	SDL_LockMutex (snd_loadlock);
+	for (i = 0; i < snd_numloads; i++)
+	{
+		switch (snd_loads[i].state)	// only the main thread moves a load out of DONE
+		{
+		case SNDLOAD_DONE:
+			S_FinishLoad (&snd_loads[i]);
+			break;
+		case SNDLOAD_QUEUED:
+		case SNDLOAD_RUNNING:
+			idle = false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (idle)
+		snd_numloads = snd_loadposted = snd_loadnext = 0;
+	SDL_UnlockMutex (snd_loadlock);
+}
+
+/*
+================
+S_FlushSounds
+
+drops the queue and frees every loaded sound. has to run before the paks
+a game change closes are unmapped
+================
+*/
+void S_FlushSounds (void)
+{
+	int		i;
+	sndload_t	*load;
+
+	if (snd_loader)
+	{
+		SDL_LockMutex (snd_loadlock);
+		for (i = 0; i < snd_numloads; i++)
+		{
+			load = &snd_loads[i];
+			while (load->state == SNDLOAD_RUNNING)
+				SDL_CondWait (snd_loaddone, snd_loadlock);
+			if (load->state == SNDLOAD_FREE)
+				continue;
+			load->sfx->load = NULL;
+			free (load->result);
+			free (load->filebuf);
+			load->state = SNDLOAD_FREE;
+		}
+		snd_numloads = snd_loadposted = snd_loadnext = 0;
+		SDL_UnlockMutex (snd_loadlock);
+	}
+
+	while (snd_lru.next && snd_lru.next != &snd_lru)
+		S_FreeSound (snd_lru.next);
+}
+
+void S_InitSoundCache (void)
+{
+	snd_lru.next = snd_lru.prev = &snd_lru;
+
+	snd_loadlock = SDL_CreateMutex ();
+	snd_loadwake = SDL_CreateCond ();
+	snd_loaddone = SDL_CreateCond ();
+	if (snd_loadlock && snd_loadwake && snd_loaddone)
+		snd_loader = Tasks_CreateThread (S_LoaderThread, NULL, "soundloader");
+	if (!snd_loader)
+		Con_Printf ("Couldn't start the sound loader, loading sounds on demand\n");
+}
+
+void S_ShutdownSoundCache (void)
+{
+	S_FlushSounds ();
+
+	if (snd_loader)
+	{
+		SDL_LockMutex (snd_loadlock);
+		snd_loadquit = true;
+		SDL_CondSignal (snd_loadwake);
+		SDL_UnlockMutex (snd_loadlock);
+		SDL_WaitThread (snd_loader, NULL);
+		snd_loader = NULL;
+	}
+}
+
+/*
+================
+S_CachedSound
+
+the sound if it's loaded, without loading it
+================
+*/
+sfxcache_t *S_CachedSound (sfx_t *s)
+{
+	if (!s->cache)
 		return NULL;
+
+// move to the front of the LRU
+	s->prev->next = s->next;
+	s->next->prev = s->prev;
+	s->next = snd_lru.next;
+	s->prev = &snd_lru;
+	s->next->prev = s;
+	s->prev->next = s;
+	s->used = realtime;
+
+	return s->cache;
+}
+
+/*
+==============
+S_LoadSound
+==============
+*/
+sfxcache_t *S_LoadSound (sfx_t *s)
+{
+	sndload_t	load;
+	sfxcache_t	*sc;
+
+// see if still in memory
+	if (s->cache)
+		return S_CachedSound (s);
+
+// queued for the loader
+	if (s->load)
+	{
+		S_FinishLoad (s->load);
+		return s->cache;
 	}
 
-	sc = (sfxcache_t *) Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
-	if (!sc)
+	if (!snd_lru.next)	// sound cache isn't up
 		return NULL;
 
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-	sc->speed = info.rate;
-	sc->width = info.width;
-	sc->stereo = info.channels;
+// load it in
+	if (!S_OpenSound (s, &load))
+		return NULL;
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	sc = S_BuildSound (&load, load.info.samples > snd_streamlength.value * load.info.rate);
+	if (!sc)
+	{
+		free (load.filebuf);
+		return NULL;
+	}
+	S_AddSound (s, sc, &load);
 
 	return sc;
 }
 
-
+//=============================================================================
 
 /*
 ===============================================================================
@@ -23,6 +23,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SND_SSE2
+#include <emmintrin.h>
+#endif
+
 #define	PAINTBUFFER_SIZE	2048
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 int		snd_scaletable[32][256];
@@ -197,6 +202,7 @@ static void S_MakeBlackmanWindowKernel(float *kernel, int M, float f_c)
 typedef struct {
 	float *memory;  // kernelsize floats
 	float *kernel;  // kernelsize floats
+	float *phases;  // kernelsize floats: kernel[j], kernel[j+4], ... for j = 0..3
 	int kernelsize; // M+1, rounded up to be a multiple of 16
 	int M;			// M value used to make kernel, even
 	int parity;		// 0-3
@@ -209,6 +215,7 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 	{
 		if (filter->memory != NULL) free(filter->memory);
 		if (filter->kernel != NULL) free(filter->kernel);
+		if (filter->phases != NULL) free(filter->phases);
 
 		filter->M = M;
 		filter->f_c = f_c;
@@ -218,8 +225,18 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 		filter->kernelsize = (M + 1) + 16 - ((M + 1) % 16);
 		filter->memory = (float *) calloc(filter->kernelsize, sizeof(float));
 		filter->kernel = (float *) calloc(filter->kernelsize, sizeof(float));
+		filter->phases = (float *) calloc(filter->kernelsize, sizeof(float));
 		
 		S_MakeBlackmanWindowKernel(filter->kernel, M, f_c);
+
+	// the float filter reads the kernel one phase at a time, see
+	// S_ApplyFilterFloat
+		{
+			int i, j, taps = filter->kernelsize / 4;
+			for (j = 0; j < 4; j++)
+				for (i = 0; i < taps; i++)
+					filter->phases[j * taps + i] = filter->kernel[j + 4 * i];
+		}
 	}
 }
 
@@ -288,15 +305,14 @@ static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 
 /*
 ==============
-S_LowpassFilter
+S_SetupLowpass
 
-lowpass filters 24-bit integer samples in 'data' (stored in 32-bit ints).
+picks the kernel for snd_filterquality.
 assumes 44100Hz sample rate, and lowpasses at around 5kHz
 memory should be a zero-filled filter_t struct
 ==============
 */
-static void S_LowpassFilter(int *data, int stride, int count,
-							filter_t *memory)
+static void S_SetupLowpass(filter_t *memory)
 {
 	int M;
 	float bw, f_c;
@@ -319,6 +335,19 @@ static void S_LowpassFilter(int *data, int stride, int count,
 	f_c = (bw * 11025 / 2.0) / 44100.0;
 
 	S_UpdateFilter(memory, M, f_c);
+}
+
+/*
+==============
+S_LowpassFilter
+
+lowpass filters 24-bit integer samples in 'data' (stored in 32-bit ints).
+==============
+*/
+static void S_LowpassFilter(int *data, int stride, int count,
+							filter_t *memory)
+{
+	S_SetupLowpass(memory);
 	S_ApplyFilter(memory, data, stride, count);
 }
 
@@ -330,13 +359,74 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
-static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
+static void SND_PaintChannelFrom8 (portable_samplepair_t *pb, channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
+static void SND_PaintChannelFrom16 (portable_samplepair_t *pb, channel_t *ch, sfxcache_t *sc, int endtime, int paintbufferstart);
+static void S_PaintFloat (channel_t *channels, int numchannels, int end, qboolean canload);
+
+static filter_t	snd_filter_l, snd_filter_r;
+
+/*
+==============
+SND_PaintChannel
+
+paints ch into pb, which holds the samples from start to end, and
+restarts or stops the channel when it runs out
+==============
+*/
+static void SND_PaintChannel (portable_samplepair_t *pb, channel_t *ch, sfxcache_t *sc, int start, int end)
+{
+	int		ltime, count;
+
+	ltime = start;
+
+	while (ltime < end)
+	{	// paint up to end
+		if (ch->end < end)
+			count = ch->end - ltime;
+		else
+			count = end - ltime;
+
+		if (count > 0)
+		{
+			// the last param to SND_PaintChannelFrom is the index
+			// to start painting to in the paintbuffer, usually 0.
+			if (sc->width == 1)
+				SND_PaintChannelFrom8(pb, ch, sc, count, ltime - start);
+			else
+				SND_PaintChannelFrom16(pb, ch, sc, count, ltime - start);
+
+			ltime += count;
+		}
+
+	// if at end of loop, restart
+		if (ltime >= ch->end)
+		{
+			if (sc->loopstart >= 0)
+			{
+				ch->pos = sc->loopstart;
+				ch->end = ltime + sc->length - ch->pos;
+			}
+			else
+			{	// channel just stopped
+				ch->sfx = NULL;
+				break;
+			}
+		}
+	}
+}
+
+/*
+==============
+S_PaintChannels
 
-void S_PaintChannels (int endtime)
+mixes channels up to endtime. the mixer thread passes canload false: it
+can't load sounds, it only plays what the main thread keeps in the cache
+==============
+*/
+void S_PaintChannels (channel_t *channels, int numchannels, int endtime, qboolean canload)
 {
 	int		i;
-	int		end, ltime, count;
+	int		end;
 	channel_t	*ch;
 	sfxcache_t	*sc;
 
@@ -349,57 +439,31 @@ void S_PaintChannels (int endtime)
 		if (endtime - paintedtime > PAINTBUFFER_SIZE)
 			end = paintedtime + PAINTBUFFER_SIZE;
 
+		if (snd_mixfloat.value)
+		{
+			S_PaintFloat (channels, numchannels, end, canload);
+			S_TransferPaintBuffer(end);
+			paintedtime = end;
+			continue;
+		}
+
 	// clear the paint buffer
 		memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
 
 	// paint in the channels.
-		ch = snd_channels;
-		for (i = 0; i < total_channels; i++, ch++)
+		ch = channels;
+		for (i = 0; i < numchannels; i++, ch++)
 		{
 			if (!ch->sfx)
 				continue;
 			if (!ch->leftvol && !ch->rightvol)
 				continue;
-			sc = S_LoadSound (ch->sfx);
+			sc = canload ? S_LoadSound (ch->sfx) : ch->sfx->cache;
 			if (!sc)
 				continue;
+			S_ReadySound (sc, ch->pos + (end - paintedtime));
 
-			ltime = paintedtime;
-
-			while (ltime < end)
-			{	// paint up to end
-				if (ch->end < end)
-					count = ch->end - ltime;
-				else
-					count = end - ltime;
-
-				if (count > 0)
-				{
-					// the last param to SND_PaintChannelFrom is the index
-					// to start painting to in the paintbuffer, usually 0.
-					if (sc->width == 1)
-						SND_PaintChannelFrom8(ch, sc, count, ltime - paintedtime);
-					else
-						SND_PaintChannelFrom16(ch, sc, count, ltime - paintedtime);
-
-					ltime += count;
-				}
-
-			// if at end of loop, restart
-				if (ltime >= ch->end)
-				{
-					if (sc->loopstart >= 0)
-					{
-						ch->pos = sc->loopstart;
-						ch->end = ltime + sc->length - ch->pos;
-					}
-					else
-					{	// channel just stopped
-						ch->sfx = NULL;
-						break;
-					}
-				}
-			}
+			SND_PaintChannel (paintbuffer, ch, sc, paintedtime, end);
 		}
 
 	// clip each sample to 0dB, then reduce by 6dB (to leave some headroom for
@@ -414,9 +478,8 @@ void S_PaintChannels (int endtime)
 	// apply a lowpass filter
 		if (sndspeed.value == 11025 && shm->speed == 44100)
 		{
-			static filter_t memory_l, memory_r;
-			S_LowpassFilter((int *)paintbuffer,       2, end - paintedtime, &memory_l);
-			S_LowpassFilter(((int *)paintbuffer) + 1, 2, end - paintedtime, &memory_r);
+			S_LowpassFilter((int *)paintbuffer,       2, end - paintedtime, &snd_filter_l);
+			S_LowpassFilter(((int *)paintbuffer) + 1, 2, end - paintedtime, &snd_filter_r);
 		}
 
 	// paint in the music
@@ -469,7 +532,7 @@ void SND_InitScaletable (void)
 }
 
 
-static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
+static void SND_PaintChannelFrom8 (portable_samplepair_t *pb, channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
 {
 	int	data;
 	int		*lscale, *rscale;
@@ -488,14 +551,14 @@ static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int
 	for (i = 0; i < count; i++)
 	{
 		data = sfx[i];
-		paintbuffer[paintbufferstart + i].left += lscale[data];
-		paintbuffer[paintbufferstart + i].right += rscale[data];
+		pb[paintbufferstart + i].left += lscale[data];
+		pb[paintbufferstart + i].right += rscale[data];
 	}
 
 	ch->pos += count;
 }
 
-static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
+static void SND_PaintChannelFrom16 (portable_samplepair_t *pb, channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
 {
 	int	data;
 	int	left, right;
@@ -518,10 +581,526 @@ static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, in
 	//	right = (data * rightvol) >> 8;
 		left = data * leftvol;
 		right = data * rightvol;
-		paintbuffer[paintbufferstart + i].left += left;
-		paintbuffer[paintbufferstart + i].right += right;
+		pb[paintbufferstart + i].left += left;
+		pb[paintbufferstart + i].right += right;
 	}
 
 	ch->pos += count;
 }
 
+
+/*
+===============================================================================
+
+FLOAT MIXING
+
+snd_mixfloat paints into a float buffer instead of the integer one and
+runs the clipping and the lowpass filter in float as well; the result is
+converted back to the integer paintbuffer for S_TransferPaintBuffer. The
+levels are the same as the integer path: a 16-bit sample times the 0-255
+channel volume. Samples were already resampled to shm->speed at load
+time (ResampleSfx), so the mixer itself only scales and adds.
+
+With snd_mixthreads the channels are split into one group per worker
+thread, each group painted into its own buffer, and the buffers summed in
+group order afterwards, so the result doesn't depend on scheduling.
+
+===============================================================================
+*/
+
+#define	SND_MINTHREADCHANNELS	16	/* fewer channels aren't worth waking the workers */
+
+static float	paintbuffer_f[PAINTBUFFER_SIZE * 2];
+static float	*snd_groupbuffers;	/* MAX_TASK_WORKERS * PAINTBUFFER_SIZE * 2 */
+
+static channel_t	*snd_active[MAX_CHANNELS];
+static sfxcache_t	*snd_activecache[MAX_CHANNELS];
+
+typedef struct
+{
+	channel_t	**chans;
+	sfxcache_t	**caches;
+	int		numchans;
+	int		numgroups;
+	float		*buffers;
+	int		start, end;
+} sndmixjob_t;
+
+static void SND_MixFrom8 (float *out, const signed char *sfx, int count, float lvol, float rvol)
+{
+	int	i = 0;
+#ifdef SND_SSE2
+	__m128	lr = _mm_setr_ps (lvol, rvol, lvol, rvol);
+
+	for ( ; i + 8 <= count; i += 8, out += 16)
+	{
+		__m128i	b = _mm_loadl_epi64 ((const __m128i *)(sfx + i));
+		__m128i	w = _mm_srai_epi16 (_mm_unpacklo_epi8 (b, b), 8);
+		__m128	lo = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (w, w), 16));
+		__m128	hi = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (w, w), 16));
+		_mm_storeu_ps (out,      _mm_add_ps (_mm_loadu_ps (out),      _mm_mul_ps (_mm_unpacklo_ps (lo, lo), lr)));
+		_mm_storeu_ps (out + 4,  _mm_add_ps (_mm_loadu_ps (out + 4),  _mm_mul_ps (_mm_unpackhi_ps (lo, lo), lr)));
+		_mm_storeu_ps (out + 8,  _mm_add_ps (_mm_loadu_ps (out + 8),  _mm_mul_ps (_mm_unpacklo_ps (hi, hi), lr)));
+		_mm_storeu_ps (out + 12, _mm_add_ps (_mm_loadu_ps (out + 12), _mm_mul_ps (_mm_unpackhi_ps (hi, hi), lr)));
+	}
+#endif
+	for ( ; i < count; i++, out += 2)
+	{
+		out[0] += sfx[i] * lvol;
+		out[1] += sfx[i] * rvol;
+	}
+}
+
+static void SND_MixFrom16 (float *out, const short *sfx, int count, float lvol, float rvol)
+{
+	int	i = 0;
+#ifdef SND_SSE2
+	__m128	lr = _mm_setr_ps (lvol, rvol, lvol, rvol);
+
+	for ( ; i + 8 <= count; i += 8, out += 16)
+	{
+		__m128i	w = _mm_loadu_si128 ((const __m128i *)(sfx + i));
+		__m128	lo = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (w, w), 16));
+		__m128	hi = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (w, w), 16));
+		_mm_storeu_ps (out,      _mm_add_ps (_mm_loadu_ps (out),      _mm_mul_ps (_mm_unpacklo_ps (lo, lo), lr)));
+		_mm_storeu_ps (out + 4,  _mm_add_ps (_mm_loadu_ps (out + 4),  _mm_mul_ps (_mm_unpackhi_ps (lo, lo), lr)));
+		_mm_storeu_ps (out + 8,  _mm_add_ps (_mm_loadu_ps (out + 8),  _mm_mul_ps (_mm_unpacklo_ps (hi, hi), lr)));
+		_mm_storeu_ps (out + 12, _mm_add_ps (_mm_loadu_ps (out + 12), _mm_mul_ps (_mm_unpackhi_ps (hi, hi), lr)));
+	}
+#endif
+	for ( ; i < count; i++, out += 2)
+	{
+		out[0] += sfx[i] * lvol;
+		out[1] += sfx[i] * rvol;
+	}
+}
+
+/*
+==============
+SND_PaintChannelFloat
+
+float version of SND_PaintChannel; pb holds interleaved left/right
+samples from start to end. safe to run on a worker thread, it only
+touches ch.
+==============
+*/
+static void SND_PaintChannelFloat (float *pb, channel_t *ch, sfxcache_t *sc, int start, int end)
+{
+	int		ltime, count;
+	float		lvol, rvol;
+
+	if (sc->width == 1)
+	{
+	// same steps as snd_scaletable
+		if (ch->leftvol > 255)
+			ch->leftvol = 255;
+		if (ch->rightvol > 255)
+			ch->rightvol = 255;
+		lvol = (int)((ch->leftvol >> 3) * 8 * 256 * sfxvolume.value);
+		rvol = (int)((ch->rightvol >> 3) * 8 * 256 * sfxvolume.value);
+	}
+	else
+	{
+		lvol = ch->leftvol * snd_vol / 256;
+		rvol = ch->rightvol * snd_vol / 256;
+	}
+
+	ltime = start;
+
+	while (ltime < end)
+	{	// paint up to end
+		if (ch->end < end)
+			count = ch->end - ltime;
+		else
+			count = end - ltime;
+
+		if (count > 0)
+		{
+			if (sc->width == 1)
+				SND_MixFrom8 (pb + (ltime - start) * 2, (signed char *)sc->data + ch->pos, count, lvol, rvol);
+			else
+				SND_MixFrom16 (pb + (ltime - start) * 2, (short *)sc->data + ch->pos, count, lvol, rvol);
+
+			ch->pos += count;
+			ltime += count;
+		}
+
+	// if at end of loop, restart
+		if (ltime >= ch->end)
+		{
+			if (sc->loopstart >= 0)
+			{
+				ch->pos = sc->loopstart;
+				ch->end = ltime + sc->length - ch->pos;
+			}
+			else
+			{	// channel just stopped
+				ch->sfx = NULL;
+				break;
+			}
+		}
+	}
+}
+
+static void SND_PaintGroupTask (void *data, int index, int thread)
+{
+	sndmixjob_t	*job = (sndmixjob_t *) data;
+	float		*pb = job->buffers + index * PAINTBUFFER_SIZE * 2;
+	int		i;
+
+	memset (pb, 0, (job->end - job->start) * 2 * sizeof(float));
+	for (i = index; i < job->numchans; i += job->numgroups)
+		SND_PaintChannelFloat (pb, job->chans[i], job->caches[i], job->start, job->end);
+}
+
+/*
+==============
+SND_PaintChannelsFloat
+
+paints the given channels into pb, which has to be cleared already
+==============
+*/
+static void SND_PaintChannelsFloat (float *pb, channel_t **chans, sfxcache_t **caches, int numchans,
+				    int start, int end, qboolean threaded)
+{
+	sndmixjob_t	job;
+	int		i, j, count;
+
+	if (!threaded || numchans < SND_MINTHREADCHANNELS || Tasks_NumThreads () < 2)
+	{
+		for (i = 0; i < numchans; i++)
+			SND_PaintChannelFloat (pb, chans[i], caches[i], start, end);
+		return;
+	}
+
+	if (!snd_groupbuffers)
+	{
+		snd_groupbuffers = (float *) malloc (MAX_TASK_WORKERS * PAINTBUFFER_SIZE * 2 * sizeof(float));
+		if (!snd_groupbuffers)
+			Sys_Error ("SND_PaintChannelsFloat: out of memory");
+	}
+
+	job.chans = chans;
+	job.caches = caches;
+	job.numchans = numchans;
+	job.numgroups = q_min (Tasks_NumThreads (), MAX_TASK_WORKERS);
+	job.buffers = snd_groupbuffers;
+	job.start = start;
+	job.end = end;
+	Tasks_ParallelFor (SND_PaintGroupTask, &job, job.numgroups);
+
+	count = (end - start) * 2;
+	for (j = 0; j < job.numgroups; j++)
+	{
+		const float *gb = job.buffers + j * PAINTBUFFER_SIZE * 2;
+		for (i = 0; i < count; i++)
+			pb[i] += gb[i];
+	}
+}
+
+/*
+==============
+S_ApplyFilterFloat
+
+float version of S_ApplyFilter, same decimation. Only every 4th input
+sample counts, and which taps line up with them depends on the output
+position mod 4, so the input is decimated once and each output is a dot
+product of one of the four phases of the kernel with a contiguous run of
+it. The sums are grouped the same way as in S_ApplyFilter.
+==============
+*/
+static void S_ApplyFilterFloat(filter_t *filter, float *data, int stride, int count)
+{
+	static float input[256 + PAINTBUFFER_SIZE];
+	static float decimated[(256 + PAINTBUFFER_SIZE) / 4 + 1];
+	const int kernelsize = filter->kernelsize;
+	const int taps = kernelsize / 4;
+	int i, j, first, numdecimated;
+	int parity;
+
+	if (kernelsize > 256 || count > PAINTBUFFER_SIZE)
+		Sys_Error ("S_ApplyFilterFloat: bad size");
+
+	memcpy(input, filter->memory, kernelsize * sizeof(float));
+	for (i = 0; i < count; i++)
+		input[kernelsize + i] = data[i * stride] * (float)(1.0 / (32768.0 * 256.0));
+	memcpy(filter->memory, input + count, kernelsize * sizeof(float));
+
+	parity = filter->parity;
+
+// the kept samples are the ones at (4 - parity) mod 4
+	first = (4 - parity) & 3;
+	numdecimated = (kernelsize + count - first + 3) / 4;
+	for (i = 0; i < numdecimated; i++)
+		decimated[i] = input[first + 4 * i];
+
+	for (i = 0; i < count; i++)
+	{
+		const int phase = (4 - ((parity + i) & 3)) & 3;
+		const float *k = filter->phases + phase * taps;
+		const float *in = decimated + (i + phase - first) / 4;
+		float val;
+#ifdef SND_SSE2
+		__m128 sum = _mm_setzero_ps ();
+		float lanes[4];
+
+		for (j = 0; j < taps; j += 4)
+			sum = _mm_add_ps (sum, _mm_mul_ps (_mm_loadu_ps (k + j), _mm_loadu_ps (in + j)));
+		_mm_storeu_ps (lanes, sum);
+		val = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+		float sum[4] = {0, 0, 0, 0};
+
+		for (j = 0; j < taps; j += 4)
+		{
+			sum[0] += k[j] * in[j];
+			sum[1] += k[j+1] * in[j+1];
+			sum[2] += k[j+2] * in[j+2];
+			sum[3] += k[j+3] * in[j+3];
+		}
+		val = sum[0] + sum[1] + sum[2] + sum[3];
+#endif
+	// 4.0 makes up for the zero-filling, as in S_ApplyFilter
+		data[i * stride] = val * (float)(32768.0 * 256.0 * 4.0);
+	}
+
+	filter->parity = (parity + count) & 3;
+}
+
+static void S_ClipFloat (float *data, int count)
+{
+	int	i;
+
+	for (i = 0; i < count; i++)
+		data[i] = CLAMP(-32768.0f * 256.0f, data[i], 32767.0f * 256.0f) * 0.5f;
+}
+
+/*
+==============
+S_PaintFloat
+
+snd_mixfloat version of one S_PaintChannels block, leaves the result in
+the integer paintbuffer
+==============
+*/
+static void S_PaintFloat (channel_t *channels, int numchannels, int end, qboolean canload)
+{
+	int		i, count, numactive;
+	channel_t	*ch;
+	sfxcache_t	*sc;
+	int		*out;
+
+// S_LoadSound can hit the disk and the cache allocator, so it has to run
+// here and not in the paint tasks
+	numactive = 0;
+	ch = channels;
+	for (i = 0; i < numchannels; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		if (!ch->leftvol && !ch->rightvol)
+			continue;
+		sc = canload ? S_LoadSound (ch->sfx) : ch->sfx->cache;
+		if (!sc)
+			continue;
+		S_ReadySound (sc, ch->pos + (end - paintedtime));
+		snd_active[numactive] = ch;
+		snd_activecache[numactive] = sc;
+		numactive++;
+	}
+
+	count = end - paintedtime;
+	memset (paintbuffer_f, 0, count * 2 * sizeof(float));
+	SND_PaintChannelsFloat (paintbuffer_f, snd_active, snd_activecache, numactive,
+				paintedtime, end, snd_mixthreads.value != 0);
+
+	S_ClipFloat (paintbuffer_f, count * 2);
+
+	if (sndspeed.value == 11025 && shm->speed == 44100)
+	{
+		S_SetupLowpass (&snd_filter_l);
+		S_SetupLowpass (&snd_filter_r);
+		S_ApplyFilterFloat (&snd_filter_l, paintbuffer_f,     2, count);
+		S_ApplyFilterFloat (&snd_filter_r, paintbuffer_f + 1, 2, count);
+	}
+
+	out = (int *) paintbuffer;
+	for (i = 0; i < count * 2; i++)
+		out[i] = (int) paintbuffer_f[i];
+
+// the music is already integer, add it after the conversion
+	if (s_rawend >= paintedtime)
+	{
+		int	s, stop;
+
+		stop = (end < s_rawend) ? end : s_rawend;
+		for (i = paintedtime; i < stop; i++)
+		{
+			s = i & (MAX_RAW_SAMPLES - 1);
+			paintbuffer[i - paintedtime].left += s_rawsamples[s].left / 2;
+			paintbuffer[i - paintedtime].right += s_rawsamples[s].right / 2;
+		}
+	}
+}
+
+/*
+==============
+SND_MixBench_f
+
+snd_mixbench [channels] [seconds]: paints synthetic looping 8 and 16-bit
+channels with the integer mixer, the float mixer and the threaded float
+mixer, then runs the lowpass filter both ways. Works on private copies,
+the playing sounds are left alone.
+==============
+*/
+static void SND_BenchReset (channel_t *chans, sfxcache_t **caches, int numchans, sfxcache_t *sc8, sfxcache_t *sc16)
+{
+	int	i;
+
+	srand (numchans);
+	memset (chans, 0, numchans * sizeof(channel_t));
+	for (i = 0; i < numchans; i++)
+	{
+		caches[i] = (i & 1) ? sc16 : sc8;
+		chans[i].sfx = (sfx_t *) caches[i];	/* only tested for NULL */
+		chans[i].leftvol = 64 + rand () % 192;
+		chans[i].rightvol = 64 + rand () % 192;
+		chans[i].pos = rand () % caches[i]->length;
+		chans[i].end = caches[i]->length - chans[i].pos;
+		chans[i].looping = 0;
+	}
+}
+
+void SND_MixBench_f (void)
+{
+	int		numchans, total, length, time, end, count;
+	int		i, pass, maxdiff;
+	float		seconds;
+	double		t[3], tfilter[2];
+	sfxcache_t	*sc8, *sc16, **caches;
+	channel_t	*chans, **chanptrs;
+	portable_samplepair_t	*pbi, *last;
+	float		*pbf;
+	filter_t	fi, ff;
+
+	numchans = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 64;
+	numchans = CLAMP (1, numchans, MAX_CHANNELS);
+	seconds = (Cmd_Argc () > 2) ? atof (Cmd_Argv (2)) : 10;
+	seconds = CLAMP (0.1f, seconds, 600.f);
+
+	length = 44100;
+	total = (int)(seconds * 44100);
+
+	sc8 = (sfxcache_t *) malloc (sizeof(sfxcache_t) + length);
+	sc16 = (sfxcache_t *) malloc (sizeof(sfxcache_t) + length * 2);
+	caches = (sfxcache_t **) malloc (numchans * sizeof(sfxcache_t *));
+	chans = (channel_t *) malloc (numchans * sizeof(channel_t));
+	chanptrs = (channel_t **) malloc (numchans * sizeof(channel_t *));
+	pbi = (portable_samplepair_t *) malloc (PAINTBUFFER_SIZE * sizeof(portable_samplepair_t));
+	last = (portable_samplepair_t *) malloc (PAINTBUFFER_SIZE * sizeof(portable_samplepair_t));
+	pbf = (float *) malloc (PAINTBUFFER_SIZE * 2 * sizeof(float));
+	if (!sc8 || !sc16 || !caches || !chans || !chanptrs || !pbi || !last || !pbf)
+		Sys_Error ("SND_MixBench_f: out of memory");
+
+	srand (1);
+	sc8->length = sc16->length = length;
+	sc8->loopstart = sc16->loopstart = 0;
+	sc8->speed = sc16->speed = 44100;
+	sc8->width = 1;
+	sc16->width = 2;
+	sc8->stereo = sc16->stereo = 0;
+	sc8->decoded = sc16->decoded = length;
+	for (i = 0; i < length; i++)
+	{
+		sc8->data[i] = rand () & 255;
+		((short *)sc16->data)[i] = (rand () & 0xffff) - 0x8000;
+	}
+	for (i = 0; i < numchans; i++)
+		chanptrs[i] = &chans[i];
+
+// the mixer thread shares the group buffers and snd_vol
+	S_LockMixer ();
+
+	snd_vol = sfxvolume.value * 256;
+	maxdiff = 0;
+	count = 0;
+
+	for (pass = 0; pass < 3; pass++)
+	{
+		SND_BenchReset (chans, caches, numchans, sc8, sc16);
+		t[pass] = Sys_DoubleTime ();
+		for (time = 0; time < total; time = end)
+		{
+			end = q_min (time + PAINTBUFFER_SIZE, total);
+			count = end - time;
+			if (pass == 0)
+			{
+				memset (pbi, 0, count * sizeof(portable_samplepair_t));
+				for (i = 0; i < numchans; i++)
+					SND_PaintChannel (pbi, chans + i, caches[i], time, end);
+			}
+			else
+			{
+				memset (pbf, 0, count * 2 * sizeof(float));
+				SND_PaintChannelsFloat (pbf, chanptrs, caches, numchans, time, end, pass == 2);
+			}
+		}
+		t[pass] = Sys_DoubleTime () - t[pass];
+
+	// the last block has to come out the same every pass
+		if (pass == 0)
+			memcpy (last, pbi, count * sizeof(portable_samplepair_t));
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				maxdiff = q_max (maxdiff, abs (last[i].left - (int) pbf[i * 2]));
+				maxdiff = q_max (maxdiff, abs (last[i].right - (int) pbf[i * 2 + 1]));
+			}
+		}
+	}
+
+// filter the last block over and over, the content doesn't matter
+	memset (&fi, 0, sizeof(fi));
+	memset (&ff, 0, sizeof(ff));
+	S_SetupLowpass (&fi);
+	S_SetupLowpass (&ff);
+	tfilter[0] = Sys_DoubleTime ();
+	for (time = 0; time < total; time += count)
+	{
+		memcpy (pbi, last, count * sizeof(portable_samplepair_t));
+		S_ApplyFilter (&fi, (int *) pbi, 2, count);
+		S_ApplyFilter (&fi, (int *) pbi + 1, 2, count);
+	}
+	tfilter[0] = Sys_DoubleTime () - tfilter[0];
+	tfilter[1] = Sys_DoubleTime ();
+	for (time = 0; time < total; time += count)
+	{
+		for (i = 0; i < count * 2; i++)
+			pbf[i] = ((int *) last)[i];
+		S_ApplyFilterFloat (&ff, pbf, 2, count);
+		S_ApplyFilterFloat (&ff, pbf + 1, 2, count);
+	}
+	tfilter[1] = Sys_DoubleTime () - tfilter[1];
+
+	S_UnlockMixer ();
+
+	Con_Printf ("%d channels, %g seconds of audio, %d threads\n", numchans, total / 44100.0, Tasks_NumThreads ());
+	Con_Printf ("int mix     %7.2f ms\n", t[0] * 1000);
+	Con_Printf ("float mix   %7.2f ms\n", t[1] * 1000);
+	Con_Printf ("threaded    %7.2f ms\n", t[2] * 1000);
+	Con_Printf ("int filter  %7.2f ms\n", tfilter[0] * 1000);
+	Con_Printf ("float filter%7.2f ms\n", tfilter[1] * 1000);
+	Con_Printf ("max int/float difference %d\n", maxdiff);
+
+	free (fi.memory); free (fi.kernel); free (fi.phases);
+	free (ff.memory); free (ff.kernel); free (ff.phases);
+	free (pbf);
+	free (last);
+	free (pbi);
+	free (chanptrs);
+	free (chans);
+	free (caches);
+	free (sc16);
+	free (sc8);
+}
@@ -0,0 +1,626 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_broadphase.c -- loose grid broadphase, broadphase recording and benchmark
+
+#include "quakedef.h"
+
+/*
+sv_broadphase picks what holds the entity links for SV_LinkEdict and the
+area walks of world.c: 0 is the original area node tree, 1 a loose grid.
+It takes effect on the next map.
+
+sv_recordbroadphase saves the links, unlinks and queries of a stretch of
+play, and sv_broadphasebench replays them against every broadphase.
+*/
+
+cvar_t	sv_broadphase = {"sv_broadphase","0",CVAR_NONE};
+
+static void SV_Broadphase_f (cvar_t *var)
+{
+	if (sv.active)
+		Con_Printf ("%s takes effect on the next map\n", var->name);
+}
+
+/*
+===============================================================================
+
+LOOSE GRID
+
+The world is cut into square columns. Each link goes into the cell that
+holds the center of its box, and walks look at every cell within half a cell
+of the query box, which finds all the boxes up to a cell wide. Bigger boxes
+(mostly brush entities) are kept in lists of their own that every walk goes
+through. Unlike the area node tree, a crowd in one spot of a large open map
+doesn't end up in one long list near the root.
+
+===============================================================================
+*/
+
+#define	GRID_CELLSIZE	256
+#define	GRID_MAXSIZE	128		// cells along either axis
+
+typedef struct
+{
+	vec3_t	mins;
+	float	cellsize, invcell;
+	int		width, height;
+	int		numcells;
+	link_t	*solid, *trigger;		// numcells each
+	link_t	bigsolid, bigtrigger;	// boxes too large for a cell
+} areagrid_t;
+
+static void Grid_Clear (broadphase_t *bp, vec3_t mins, vec3_t maxs)
+{
+	areagrid_t	*grid;
+	float		size;
+	int			i;
+
+	if (!bp->state)
+	{
+		bp->state = calloc (1, sizeof(areagrid_t));
+		if (!bp->state)
+			Sys_Error ("Grid_Clear: out of memory");
+	}
+	grid = (areagrid_t *) bp->state;
+
+	size = q_max (maxs[0] - mins[0], maxs[1] - mins[1]);
+	grid->cellsize = q_max ((float)GRID_CELLSIZE, size / GRID_MAXSIZE);
+	grid->invcell = 1.0f / grid->cellsize;
+	grid->width = CLAMP (1, (int) ceil ((maxs[0] - mins[0]) * grid->invcell), GRID_MAXSIZE);
+	grid->height = CLAMP (1, (int) ceil ((maxs[1] - mins[1]) * grid->invcell), GRID_MAXSIZE);
+	VectorCopy (mins, grid->mins);
+
+	if (grid->numcells != grid->width * grid->height)
+	{
+		free (grid->solid);
+		grid->numcells = grid->width * grid->height;
+		grid->solid = (link_t *) malloc (2 * grid->numcells * sizeof(link_t));
+		if (!grid->solid)
+			Sys_Error ("Grid_Clear: out of memory");
+		grid->trigger = grid->solid + grid->numcells;
+	}
+
+	for (i=0 ; i<grid->numcells ; i++)
+	{
+		ClearLink (&grid->solid[i]);
+		ClearLink (&grid->trigger[i]);
+	}
+	ClearLink (&grid->bigsolid);
+	ClearLink (&grid->bigtrigger);
+}
+
+static void Grid_Free (broadphase_t *bp)
+{
+	areagrid_t	*grid = (areagrid_t *) bp->state;
+
+	if (grid)
+		free (grid->solid);
+	free (grid);
+	bp->state = NULL;
+}
+
+// clamps to the border cells, so boxes out of the world still get found
+static int Grid_Cell (float v, float origin, float invcell, int size)
+{
+	float	f;
+
+	f = (v - origin) * invcell;
+	if (!(f >= 0))
+		return 0;	// NaNs too
+	if (f >= size)
+		return size - 1;
+	return (int) f;
+}
+
+static void Grid_Link (broadphase_t *bp, link_t *l, vec3_t absmin, vec3_t absmax, qboolean trigger)
+{
+	areagrid_t	*grid = (areagrid_t *) bp->state;
+	float		sizex, sizey;
+	int			x, y;
+
+	sizex = absmax[0] - absmin[0];
+	sizey = absmax[1] - absmin[1];
+
+	// a unit of slack against rounding of the center
+	if (!(sizex <= grid->cellsize - 2 && sizey <= grid->cellsize - 2))
+	{
+		InsertLinkBefore (l, trigger ? &grid->bigtrigger : &grid->bigsolid);
+		return;
+	}
+
+	x = Grid_Cell ((absmin[0] + absmax[0]) * 0.5f, grid->mins[0], grid->invcell, grid->width);
+	y = Grid_Cell ((absmin[1] + absmax[1]) * 0.5f, grid->mins[1], grid->invcell, grid->height);
+	InsertLinkBefore (l, (trigger ? grid->trigger : grid->solid) + y * grid->width + x);
+}
+
+static qboolean Grid_WalkList (link_t *list, areafunc_t func, void *data)
+{
+	link_t	*l, *next;
+
+	for (l = list->next ; l != list ; l = next)
+	{
+		next = l->next;
+		if (!func (l, data))
+			return false;
+	}
+	return true;
+}
+
+static void Grid_Walk (broadphase_t *bp, vec3_t mins, vec3_t maxs, qboolean triggers, areafunc_t func, void *data)
+{
+	areagrid_t	*grid = (areagrid_t *) bp->state;
+	link_t		*cells;
+	float		half;
+	int			x0, x1, y0, y1, x, y;
+
+	if (!Grid_WalkList (triggers ? &grid->bigtrigger : &grid->bigsolid, func, data))
+		return;
+
+	half = grid->cellsize * 0.5f;
+	x0 = Grid_Cell (mins[0] - half, grid->mins[0], grid->invcell, grid->width);
+	x1 = Grid_Cell (maxs[0] + half, grid->mins[0], grid->invcell, grid->width);
+	y0 = Grid_Cell (mins[1] - half, grid->mins[1], grid->invcell, grid->height);
+	y1 = Grid_Cell (maxs[1] + half, grid->mins[1], grid->invcell, grid->height);
+
+	cells = triggers ? grid->trigger : grid->solid;
+	for (y=y0 ; y<=y1 ; y++)
+	{
+		for (x=x0 ; x<=x1 ; x++)
+		{
+			if (!Grid_WalkList (cells + y * grid->width + x, func, data))
+				return;
+		}
+	}
+}
+
+const broadphase_t sv_gridphase =
+{
+	"loose grid",
+	Grid_Clear,
+	Grid_Free,
+	Grid_Link,
+	Grid_Walk,
+	NULL
+};
+
+static const broadphase_t *sv_broadphases[] =
+{
+	&sv_areanodephase,
+	&sv_gridphase
+};
+
+#define	NUM_BROADPHASES	(int)(sizeof(sv_broadphases) / sizeof(sv_broadphases[0]))
+
+const broadphase_t *SV_BroadphaseType (void)
+{
+	return sv_broadphases[CLAMP (0, (int)sv_broadphase.value, NUM_BROADPHASES - 1)];
+}
+
+/*
+===============================================================================
+
+RECORDING
+
+A recording starts with a link for every entity already linked, then has
+the world's links, unlinks and area walks in the order they happened.
+
+===============================================================================
+*/
+
+#define	BP_MAXEVENTS	(1<<22)
+#define	BP_VERSION		1
+
+typedef struct
+{
+	int		type;		// BP_LINK, BP_UNLINK or BP_QUERY
+	int		num;		// edict number
+	int		trigger;	// trigger link or walk
+	float	mins[3], maxs[3];
+} bpevent_t;
+
+typedef struct
+{
+	char	magic[4];	// "QBPR"
+	int		version;
+	float	mins[3], maxs[3];	// the world
+	int		numevents;
+} bpheader_t;
+
+qboolean		sv_bprecording;
+
+static	bpevent_t	*bp_events;
+static	int			bp_numevents, bp_maxevents;
+static	int			bp_framesleft;
+static	char		bp_filename[MAX_OSPATH];
+static	vec3_t		bp_worldmins, bp_worldmaxs;
+
+static void BP_SwapEvent (bpevent_t *e)
+{
+	int		i;
+
+	e->type = LittleLong (e->type);
+	e->num = LittleLong (e->num);
+	e->trigger = LittleLong (e->trigger);
+	for (i=0 ; i<3 ; i++)
+	{
+		e->mins[i] = LittleFloat (e->mins[i]);
+		e->maxs[i] = LittleFloat (e->maxs[i]);
+	}
+}
+
+/*
+===============
+SV_RecordBroadphase
+
+Called from world.c for every link, unlink and walk while recording.
+===============
+*/
+void SV_RecordBroadphase (int type, int num, vec3_t mins, vec3_t maxs, qboolean trigger)
+{
+	bpevent_t	*e;
+
+	if (bp_numevents == bp_maxevents)
+	{
+		if (bp_maxevents == BP_MAXEVENTS)
+			return;		// SV_BroadphaseFrame stops it
+		bp_maxevents = bp_maxevents ? bp_maxevents * 2 : 65536;
+		bp_events = (bpevent_t *) realloc (bp_events, bp_maxevents * sizeof(bpevent_t));
+		if (!bp_events)
+			Sys_Error ("SV_RecordBroadphase: out of memory");
+	}
+
+	e = &bp_events[bp_numevents++];
+	e->type = type;
+	e->num = num;
+	e->trigger = trigger;
+	if (mins)
+	{
+		VectorCopy (mins, e->mins);
+		VectorCopy (maxs, e->maxs);
+	}
+	else
+	{
+		VectorCopy (vec3_origin, e->mins);
+		VectorCopy (vec3_origin, e->maxs);
+	}
+}
+
+/*
+===============
+SV_StopRecordBroadphase
+
+Writes out the recording, also when the map changes.
+===============
+*/
+void SV_StopRecordBroadphase (void)
+{
+	bpheader_t	header;
+	FILE		*f;
+	int			i;
+
+	if (!sv_bprecording)
+		return;
+	sv_bprecording = false;
+
+	f = fopen (bp_filename, "wb");
+	if (!f)
+	{
+		Con_Printf ("Couldn't write %s\n", bp_filename);
+	}
+	else
+	{
+		memcpy (header.magic, "QBPR", 4);
+		header.version = LittleLong (BP_VERSION);
+		for (i=0 ; i<3 ; i++)
+		{
+			header.mins[i] = LittleFloat (bp_worldmins[i]);
+			header.maxs[i] = LittleFloat (bp_worldmaxs[i]);
+		}
+		header.numevents = LittleLong (bp_numevents);
+		fwrite (&header, sizeof(header), 1, f);
+		for (i=0 ; i<bp_numevents ; i++)
+			BP_SwapEvent (&bp_events[i]);
+		fwrite (bp_events, sizeof(bpevent_t), bp_numevents, f);
+		fclose (f);
+		Con_Printf ("Wrote %i broadphase events to %s\n", bp_numevents, bp_filename);
+	}
+
+	free (bp_events);
+	bp_events = NULL;
+	bp_numevents = bp_maxevents = 0;
+}
+
+/*
+===============
+SV_BroadphaseFrame
+
+Called at the end of every server frame.
+===============
+*/
+void SV_BroadphaseFrame (void)
+{
+	if (!sv_bprecording)
+		return;
+	if (--bp_framesleft <= 0 || bp_numevents == BP_MAXEVENTS)
+		SV_StopRecordBroadphase ();
+}
+
+/*
+===============
+SV_RecordBroadphase_f
+
+sv_recordbroadphase <name> [frames]
+===============
+*/
+static void SV_RecordBroadphase_f (void)
+{
+	edict_t		*ent;
+	int			i;
+
+	if (sv_bprecording)
+	{
+		SV_StopRecordBroadphase ();
+		return;
+	}
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("sv_recordbroadphase <name> [frames] : record the server's entity links and area queries\n");
+		return;
+	}
+	if (!sv.active)
+	{
+		Con_Printf ("No server running\n");
+		return;
+	}
+
+	q_snprintf (bp_filename, sizeof(bp_filename), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_AddExtension (bp_filename, ".bpr", sizeof(bp_filename));
+	bp_framesleft = (Cmd_Argc () > 2) ? atoi (Cmd_Argv(2)) : 720;
+	VectorCopy (sv.worldmodel->mins, bp_worldmins);
+	VectorCopy (sv.worldmodel->maxs, bp_worldmaxs);
+	sv_bprecording = true;
+
+	for (i=1, ent=NEXT_EDICT(sv.edicts) ; i<sv.num_edicts ; i++, ent=NEXT_EDICT(ent))
+	{
+		if (!ent->free && ent->area.prev)
+			SV_RecordBroadphase (BP_LINK, i, ent->v.absmin, ent->v.absmax, ent->v.solid == SOLID_TRIGGER);
+	}
+
+	Con_Printf ("Recording broadphase for %i frames\n", bp_framesleft);
+}
+
+/*
+===============================================================================
+
+BENCHMARK
+
+===============================================================================
+*/
+
+typedef struct
+{
+	link_t	l;
+	vec3_t	mins, maxs;
+	int		num;
+} bpitem_t;
+
+typedef struct
+{
+	vec3_t		mins, maxs;		// of the current query
+	int			visited, hits;
+	unsigned	sum;			// of the entities found, to compare
+} bpresult_t;
+
+static qboolean BP_BenchLink (link_t *l, void *data)
+{
+	bpitem_t	*item = STRUCT_FROM_LINK(l, bpitem_t, l);
+	bpresult_t	*r = (bpresult_t *) data;
+
+	r->visited++;
+	if (r->mins[0] > item->maxs[0]
+	|| r->mins[1] > item->maxs[1]
+	|| r->mins[2] > item->maxs[2]
+	|| r->maxs[0] < item->mins[0]
+	|| r->maxs[1] < item->mins[1]
+	|| r->maxs[2] < item->mins[2] )
+		return true;
+
+	r->hits++;
+	r->sum += (unsigned)item->num * 2654435761u;
+	return true;
+}
+
+static double BP_Replay (broadphase_t *bp, bpheader_t *header, bpevent_t *events, bpitem_t *items, int numitems, bpresult_t *r)
+{
+	bpevent_t	*e;
+	bpitem_t	*item;
+	double		start;
+	int			i;
+
+	for (i=0 ; i<numitems ; i++)
+	{
+		items[i].l.prev = items[i].l.next = NULL;
+		items[i].num = i;
+	}
+	memset (r, 0, sizeof(*r));
+	bp->clear (bp, header->mins, header->maxs);
+
+	start = Sys_DoubleTime ();
+	for (i=0, e=events ; i<header->numevents ; i++, e++)
+	{
+		switch (e->type)
+		{
+		case BP_LINK:
+			item = &items[e->num];
+			if (item->l.prev)
+				RemoveLink (&item->l);
+			VectorCopy (e->mins, item->mins);
+			VectorCopy (e->maxs, item->maxs);
+			bp->link (bp, &item->l, item->mins, item->maxs, e->trigger);
+			break;
+		case BP_UNLINK:
+			item = &items[e->num];
+			if (item->l.prev)
+				RemoveLink (&item->l);
+			item->l.prev = item->l.next = NULL;
+			break;
+		case BP_QUERY:
+			VectorCopy (e->mins, r->mins);
+			VectorCopy (e->maxs, r->maxs);
+			bp->walk (bp, e->mins, e->maxs, e->trigger, BP_BenchLink, r);
+			break;
+		}
+	}
+	return Sys_DoubleTime () - start;
+}
+
+/*
+===============
+SV_BroadphaseBench_f
+
+sv_broadphasebench <name> [passes]
+===============
+*/
+static void SV_BroadphaseBench_f (void)
+{
+	char		name[MAX_OSPATH];
+	bpheader_t	header;
+	bpevent_t	*events;
+	bpitem_t	*items;
+	bpresult_t	r, first;
+	broadphase_t	bp;
+	FILE		*f;
+	double		t, best;
+	int			passes, numitems, counts[3];
+	int			i, j;
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("sv_broadphasebench <name> [passes] : replay a broadphase recording against every broadphase\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_AddExtension (name, ".bpr", sizeof(name));
+	passes = (Cmd_Argc () > 2) ? q_max (1, atoi (Cmd_Argv(2))) : 5;
+
+	f = fopen (name, "rb");
+	if (!f)
+	{
+		Con_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+	if (fread (&header, sizeof(header), 1, f) != 1 || memcmp (header.magic, "QBPR", 4)
+	|| LittleLong (header.version) != BP_VERSION)
+	{
+		Con_Printf ("%s is not a broadphase recording\n", name);
+		fclose (f);
+		return;
+	}
+	for (i=0 ; i<3 ; i++)
+	{
+		header.mins[i] = LittleFloat (header.mins[i]);
+		header.maxs[i] = LittleFloat (header.maxs[i]);
+	}
+	header.numevents = LittleLong (header.numevents);
+	if (header.numevents < 0 || header.numevents > BP_MAXEVENTS)
+	{
+		Con_Printf ("%s is corrupt\n", name);
+		fclose (f);
+		return;
+	}
+
+	events = (bpevent_t *) malloc (header.numevents * sizeof(bpevent_t) + 1);
+	if (!events)
+		Sys_Error ("SV_BroadphaseBench_f: out of memory");
+	i = (int) fread (events, sizeof(bpevent_t), header.numevents, f);
+	fclose (f);
+	if (i != header.numevents)
+	{
+		Con_Printf ("%s is truncated\n", name);
+		free (events);
+		return;
+	}
+
+	numitems = 0;
+	memset (counts, 0, sizeof(counts));
+	for (i=0 ; i<header.numevents ; i++)
+	{
+		BP_SwapEvent (&events[i]);
+		if (events[i].type < BP_LINK || events[i].type > BP_QUERY || events[i].num < 0 || events[i].num >= MAX_EDICTS)
+		{
+			Con_Printf ("%s is corrupt\n", name);
+			free (events);
+			return;
+		}
+		counts[events[i].type]++;
+		numitems = q_max (numitems, events[i].num + 1);
+	}
+
+	items = (bpitem_t *) calloc (numitems, sizeof(bpitem_t));
+	if (!items)
+		Sys_Error ("SV_BroadphaseBench_f: out of memory");
+
+	Con_Printf ("%i links, %i unlinks and %i queries of %i entities\n", counts[BP_LINK], counts[BP_UNLINK], counts[BP_QUERY], numitems);
+
+	memset (&first, 0, sizeof(first));
+	for (i=0 ; i<NUM_BROADPHASES ; i++)
+	{
+		bp = *sv_broadphases[i];
+		bp.state = NULL;
+
+		best = 0;
+		for (j=0 ; j<passes ; j++)
+		{
+			t = BP_Replay (&bp, &header, events, items, numitems, &r);
+			if (!j || t < best)
+				best = t;
+		}
+		bp.free (&bp);
+
+		Con_Printf ("%-12s %8.2f ms, %6.1f visited for %5.1f found per query\n", bp.name, best * 1000,
+			counts[BP_QUERY] ? (float)r.visited / counts[BP_QUERY] : 0, counts[BP_QUERY] ? (float)r.hits / counts[BP_QUERY] : 0);
+
+		if (!i)
+			first = r;
+		else if (r.hits != first.hits || r.sum != first.sum)
+			Con_Printf ("%s found other entities than %s!\n", bp.name, sv_broadphases[0]->name);
+	}
+
+	free (items);
+	free (events);
+}
+
+/*
+===============
+SV_InitBroadphase
+===============
+*/
+void SV_InitBroadphase (void)
+{
+	Cvar_RegisterVariable (&sv_broadphase);
+	Cvar_SetCallback (&sv_broadphase, SV_Broadphase_f);
+
+	Cmd_AddCommand ("sv_recordbroadphase", SV_RecordBroadphase_f);
+	Cmd_AddCommand ("sv_broadphasebench", SV_BroadphaseBench_f);
+}
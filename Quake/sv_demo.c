@@ -0,0 +1,650 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_demo.c -- server side multiview demos
+
+#include "quakedef.h"
+
+/*
+==============================================================================
+
+SERVER DEMOS
+
+"sv_record <name>" writes everything the server sends to every client into
+<name>.mvd in the game directory, dedicated server or not.  Each server
+frame SV_SendClientMessages adds:
+
+  MVD_FRAME       sv.time
+  MVD_ENTITIES    an update for every client and every entity with a model,
+                  not only the ones some client can see
+  MVD_DATAGRAM    sv.datagram (sounds, particles, temp entities)
+  MVD_CLIENTDATA  per client that got a datagram: its view angles and
+                  svc_clientdata
+  MVD_RELIABLE    per client: its reliable message as it was sent
+  MVD_SIGNON      a reliable message that starts a signon: a connection or
+                  a level change, or the one made up for each player that
+                  was already in the game when recording started
+
+A record is a type byte, a client byte, a little-endian length and the
+data.  The frame is built on the main thread and handed to a writer thread
+that does the file I/O, so a slow disk never holds up the server frame;
+the queue grows instead.
+
+"mvdtodem <name> <player>" turns one player's part of a .mvd into a client
+demo that playdemo can show: the player's reliable messages from their
+first signon on, and for each of their datagrams the clientdata with every
+entity and the server datagram.
+==============================================================================
+*/
+
+#define	MVD_HEADER	"QSMVD 1\n"
+
+enum
+{
+	MVD_FRAME = 1,
+	MVD_ENTITIES,
+	MVD_DATAGRAM,
+	MVD_CLIENTDATA,
+	MVD_RELIABLE,
+	MVD_SIGNON
+};
+
+#define	MVD_RECORDHEADER	6
+#define	MVD_MAXRECORD		(MAX_MSGLEN + 16)
+#define	MVD_ENTITYBYTES		(MAX_MSGLEN - 1024)	// leaves room for clientdata in a demo message
+
+qboolean	sv_demorecording;
+
+static FILE		*mvd_file;
+static char		mvd_name[MAX_OSPATH];
+static qboolean		mvd_signon[MAX_SCOREBOARD];	// next reliable message starts a signon
+
+static byte		*mvd_frame;	// being built on the main thread
+static int		mvd_framesize, mvd_framemax;
+
+static SDL_Thread	*mvd_writer;	// NULL writes from the main thread
+static SDL_mutex	*mvd_lock;
+static SDL_cond		*mvd_wake;
+static byte		*mvd_queue;	// frames waiting for the writer
+static int		mvd_queuesize, mvd_queuemax;
+static byte		*mvd_spare;	// what the writer is writing
+static int		mvd_sparemax;
+static qboolean		mvd_quit;
+static qboolean		mvd_writeerror;
+
+static byte		mvd_msgbuf[MAX_MSGLEN];
+
+/*
+================
+SV_DemoGrow
+================
+*/
+static void SV_DemoGrow (byte **buf, int *max, int size)
+{
+	if (size <= *max)
+		return;
+
+	*max = q_max (size, *max * 2);
+	*buf = (byte *) realloc (*buf, *max);
+	if (!*buf)
+		Sys_Error ("SV_DemoGrow: couldn't allocate %d bytes", *max);
+}
+
+/*
+================
+SV_DemoRecord
+
+adds a record to the frame
+================
+*/
+static void SV_DemoRecord (int type, int client, const void *data, int len)
+{
+	byte	*p;
+
+	SV_DemoGrow (&mvd_frame, &mvd_framemax, mvd_framesize + MVD_RECORDHEADER + len);
+	p = mvd_frame + mvd_framesize;
+	p[0] = type;
+	p[1] = client;
+	p[2] = len & 0xff;
+	p[3] = (len >> 8) & 0xff;
+	p[4] = (len >> 16) & 0xff;
+	p[5] = (len >> 24) & 0xff;
+	memcpy (p + MVD_RECORDHEADER, data, len);
+	mvd_framesize += MVD_RECORDHEADER + len;
+}
+
+/*
+================
+SV_DemoWriter
+
+writer thread: writes out whatever is queued until told to quit with
+nothing left
+================
+*/
+static int SV_DemoWriter (void *unused)
+{
+	byte		*buf;
+	int		size, max;
+	qboolean	ok;
+
+	Prof_ThreadName ("demowriter");
+
+	SDL_LockMutex (mvd_lock);
+	while (1)
+	{
+		if (!mvd_queuesize)
+		{
+			if (mvd_quit)
+				break;
+			SDL_CondWait (mvd_wake, mvd_lock);
+			continue;
+		}
+
+		// take the queue, the main thread gets the buffer written last time
+		buf = mvd_queue;
+		max = mvd_queuemax;
+		size = mvd_queuesize;
+		mvd_queue = mvd_spare;
+		mvd_queuemax = mvd_sparemax;
+		mvd_queuesize = 0;
+		mvd_spare = buf;
+		mvd_sparemax = max;
+		SDL_UnlockMutex (mvd_lock);
+
+		ok = (fwrite (buf, 1, size, mvd_file) == (size_t) size);
+
+		SDL_LockMutex (mvd_lock);
+		if (!ok)
+			mvd_writeerror = true;
+	}
+	SDL_UnlockMutex (mvd_lock);
+
+	return 0;
+}
+
+/*
+================
+SV_DemoStartSignon
+
+called when a client is sent serverinfo
+================
+*/
+void SV_DemoStartSignon (client_t *client)
+{
+	mvd_signon[client - svs.clients] = true;
+}
+
+/*
+================
+SV_DemoBeginFrame
+
+called by SV_SendClientMessages before any client is sent anything
+================
+*/
+void SV_DemoBeginFrame (void)
+{
+	sizebuf_t	msg;
+	float		time;
+	int		i;
+
+	time = LittleFloat (sv.time);
+	SV_DemoRecord (MVD_FRAME, 0, &time, sizeof(time));
+
+	for (i = 0; i < svs.maxclients; i++)
+	{
+		if (svs.clients[i].active && svs.clients[i].spawned)
+			break;
+	}
+	if (i == svs.maxclients)
+		return;		// nobody to see the entities
+
+	msg.data = mvd_msgbuf;
+	msg.maxsize = MVD_ENTITYBYTES;
+	msg.cursize = 0;
+	msg.allowoverflow = true;
+	msg.overflowed = false;
+	SV_WriteAllEntities (&msg);
+	SV_DemoRecord (MVD_ENTITIES, 0, msg.data, msg.cursize);
+
+	if (sv.datagram.cursize)
+		SV_DemoRecord (MVD_DATAGRAM, 0, sv.datagram.data, sv.datagram.cursize);
+}
+
+/*
+================
+SV_DemoClientData
+
+called with the svc_clientdata of each datagram
+================
+*/
+void SV_DemoClientData (client_t *client, const byte *data, int len)
+{
+	float	*angles;
+	int	i;
+
+	if (len + 12 > (int) sizeof(mvd_msgbuf))
+		return;
+
+	angles = (float *) mvd_msgbuf;
+	for (i = 0; i < 3; i++)
+		angles[i] = LittleFloat (client->edict->v.v_angle[i]);
+	memcpy (mvd_msgbuf + 12, data, len);
+	SV_DemoRecord (MVD_CLIENTDATA, client - svs.clients, mvd_msgbuf, len + 12);
+}
+
+/*
+================
+SV_DemoReliable
+
+called with each reliable message before it is sent
+================
+*/
+void SV_DemoReliable (client_t *client)
+{
+	int	num = client - svs.clients;
+
+	SV_DemoRecord (mvd_signon[num] ? MVD_SIGNON : MVD_RELIABLE, num,
+		       client->message.data, client->message.cursize);
+	mvd_signon[num] = false;
+}
+
+/*
+================
+SV_DemoEndFrame
+
+hands the frame to the writer
+================
+*/
+void SV_DemoEndFrame (void)
+{
+	byte		*buf;
+	int		max;
+	qboolean	error;
+
+	if (!mvd_framesize)
+		return;
+
+	if (!mvd_writer)
+	{
+		error = (fwrite (mvd_frame, 1, mvd_framesize, mvd_file) != (size_t) mvd_framesize);
+		mvd_framesize = 0;
+	}
+	else
+	{
+		SDL_LockMutex (mvd_lock);
+		if (!mvd_queuesize)
+		{	// swap instead of copying
+			buf = mvd_queue;
+			max = mvd_queuemax;
+			mvd_queue = mvd_frame;
+			mvd_queuemax = mvd_framemax;
+			mvd_frame = buf;
+			mvd_framemax = max;
+		}
+		else
+		{
+			SV_DemoGrow (&mvd_queue, &mvd_queuemax, mvd_queuesize + mvd_framesize);
+			memcpy (mvd_queue + mvd_queuesize, mvd_frame, mvd_framesize);
+		}
+		mvd_queuesize += mvd_framesize;
+		mvd_framesize = 0;
+		error = mvd_writeerror;
+		SDL_CondSignal (mvd_wake);
+		SDL_UnlockMutex (mvd_lock);
+	}
+
+	if (error)
+	{
+		Con_Printf ("ERROR: couldn't write to %s\n", mvd_name);
+		SV_StopDemo ();
+	}
+}
+
+/*
+================
+SV_StopDemo
+
+finishes the file, also called when the server shuts down
+================
+*/
+void SV_StopDemo (void)
+{
+	if (!sv_demorecording)
+		return;
+
+	sv_demorecording = false;
+
+	if (mvd_writer)
+	{
+		SDL_LockMutex (mvd_lock);
+		mvd_quit = true;
+		SDL_CondSignal (mvd_wake);
+		SDL_UnlockMutex (mvd_lock);
+		SDL_WaitThread (mvd_writer, NULL);
+		mvd_writer = NULL;
+	}
+	else if (mvd_framesize)
+		fwrite (mvd_frame, 1, mvd_framesize, mvd_file);
+	mvd_framesize = 0;
+
+	fclose (mvd_file);
+	mvd_file = NULL;
+	Con_Printf ("Completed server demo %s\n", mvd_name);
+}
+
+/*
+================
+SV_Record_f
+
+sv_record <name>
+================
+*/
+static void SV_Record_f (void)
+{
+	sizebuf_t	msg;
+	client_t	*client;
+	int		i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("sv_record <name> : records every client to <name>.mvd\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	if (!sv.active)
+	{
+		Con_Printf ("No server running.\n");
+		return;
+	}
+
+	SV_StopDemo ();
+
+	q_snprintf (mvd_name, sizeof(mvd_name), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_AddExtension (mvd_name, ".mvd", sizeof(mvd_name));
+	mvd_file = fopen (mvd_name, "wb");
+	if (!mvd_file)
+	{
+		Con_Printf ("ERROR: couldn't create %s\n", mvd_name);
+		return;
+	}
+	fputs (MVD_HEADER, mvd_file);
+
+	if (!mvd_lock)
+		mvd_lock = SDL_CreateMutex ();
+	if (!mvd_wake)
+		mvd_wake = SDL_CreateCond ();
+	mvd_quit = false;
+	mvd_writeerror = false;
+	mvd_queuesize = 0;
+	if (mvd_lock && mvd_wake)
+		mvd_writer = Tasks_CreateThread (SV_DemoWriter, NULL, "demowriter");
+	if (!mvd_writer)
+		Con_Printf ("Couldn't start the demo writer, writing from the server frame\n");
+
+	sv_demorecording = true;
+	memset (mvd_signon, 0, sizeof(mvd_signon));
+	Con_Printf ("recording server demo to %s.\n", mvd_name);
+
+	// players already in the game get the signon a new connection would
+	msg.data = mvd_msgbuf;
+	msg.maxsize = sizeof(mvd_msgbuf);
+	msg.allowoverflow = true;
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned)
+			continue;
+
+		SZ_Clear (&msg);
+		SV_WriteServerinfo (client, &msg);
+		SV_DemoRecord (MVD_SIGNON, i, msg.data, msg.cursize);
+
+		SZ_Clear (&msg);
+		SZ_Write (&msg, sv.signon.data, sv.signon.cursize);
+		MSG_WriteByte (&msg, svc_signonnum);
+		MSG_WriteByte (&msg, 2);
+		SV_DemoRecord (MVD_RELIABLE, i, msg.data, msg.cursize);
+
+		SZ_Clear (&msg);
+		SV_WriteSpawnState (client, &msg);
+		MSG_WriteByte (&msg, svc_signonnum);
+		MSG_WriteByte (&msg, 3);
+		SV_DemoRecord (MVD_RELIABLE, i, msg.data, msg.cursize);
+	}
+}
+
+/*
+================
+SV_StopRecord_f
+================
+*/
+static void SV_StopRecord_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+
+	if (!sv_demorecording)
+	{
+		Con_Printf ("Not recording a server demo.\n");
+		return;
+	}
+
+	SV_StopDemo ();
+}
+
+/*
+================
+SV_WriteDemoMessage
+
+a client demo message, like CL_WriteDemoMessage
+================
+*/
+static void SV_WriteDemoMessage (FILE *f, const byte *data, int len, const float *angles)
+{
+	int	i;
+	float	a;
+
+	i = LittleLong (len);
+	fwrite (&i, 4, 1, f);
+	for (i = 0; i < 3; i++)
+	{
+		a = LittleFloat (angles[i]);
+		fwrite (&a, 4, 1, f);
+	}
+	fwrite (data, len, 1, f);
+}
+
+/*
+================
+SV_MvdToDem_f
+
+mvdtodem <name> <player> [demoname]
+================
+*/
+static void SV_MvdToDem_f (void)
+{
+	static byte	rec[MVD_MAXRECORD];
+	static byte	ents[MAX_MSGLEN];
+	static byte	dgram[MAX_MSGLEN];
+	char		name[MAX_OSPATH], header[16];
+	byte		head[MVD_RECORDHEADER];
+	FILE		*in, *out;
+	sizebuf_t	msg;
+	float		angles[3], time;
+	int		player, type, len, entslen, dgramlen, messages, i;
+	qboolean	started;
+
+	if (Cmd_Argc() != 3 && Cmd_Argc() != 4)
+	{
+		Con_Printf ("mvdtodem <name> <player> [demoname] : writes player's view of a server demo\n");
+		Con_Printf ("  player is the slot number \"status\" showed, from 1\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), "..") || (Cmd_Argc() == 4 && strstr(Cmd_Argv(3), "..")))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	player = Q_atoi (Cmd_Argv(2)) - 1;
+	if (player < 0 || player >= MAX_SCOREBOARD)
+	{
+		Con_Printf ("player must be from 1 to %d\n", MAX_SCOREBOARD);
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_AddExtension (name, ".mvd", sizeof(name));
+	in = fopen (name, "rb");
+	if (!in)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+	if (!fgets (header, sizeof(header), in) || strcmp (header, MVD_HEADER))
+	{
+		Con_Printf ("ERROR: %s is not a server demo\n", name);
+		fclose (in);
+		return;
+	}
+
+	if (Cmd_Argc() == 4)
+		q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(3));
+	else
+		q_snprintf (name, sizeof(name), "%s/%s_%d", com_gamedir, Cmd_Argv(1), player + 1);
+	COM_StripExtension (name, name, sizeof(name));
+	COM_AddExtension (name, ".dem", sizeof(name));
+	out = fopen (name, "wb");
+	if (!out)
+	{
+		Con_Printf ("ERROR: couldn't create %s\n", name);
+		fclose (in);
+		return;
+	}
+	fprintf (out, "-1\n");	// no forced cd track
+
+	msg.data = mvd_msgbuf;
+	msg.maxsize = sizeof(mvd_msgbuf);
+	msg.allowoverflow = true;
+	angles[0] = angles[1] = angles[2] = 0;
+	time = 0;
+	entslen = dgramlen = messages = 0;
+	started = false;
+
+	while (fread (head, MVD_RECORDHEADER, 1, in) == 1)
+	{
+		type = head[0];
+		len = head[2] + (head[3] << 8) + (head[4] << 16) + (head[5] << 24);
+		if (len < 0 || len > MVD_MAXRECORD || (len && fread (rec, len, 1, in) != 1))
+		{
+			Con_Printf ("%s is cut short\n", Cmd_Argv(1));
+			break;
+		}
+
+		switch (type)
+		{
+		case MVD_FRAME:
+			if (len == 4)
+				time = LittleFloat (*(float *)rec);
+			entslen = dgramlen = 0;
+			break;
+
+		case MVD_ENTITIES:
+			entslen = q_min (len, (int) sizeof(ents));
+			memcpy (ents, rec, entslen);
+			break;
+
+		case MVD_DATAGRAM:
+			dgramlen = q_min (len, (int) sizeof(dgram));
+			memcpy (dgram, rec, dgramlen);
+			break;
+
+		case MVD_CLIENTDATA:
+			if (head[1] != player || !started || len < 12)
+				break;
+			for (i = 0; i < 3; i++)
+				angles[i] = LittleFloat (((float *)rec)[i]);
+
+			// what SV_SendClientDatagram would have sent, with every entity
+			SZ_Clear (&msg);
+			MSG_WriteByte (&msg, svc_time);
+			MSG_WriteFloat (&msg, time);
+			SZ_Write (&msg, rec + 12, len - 12);
+			if (msg.cursize + entslen <= msg.maxsize)
+				SZ_Write (&msg, ents, entslen);
+			if (msg.cursize + dgramlen <= msg.maxsize)
+				SZ_Write (&msg, dgram, dgramlen);
+			SV_WriteDemoMessage (out, msg.data, msg.cursize, angles);
+			messages++;
+			break;
+
+		case MVD_SIGNON:
+			if (head[1] == player)
+				started = true;
+			// fall through
+		case MVD_RELIABLE:
+			if (head[1] != player || !started || !len)
+				break;
+			SV_WriteDemoMessage (out, rec, len, angles);
+			messages++;
+			break;
+
+		default:
+			break;	// from a newer version
+		}
+	}
+	fclose (in);
+
+	if (started)
+	{
+		msg.data[0] = svc_disconnect;
+		SV_WriteDemoMessage (out, msg.data, 1, angles);
+	}
+	fclose (out);
+
+	if (!started)
+	{
+		Con_Printf ("player %d never joined in %s\n", player + 1, Cmd_Argv(1));
+		return;
+	}
+	Con_Printf ("Wrote %d messages to %s\n", messages, name);
+}
+
+/*
+================
+SV_InitDemo
+================
+*/
+void SV_InitDemo (void)
+{
+	Cmd_AddCommand ("sv_record", SV_Record_f);
+	Cmd_AddCommand ("sv_stop", SV_StopRecord_f);
+	Cmd_AddCommand ("mvdtodem", SV_MvdToDem_f);
+}
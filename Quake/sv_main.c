@@ -30,6 +30,8 @@ static char	localmodels[MAX_MODELS][8];	// inline model names for precache
 
 int		sv_protocol = PROTOCOL_FITZQUAKE; //johnfitz
 
+cvar_t	sv_deltaentities = {"sv_deltaentities", "1", CVAR_NONE};
+
 extern qboolean	pr_alpha_supported; //johnfitz
 
 //============================================================================
@@ -78,6 +80,8 @@ void SV_Init (void)
 	extern	cvar_t	sv_gravity;
 	extern	cvar_t	sv_nostep;
 	extern	cvar_t	sv_freezenonclients;
+	extern	cvar_t	sv_parallelphysics;
+	extern	cvar_t	sv_parallelcheck;
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_edgefriction;
 	extern	cvar_t	sv_stopspeed;
@@ -103,9 +107,15 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_aim);
 	Cvar_RegisterVariable (&sv_nostep);
 	Cvar_RegisterVariable (&sv_freezenonclients);
+	Cvar_RegisterVariable (&sv_parallelphysics);
+	Cvar_RegisterVariable (&sv_parallelcheck);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
+	Cvar_RegisterVariable (&sv_deltaentities);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_parallelstats", &SV_ParallelStats_f);
+	SV_InitBroadphase ();
+	SV_InitDemo ();
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -276,66 +286,152 @@ CLIENT SPAWNING
 
 /*
 ================
-SV_SendServerinfo
+SV_WriteServerinfo
 
-Sends the first message from the server to a connected client.
-This will be sent on the initial connection and upon each server load.
+The first stage of the signon, viewed from client's entity.
 ================
 */
-void SV_SendServerinfo (client_t *client)
+void SV_WriteServerinfo (client_t *client, sizebuf_t *msg)
 {
 	const char		**s;
 	char			message[2048];
 	int				i; //johnfitz
 
-	MSG_WriteByte (&client->message, svc_print);
+	MSG_WriteByte (msg, svc_print);
 	sprintf (message, "%c\nFITZQUAKE %1.2f SERVER (%i CRC)\n", 2, FITZQUAKE_VERSION, pr_crc); //johnfitz -- include fitzquake version
-	MSG_WriteString (&client->message,message);
+	MSG_WriteString (msg,message);
 
-	MSG_WriteByte (&client->message, svc_serverinfo);
-	MSG_WriteLong (&client->message, sv.protocol); //johnfitz -- sv.protocol instead of PROTOCOL_VERSION
+	MSG_WriteByte (msg, svc_serverinfo);
+	MSG_WriteLong (msg, sv.protocol); //johnfitz -- sv.protocol instead of PROTOCOL_VERSION
 	
 	if (sv.protocol == PROTOCOL_RMQ)
 	{
 		// mh - now send protocol flags so that the client knows the protocol features to expect
-		MSG_WriteLong (&client->message, sv.protocolflags);
+		MSG_WriteLong (msg, sv.protocolflags);
 	}
 	
-	MSG_WriteByte (&client->message, svs.maxclients);
+	MSG_WriteByte (msg, svs.maxclients);
 
 	if (!coop.value && deathmatch.value)
-		MSG_WriteByte (&client->message, GAME_DEATHMATCH);
+		MSG_WriteByte (msg, GAME_DEATHMATCH);
 	else
-		MSG_WriteByte (&client->message, GAME_COOP);
+		MSG_WriteByte (msg, GAME_COOP);
 
-	MSG_WriteString (&client->message, PR_GetString(sv.edicts->v.message));
+	MSG_WriteString (msg, PR_GetString(sv.edicts->v.message));
 
 	//johnfitz -- only send the first 256 model and sound precaches if protocol is 15
 	for (i=0,s = sv.model_precache+1 ; *s; s++,i++)
 		if (sv.protocol != PROTOCOL_NETQUAKE || i < 256)
-			MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+			MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 
 	for (i=0,s = sv.sound_precache+1 ; *s ; s++,i++)
 		if (sv.protocol != PROTOCOL_NETQUAKE || i < 256)
-			MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+			MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 	//johnfitz
 
 // send music
-	MSG_WriteByte (&client->message, svc_cdtrack);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, svc_cdtrack);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
 
 // set view
-	MSG_WriteByte (&client->message, svc_setview);
-	MSG_WriteShort (&client->message, NUM_FOR_EDICT(client->edict));
+	MSG_WriteByte (msg, svc_setview);
+	MSG_WriteShort (msg, NUM_FOR_EDICT(client->edict));
+
+	MSG_WriteByte (msg, svc_signonnum);
+	MSG_WriteByte (msg, 1);
+}
 
-	MSG_WriteByte (&client->message, svc_signonnum);
-	MSG_WriteByte (&client->message, 1);
+/*
+================
+SV_SendServerinfo
+
+Sends the first message from the server to a connected client.
+This will be sent on the initial connection and upon each server load.
+================
+*/
+void SV_SendServerinfo (client_t *client)
+{
+	SV_WriteServerinfo (client, &client->message);
 
 	client->sendsignon = true;
 	client->spawned = false;		// need prespawn, spawn, etc
+
+	if (sv_demorecording)
+		SV_DemoStartSignon (client);
+}
+
+/*
+================
+SV_WriteSpawnState
+
+The spawn stage of the signon: the scoreboard, lightstyles, level stats
+and a fixangle for client.
+================
+*/
+void SV_WriteSpawnState (client_t *client, sizebuf_t *msg)
+{
+	int		i;
+	client_t	*cl;
+	edict_t	*ent;
+
+// send time of update
+	MSG_WriteByte (msg, svc_time);
+	MSG_WriteFloat (msg, sv.time);
+
+	for (i = 0, cl = svs.clients; i < svs.maxclients; i++, cl++)
+	{
+		MSG_WriteByte (msg, svc_updatename);
+		MSG_WriteByte (msg, i);
+		MSG_WriteString (msg, cl->name);
+		MSG_WriteByte (msg, svc_updatefrags);
+		MSG_WriteByte (msg, i);
+		MSG_WriteShort (msg, cl->old_frags);
+		MSG_WriteByte (msg, svc_updatecolors);
+		MSG_WriteByte (msg, i);
+		MSG_WriteByte (msg, cl->colors);
+	}
+
+// send all current light styles
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		MSG_WriteByte (msg, svc_lightstyle);
+		MSG_WriteByte (msg, (char)i);
+		MSG_WriteString (msg, sv.lightstyles[i]);
+	}
+
+//
+// send some stats
+//
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_TOTALSECRETS);
+	MSG_WriteLong (msg, pr_global_struct->total_secrets);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_TOTALMONSTERS);
+	MSG_WriteLong (msg, pr_global_struct->total_monsters);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_SECRETS);
+	MSG_WriteLong (msg, pr_global_struct->found_secrets);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_MONSTERS);
+	MSG_WriteLong (msg, pr_global_struct->killed_monsters);
+
+//
+// send a fixangle
+// Never send a roll angle, because savegames can catch the server
+// in a state where it is expecting the client to correct the angle
+// and it won't happen if the game was just loaded, so you wind up
+// with a permanent head tilt
+	ent = EDICT_NUM( 1 + (client - svs.clients) );
+	MSG_WriteByte (msg, svc_setangle);
+	for (i = 0; i < 2; i++)
+		MSG_WriteAngle (msg, ent->v.angles[i], sv.protocolflags );
+	MSG_WriteAngle (msg, 0, sv.protocolflags );
 }
 
 /*
@@ -546,6 +642,506 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 	return false;
 }
 
+/*
+=============================================================================
+
+ENTITY VISIBILITY
+
+Once per frame every edict with a visible model is bucketed by the leafs it
+touches.  A client's entity set is then the union of the buckets of the leafs
+in its fat PVS, kept as a bitset over edict numbers, so the per client cost
+follows what is visible rather than sv.num_edicts.  Clients whose eyes touch
+the same leafs share both the PVS and the resulting bitset.
+
+=============================================================================
+*/
+
+#define	MAX_FAT_LEAFS	32
+
+typedef struct
+{
+	int		numfat;
+	int		fatleafs[MAX_FAT_LEAFS];
+	unsigned	*ents;
+} entvisclient_t;
+
+typedef struct
+{
+	qboolean	built;
+	int		numwords;		/* size of an edict bitset in unsigned ints */
+	int		wordcapacity;
+	int		numleafs;
+	int		leafcapacity;
+	int		*leafstart;		/* numleafs + 1 offsets into leafents */
+	int		*leafents;
+	int		leafentcapacity;
+	unsigned	*always;		/* spans too many leafs to be culled */
+	unsigned	*scratch;		/* result for clients that can't be shared */
+	byte		*pvs;
+	int		numclients;
+	entvisclient_t	clients[MAX_SCOREBOARD];
+	unsigned	*clientents;
+} entvis_t;
+
+static entvis_t	sv_entvis;
+
+/*
+=============
+SV_EntityHasVisibleModel
+=============
+*/
+static qboolean SV_EntityHasVisibleModel (edict_t *ent)
+{
+	if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+		return false;
+
+	//johnfitz -- don't send model>255 entities if protocol is 15
+	if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+		return false;
+
+	return true;
+}
+
+/*
+=============
+SV_GrowEntVis
+=============
+*/
+static void *SV_GrowEntVis (void *buf, int size)
+{
+	buf = realloc (buf, size);
+	if (!buf)
+		Sys_Error ("SV_GrowEntVis: realloc() failed on %d bytes", size);
+	return buf;
+}
+
+/*
+=============
+SV_BuildEntityVis
+
+Buckets the visible-model edicts by leaf for this frame.
+=============
+*/
+static void SV_BuildEntityVis (void)
+{
+	entvis_t	*ev = &sv_entvis;
+	int		e, i, total;
+	edict_t		*ent;
+
+	ev->numwords = (sv.num_edicts + 31) >> 5;
+	ev->numleafs = sv.worldmodel->numleafs;
+
+	if (ev->numwords > ev->wordcapacity)
+	{
+		ev->wordcapacity = ev->numwords;
+		ev->always = (unsigned *) SV_GrowEntVis (ev->always, ev->wordcapacity * sizeof(unsigned));
+		ev->scratch = (unsigned *) SV_GrowEntVis (ev->scratch, ev->wordcapacity * sizeof(unsigned));
+		ev->clientents = (unsigned *) SV_GrowEntVis (ev->clientents, MAX_SCOREBOARD * ev->wordcapacity * sizeof(unsigned));
+	}
+	for (i = 0 ; i < MAX_SCOREBOARD ; i++)
+		ev->clients[i].ents = ev->clientents + i * ev->wordcapacity;
+
+	if (ev->numleafs > ev->leafcapacity)
+	{
+		ev->leafcapacity = ev->numleafs;
+		ev->leafstart = (int *) SV_GrowEntVis (ev->leafstart, (ev->leafcapacity + 1) * sizeof(int));
+		ev->pvs = (byte *) SV_GrowEntVis (ev->pvs, (ev->leafcapacity + 7) >> 3);
+	}
+
+	memset (ev->always, 0, ev->numwords * sizeof(unsigned));
+	memset (ev->leafstart, 0, (ev->numleafs + 1) * sizeof(int));
+
+// count the edicts in each leaf
+	total = 0;
+	ent = NEXT_EDICT(sv.edicts);
+	for (e = 1 ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	{
+		if (!SV_EntityHasVisibleModel (ent))
+			continue;
+
+		// ericw -- if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from
+		// too many leafs for us to say whether it's in the PVS, so don't try
+		// to vis cull it.
+		if (ent->num_leafs == MAX_ENT_LEAFS)
+		{
+			ev->always[e >> 5] |= 1u << (e & 31);
+			continue;
+		}
+
+		for (i = 0 ; i < ent->num_leafs ; i++)
+			ev->leafstart[ent->leafnums[i] + 1]++;
+		total += ent->num_leafs;
+	}
+
+	for (i = 0 ; i < ev->numleafs ; i++)
+		ev->leafstart[i + 1] += ev->leafstart[i];
+
+	if (total > ev->leafentcapacity)
+	{
+		ev->leafentcapacity = total + total / 2;
+		ev->leafents = (int *) SV_GrowEntVis (ev->leafents, ev->leafentcapacity * sizeof(int));
+	}
+
+// fill the buckets, using leafstart as the write cursor and shifting back after
+	ent = NEXT_EDICT(sv.edicts);
+	for (e = 1 ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->num_leafs == MAX_ENT_LEAFS || !SV_EntityHasVisibleModel (ent))
+			continue;
+		for (i = 0 ; i < ent->num_leafs ; i++)
+			ev->leafents[ev->leafstart[ent->leafnums[i]]++] = e;
+	}
+
+	for (i = ev->numleafs ; i > 0 ; i--)
+		ev->leafstart[i] = ev->leafstart[i - 1];
+	ev->leafstart[0] = 0;
+
+	ev->numclients = 0;
+	ev->built = true;
+}
+
+/*
+=============
+SV_InvalidateEntityVis
+
+Edicts moved, were freed or lost their models since the buckets were built
+=============
+*/
+void SV_InvalidateEntityVis (void)
+{
+	sv_entvis.built = false;
+}
+
+/*
+=============
+SV_AddFatLeafs
+
+Collects the non-solid leafs within 8 units of org, in tree order, the same
+set SV_AddToFatPVS merges.  Returns false if there are too many to key on.
+=============
+*/
+static qboolean SV_AddFatLeafs (vec3_t org, mnode_t *node, entvisclient_t *fat)
+{
+	mplane_t	*plane;
+	float		d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID)
+			{
+				if (fat->numfat == MAX_FAT_LEAFS)
+					return false;
+				fat->fatleafs[fat->numfat++] = (mleaf_t *)node - sv.worldmodel->leafs;
+			}
+			return true;
+		}
+
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{
+			if (!SV_AddFatLeafs (org, node->children[0], fat))
+				return false;
+			node = node->children[1];
+		}
+	}
+}
+
+/*
+=============
+SV_VisibleEntities
+
+Returns the bitset of edicts with visible models that touch the fat PVS
+around org.  Valid until the next call.
+=============
+*/
+static unsigned *SV_VisibleEntities (vec3_t org)
+{
+	entvis_t	*ev = &sv_entvis;
+	entvisclient_t	key, *fat;
+	unsigned	*ents;
+	byte		*pvs;
+	int		i, j, k, leaf, pvsbytes;
+
+	if (!ev->built || ev->numwords != ((sv.num_edicts + 31) >> 5))
+		SV_BuildEntityVis ();
+
+	key.numfat = 0;
+	if (SV_AddFatLeafs (org, sv.worldmodel->nodes, &key))
+	{
+		for (i = 0, fat = ev->clients ; i < ev->numclients ; i++, fat++)
+		{
+			if (fat->numfat == key.numfat && !memcmp (fat->fatleafs, key.fatleafs, key.numfat * sizeof(int)))
+				return fat->ents;
+		}
+
+		if (ev->numclients < MAX_SCOREBOARD)
+		{
+			fat = &ev->clients[ev->numclients++];
+			fat->numfat = key.numfat;
+			memcpy (fat->fatleafs, key.fatleafs, key.numfat * sizeof(int));
+			ents = fat->ents;
+		}
+		else
+			ents = ev->scratch;
+
+	// merge the pvs of the leafs we already found
+		pvsbytes = (ev->numleafs + 7) >> 3;
+		pvs = ev->pvs;
+		memset (pvs, 0, pvsbytes);
+		for (i = 0 ; i < key.numfat ; i++)
+		{
+			byte *leafpvs = Mod_LeafPVS (sv.worldmodel->leafs + key.fatleafs[i], sv.worldmodel);
+			for (j = 0 ; j < pvsbytes ; j++)
+				pvs[j] |= leafpvs[j];
+		}
+	}
+	else
+	{
+		ents = ev->scratch;
+		pvs = SV_FatPVS (org, sv.worldmodel);
+	}
+
+	memcpy (ents, ev->always, ev->numwords * sizeof(unsigned));
+	for (i = 0 ; i < (ev->numleafs + 7) >> 3 ; i++)
+	{
+		if (!pvs[i])
+			continue;
+		for (j = 0 ; j < 8 ; j++)
+		{
+			if (!(pvs[i] & (1 << j)))
+				continue;
+			leaf = (i << 3) + j;
+			if (leaf >= ev->numleafs)
+				break;
+			for (k = ev->leafstart[leaf] ; k < ev->leafstart[leaf + 1] ; k++)
+				ents[ev->leafents[k] >> 5] |= 1u << (ev->leafents[k] & 31);
+		}
+	}
+
+	return ents;
+}
+
+//=============================================================================
+
+/*
+=============
+SV_UpdateEntityAlpha -- johnfitz
+=============
+*/
+static void SV_UpdateEntityAlpha (edict_t *ent)
+{
+	eval_t	*val;
+
+	if (pr_alpha_supported)
+	{
+		// TODO: find a cleaner place to put this code
+		val = GetEdictFieldValue(ent, "alpha");
+		if (val)
+			ent->alpha = ENTALPHA_ENCODE(val->_float);
+	}
+}
+
+/*
+=============
+SV_EntitySnapshot
+
+Captures the fields of an entity update in their wire precision.
+=============
+*/
+static void SV_EntitySnapshot (edict_t *ent, int e, snapentity_t *s)
+{
+	s->num = e;
+	VectorCopy (ent->v.origin, s->state.origin);
+	VectorCopy (ent->v.angles, s->state.angles);
+	s->state.modelindex = (int)ent->v.modelindex;
+	s->state.frame = (int)ent->v.frame;
+	s->state.colormap = (int)ent->v.colormap;
+	s->state.skin = (int)ent->v.skin;
+	s->state.alpha = ent->alpha;
+	s->state.effects = (int)ent->v.effects;
+
+	s->bits = 0;
+	if (ent->v.movetype == MOVETYPE_STEP)
+		s->bits |= U_STEP;	// don't mess up the step animation
+	if (ent->sendinterval && sv.protocol != PROTOCOL_NETQUAKE)
+		s->bits |= U_LERPFINISH;
+	s->lerpfinish = (byte)(Q_rint((ent->v.nextthink-sv.time)*255));
+}
+
+/*
+=============
+SV_WriteEntityUpdate
+
+Writes the fields flagged in bits, which must already include the
+U_MOREBITS/U_EXTEND/U_LONGENTITY bits the values need.
+=============
+*/
+static void SV_WriteEntityUpdate (sizebuf_t *msg, int bits, const snapentity_t *s)
+{
+	MSG_WriteByte (msg, bits | U_SIGNAL);
+
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (bits & U_EXTEND1)
+		MSG_WriteByte(msg, bits>>16);
+	if (bits & U_EXTEND2)
+		MSG_WriteByte(msg, bits>>24);
+	//johnfitz
+
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg, s->num);
+	else
+		MSG_WriteByte (msg, s->num);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg, s->state.modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, s->state.frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, s->state.colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, s->state.skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, s->state.effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, s->state.origin[0], sv.protocolflags);
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle(msg, s->state.angles[0], sv.protocolflags);
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, s->state.origin[1], sv.protocolflags);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle(msg, s->state.angles[1], sv.protocolflags);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, s->state.origin[2], sv.protocolflags);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle(msg, s->state.angles[2], sv.protocolflags);
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (bits & U_ALPHA)
+		MSG_WriteByte(msg, s->state.alpha);
+	if (bits & U_FRAME2)
+		MSG_WriteByte(msg, s->state.frame >> 8);
+	if (bits & U_MODEL2)
+		MSG_WriteByte(msg, s->state.modelindex >> 8);
+	if (bits & U_LERPFINISH)
+		MSG_WriteByte(msg, s->lerpfinish);
+	//johnfitz
+}
+
+/*
+=============
+SV_PacketOverflow -- johnfitz -- less spammy overflow message
+=============
+*/
+static void SV_PacketOverflow (void)
+{
+	if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
+	{
+		Con_Printf ("Packet overflow!\n");
+		dev_overflows.packetsize = realtime;
+	}
+}
+
+/*
+=============
+SV_PacketStats -- johnfitz -- devstats
+=============
+*/
+static void SV_PacketStats (sizebuf_t *msg)
+{
+	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
+		Con_DWarning ("%i byte packet exceeds standard limit of 1024 (max = %d).\n", msg->cursize, msg->maxsize);
+	dev_stats.packetsize = msg->cursize;
+	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
+}
+
+/*
+=============
+SV_EntityUpdateBits
+
+The bits of an update relative to the baseline, -1 for an entity that
+isn't sent at all.
+=============
+*/
+static int SV_EntityUpdateBits (edict_t *ent, int e)
+{
+	int		i;
+	int		bits;
+	float	miss;
+
+	bits = 0;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = ent->v.origin[i] - ent->baseline.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if ( ent->v.angles[0] != ent->baseline.angles[0] )
+		bits |= U_ANGLE1;
+
+	if ( ent->v.angles[1] != ent->baseline.angles[1] )
+		bits |= U_ANGLE2;
+
+	if ( ent->v.angles[2] != ent->baseline.angles[2] )
+		bits |= U_ANGLE3;
+
+	if (ent->v.movetype == MOVETYPE_STEP)
+		bits |= U_STEP;	// don't mess up the step animation
+
+	if (ent->baseline.colormap != ent->v.colormap)
+		bits |= U_COLORMAP;
+
+	if (ent->baseline.skin != ent->v.skin)
+		bits |= U_SKIN;
+
+	if (ent->baseline.frame != ent->v.frame)
+		bits |= U_FRAME;
+
+	if (ent->baseline.effects != ent->v.effects)
+		bits |= U_EFFECTS;
+
+	if (ent->baseline.modelindex != ent->v.modelindex)
+		bits |= U_MODEL;
+
+	SV_UpdateEntityAlpha (ent);
+
+	//johnfitz -- don't send invisible entities unless they have effects
+	if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+		return -1;
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (sv.protocol != PROTOCOL_NETQUAKE)
+	{
+
+		if (ent->baseline.alpha != ent->alpha) bits |= U_ALPHA;
+		if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
+		if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
+		if (ent->sendinterval) bits |= U_LERPFINISH;
+		if (bits >= 65536) bits |= U_EXTEND1;
+		if (bits >= 16777216) bits |= U_EXTEND2;
+	}
+	//johnfitz
+
+	if (e >= 256)
+		bits |= U_LONGENTITY;
+
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+	return bits;
+}
+
 //=============================================================================
 
 /*
@@ -556,194 +1152,365 @@ SV_WriteEntitiesToClient
 */
 void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 {
-	int		e, i;
+	int		e;
 	int		bits;
-	byte	*pvs;
+	unsigned	*visents;
+	int		clentnum;
 	vec3_t	org;
-	float	miss;
 	edict_t	*ent;
+	snapentity_t	snap;
 
-// find the client's PVS
+// find the entities touching the client's PVS
 	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, sv.worldmodel);
+	visents = SV_VisibleEntities (org);
+	clentnum = NUM_FOR_EDICT(clent);
 
 // send over all entities (excpet the client) that touch the pvs
-	ent = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	for (e=1 ; e<sv.num_edicts ; e++)
 	{
-
-		if (ent != clent)	// clent is ALLWAYS sent
+		if (e != clentnum)	// clent is ALLWAYS sent
 		{
-			// ignore ents without visible models
-			if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
-				continue;
-
-			//johnfitz -- don't send model>255 entities if protocol is 15
-			if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
-				continue;
-
-			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-			
-			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
-			//
-			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
-			// for us to say whether it's in the PVS, so don't try to vis cull it.
-			// this commonly happens with rotators, because they often have huge bboxes
-			// spanning the entire map, or really tall lifts, etc.
-			if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
+			if (!(visents[e >> 5] & (1u << (e & 31))))
+			{
+				// skip the rest of an empty word unless the client is in it
+				if (!visents[e >> 5] && (e >> 5) != (clentnum >> 5))
+					e |= 31;
 				continue;		// not visible
+			}
 		}
+		ent = EDICT_NUM(e);
 
 		//johnfitz -- max size for protocol 15 is 18 bytes, not 16 as originally
 		//assumed here.  And, for protocol 85 the max size is actually 24 bytes.
 		if (msg->cursize + 24 > msg->maxsize)
 		{
-			//johnfitz -- less spammy overflow message
-			if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
-			{
-				Con_Printf ("Packet overflow!\n");
-				dev_overflows.packetsize = realtime;
-			}
-			goto stats;
-			//johnfitz
+			SV_PacketOverflow ();
+			break;
 		}
 
 // send an update
-		bits = 0;
+		bits = SV_EntityUpdateBits (ent, e);
+		if (bits == -1)
+			continue;
 
-		for (i=0 ; i<3 ; i++)
-		{
-			miss = ent->v.origin[i] - ent->baseline.origin[i];
-			if ( miss < -0.1 || miss > 0.1 )
-				bits |= U_ORIGIN1<<i;
-		}
+	//
+	// write the message
+	//
+		SV_EntitySnapshot (ent, e, &snap);
+		SV_WriteEntityUpdate (msg, bits, &snap);
+	}
+
+	SV_PacketStats (msg);
+}
+
+/*
+=============
+SV_WriteAllEntities
+
+Every client and every entity with a model, whoever can see it, for server
+side demos.
+=============
+*/
+void SV_WriteAllEntities (sizebuf_t *msg)
+{
+	int		e;
+	int		bits;
+	edict_t	*ent;
+	snapentity_t	snap;
+
+	for (e=1 ; e<sv.num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->free)
+			continue;
+		if (e > svs.maxclients && !SV_EntityHasVisibleModel (ent))
+			continue;
+
+		if (msg->cursize + 24 > msg->maxsize)
+			break;
+
+		bits = SV_EntityUpdateBits (ent, e);
+		if (bits == -1)
+			continue;
+
+		SV_EntitySnapshot (ent, e, &snap);
+		SV_WriteEntityUpdate (msg, bits, &snap);
+	}
+}
+
+/*
+=============================================================================
+
+ENTITY DELTAS
+
+Clients that ask for it with "deltaentities" get svc_deltaentities instead of
+one update per entity per frame.  Every snapshot sent is kept for
+ENTITYDELTA_BACKUP frames, and the next one only carries what changed since
+the last snapshot the client acknowledged with clc_deltaack.  Until there is
+an usable ack, or if it got too old, the snapshot is relative to the baselines.
+
+The stored snapshot is what the client will hold after parsing, so origins
+that moved less than the send threshold keep the old value instead of
+drifting.
+
+=============================================================================
+*/
 
-		if ( ent->v.angles[0] != ent->baseline.angles[0] )
-			bits |= U_ANGLE1;
+typedef struct
+{
+	int		frame;			/* 0 if unused */
+	int		numents;
+	int		maxents;
+	snapentity_t	*ents;
+} svsnapshot_t;
+
+typedef struct
+{
+	int		sequence;		/* last frame sent */
+	svsnapshot_t	frames[ENTITYDELTA_BACKUP];
+} svsnapshots_t;
 
-		if ( ent->v.angles[1] != ent->baseline.angles[1] )
-			bits |= U_ANGLE2;
+static svsnapshots_t	sv_snapshots[MAX_SCOREBOARD];
+static snapentity_t	*sv_snapents;
+static int		sv_maxsnapents;
 
-		if ( ent->v.angles[2] != ent->baseline.angles[2] )
-			bits |= U_ANGLE3;
+/*
+=============
+SV_ReserveSnapshot
+=============
+*/
+static void SV_ReserveSnapshot (snapentity_t **ents, int *maxents, int count)
+{
+	if (count <= *maxents)
+		return;
+	*maxents = count + count / 2;
+	*ents = (snapentity_t *) realloc (*ents, *maxents * sizeof(snapentity_t));
+	if (!*ents)
+		Sys_Error ("SV_ReserveSnapshot: realloc() failed on %d entities", *maxents);
+}
 
-		if (ent->v.movetype == MOVETYPE_STEP)
-			bits |= U_STEP;	// don't mess up the step animation
+/*
+=============
+SV_ClearSnapshots
 
-		if (ent->baseline.colormap != ent->v.colormap)
-			bits |= U_COLORMAP;
+Forgets every snapshot sent to a client, the next one goes from baselines.
+=============
+*/
+void SV_ClearSnapshots (client_t *client)
+{
+	svsnapshots_t	*snaps = &sv_snapshots[client - svs.clients];
+	int		i;
 
-		if (ent->baseline.skin != ent->v.skin)
-			bits |= U_SKIN;
+	snaps->sequence = 0;
+	for (i = 0 ; i < ENTITYDELTA_BACKUP ; i++)
+	{
+		snaps->frames[i].frame = 0;
+		snaps->frames[i].numents = 0;
+	}
+	client->deltaframe = 0;
+}
 
-		if (ent->baseline.frame != ent->v.frame)
-			bits |= U_FRAME;
+/*
+=============
+SV_EntityDeltaBits
+
+Update bits for moving from one entity state to another.
+=============
+*/
+static int SV_EntityDeltaBits (const snapentity_t *from, const snapentity_t *to)
+{
+	int	i, bits;
+	float	miss;
+
+	bits = 0;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = to->state.origin[i] - from->state.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if (to->state.angles[0] != from->state.angles[0])
+		bits |= U_ANGLE1;
+	if (to->state.angles[1] != from->state.angles[1])
+		bits |= U_ANGLE2;
+	if (to->state.angles[2] != from->state.angles[2])
+		bits |= U_ANGLE3;
+
+	if (to->state.colormap != from->state.colormap)
+		bits |= U_COLORMAP;
+	if (to->state.skin != from->state.skin)
+		bits |= U_SKIN;
+	if (to->state.frame != from->state.frame)
+		bits |= U_FRAME;
+	if (to->state.effects != from->state.effects)
+		bits |= U_EFFECTS;
+	if (to->state.modelindex != from->state.modelindex)
+		bits |= U_MODEL;
+	if (to->state.alpha != from->state.alpha)
+		bits |= U_ALPHA;
+
+	if (bits & U_FRAME && to->state.frame & 0xFF00)
+		bits |= U_FRAME2;
+	if (bits & U_MODEL && to->state.modelindex & 0xFF00)
+		bits |= U_MODEL2;
+
+	return bits | to->bits;
+}
+
+/*
+=============
+SV_FinishEntityBits
+=============
+*/
+static int SV_FinishEntityBits (int bits, int e)
+{
+	if (bits >= 65536) bits |= U_EXTEND1;
+	if (bits >= 16777216) bits |= U_EXTEND2;
+	if (e >= 256)
+		bits |= U_LONGENTITY;
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+	return bits;
+}
+
+/*
+=============
+SV_CollectEntities
+
+The entities SV_WriteEntitiesToClient would send, in edict order.
+=============
+*/
+static int SV_CollectEntities (edict_t *clent)
+{
+	int		e, count;
+	unsigned	*visents;
+	int		clentnum;
+	vec3_t		org;
+	edict_t		*ent;
 
-		if (ent->baseline.effects != ent->v.effects)
-			bits |= U_EFFECTS;
+	SV_ReserveSnapshot (&sv_snapents, &sv_maxsnapents, sv.num_edicts);
 
-		if (ent->baseline.modelindex != ent->v.modelindex)
-			bits |= U_MODEL;
+	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+	visents = SV_VisibleEntities (org);
+	clentnum = NUM_FOR_EDICT(clent);
 
-		//johnfitz -- alpha
-		if (pr_alpha_supported)
+	count = 0;
+	for (e=1 ; e<sv.num_edicts ; e++)
+	{
+		if (e != clentnum && !(visents[e >> 5] & (1u << (e & 31))))
 		{
-			// TODO: find a cleaner place to put this code
-			eval_t	*val;
-			val = GetEdictFieldValue(ent, "alpha");
-			if (val)
-				ent->alpha = ENTALPHA_ENCODE(val->_float);
+			if (!visents[e >> 5] && (e >> 5) != (clentnum >> 5))
+				e |= 31;
+			continue;
 		}
+		ent = EDICT_NUM(e);
 
-		//don't send invisible entities unless they have effects
+		SV_UpdateEntityAlpha (ent);
 		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
 			continue;
-		//johnfitz
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol != PROTOCOL_NETQUAKE)
-		{
+		SV_EntitySnapshot (ent, e, &sv_snapents[count++]);
+	}
 
-			if (ent->baseline.alpha != ent->alpha) bits |= U_ALPHA;
-			if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
-			if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
-			if (ent->sendinterval) bits |= U_LERPFINISH;
-			if (bits >= 65536) bits |= U_EXTEND1;
-			if (bits >= 16777216) bits |= U_EXTEND2;
-		}
-		//johnfitz
+	return count;
+}
+
+/*
+=============
+SV_WriteEntityDeltas
+=============
+*/
+void SV_WriteEntityDeltas (client_t *client, sizebuf_t *msg)
+{
+	svsnapshots_t	*snaps = &sv_snapshots[client - svs.clients];
+	svsnapshot_t	*from, *to;
+	snapentity_t	*cur, *old, *out, base;
+	int		frame, numcur, i, j, k, bits;
+	edict_t		*ent;
+
+	if (msg->cursize + 10 > msg->maxsize)
+	{
+		SV_PacketOverflow ();
+		return;
+	}
 
-		if (e >= 256)
-			bits |= U_LONGENTITY;
+	numcur = SV_CollectEntities (client->edict);
 
-		if (bits >= 256)
-			bits |= U_MOREBITS;
+	frame = snaps->sequence + 1;
+	from = &snaps->frames[client->deltaframe & ENTITYDELTA_MASK];
+	if (client->deltaframe <= 0 || frame - client->deltaframe >= ENTITYDELTA_BACKUP || from->frame != client->deltaframe)
+		from = NULL;
 
-	//
-	// write the message
-	//
-		MSG_WriteByte (msg, bits | U_SIGNAL);
+	to = &snaps->frames[frame & ENTITYDELTA_MASK];
+	to->frame = 0;
+	SV_ReserveSnapshot (&to->ents, &to->maxents, numcur + (from ? from->numents : 0));
 
-		if (bits & U_MOREBITS)
-			MSG_WriteByte (msg, bits>>8);
+	MSG_WriteByte (msg, svc_deltaentities);
+	MSG_WriteLong (msg, frame);
+	MSG_WriteLong (msg, from ? from->frame : 0);
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (bits & U_EXTEND1)
-			MSG_WriteByte(msg, bits>>16);
-		if (bits & U_EXTEND2)
-			MSG_WriteByte(msg, bits>>24);
-		//johnfitz
+// walk the new and old entity lists together
+	out = to->ents;
+	for (i = j = 0 ; i < numcur || (from && j < from->numents) ; )
+	{
+		cur = (i < numcur) ? &sv_snapents[i] : NULL;
+		old = (from && j < from->numents) ? &from->ents[j] : NULL;
 
-		if (bits & U_LONGENTITY)
-			MSG_WriteShort (msg,e);
+		// one for the terminator
+		if (msg->cursize + 24 + 1 > msg->maxsize)
+		{
+			SV_PacketOverflow ();
+			break;
+		}
+
+		if (old && (!cur || old->num < cur->num))
+		{
+			SV_WriteEntityUpdate (msg, SV_FinishEntityBits (U_REMOVE, old->num), old);
+			j++;
+			continue;
+		}
+
+		if (old && old->num == cur->num)
+			j++;
 		else
-			MSG_WriteByte (msg,e);
-
-		if (bits & U_MODEL)
-			MSG_WriteByte (msg,	ent->v.modelindex);
-		if (bits & U_FRAME)
-			MSG_WriteByte (msg, ent->v.frame);
-		if (bits & U_COLORMAP)
-			MSG_WriteByte (msg, ent->v.colormap);
-		if (bits & U_SKIN)
-			MSG_WriteByte (msg, ent->v.skin);
-		if (bits & U_EFFECTS)
-			MSG_WriteByte (msg, ent->v.effects);
-		if (bits & U_ORIGIN1)
-			MSG_WriteCoord (msg, ent->v.origin[0], sv.protocolflags);
-		if (bits & U_ANGLE1)
-			MSG_WriteAngle(msg, ent->v.angles[0], sv.protocolflags);
-		if (bits & U_ORIGIN2)
-			MSG_WriteCoord (msg, ent->v.origin[1], sv.protocolflags);
-		if (bits & U_ANGLE2)
-			MSG_WriteAngle(msg, ent->v.angles[1], sv.protocolflags);
-		if (bits & U_ORIGIN3)
-			MSG_WriteCoord (msg, ent->v.origin[2], sv.protocolflags);
-		if (bits & U_ANGLE3)
-			MSG_WriteAngle(msg, ent->v.angles[2], sv.protocolflags);
+		{
+			ent = EDICT_NUM(cur->num);
+			base.num = cur->num;
+			base.state = ent->baseline;
+			base.bits = 0;
+			old = &base;
+		}
+		i++;
+
+		bits = SV_EntityDeltaBits (old, cur);
+		*out = *cur;
+		for (k = 0 ; k < 3 ; k++)
+			if (!(bits & (U_ORIGIN1<<k)))
+				out->state.origin[k] = old->state.origin[k];
+		out++;
+
+		// nothing the client can't work out for itself; it replays the
+		// lerpfinish byte it has against the new frame time
+		if (old != &base && !(bits & ~U_STEP) && !((old->bits ^ cur->bits) & (U_STEP|U_LERPFINISH))
+			&& (!(cur->bits & U_LERPFINISH) || old->lerpfinish == cur->lerpfinish))
+			continue;
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (bits & U_ALPHA)
-			MSG_WriteByte(msg, ent->alpha);
-		if (bits & U_FRAME2)
-			MSG_WriteByte(msg, (int)ent->v.frame >> 8);
-		if (bits & U_MODEL2)
-			MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
-		if (bits & U_LERPFINISH)
-			MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-sv.time)*255)));
-		//johnfitz
+		SV_WriteEntityUpdate (msg, SV_FinishEntityBits (bits, cur->num), cur);
 	}
 
-	//johnfitz -- devstats
-stats:
-	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
-		Con_DWarning ("%i byte packet exceeds standard limit of 1024 (max = %d).\n", msg->cursize, msg->maxsize);
-	dev_stats.packetsize = msg->cursize;
-	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
-	//johnfitz
+// anything not reached keeps its old state on the client too
+	for ( ; from && j < from->numents ; j++)
+		*out++ = from->ents[j];
+
+	MSG_WriteByte (msg, 0);
+
+	to->numents = out - to->ents;
+	to->frame = frame;
+	snaps->sequence = frame;
+
+	SV_PacketStats (msg);
 }
 
 /*
@@ -955,6 +1722,7 @@ qboolean SV_SendClientDatagram (client_t *client)
 {
 	byte		buf[MAX_DATAGRAM];
 	sizebuf_t	msg;
+	int			start;
 
 	msg.data = buf;
 	msg.maxsize = sizeof(buf);
@@ -969,9 +1737,15 @@ qboolean SV_SendClientDatagram (client_t *client)
 	MSG_WriteFloat (&msg, sv.time);
 
 // add the client specific data to the datagram
+	start = msg.cursize;
 	SV_WriteClientdataToMessage (client->edict, &msg);
+	if (sv_demorecording)
+		SV_DemoClientData (client, msg.data + start, msg.cursize - start);
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	if (client->deltaentities)
+		SV_WriteEntityDeltas (client, &msg);
+	else
+		SV_WriteEntitiesToClient (client->edict, &msg);
 
 // copy the server datagram if there is space
 	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
@@ -1059,9 +1833,17 @@ void SV_SendClientMessages (void)
 {
 	int			i;
 
+	PROF_BEGIN ("SV_SendClientMessages");
+
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+	if (sv_demorecording)
+		SV_DemoBeginFrame ();
+
+// entities may have moved since the last frame
+	SV_InvalidateEntityVis ();
+
 // build individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
@@ -1110,6 +1892,8 @@ void SV_SendClientMessages (void)
 				SV_DropClient (false);	// went to another level
 			else
 			{
+				if (sv_demorecording)
+					SV_DemoReliable (host_client);
 				if (NET_SendMessage (host_client->netconnection
 				, &host_client->message) == -1)
 					SV_DropClient (true);	// if the message couldn't send, kick off
@@ -1121,8 +1905,13 @@ void SV_SendClientMessages (void)
 	}
 
 
+	if (sv_demorecording)
+		SV_DemoEndFrame ();
+
 // clear muzzle flashes
 	SV_CleanupEnts ();
+
+	PROF_END ();
 }
 
 
@@ -1397,6 +2186,7 @@ void SV_SpawnServer (const char *server)
 // leave slots at start for clients only
 	sv.num_edicts = svs.maxclients+1;
 	memset(sv.edicts, 0, sv.num_edicts*pr_edict_size); // ericw -- sv.edicts switched to use malloc()
+	ED_ResetFindIndex ();
 	for (i=0 ; i<svs.maxclients ; i++)
 	{
 		ent = EDICT_NUM(i+1);
@@ -38,9 +38,11 @@ int c_yes, c_no;
 
 qboolean SV_CheckBottom (edict_t *ent)
 {
-	vec3_t	mins, maxs, start, stop;
-	trace_t	trace;
-	int		x, y;
+	vec3_t	mins, maxs;
+	vec3_t	starts[5], stops[5];
+	int		contents[4];
+	trace_t	traces[5];
+	int		x, y, i;
 	float	mid, bottom;
 
 	VectorAdd (ent->v.origin, ent->v.mins, mins);
@@ -49,15 +51,20 @@ qboolean SV_CheckBottom (edict_t *ent)
 // if all of the points under the corners are solid world, don't bother
 // with the tougher checks
 // the corners must be within 16 of the midpoint
-	start[2] = mins[2] - 1;
 	for	(x=0 ; x<=1 ; x++)
 		for	(y=0 ; y<=1 ; y++)
 		{
-			start[0] = x ? maxs[0] : mins[0];
-			start[1] = y ? maxs[1] : mins[1];
-			if (SV_PointContents (start) != CONTENTS_SOLID)
-				goto realcheck;
+			i = x*2 + y;
+			starts[i][0] = x ? maxs[0] : mins[0];
+			starts[i][1] = y ? maxs[1] : mins[1];
+			starts[i][2] = mins[2] - 1;
 		}
+	SV_PointContentsBatch (4, starts, contents);
+	for (i=0 ; i<4 ; i++)
+	{
+		if (contents[i] != CONTENTS_SOLID)
+			goto realcheck;
+	}
 
 	c_yes++;
 	return true;		// we got out easy
@@ -67,32 +74,38 @@ realcheck:
 //
 // check it for real...
 //
-	start[2] = mins[2];
+// the corners and the midpoint go down in one batch, the midpoint last
+	for (i=0 ; i<5 ; i++)
+	{
+		if (i < 4)
+		{
+			starts[i][0] = (i & 2) ? maxs[0] : mins[0];
+			starts[i][1] = (i & 1) ? maxs[1] : mins[1];
+		}
+		else
+		{
+			starts[i][0] = (mins[0] + maxs[0])*0.5;
+			starts[i][1] = (mins[1] + maxs[1])*0.5;
+		}
+		starts[i][2] = mins[2];
+		VectorCopy (starts[i], stops[i]);
+		stops[i][2] = mins[2] - 2*STEPSIZE;
+	}
+	SV_MoveBatch (5, starts, stops, vec3_origin, vec3_origin, true, ent, traces);
 
 // the midpoint must be within 16 of the bottom
-	start[0] = stop[0] = (mins[0] + maxs[0])*0.5;
-	start[1] = stop[1] = (mins[1] + maxs[1])*0.5;
-	stop[2] = start[2] - 2*STEPSIZE;
-	trace = SV_Move (start, vec3_origin, vec3_origin, stop, true, ent);
-
-	if (trace.fraction == 1.0)
+	if (traces[4].fraction == 1.0)
 		return false;
-	mid = bottom = trace.endpos[2];
+	mid = bottom = traces[4].endpos[2];
 
 // the corners must be within 16 of the midpoint
-	for	(x=0 ; x<=1 ; x++)
-		for	(y=0 ; y<=1 ; y++)
-		{
-			start[0] = stop[0] = x ? maxs[0] : mins[0];
-			start[1] = stop[1] = y ? maxs[1] : mins[1];
-
-			trace = SV_Move (start, vec3_origin, vec3_origin, stop, true, ent);
-
-			if (trace.fraction != 1.0 && trace.endpos[2] > bottom)
-				bottom = trace.endpos[2];
-			if (trace.fraction == 1.0 || mid - trace.endpos[2] > STEPSIZE)
-				return false;
-		}
+	for (i=0 ; i<4 ; i++)
+	{
+		if (traces[i].fraction != 1.0 && traces[i].endpos[2] > bottom)
+			bottom = traces[i].endpos[2];
+		if (traces[i].fraction == 1.0 || mid - traces[i].endpos[2] > STEPSIZE)
+			return false;
+	}
 
 	c_yes++;
 	return true;
@@ -47,6 +47,8 @@ cvar_t	sv_gravity = {"sv_gravity","800",CVAR_NOTIFY|CVAR_SERVERINFO};
 cvar_t	sv_maxvelocity = {"sv_maxvelocity","2000",CVAR_NONE};
 cvar_t	sv_nostep = {"sv_nostep","0",CVAR_NONE};
 cvar_t	sv_freezenonclients = {"sv_freezenonclients","0",CVAR_NONE};
+cvar_t	sv_parallelphysics = {"sv_parallelphysics","0",CVAR_NONE};
+cvar_t	sv_parallelcheck = {"sv_parallelcheck","0",CVAR_NONE};
 
 
 #define	MOVE_EPSILON	0.01
@@ -383,16 +385,21 @@ SV_AddGravity
 
 ============
 */
-void SV_AddGravity (edict_t *ent)
+static float SV_EntityGravity (edict_t *ent)
 {
-	float	ent_gravity;
 	eval_t	*val;
 
 	val = GetEdictFieldValue(ent, "gravity");
 	if (val && val->_float)
-		ent_gravity = val->_float;
-	else
-		ent_gravity = 1.0;
+		return val->_float;
+	return 1.0;
+}
+
+void SV_AddGravity (edict_t *ent)
+{
+	float	ent_gravity;
+
+	ent_gravity = SV_EntityGravity (ent);
 
 	ent->v.velocity[2] -= ent_gravity * sv_gravity.value * host_frametime;
 }
@@ -406,6 +413,17 @@ PUSHMOVE
 ===============================================================================
 */
 
+static int SV_PushMoveType (edict_t *ent)
+{
+	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
+		return MOVE_MISSILE;
+	if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
+		return MOVE_NOMONSTERS;	// only clip against bmodels
+	return MOVE_NORMAL;
+}
+
+static qboolean SV_SpeculatedMove (edict_t *ent, vec3_t end, int type, trace_t *trace);
+
 /*
 ============
 SV_PushEntity
@@ -417,16 +435,13 @@ trace_t SV_PushEntity (edict_t *ent, vec3_t push)
 {
 	trace_t	trace;
 	vec3_t	end;
+	int		type;
 
 	VectorAdd (ent->v.origin, push, end);
 
-	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_MISSILE, ent);
-	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
-	// only clip against bmodels
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NOMONSTERS, ent);
-	else
-		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NORMAL, ent);
+	type = SV_PushMoveType (ent);
+	if (!SV_SpeculatedMove (ent, end, type, &trace))
+		trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent);
 
 	VectorCopy (trace.endpos, ent->v.origin);
 	SV_LinkEdict (ent, true);
@@ -1180,6 +1195,260 @@ void SV_Physics_Step (edict_t *ent)
 }
 
 
+/*
+===============================================================================
+
+PARALLEL MOVES
+
+With sv_parallelphysics, the traces of free flying toss, bounce, fly and
+missile entities are made up front from the state at the start of the
+frame, on the task threads, one area node island per job. The serial loop
+still runs all the thinks and touches in edict order, and SV_PushEntity only
+takes a precomputed trace when it is about to make the very same move and
+nothing the trace looked at has moved or changed since, so the frame comes
+out as it would serially. sv_parallelcheck 1 reruns every reused trace on
+the spot and reports any difference.
+
+===============================================================================
+*/
+
+#define	MAX_SPECMOVES	1024
+
+typedef struct
+{
+	edict_t		*ent;
+	int			type;
+	qboolean	used;
+	vec3_t		start, end;
+	trace_t		trace;
+	movedeps_t	deps;
+} specmove_t;
+
+typedef struct
+{
+	int			first, count;	// into sv_specorder
+} specisland_t;
+
+static	specmove_t		sv_specmoves[MAX_SPECMOVES];	// in edict order
+static	int				sv_numspecmoves;
+static	int				sv_specorder[MAX_SPECMOVES];	// grouped by island
+static	specisland_t	sv_specislands[AREA_NODES];
+static	int				sv_numspecislands;
+
+static struct
+{
+	int		moves, reused, rejected, mismatched;
+} sv_specstats;
+
+/*
+=============
+SV_SpeculateIsland
+
+Task function, traces the moves of one island.
+=============
+*/
+static void SV_SpeculateIsland (void *data, int index, int thread)
+{
+	specisland_t	*island = &sv_specislands[index];
+	specmove_t		*spec;
+	int				i;
+
+	for (i=island->first ; i<island->first+island->count ; i++)
+	{
+		spec = &sv_specmoves[sv_specorder[i]];
+		spec->trace = SV_MoveThread (spec->start, spec->ent->v.mins, spec->ent->v.maxs, spec->end,
+					spec->type, spec->ent, thread, &spec->deps);
+	}
+}
+
+/*
+=============
+SV_SpeculateMoves
+
+Predicts the SV_Physics_Toss move of every entity that isn't resting or
+about to think, groups them by the area node they are linked in and traces
+the groups in parallel.
+=============
+*/
+static void SV_SpeculateMoves (void)
+{
+	int			counts[AREA_NODES];
+	int			islands[MAX_SPECMOVES];
+	edict_t		*ent;
+	specmove_t	*spec;
+	vec3_t		vel, move;
+	int			i, j;
+
+	sv_numspecmoves = 0;
+	sv_numspecislands = 0;
+	SV_TrackMoves (false);
+
+	if (!sv_parallelphysics.value || sv_freezenonclients.value)
+		return;
+	if (pr_global_struct->force_retouch)
+		return;		// everything gets relinked anyway
+
+	SV_TrackMoves (true);
+
+	memset (counts, 0, sizeof(counts));
+	ent = EDICT_NUM(svs.maxclients + 1);
+	for (i=svs.maxclients+1 ; i<sv.num_edicts && sv_numspecmoves<MAX_SPECMOVES ; i++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->free)
+			continue;
+		if (ent->v.movetype != MOVETYPE_TOSS
+		&& ent->v.movetype != MOVETYPE_BOUNCE
+		&& ent->v.movetype != MOVETYPE_FLY
+		&& ent->v.movetype != MOVETYPE_FLYMISSILE)
+			continue;
+		if ((int)ent->v.flags & FL_ONGROUND)
+			continue;
+		if (ent->v.nextthink > 0 && ent->v.nextthink <= sv.time + host_frametime)
+			continue;	// the think is likely to change the move
+
+	// same steps as SV_Physics_Toss, on a copy
+		VectorCopy (ent->v.velocity, vel);
+		for (j=0 ; j<3 ; j++)
+		{
+			if (IS_NAN(vel[j]) || IS_NAN(ent->v.origin[j]))
+				break;	// leave the warnings to SV_CheckVelocity
+			if (vel[j] > sv_maxvelocity.value)
+				vel[j] = sv_maxvelocity.value;
+			else if (vel[j] < -sv_maxvelocity.value)
+				vel[j] = -sv_maxvelocity.value;
+		}
+		if (j < 3)
+			continue;
+
+		if (ent->v.movetype != MOVETYPE_FLY
+		&& ent->v.movetype != MOVETYPE_FLYMISSILE)
+			vel[2] -= SV_EntityGravity (ent) * sv_gravity.value * host_frametime;
+
+		spec = &sv_specmoves[sv_numspecmoves];
+		spec->ent = ent;
+		spec->type = SV_PushMoveType (ent);
+		spec->used = false;
+		VectorScale (vel, host_frametime, move);
+		VectorCopy (ent->v.origin, spec->start);
+		VectorAdd (ent->v.origin, move, spec->end);
+
+		islands[sv_numspecmoves] = SV_AreaNodeForBox (ent->v.absmin, ent->v.absmax);
+		counts[islands[sv_numspecmoves]]++;
+		sv_numspecmoves++;
+	}
+
+	if (!sv_numspecmoves)
+		return;
+
+// one job per island, edict order within each
+	for (i=0, j=0 ; i<AREA_NODES ; i++)
+	{
+		if (!counts[i])
+			continue;
+		sv_specislands[sv_numspecislands].first = j;
+		sv_specislands[sv_numspecislands].count = 0;
+		j += counts[i];
+		counts[i] = sv_numspecislands++;
+	}
+	for (i=0 ; i<sv_numspecmoves ; i++)
+	{
+		specisland_t *island = &sv_specislands[counts[islands[i]]];
+		sv_specorder[island->first + island->count++] = i;
+	}
+
+	sv_movethreads = true;
+	Tasks_ParallelFor (SV_SpeculateIsland, NULL, sv_numspecislands);
+	sv_movethreads = false;
+
+	sv_specstats.moves += sv_numspecmoves;
+}
+
+static qboolean SV_TracesEqual (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos)
+		&& VectorCompare (a->plane.normal, b->plane.normal)
+		&& a->plane.dist == b->plane.dist && a->ent == b->ent;
+}
+
+/*
+=============
+SV_SpeculatedMove
+
+Fills in trace and returns true if SV_SpeculateMoves already made this
+move and its result still holds. Each precomputed move is tried once.
+=============
+*/
+static qboolean SV_SpeculatedMove (edict_t *ent, vec3_t end, int type, trace_t *trace)
+{
+	specmove_t	*spec;
+	trace_t		check;
+	int			lo, hi, mid;
+
+	lo = 0;
+	hi = sv_numspecmoves;
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (sv_specmoves[mid].ent < ent)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == sv_numspecmoves || sv_specmoves[lo].ent != ent)
+		return false;
+
+	spec = &sv_specmoves[lo];
+	if (spec->used)
+		return false;
+	spec->used = true;
+
+	if (spec->type != type
+	|| !VectorCompare (spec->start, ent->v.origin)
+	|| !VectorCompare (spec->end, end)
+	|| !SV_MoveDepsValid (&spec->deps, ent))
+	{
+		sv_specstats.rejected++;
+		return false;
+	}
+
+	sv_specstats.reused++;
+	*trace = spec->trace;
+
+	if (sv_parallelcheck.value)
+	{
+		check = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent);
+		if (!SV_TracesEqual (trace, &check))
+		{
+			sv_specstats.mismatched++;
+			Con_Printf ("parallel physics mismatch: edict %i (%s) at %f, fraction %f vs %f\n",
+				NUM_FOR_EDICT(ent), PR_GetString(ent->v.classname), sv.time, trace->fraction, check.fraction);
+			*trace = check;
+		}
+	}
+
+	return true;
+}
+
+/*
+=============
+SV_ParallelStats_f
+
+Prints and clears the parallel physics counters.
+=============
+*/
+void SV_ParallelStats_f (void)
+{
+	Con_Printf ("%i moves traced ahead, %i reused, %i rejected", sv_specstats.moves,
+		sv_specstats.reused, sv_specstats.rejected);
+	if (sv_parallelcheck.value || sv_specstats.mismatched)
+		Con_Printf (", %i mismatched", sv_specstats.mismatched);
+	Con_Printf ("\n");
+
+	memset (&sv_specstats, 0, sizeof(sv_specstats));
+}
+
 //============================================================================
 
 /*
@@ -1194,6 +1463,8 @@ void SV_Physics (void)
 	int	entity_cap; // For sv_freezenonclients 
 	edict_t	*ent;
 
+	PROF_BEGIN ("SV_Physics");
+
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
 	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -1202,6 +1473,8 @@ void SV_Physics (void)
 
 //SV_CheckAllEnts ();
 
+	SV_SpeculateMoves ();
+
 //
 // treat each object in turn
 //
@@ -1242,9 +1515,15 @@ void SV_Physics (void)
 			Sys_Error ("SV_Physics: bad movetype %i", (int)ent->v.movetype);
 	}
 
+	SV_TrackMoves (false);
+	sv_numspecmoves = 0;
+	SV_BroadphaseFrame ();
+
 	if (pr_global_struct->force_retouch)
 		pr_global_struct->force_retouch--;
 
 	if (!sv_freezenonclients.value) 
 	  sv.time += host_frametime;
+
+	PROF_END ();
 }
@@ -42,6 +42,12 @@ int Sys_FileWrite (int handle,const void *data, int count);
 int Sys_FileTime (const char *path);
 void Sys_mkdir (const char *path);
 
+// maps the whole file read-only into memory. returns NULL if that is
+// not possible, in which case the caller should use Sys_FileRead.
+// the mapping stays valid after closing the handle.
+void *Sys_FileMap (int handle, int *size);
+void Sys_FileUnmap (void *data, int size);
+
 //
 // system IO
 //
@@ -32,6 +32,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
 #ifdef DO_USERDIRS
@@ -155,6 +156,29 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_FileMap (int handle, int *size)
+{
+	struct stat	st;
+	void		*data;
+	int		fd;
+
+	fd = fileno (sys_handles[handle]);
+	if (fstat (fd, &st) == -1 || st.st_size <= 0 || st.st_size > 0x7fffffff)
+		return NULL;
+
+	data = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	*size = (int)st.st_size;
+	return data;
+}
+
+void Sys_FileUnmap (void *data, int size)
+{
+	munmap (data, (size_t)size);
+}
+
 
 #if defined(__linux__) || defined(__sun) || defined(sun) || defined(_AIX)
 static int Sys_NumCPUs (void)
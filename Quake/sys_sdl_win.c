@@ -154,6 +154,36 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_FileMap (int handle, int *size)
+{
+	HANDLE	file, mapping;
+	DWORD	sizehigh, sizelow;
+	void	*data;
+
+	file = (HANDLE) _get_osfhandle (_fileno (sys_handles[handle]));
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	sizelow = GetFileSize (file, &sizehigh);
+	if (sizelow == INVALID_FILE_SIZE || sizehigh || sizelow == 0 || sizelow > 0x7fffffff)
+		return NULL;
+
+	mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+		return NULL;
+	data = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle (mapping);	/* the view keeps the mapping alive */
+	if (!data)
+		return NULL;
+
+	*size = (int)sizelow;
+	return data;
+}
+
+void Sys_FileUnmap (void *data, int size)
+{
+	UnmapViewOfFile (data);
+}
+
 static char	cwd[1024];
 
 static void Sys_GetBasedir (char *argv0, char *dst, size_t dstsize)
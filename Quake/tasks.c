@@ -0,0 +1,235 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// tasks.c -- worker thread pool for cpu-only jobs
+
+#include "quakedef.h"
+
+/*
+The pool runs one job at a time. A job is a range of indexes which the
+workers and the posting thread pull in chunks, so tiny task functions
+don't spend all their time on the lock.
+*/
+
+typedef struct
+{
+	taskfunc_t	func;
+	void		*data;
+	int		count;
+	int		chunk;		// indexes handed out per lock
+	int		next;		// next index to hand out
+	int		finished;	// number of indexes done
+	int		numthreads;	// threads which joined the job so far
+	int		generation;	// bumped for every job
+} taskjob_t;
+
+static SDL_Thread	*task_threads[MAX_TASK_WORKERS];
+static int		task_numworkers;
+static SDL_mutex	*task_lock;
+static SDL_cond		*task_wake;	// a job was posted, or shutdown
+static SDL_cond		*task_done;	// the last index of a job finished
+static taskjob_t	task_job;
+static qboolean		task_busy;
+static qboolean		task_quit;
+
+/*
+================
+Tasks_RunJob
+
+Called with task_lock held, returns with it held.
+================
+*/
+static void Tasks_RunJob (int thread)
+{
+	taskfunc_t	func = task_job.func;
+	void		*data = task_job.data;
+	int		start, end, i;
+
+	while (task_job.next < task_job.count)
+	{
+		start = task_job.next;
+		end = q_min (start + task_job.chunk, task_job.count);
+		task_job.next = end;
+
+		SDL_UnlockMutex (task_lock);
+		PROF_BEGIN ("Tasks_RunJob");
+		for (i = start; i < end; i++)
+			func (data, i, thread);
+		PROF_END ();
+		SDL_LockMutex (task_lock);
+
+		task_job.finished += end - start;
+		if (task_job.finished == task_job.count)
+			SDL_CondSignal (task_done);
+	}
+}
+
+static int Tasks_Worker (void *unused)
+{
+	int	generation = 0;
+
+	Prof_ThreadName ("worker");
+
+	SDL_LockMutex (task_lock);
+	for (;;)
+	{
+		while (!task_quit && (task_job.generation == generation || task_job.next >= task_job.count))
+		{
+			generation = task_job.generation;
+			SDL_CondWait (task_wake, task_lock);
+		}
+		if (task_quit)
+			break;
+		generation = task_job.generation;
+		Tasks_RunJob (task_job.numthreads++);
+	}
+	SDL_UnlockMutex (task_lock);
+
+	return 0;
+}
+
+/*
+================
+Tasks_CreateThread
+================
+*/
+SDL_Thread *Tasks_CreateThread (int (*func) (void *), void *data, const char *name)
+{
+#if defined(USE_SDL2)
+	return SDL_CreateThread (func, name, data);
+#else
+	return SDL_CreateThread (func, data);
+#endif
+}
+
+/*
+================
+Tasks_ParallelFor
+================
+*/
+void Tasks_ParallelFor (taskfunc_t func, void *data, int count)
+{
+	int		i;
+
+	if (count <= 0)
+		return;
+
+	if (task_numworkers && count > 1)
+	{
+		SDL_LockMutex (task_lock);
+		if (!task_busy)
+		{
+			task_busy = true;
+			task_job.func = func;
+			task_job.data = data;
+			task_job.count = count;
+			task_job.chunk = q_max (1, count / ((task_numworkers + 1) * 4));
+			task_job.next = 0;
+			task_job.finished = 0;
+			task_job.numthreads = 1;	// the posting thread is 0
+			task_job.generation++;
+			SDL_CondBroadcast (task_wake);
+
+			Tasks_RunJob (0);
+			while (task_job.finished < task_job.count)
+				SDL_CondWait (task_done, task_lock);
+
+			task_busy = false;
+			SDL_UnlockMutex (task_lock);
+			return;
+		}
+		SDL_UnlockMutex (task_lock);
+	}
+
+	// no workers, or somebody else's job is running
+	for (i = 0; i < count; i++)
+		func (data, i, 0);
+}
+
+/*
+================
+Tasks_NumThreads
+================
+*/
+int Tasks_NumThreads (void)
+{
+	return task_numworkers + 1;
+}
+
+/*
+================
+Tasks_Init
+================
+*/
+void Tasks_Init (void)
+{
+	int	i, numworkers;
+
+	i = COM_CheckParm ("-threads");
+	if (i && i < com_argc-1)
+		numworkers = Q_atoi (com_argv[i+1]) - 1;
+	else
+		numworkers = host_parms->numcpus - 1;
+	numworkers = CLAMP (0, numworkers, MAX_TASK_WORKERS);
+
+	if (!numworkers)
+		return;
+
+	task_lock = SDL_CreateMutex ();
+	task_wake = SDL_CreateCond ();
+	task_done = SDL_CreateCond ();
+	if (!task_lock || !task_wake || !task_done)
+	{
+		Con_Warning ("Tasks_Init: couldn't create thread primitives\n");
+		return;
+	}
+
+	for (i = 0; i < numworkers; i++)
+	{
+		task_threads[i] = Tasks_CreateThread (Tasks_Worker, NULL, "worker");
+		if (!task_threads[i])
+			break;
+		task_numworkers++;
+	}
+	Con_Printf ("Tasks: %i worker threads\n", task_numworkers);
+}
+
+/*
+================
+Tasks_Shutdown
+================
+*/
+void Tasks_Shutdown (void)
+{
+	int	i;
+
+	if (!task_numworkers)
+		return;
+
+	SDL_LockMutex (task_lock);
+	task_quit = true;
+	SDL_CondBroadcast (task_wake);
+	SDL_UnlockMutex (task_lock);
+
+	for (i = 0; i < task_numworkers; i++)
+		SDL_WaitThread (task_threads[i], NULL);
+	task_numworkers = 0;
+}
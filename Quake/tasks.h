@@ -0,0 +1,65 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_TASKS_H
+#define _QUAKE_TASKS_H
+
+// tasks.h -- worker thread pool for cpu-only jobs
+
+#define	MAX_TASK_WORKERS	16
+
+typedef void (*taskfunc_t) (void *data, int index, int thread);
+
+void Tasks_Init (void);
+void Tasks_Shutdown (void);
+
+int Tasks_NumThreads (void);
+// number of threads that run a Tasks_ParallelFor, including the
+// calling one. always at least 1.
+
+void Tasks_ParallelFor (taskfunc_t func, void *data, int count);
+// calls func (data, i, thread) for every i in [0, count), spread over
+// the worker threads and the calling thread, and returns when all the
+// calls have finished. thread is in [0, Tasks_NumThreads ()) and unique
+// among the threads running the job, for indexing per-thread scratch
+// buffers. the order of the calls is undefined, so they must not depend
+// on each other. task functions run outside of the main thread: they
+// must not print, allocate from the hunk/zone/cache or call Host_Error.
+// a call made while another job is running runs serially.
+
+SDL_Thread *Tasks_CreateThread (int (*func) (void *), void *data, const char *name);
+// starts a dedicated thread, hides the SDL 1.2 / 2.0 differences.
+
+// Tasks_MemoryBarrier () keeps the stores before it from becoming visible
+// to other threads after the stores following it, for lock-free handoffs
+// of a single producer and a single consumer. TASKS_HAVE_BARRIER is left
+// undefined on compilers we don't know a barrier for.
+#if defined(__GNUC__)
+#define	TASKS_HAVE_BARRIER
+#define	Tasks_MemoryBarrier()	__sync_synchronize ()
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define	TASKS_HAVE_BARRIER
+#define	Tasks_MemoryBarrier()	_ReadWriteBarrier ()	/* x86 doesn't reorder stores */
+#endif
+
+#endif	/* _QUAKE_TASKS_H */
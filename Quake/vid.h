@@ -89,5 +89,9 @@ qboolean VID_HasMouseOrInputFocus (void);
 qboolean VID_IsMinimized (void);
 void	VID_Lock (void);
 
+extern qboolean	vid_nullvideo;	// -nullvideo: no window, no GL context, nothing drawn
+
+void VID_Null_Init (void);
+
 #endif	/* __VID_DEFS_H */
 
@@ -0,0 +1,93 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// vid_null.c -- null video driver, selected with -nullvideo
+
+/*
+==============================================================================
+
+NULL VIDEO
+
+Runs the full client without a window or a GL context, so timedemo and the
+benchmark targets work on headless machines.  gl_vidsdl.c hands VID_Init
+over to VID_Null_Init when -nullvideo is on the command line, and the few
+places that would talk to GL check vid_nullvideo instead:
+
+  - SCR_UpdateScreen returns before any drawing
+  - the texture manager keeps its gltexture_t bookkeeping (and lightmaps are
+    still built on the CPU) but never uploads or deletes texture objects
+  - every gl_*_able flag stays false, so no VBOs or GLSL programs are made
+
+Stray state calls from cvar callbacks (glClearColor and friends) have no
+current context to go to and are dropped by the GL library.
+
+==============================================================================
+*/
+
+#include "quakedef.h"
+
+#define NULLVID_WIDTH		640
+#define NULLVID_HEIGHT		480
+#define NULLVID_WARP_WIDTH	320
+#define NULLVID_WARP_HEIGHT	200
+
+qboolean	vid_nullvideo = false;
+
+/*
+================
+VID_Null_Init
+
+sets up vid for a mode that never reaches the screen.  -width and
+-height are honoured so the console and status bar layout matches a real
+run at that size.
+================
+*/
+void VID_Null_Init (void)
+{
+	int	p, width, height;
+
+	width = NULLVID_WIDTH;
+	height = NULLVID_HEIGHT;
+
+	p = COM_CheckParm ("-width");
+	if (p && p < com_argc-1)
+		width = Q_atoi (com_argv[p+1]);
+	p = COM_CheckParm ("-height");
+	if (p && p < com_argc-1)
+		height = Q_atoi (com_argv[p+1]);
+
+	vid_nullvideo = true;
+
+	vid.width = q_max (width, 320);
+	vid.height = q_max (height, 200);
+	vid.conwidth = vid.width & 0xFFFFFFF8;
+	vid.conheight = vid.conwidth * vid.height / vid.width;
+	vid.numpages = 2;
+	vid.maxwarpwidth = NULLVID_WARP_WIDTH;
+	vid.maxwarpheight = NULLVID_WARP_HEIGHT;
+	vid.colormap = host_colormap;
+	vid.fullbright = 256 - LittleLong (*((int *)vid.colormap + 2048));
+	vid.recalc_refdef = 1;
+
+	modestate = MS_WINDOWED;
+
+	Con_SafePrintf ("Video: null driver, %dx%d, nothing is drawn\n", vid.width, vid.height);
+}
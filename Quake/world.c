@@ -24,6 +24,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+/* the batched traces classify four points per plane with SSE2 when the
+   scalar code does its float math in SSE2 too, so both round alike */
+#if defined(__SSE2_MATH__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WORLD_SSE2
+#include <emmintrin.h>
+#endif
+
 /*
 
 entities never clip against themselves, or their owner
@@ -42,6 +49,8 @@ typedef struct
 	trace_t		trace;
 	int			type;
 	edict_t		*passedict;
+	hull_t		*box;		// scratch hull for bounding box entities
+	movedeps_t	*deps;		// SV_MoveThread: what the trace depends on
 } moveclip_t;
 
 
@@ -60,6 +69,11 @@ static	hull_t		box_hull;
 static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
 static	mplane_t	box_planes[6];
 
+// SV_MoveThread gets a box hull of its own per task thread; they share
+// box_clipnodes and only differ in the plane distances
+static	hull_t		box_threadhulls[MAX_TASK_WORKERS + 1];
+static	mplane_t	box_threadplanes[MAX_TASK_WORKERS + 1][6];
+
 /*
 ===================
 SV_InitBoxHull
@@ -94,6 +108,12 @@ void SV_InitBoxHull (void)
 		box_planes[i].normal[i>>1] = 1;
 	}
 
+	for (i=0 ; i<=MAX_TASK_WORKERS ; i++)
+	{
+		box_threadhulls[i] = box_hull;
+		box_threadhulls[i].planes = box_threadplanes[i];
+		memcpy (box_threadplanes[i], box_planes, sizeof(box_planes));
+	}
 }
 
 
@@ -105,16 +125,21 @@ To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 ===================
 */
-hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
+static hull_t *SV_SetBoxHull (hull_t *hull, vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
+	hull->planes[0].dist = maxs[0];
+	hull->planes[1].dist = mins[0];
+	hull->planes[2].dist = maxs[1];
+	hull->planes[3].dist = mins[1];
+	hull->planes[4].dist = maxs[2];
+	hull->planes[5].dist = mins[2];
 
-	return &box_hull;
+	return hull;
+}
+
+hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
+{
+	return SV_SetBoxHull (&box_hull, mins, maxs);
 }
 
 
@@ -127,9 +152,10 @@ Returns a hull that can be used for testing or clipping an object of mins/maxs
 size.
 Offset is filled in to contain the adjustment that must be added to the
 testing object's origin to get a point to use with the returned hull.
+box is the hull bounding box entities are turned into.
 ================
 */
-hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+static hull_t *SV_HullForEntityBox (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset, hull_t *box)
 {
 	qmodel_t	*model;
 	vec3_t		size;
@@ -166,7 +192,7 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 
 		VectorSubtract (ent->v.mins, maxs, hullmins);
 		VectorSubtract (ent->v.maxs, mins, hullmaxs);
-		hull = SV_HullForBox (hullmins, hullmaxs);
+		hull = SV_SetBoxHull (box, hullmins, hullmaxs);
 
 		VectorCopy (ent->v.origin, offset);
 	}
@@ -175,6 +201,11 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 	return hull;
 }
 
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+{
+	return SV_HullForEntityBox (ent, mins, maxs, offset, &box_hull);
+}
+
 /*
 ===============================================================================
 
@@ -192,11 +223,17 @@ typedef struct areanode_s
 	link_t	solid_edicts;
 } areanode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+typedef struct
+{
+	areanode_t	nodes[AREA_NODES];
+	int			numnodes;
+} areatree_t;
+
+// the split the area node broadphase uses, always built so
+// SV_AreaNodeForBox works whatever the broadphase is
+static	areatree_t	sv_areatree;
 
-static	areanode_t	sv_areanodes[AREA_NODES];
-static	int			sv_numareanodes;
+static	broadphase_t	sv_bp;		// holds the links of the current map
 
 /*
 ===============
@@ -204,14 +241,14 @@ SV_CreateAreaNode
 
 ===============
 */
-areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
+static areanode_t *SV_CreateAreaNode (areatree_t *tree, int depth, vec3_t mins, vec3_t maxs)
 {
 	areanode_t	*anode;
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
 
-	anode = &sv_areanodes[sv_numareanodes];
-	sv_numareanodes++;
+	anode = &tree->nodes[tree->numnodes];
+	tree->numnodes++;
 
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
@@ -237,12 +274,132 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 
 	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
 
-	anode->children[0] = SV_CreateAreaNode (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateAreaNode (depth+1, mins1, maxs1);
+	anode->children[0] = SV_CreateAreaNode (tree, depth+1, mins2, maxs2);
+	anode->children[1] = SV_CreateAreaNode (tree, depth+1, mins1, maxs1);
 
 	return anode;
 }
 
+static void SV_CreateAreaTree (areatree_t *tree, vec3_t mins, vec3_t maxs)
+{
+	memset (tree, 0, sizeof(*tree));
+	SV_CreateAreaNode (tree, 0, mins, maxs);
+}
+
+static areanode_t *SV_AreaNodeInTree (areatree_t *tree, vec3_t absmin, vec3_t absmax)
+{
+	areanode_t	*node;
+
+	node = tree->nodes;
+	while (node->axis != -1)
+	{
+		if (absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+
+	return node;
+}
+
+/*
+===============
+SV_AreaNodeForBox
+
+Returns the index of the first area node the box crosses, the one an
+entity with that absbox gets linked into.
+===============
+*/
+int SV_AreaNodeForBox (vec3_t absmin, vec3_t absmax)
+{
+	return SV_AreaNodeInTree (&sv_areatree, absmin, absmax) - sv_areatree.nodes;
+}
+
+/*
+===============================================================================
+
+AREA NODE BROADPHASE
+
+The original fixed depth tree: every link goes into the first node its box
+crosses, walks go down every side the box reaches.
+
+===============================================================================
+*/
+
+static void AreaNodes_Clear (broadphase_t *bp, vec3_t mins, vec3_t maxs)
+{
+	if (!bp->state)
+	{
+		bp->state = malloc (sizeof(areatree_t));
+		if (!bp->state)
+			Sys_Error ("AreaNodes_Clear: out of memory");
+	}
+	SV_CreateAreaTree ((areatree_t *) bp->state, mins, maxs);
+}
+
+static void AreaNodes_Free (broadphase_t *bp)
+{
+	free (bp->state);
+	bp->state = NULL;
+}
+
+static void AreaNodes_Link (broadphase_t *bp, link_t *l, vec3_t absmin, vec3_t absmax, qboolean trigger)
+{
+	areanode_t	*node;
+
+	node = SV_AreaNodeInTree ((areatree_t *) bp->state, absmin, absmax);
+	if (trigger)
+		InsertLinkBefore (l, &node->trigger_edicts);
+	else
+		InsertLinkBefore (l, &node->solid_edicts);
+}
+
+static qboolean AreaNodes_WalkNode (areanode_t *node, vec3_t mins, vec3_t maxs, qboolean triggers, areafunc_t func, void *data)
+{
+	link_t		*list, *l, *next;
+
+	list = triggers ? &node->trigger_edicts : &node->solid_edicts;
+	for (l = list->next ; l != list ; l = next)
+	{
+		next = l->next;
+		if (!func (l, data))
+			return false;
+	}
+
+// recurse down both sides
+	if (node->axis == -1)
+		return true;
+
+	if ( maxs[node->axis] > node->dist )
+	{
+		if (!AreaNodes_WalkNode (node->children[0], mins, maxs, triggers, func, data))
+			return false;
+	}
+	if ( mins[node->axis] < node->dist )
+	{
+		if (!AreaNodes_WalkNode (node->children[1], mins, maxs, triggers, func, data))
+			return false;
+	}
+	return true;
+}
+
+static void AreaNodes_Walk (broadphase_t *bp, vec3_t mins, vec3_t maxs, qboolean triggers, areafunc_t func, void *data)
+{
+	AreaNodes_WalkNode (((areatree_t *) bp->state)->nodes, mins, maxs, triggers, func, data);
+}
+
+const broadphase_t sv_areanodephase =
+{
+	"area nodes",
+	AreaNodes_Clear,
+	AreaNodes_Free,
+	AreaNodes_Link,
+	AreaNodes_Walk,
+	NULL
+};
+
 /*
 ===============
 SV_ClearWorld
@@ -251,11 +408,168 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
+	const broadphase_t	*type;
+
+	SV_StopRecordBroadphase ();
 	SV_InitBoxHull ();
 
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
-	sv_numareanodes = 0;
-	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+	SV_CreateAreaTree (&sv_areatree, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+// sv_broadphase changes take effect here, with nothing linked
+	type = SV_BroadphaseType ();
+	if (sv_bp.clear != type->clear)
+	{
+		if (sv_bp.free)
+			sv_bp.free (&sv_bp);
+		sv_bp = *type;
+		sv_bp.state = NULL;
+	}
+	sv_bp.clear (&sv_bp, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	SV_TrackMoves (false);
+}
+
+/*
+===============
+SV_AreaWalk
+
+Walks the current broadphase, and records the query while
+sv_recordbroadphase runs.
+===============
+*/
+static void SV_AreaWalk (vec3_t mins, vec3_t maxs, qboolean triggers, areafunc_t func, void *data)
+{
+	if (sv_bprecording && !sv_movethreads)
+		SV_RecordBroadphase (BP_QUERY, 0, mins, maxs, triggers);
+	sv_bp.walk (&sv_bp, mins, maxs, triggers, func, data);
+}
+
+
+/*
+===============================================================================
+
+MOVE TRACKING
+
+While tracking, every link and unlink leaves the entity's absbox here, so
+traces run ahead of time by SV_MoveThread can be checked against whatever
+has moved since.
+
+===============================================================================
+*/
+
+#define	MAX_MOVEDBOXES	1024
+
+typedef struct
+{
+	edict_t		*ent;
+	vec3_t		absmin, absmax;
+} movedbox_t;
+
+static	movedbox_t	sv_movedboxes[MAX_MOVEDBOXES];
+static	int			sv_nummovedboxes;
+static	qboolean	sv_trackmoves;
+qboolean			sv_movethreads;
+
+/*
+===============
+SV_TrackMoves
+
+Starts a fresh list of moved boxes, or stops recording them.
+===============
+*/
+void SV_TrackMoves (qboolean track)
+{
+	sv_trackmoves = track;
+	sv_nummovedboxes = 0;
+}
+
+static void SV_MarkMoved (edict_t *ent)
+{
+	movedbox_t	*moved;
+
+	if (!sv_trackmoves)
+		return;
+	if (sv_nummovedboxes == MAX_MOVEDBOXES)
+	{	// too busy a frame, nothing can be trusted any more
+		sv_nummovedboxes++;
+		return;
+	}
+	if (sv_nummovedboxes > MAX_MOVEDBOXES)
+		return;
+
+	moved = &sv_movedboxes[sv_nummovedboxes++];
+	moved->ent = ent;
+	VectorCopy (ent->v.absmin, moved->absmin);
+	VectorCopy (ent->v.absmax, moved->absmax);
+}
+
+/*
+===============
+SV_ClipState
+
+Everything SV_ClipToLinks reads from an entity it considers.
+===============
+*/
+void SV_ClipState (edict_t *ent, clipstate_t *state)
+{
+	memset (state, 0, sizeof(*state));
+	state->ent = ent;
+	state->solid = ent->v.solid;
+	state->movetype = ent->v.movetype;
+	state->flags = ent->v.flags;
+	state->modelindex = ent->v.modelindex;
+	state->size0 = ent->v.size[0];
+	state->owner = ent->v.owner;
+	VectorCopy (ent->v.origin, state->origin);
+	VectorCopy (ent->v.mins, state->mins);
+	VectorCopy (ent->v.maxs, state->maxs);
+	VectorCopy (ent->v.absmin, state->absmin);
+	VectorCopy (ent->v.absmax, state->absmax);
+}
+
+/*
+===============
+SV_MoveDepsValid
+
+True if the trace deps were recorded for would still come out the same:
+nothing it looked at has changed and nothing was linked or unlinked inside
+its swept box since. Moves of passedict itself don't matter, the trace
+skips it and its own state is in the deps.
+Only engine maintained absboxes are tracked, progs writing absmin/absmax
+directly can't be seen.
+===============
+*/
+qboolean SV_MoveDepsValid (movedeps_t *deps, edict_t *passedict)
+{
+	movedbox_t	*moved;
+	clipstate_t	state;
+	int			i;
+
+	if (deps->numclips < 0 || sv_nummovedboxes > MAX_MOVEDBOXES)
+		return false;
+
+	for (i=0, moved=sv_movedboxes ; i<sv_nummovedboxes ; i++, moved++)
+	{
+		if (moved->ent == passedict)
+			continue;
+		if (deps->boxmins[0] > moved->absmax[0]
+		|| deps->boxmins[1] > moved->absmax[1]
+		|| deps->boxmins[2] > moved->absmax[2]
+		|| deps->boxmaxs[0] < moved->absmin[0]
+		|| deps->boxmaxs[1] < moved->absmin[1]
+		|| deps->boxmaxs[2] < moved->absmin[2] )
+			continue;
+		return false;
+	}
+
+	for (i=0 ; i<deps->numclips ; i++)
+	{
+		SV_ClipState (deps->clips[i].ent, &state);
+		if (memcmp (&state, &deps->clips[i], sizeof(state)))
+			return false;
+	}
+
+	return true;
 }
 
 
@@ -269,6 +583,9 @@ void SV_UnlinkEdict (edict_t *ent)
 {
 	if (!ent->area.prev)
 		return;		// not linked in anywhere
+	SV_MarkMoved (ent);
+	if (sv_bprecording)
+		SV_RecordBroadphase (BP_UNLINK, NUM_FOR_EDICT(ent), NULL, NULL, false);
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
 }
@@ -276,50 +593,45 @@ void SV_UnlinkEdict (edict_t *ent)
 
 /*
 ====================
-SV_AreaTriggerEdicts
+SV_AreaTriggerEdict
 
 Spike -- just builds a list of entities within the area, rather than walking
 them and risking the list getting corrupt.
 ====================
 */
-static void
-SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *listcount, const int listspace )
+typedef struct
 {
-	link_t		*l, *next;
-	edict_t		*touch;
-
-// touch linked edicts
-	for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = next)
-	{
-		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch == ent)
-			continue;
-		if (!touch->v.touch || touch->v.solid != SOLID_TRIGGER)
-			continue;
-		if (ent->v.absmin[0] > touch->v.absmax[0]
-		|| ent->v.absmin[1] > touch->v.absmax[1]
-		|| ent->v.absmin[2] > touch->v.absmax[2]
-		|| ent->v.absmax[0] < touch->v.absmin[0]
-		|| ent->v.absmax[1] < touch->v.absmin[1]
-		|| ent->v.absmax[2] < touch->v.absmin[2] )
-			continue;
-
-		if (*listcount == listspace)
-			return; // should never happen
-
-		list[*listcount] = touch;
-		(*listcount)++;
-	}
-
-// recurse down both sides
-	if (node->axis == -1)
-		return;
+	edict_t		*ent;
+	edict_t		**list;
+	int			listcount;
+	int			listspace;
+} triggerlist_t;
 
-	if ( ent->v.absmax[node->axis] > node->dist )
-		SV_AreaTriggerEdicts ( ent, node->children[0], list, listcount, listspace );
-	if ( ent->v.absmin[node->axis] < node->dist )
-		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
+static qboolean SV_AreaTriggerEdict (link_t *l, void *data)
+{
+	triggerlist_t	*tl = (triggerlist_t *) data;
+	edict_t			*ent = tl->ent;
+	edict_t			*touch;
+
+	touch = EDICT_FROM_AREA(l);
+	if (touch == ent)
+		return true;
+	if (!touch->v.touch || touch->v.solid != SOLID_TRIGGER)
+		return true;
+	if (ent->v.absmin[0] > touch->v.absmax[0]
+	|| ent->v.absmin[1] > touch->v.absmax[1]
+	|| ent->v.absmin[2] > touch->v.absmax[2]
+	|| ent->v.absmax[0] < touch->v.absmin[0]
+	|| ent->v.absmax[1] < touch->v.absmin[1]
+	|| ent->v.absmax[2] < touch->v.absmin[2] )
+		return true;
+
+	if (tl->listcount == tl->listspace)
+		return false; // should never happen
+
+	tl->list[tl->listcount] = touch;
+	tl->listcount++;
+	return true;
 }
 
 /*
@@ -334,6 +646,7 @@ Based on code from Spike.
 */
 void SV_TouchLinks (edict_t *ent)
 {
+	triggerlist_t	tl;
 	edict_t		**list;
 	edict_t		*touch;
 	int		old_self, old_other;
@@ -343,8 +656,12 @@ void SV_TouchLinks (edict_t *ent)
 	mark = Hunk_LowMark ();
 	list = (edict_t **) Hunk_Alloc (sv.num_edicts*sizeof(edict_t *));
 	
-	listcount = 0;
-	SV_AreaTriggerEdicts (ent, sv_areanodes, list, &listcount, sv.num_edicts);
+	tl.ent = ent;
+	tl.list = list;
+	tl.listcount = 0;
+	tl.listspace = sv.num_edicts;
+	SV_AreaWalk (ent->v.absmin, ent->v.absmax, true, SV_AreaTriggerEdict, &tl);
+	listcount = tl.listcount;
 
 	for (i = 0; i < listcount; i++)
 	{
@@ -431,8 +748,6 @@ SV_LinkEdict
 */
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
-	areanode_t	*node;
-
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 
@@ -476,26 +791,11 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-
 // link it in
-
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	sv_bp.link (&sv_bp, &ent->area, ent->v.absmin, ent->v.absmax, ent->v.solid == SOLID_TRIGGER);
+	SV_MarkMoved (ent);
+	if (sv_bprecording)
+		SV_RecordBroadphase (BP_LINK, NUM_FOR_EDICT(ent), ent->v.absmin, ent->v.absmax, ent->v.solid == SOLID_TRIGGER);
 
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -721,7 +1021,8 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 		{
 			trace->fraction = midf;
 			VectorCopy (mid, trace->endpos);
-			Con_DPrintf ("backup past 0\n");
+			if (!sv_movethreads)
+				Con_DPrintf ("backup past 0\n");
 			return false;
 		}
 		midf = p1f + (p2f - p1f)*frac;
@@ -744,7 +1045,7 @@ Handles selection or creation of a clipping hull, and offseting (and
 eventually rotation) of the end points
 ==================
 */
-trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+static trace_t SV_ClipMoveToEntityBox (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, hull_t *box)
 {
 	trace_t		trace;
 	vec3_t		offset;
@@ -758,7 +1059,7 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	VectorCopy (end, trace.endpos);
 
 // get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
+	hull = SV_HullForEntityBox (ent, mins, maxs, offset, box);
 
 	VectorSubtract (start, offset, start_l);
 	VectorSubtract (end, offset, end_l);
@@ -777,86 +1078,137 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	return trace;
 }
 
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	return SV_ClipMoveToEntityBox (ent, start, mins, maxs, end, &box_hull);
+}
+
 //===========================================================================
 
 /*
 ====================
-SV_ClipToLinks
+SV_ClipDepend
 
-Mins and maxs enclose the entire area swept by the move
+Adds touch to the deps of a threaded trace if it is inside the swept box,
+whatever its state, so a later change to it is noticed. Returns false
+once the trace can't be reused.
 ====================
 */
-void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+static qboolean SV_ClipDepend (moveclip_t *clip, edict_t *touch)
 {
-	link_t		*l, *next;
-	edict_t		*touch;
-	trace_t		trace;
+	movedeps_t	*deps = clip->deps;
 
-// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	if (deps->numclips < 0)
+		return false;
+	if (touch == clip->passedict)
+		return true;	// already in
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return true;
+
+	if (deps->numclips == MAX_MOVECLIPS
+	// leave the errors to the serial trace
+	|| touch->v.solid == SOLID_TRIGGER
+	|| (touch->v.solid == SOLID_BSP && (touch->v.movetype != MOVETYPE_PUSH
+		|| !sv.models[(int)touch->v.modelindex] || sv.models[(int)touch->v.modelindex]->type != mod_brush)))
 	{
-		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch->v.solid == SOLID_NOT)
-			continue;
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			Sys_Error ("Trigger in clipping list");
+		deps->numclips = -1;
+		return false;
+	}
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+	SV_ClipState (touch, &deps->clips[deps->numclips++]);
+	return true;
+}
 
-		if (clip->boxmins[0] > touch->v.absmax[0]
-		|| clip->boxmins[1] > touch->v.absmax[1]
-		|| clip->boxmins[2] > touch->v.absmax[2]
-		|| clip->boxmaxs[0] < touch->v.absmin[0]
-		|| clip->boxmaxs[1] < touch->v.absmin[1]
-		|| clip->boxmaxs[2] < touch->v.absmin[2] )
-			continue;
+/*
+====================
+SV_ClipToEdict
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+Exact clip of the move against one entity that passed the checks
+====================
+*/
+static void SV_ClipToEdict (moveclip_t *clip, edict_t *touch)
+{
+	trace_t		trace;
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
+	if ((int)touch->v.flags & FL_MONSTER)
+		trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->box);
+	else
+		trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->box);
+	if (trace.allsolid || trace.startsolid ||
+	trace.fraction < clip->trace.fraction)
+	{
+		trace.ent = touch;
+	 	if (clip->trace.startsolid)
 		{
-		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
+			clip->trace = trace;
+			clip->trace.startsolid = true;
 		}
-
-		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
 		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
-		{
-			trace.ent = touch;
-		 	if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
+			clip->trace = trace;
 	}
+	else if (trace.startsolid)
+		clip->trace.startsolid = true;
+}
 
-// recurse down both sides
-	if (node->axis == -1)
-		return;
+/*
+====================
+SV_ClipToLinks
 
-	if ( clip->boxmaxs[node->axis] > node->dist )
-		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
-		SV_ClipToLinks ( node->children[1], clip );
+Mins and maxs enclose the entire area swept by the move
+====================
+*/
+static qboolean SV_ClipToLink (link_t *l, void *data)
+{
+	moveclip_t	*clip = (moveclip_t *) data;
+	edict_t		*touch;
+
+	touch = EDICT_FROM_AREA(l);
+	if (clip->deps && !SV_ClipDepend (clip, touch))
+		return false;
+	if (touch->v.solid == SOLID_NOT)
+		return true;
+	if (touch == clip->passedict)
+		return true;
+	if (touch->v.solid == SOLID_TRIGGER)
+		Sys_Error ("Trigger in clipping list");
+
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return true;
+
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return true;
+
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return true;	// points never interact
+
+// might intersect, so do an exact clip
+	if (clip->trace.allsolid)
+		return false;	// nothing can change it any more
+	if (clip->passedict)
+	{
+	 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return true;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return true;	// don't clip against owner
+	}
+
+	SV_ClipToEdict (clip, touch);
+	return true;
+}
+
+static void SV_ClipToLinks (moveclip_t *clip)
+{
+	SV_AreaWalk (clip->boxmins, clip->boxmaxs, false, SV_ClipToLink, clip);
 }
 
 
@@ -892,10 +1244,10 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 
 /*
 ==================
-SV_Move
+SV_MoveClip
 ==================
 */
-trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+static trace_t SV_MoveClip (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, hull_t *box, movedeps_t *deps)
 {
 	moveclip_t	clip;
 	int			i;
@@ -903,8 +1255,10 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 // clip to world
-	clip.trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end );
+	clip.trace = SV_ClipMoveToEntityBox ( sv.edicts, start, mins, maxs, end, box );
 
+	clip.box = box;
+	clip.deps = deps;
 	clip.start = start;
 	clip.end = end;
 	clip.mins = mins;
@@ -929,9 +1283,545 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 // create the bounding box of the entire move
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
+	if (deps)
+	{
+		VectorCopy (clip.boxmins, deps->boxmins);
+		VectorCopy (clip.boxmaxs, deps->boxmaxs);
+		deps->numclips = 0;
+		if (passedict)
+			SV_ClipState (passedict, &deps->clips[deps->numclips++]);
+	}
+
 // clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	SV_ClipToLinks ( &clip );
 
 	return clip.trace;
 }
 
+/*
+==================
+SV_Move
+==================
+*/
+trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	return SV_MoveClip (start, mins, maxs, end, type, passedict, &box_hull, NULL);
+}
+
+/*
+==================
+SV_MoveThread
+
+SV_Move for task functions, thread is the one passed to the task. The
+entities the trace looks at go into deps for SV_MoveDepsValid.
+==================
+*/
+trace_t SV_MoveThread (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, int thread, movedeps_t *deps)
+{
+	return SV_MoveClip (start, mins, maxs, end, type, passedict, &box_threadhulls[thread], deps);
+}
+
+
+/*
+===============================================================================
+
+BATCHED TRACES
+
+SV_MoveBatch gives the same results as an SV_Move per move, but walks the
+broadphase once for the whole batch and traces the world hull four moves at
+a time: the moves go down the clipnodes together while they are all on the
+same side of each plane, and each one falls back to SV_RecursiveHullCheck
+from the node where it parts from the others. Lanes close to a non-axial
+plane split off as well, so a difference in rounding between the SSE2 and
+the scalar dot product can't send a move down the wrong side. The margin
+grows with the coordinates and the plane distance, as float precision
+drops with them on big BSP2 maps.
+
+===============================================================================
+*/
+
+#define	PACK_LANES		4
+#define	PACK_MARGIN		(1.0f/256)	// at least, near non-axial planes
+#define	PACK_MARGIN_SCALE	(1.0f/(1<<22))	// two float ulps of |x|+|y|+|z|+|dist|
+#define	MAX_BATCHMOVES	64		// moves sharing one broadphase walk
+#define	MAX_BATCHTOUCHES	256
+
+typedef struct
+{
+	float	v[3][PACK_LANES];	// points by axis, then lane
+	float	extent;			// largest |coordinate| in the pack
+} pointpack_t;
+
+typedef struct
+{
+	int		num;
+	int		lanes;
+} packnode_t;
+
+static void SV_PackPoints (pointpack_t *pack, vec3_t *points, int count)
+{
+	int		i, j;
+
+	pack->extent = 0;
+	for (i=0 ; i<PACK_LANES ; i++)
+	{
+		for (j=0 ; j<3 ; j++)
+		{
+			pack->v[j][i] = points[i < count ? i : 0][j];
+			pack->extent = q_max (pack->extent, (float)fabs(pack->v[j][i]));
+		}
+	}
+}
+
+/*
+==================
+SV_PackMargin
+
+How close to a non-axial plane a lane may be and still go down one side
+with the others.
+==================
+*/
+static inline float SV_PackMargin (mplane_t *plane, pointpack_t *p1, pointpack_t *p2)
+{
+	float	extent = p2 ? q_max (p1->extent, p2->extent) : p1->extent;
+
+	return q_max (PACK_MARGIN, (3 * extent + (float)fabs(plane->dist)) * PACK_MARGIN_SCALE);
+}
+
+/*
+==================
+SV_PackSides
+
+Sets front and back to the lanes of the packs that are entirely in front
+of or behind the plane, the same way SV_RecursiveHullCheck decides to go
+down one side only. With a single pack (p2 NULL) every lane is on one side
+or the other, except near non-axial planes.
+==================
+*/
+#ifdef WORLD_SSE2
+static inline __m128 SV_PackDists (mplane_t *plane, pointpack_t *p)
+{
+	__m128d	nx, ny, nz, dist, lo, hi;
+	__m128	x, y, z;
+
+	if (plane->type < 3)
+		return _mm_sub_ps (_mm_loadu_ps (p->v[plane->type]), _mm_set1_ps (plane->dist));
+
+	nx = _mm_set1_pd (plane->normal[0]);
+	ny = _mm_set1_pd (plane->normal[1]);
+	nz = _mm_set1_pd (plane->normal[2]);
+	dist = _mm_set1_pd (plane->dist);
+	x = _mm_loadu_ps (p->v[0]);
+	y = _mm_loadu_ps (p->v[1]);
+	z = _mm_loadu_ps (p->v[2]);
+
+	lo = _mm_add_pd (_mm_add_pd (_mm_mul_pd (nx, _mm_cvtps_pd (x)), _mm_mul_pd (ny, _mm_cvtps_pd (y))),
+		_mm_mul_pd (nz, _mm_cvtps_pd (z)));
+	x = _mm_movehl_ps (x, x);
+	y = _mm_movehl_ps (y, y);
+	z = _mm_movehl_ps (z, z);
+	hi = _mm_add_pd (_mm_add_pd (_mm_mul_pd (nx, _mm_cvtps_pd (x)), _mm_mul_pd (ny, _mm_cvtps_pd (y))),
+		_mm_mul_pd (nz, _mm_cvtps_pd (z)));
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (_mm_sub_pd (lo, dist)), _mm_cvtpd_ps (_mm_sub_pd (hi, dist)));
+}
+
+static inline void SV_PackSides (mplane_t *plane, pointpack_t *p1, pointpack_t *p2, int *front, int *back)
+{
+	__m128	zero, t1, t2, f, b;
+
+	zero = _mm_setzero_ps ();
+	t1 = SV_PackDists (plane, p1);
+	t2 = p2 ? SV_PackDists (plane, p2) : t1;
+	f = _mm_and_ps (_mm_cmpge_ps (t1, zero), _mm_cmpge_ps (t2, zero));
+	b = _mm_and_ps (_mm_cmplt_ps (t1, zero), _mm_cmplt_ps (t2, zero));
+
+	if (plane->type >= 3)
+	{
+		__m128	sign, margin, far;
+
+		sign = _mm_set1_ps (-0.0f);
+		margin = _mm_set1_ps (SV_PackMargin (plane, p1, p2));
+		far = _mm_and_ps (_mm_cmpge_ps (_mm_andnot_ps (sign, t1), margin),
+			_mm_cmpge_ps (_mm_andnot_ps (sign, t2), margin));
+		f = _mm_and_ps (f, far);
+		b = _mm_and_ps (b, far);
+	}
+
+	*front = _mm_movemask_ps (f);
+	*back = _mm_movemask_ps (b);
+}
+#else
+static inline void SV_PackSides (mplane_t *plane, pointpack_t *p1, pointpack_t *p2, int *front, int *back)
+{
+	float	t1, t2, margin;
+	int		i;
+
+	margin = (plane->type < 3) ? 0 : SV_PackMargin (plane, p1, p2);
+	*front = *back = 0;
+	for (i=0 ; i<PACK_LANES ; i++)
+	{
+		if (plane->type < 3)
+		{
+			t1 = p1->v[plane->type][i] - plane->dist;
+			t2 = p2 ? p2->v[plane->type][i] - plane->dist : t1;
+		}
+		else
+		{
+			t1 = (double)plane->normal[0]*p1->v[0][i] + (double)plane->normal[1]*p1->v[1][i]
+				+ (double)plane->normal[2]*p1->v[2][i] - plane->dist;
+			t2 = p2 ? (double)plane->normal[0]*p2->v[0][i] + (double)plane->normal[1]*p2->v[1][i]
+				+ (double)plane->normal[2]*p2->v[2][i] - plane->dist : t1;
+			if (fabs(t1) < margin || fabs(t2) < margin)
+				continue;
+		}
+		if (t1 >= 0 && t2 >= 0)
+			*front |= 1<<i;
+		else if (t1 < 0 && t2 < 0)
+			*back |= 1<<i;
+	}
+}
+#endif
+
+/*
+==================
+SV_HullCheckPack
+
+SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, p1[i], p2[i],
+&traces[i]) for up to four moves.
+==================
+*/
+static void SV_HullCheckPack (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces)
+{
+	packnode_t	stack[PACK_LANES];
+	pointpack_t	pack1, pack2;
+	mclipnode_t	*node;
+	int			sp, num, lanes, front, back, i;
+
+	SV_PackPoints (&pack1, p1, count);
+	SV_PackPoints (&pack2, p2, count);
+
+	// the lanes of the nodes on the stack never overlap, so four will do
+	stack[0].num = hull->firstclipnode;
+	stack[0].lanes = (1<<count) - 1;
+	sp = 1;
+	while (sp)
+	{
+		sp--;
+		num = stack[sp].num;
+		lanes = stack[sp].lanes;
+
+		if (num >= 0 && (lanes & (lanes - 1)))
+		{
+			if (num < hull->firstclipnode || num > hull->lastclipnode)
+				Sys_Error ("SV_HullCheckPack: bad node number");
+
+			node = hull->clipnodes + num;
+			SV_PackSides (hull->planes + node->planenum, &pack1, &pack2, &front, &back);
+			front &= lanes;
+			back &= lanes;
+			if (front)
+			{
+				stack[sp].num = node->children[0];
+				stack[sp++].lanes = front;
+			}
+			if (back)
+			{
+				stack[sp].num = node->children[1];
+				stack[sp++].lanes = back;
+			}
+			lanes &= ~(front|back);
+		}
+
+		// leaves, lone moves and the ones crossing the plane go on alone
+		for (i=0 ; lanes ; i++, lanes >>= 1)
+		{
+			if (lanes & 1)
+				SV_RecursiveHullCheck (hull, num, 0, 1, p1[i], p2[i], &traces[i]);
+		}
+	}
+}
+
+/*
+==================
+SV_PointContentsBatch
+
+SV_PointContents for count points.
+==================
+*/
+void SV_PointContentsBatch (int count, vec3_t *points, int *contents)
+{
+	packnode_t	stack[PACK_LANES];
+	pointpack_t	pack;
+	hull_t		*hull;
+	mclipnode_t	*node;
+	int			base, n, sp, num, lanes, front, back, i;
+
+	hull = &sv.worldmodel->hulls[0];
+
+	for (base=0 ; base<count ; base+=PACK_LANES)
+	{
+		n = q_min (count - base, PACK_LANES);
+		SV_PackPoints (&pack, points + base, n);
+
+		stack[0].num = hull->firstclipnode;
+		stack[0].lanes = (1<<n) - 1;
+		sp = 1;
+		while (sp)
+		{
+			sp--;
+			num = stack[sp].num;
+			lanes = stack[sp].lanes;
+
+			// follow the lanes down while they stay together
+			while (num >= 0 && (lanes & (lanes - 1)))
+			{
+				if (num < hull->firstclipnode || num > hull->lastclipnode)
+					Sys_Error ("SV_PointContentsBatch: bad node number");
+
+				node = hull->clipnodes + num;
+				SV_PackSides (hull->planes + node->planenum, &pack, NULL, &front, &back);
+				front &= lanes;
+				back &= lanes;
+				if (front == lanes)
+				{
+					num = node->children[0];
+					continue;
+				}
+				if (back == lanes)
+				{
+					num = node->children[1];
+					continue;
+				}
+				if (front)
+				{
+					stack[sp].num = node->children[0];
+					stack[sp++].lanes = front;
+				}
+				if (back)
+				{
+					stack[sp].num = node->children[1];
+					stack[sp++].lanes = back;
+				}
+				lanes &= ~(front|back);
+				break;
+			}
+
+			for (i=0 ; lanes ; i++, lanes >>= 1)
+			{
+				if (lanes & 1)
+					contents[base + i] = SV_HullPointContents (hull, num, points[base + i]);
+			}
+		}
+	}
+
+	for (i=0 ; i<count ; i++)
+	{
+		if (contents[i] <= CONTENTS_CURRENT_0 && contents[i] >= CONTENTS_CURRENT_DOWN)
+			contents[i] = CONTENTS_WATER;
+	}
+}
+
+/*
+==================
+SV_ClipMoveToWorldBatch
+
+SV_ClipMoveToEntity against the world for every move.
+==================
+*/
+static void SV_ClipMoveToWorldBatch (int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, trace_t *traces)
+{
+	vec3_t		offset;
+	vec3_t		start_l[PACK_LANES], end_l[PACK_LANES];
+	hull_t		*hull;
+	trace_t		*trace;
+	int			base, n, i;
+
+	hull = SV_HullForEntity (sv.edicts, mins, maxs, offset);
+
+	for (base=0 ; base<count ; base+=PACK_LANES)
+	{
+		n = q_min (count - base, PACK_LANES);
+		for (i=0 ; i<n ; i++)
+		{
+			trace = &traces[base + i];
+			memset (trace, 0, sizeof(trace_t));
+			trace->fraction = 1;
+			trace->allsolid = true;
+			VectorCopy (ends[base + i], trace->endpos);
+
+			VectorSubtract (starts[base + i], offset, start_l[i]);
+			VectorSubtract (ends[base + i], offset, end_l[i]);
+		}
+
+		SV_HullCheckPack (hull, n, start_l, end_l, traces + base);
+
+		for (i=0 ; i<n ; i++)
+		{
+			trace = &traces[base + i];
+			if (trace->fraction != 1)
+				VectorAdd (trace->endpos, offset, trace->endpos);
+			if (trace->fraction < 1 || trace->startsolid  )
+				trace->ent = sv.edicts;
+		}
+	}
+}
+
+/*
+====================
+SV_BatchLinks
+
+Lists the entities that SV_ClipToLinks could clip any move of the batch
+against, in the order it would get to them. Everything that doesn't depend
+on the single move is checked here.
+====================
+*/
+typedef struct
+{
+	moveclip_t	*clip;
+	edict_t		**list;
+	int			listcount;		// > MAX_BATCHTOUCHES when too many
+} batchlist_t;
+
+static qboolean SV_BatchLink (link_t *l, void *data)
+{
+	batchlist_t	*bl = (batchlist_t *) data;
+	moveclip_t	*clip = bl->clip;
+	edict_t		*touch;
+
+	touch = EDICT_FROM_AREA(l);
+	if (touch->v.solid == SOLID_NOT)
+		return true;
+	if (touch == clip->passedict)
+		return true;
+	if (touch->v.solid == SOLID_TRIGGER)
+		Sys_Error ("Trigger in clipping list");
+
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return true;
+
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return true;
+
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return true;	// points never interact
+	if (clip->passedict)
+	{
+	 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return true;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return true;	// don't clip against owner
+	}
+
+	if (bl->listcount == MAX_BATCHTOUCHES)
+	{
+		bl->listcount++;	// too many, caller goes one move at a time
+		return false;
+	}
+	bl->list[bl->listcount++] = touch;
+	return true;
+}
+
+/*
+==================
+SV_MoveBatch
+
+Same as SV_Move (starts[i], mins, maxs, ends[i], type, passedict) into
+traces[i] for each of the count moves.
+==================
+*/
+void SV_MoveBatch (int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, int type, edict_t *passedict, trace_t *traces)
+{
+	moveclip_t	clip, all;
+	batchlist_t	bl;
+	vec3_t		boxmins[MAX_BATCHMOVES], boxmaxs[MAX_BATCHMOVES];
+	edict_t		*touches[MAX_BATCHTOUCHES];
+	edict_t		*touch;
+	int			numtouches;
+	int			base, n, i, j, k;
+
+	for (base=0 ; base<count ; base+=MAX_BATCHMOVES)
+	{
+		n = q_min (count - base, MAX_BATCHMOVES);
+
+	// clip to world
+		SV_ClipMoveToWorldBatch (n, starts + base, ends + base, mins, maxs, traces + base);
+
+		memset (&clip, 0, sizeof(clip));
+		clip.mins = mins;
+		clip.maxs = maxs;
+		clip.type = type;
+		clip.passedict = passedict;
+		clip.box = &box_hull;
+
+		if (type == MOVE_MISSILE)
+		{
+			for (i=0 ; i<3 ; i++)
+			{
+				clip.mins2[i] = -15;
+				clip.maxs2[i] = 15;
+			}
+		}
+		else
+		{
+			VectorCopy (mins, clip.mins2);
+			VectorCopy (maxs, clip.maxs2);
+		}
+
+	// one broadphase walk with the box around all of the moves
+		all = clip;
+		for (i=0 ; i<n ; i++)
+		{
+			SV_MoveBounds (starts[base + i], clip.mins2, clip.maxs2, ends[base + i], boxmins[i], boxmaxs[i]);
+			for (j=0 ; j<3 ; j++)
+			{
+				all.boxmins[j] = i ? q_min (all.boxmins[j], boxmins[i][j]) : boxmins[i][j];
+				all.boxmaxs[j] = i ? q_max (all.boxmaxs[j], boxmaxs[i][j]) : boxmaxs[i][j];
+			}
+		}
+
+		bl.clip = &all;
+		bl.list = touches;
+		bl.listcount = 0;
+		SV_AreaWalk (all.boxmins, all.boxmaxs, false, SV_BatchLink, &bl);
+		numtouches = bl.listcount;
+
+	// clip to entities
+		for (i=0 ; i<n ; i++)
+		{
+			clip.start = starts[base + i];
+			clip.end = ends[base + i];
+			clip.trace = traces[base + i];
+			VectorCopy (boxmins[i], clip.boxmins);
+			VectorCopy (boxmaxs[i], clip.boxmaxs);
+
+			if (numtouches > MAX_BATCHTOUCHES)
+			{
+				SV_ClipToLinks (&clip);
+				traces[base + i] = clip.trace;
+				continue;
+			}
+
+			for (k=0 ; k<numtouches ; k++)
+			{
+				touch = touches[k];
+				if (clip.boxmins[0] > touch->v.absmax[0]
+				|| clip.boxmins[1] > touch->v.absmax[1]
+				|| clip.boxmins[2] > touch->v.absmax[2]
+				|| clip.boxmaxs[0] < touch->v.absmin[0]
+				|| clip.boxmaxs[1] < touch->v.absmin[1]
+				|| clip.boxmaxs[2] < touch->v.absmin[2] )
+					continue;
+				if (clip.trace.allsolid)
+					break;
+				SV_ClipToEdict (&clip, touch);
+			}
+			traces[base + i] = clip.trace;
+		}
+	}
+}
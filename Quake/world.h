@@ -81,7 +81,91 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_MoveBatch (int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, int type, edict_t *passedict, trace_t *traces);
+// SV_Move for count moves of the same size, type and passedict at once
+
+void SV_PointContentsBatch (int count, vec3_t *points, int *contents);
+// SV_PointContents for count points
+
 qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
 
+#define	AREA_DEPTH	4
+#define	AREA_NODES	32
+
+int SV_AreaNodeForBox (vec3_t absmin, vec3_t absmax);
+// index of the area node an entity with that absbox would be linked into
+// by the area node broadphase
+
+// broadphase
+
+typedef qboolean (*areafunc_t) (link_t *l, void *data);
+// called for the links a walk comes across, returns false to end the walk
+
+typedef struct broadphase_s
+{
+	const char	*name;
+	void	(*clear) (struct broadphase_s *bp, vec3_t mins, vec3_t maxs);
+	// empties it for a world of that size, allocating state the first time
+	void	(*free) (struct broadphase_s *bp);
+	void	(*link) (struct broadphase_s *bp, link_t *l, vec3_t absmin, vec3_t absmax, qboolean trigger);
+	// links come out again with RemoveLink
+	void	(*walk) (struct broadphase_s *bp, vec3_t mins, vec3_t maxs, qboolean triggers, areafunc_t func, void *data);
+	// calls func for every solid or trigger link whose box may touch
+	// mins/maxs, and maybe for some more. must not change the links
+	void	*state;
+} broadphase_t;
+
+extern	const broadphase_t	sv_areanodephase;	// world.c
+extern	const broadphase_t	sv_gridphase;		// sv_broadphase.c
+
+// sv_broadphase.c
+
+#define	BP_LINK		0
+#define	BP_UNLINK	1
+#define	BP_QUERY	2
+
+extern	qboolean	sv_bprecording;
+
+void SV_InitBroadphase (void);
+const broadphase_t *SV_BroadphaseType (void);
+// the one sv_broadphase asks for, SV_ClearWorld switches to it
+void SV_RecordBroadphase (int type, int num, vec3_t mins, vec3_t maxs, qboolean trigger);
+void SV_StopRecordBroadphase (void);
+void SV_BroadphaseFrame (void);
+
+// threaded traces
+
+#define	MAX_MOVECLIPS	16
+
+typedef struct
+{
+	edict_t	*ent;
+	float	solid, movetype, flags, modelindex, size0;
+	int		owner;
+	vec3_t	origin, mins, maxs, absmin, absmax;
+} clipstate_t;
+
+typedef struct
+{
+	vec3_t		boxmins, boxmaxs;	// the whole area swept by the move
+	int			numclips;			// -1 if the trace can't be reused
+	clipstate_t	clips[MAX_MOVECLIPS];
+} movedeps_t;
+
+extern	qboolean	sv_movethreads;
+// set while SV_MoveThread runs on the task threads
+
+trace_t SV_MoveThread (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, int thread, movedeps_t *deps);
+// SV_Move that may run in a task function. thread is the task's thread
+// number, deps gets the state of every entity the trace looked at
+
+void SV_TrackMoves (qboolean track);
+// starts or stops recording the boxes of linked and unlinked entities
+
+void SV_ClipState (edict_t *ent, clipstate_t *state);
+qboolean SV_MoveDepsValid (movedeps_t *deps, edict_t *passedict);
+// true if a trace made with deps would still give the same result, given
+// the same start, end, size and type
+
 #endif	/* _QUAKE_WORLD_H */
 